@@ -0,0 +1,51 @@
+#!/usr/bin/env python
+'''
+Compare two runs of bench_square.
+
+Both inputs are the CSV output of `src/bench/bench_square`. For every benchmark
+present in both runs the average time per iteration is printed together with
+the relative change. With --threshold the exit status is 1 if any benchmark
+got slower by more than the given percentage.
+'''
+from __future__ import division,print_function
+import argparse
+import csv
+import sys
+
+def read_run(filename):
+    results = {}
+    with open(filename) as f:
+        for row in csv.DictReader(f):
+            results[row['Benchmark']] = float(row['average'])
+    return results
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare two bench_square CSV outputs.')
+    parser.add_argument('before', help='CSV output of the baseline run')
+    parser.add_argument('after', help='CSV output of the run to compare')
+    parser.add_argument('--threshold', type=float, default=None,
+                        help='exit with status 1 if a benchmark slowed down by more than this many percent')
+    args = parser.parse_args()
+
+    before = read_run(args.before)
+    after = read_run(args.after)
+
+    regressions = []
+    print('%-40s %14s %14s %9s' % ('Benchmark', 'before', 'after', 'change'))
+    for name in sorted(set(before) & set(after)):
+        change = 0.0
+        if before[name] > 0:
+            change = (after[name] - before[name]) / before[name] * 100
+        print('%-40s %14.6g %14.6g %+8.1f%%' % (name, before[name], after[name], change))
+        if args.threshold is not None and change > args.threshold:
+            regressions.append(name)
+    for name in sorted(set(before) ^ set(after)):
+        print('%-40s only in %s' % (name, 'before' if name in before else 'after'))
+
+    if regressions:
+        print('Slower by more than %.1f%%: %s' % (args.threshold, ', '.join(regressions)), file=sys.stderr)
+        return 1
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
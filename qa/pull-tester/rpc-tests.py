@@ -105,6 +105,7 @@ testScripts = [
     'httpbasics.py',
     'multi_rpc.py',
     'zapwallettxes.py',
+    'rescan.py',
     'proxy_test.py',
     'merkle_blocks.py',
     'fundrawtransaction.py',
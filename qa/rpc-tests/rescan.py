@@ -0,0 +1,77 @@
+#!/usr/bin/env python2
+# Copyright (c) 2018- The Square Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test rescanblockchain and abortrescan
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+
+
+class RescanTest (BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 2)
+
+    def setup_network(self, split=False):
+        self.nodes = start_nodes(2, self.options.tmpdir)
+        connect_nodes_bi(self.nodes,0,1)
+        self.is_network_split=False
+        self.sync_all()
+
+    def run_test (self):
+        print "Mining blocks..."
+        self.nodes[0].generate(101)
+        self.sync_all()
+
+        # pay an address of node 0 in two blocks, node 1 learns its key later
+        address = self.nodes[0].getnewaddress()
+        privkey = self.nodes[0].dumpprivkey(address)
+        txid = self.nodes[0].sendtoaddress(address, 10)
+        self.nodes[0].generate(1)
+        # node 0 owns the address too, keep it from spending the first payment
+        vout = [out['n'] for out in self.nodes[0].getrawtransaction(txid, 1)['vout'] if out['value'] == 10]
+        self.nodes[0].lockunspent(False, [{"txid": txid, "vout": vout[0]}])
+        self.nodes[0].sendtoaddress(address, 7)
+        self.nodes[0].generate(1)
+        self.sync_all()
+
+        self.nodes[1].importprivkey(privkey, "", False)
+        assert_equal(self.nodes[1].getbalance(), 0)
+        assert_equal(self.nodes[1].getwalletinfo()['scanning'], False)
+
+        # only the first payment is in the range
+        result = self.nodes[1].rescanblockchain(0, 102)
+        assert_equal(result['start_height'], 0)
+        assert_equal(result['stop_height'], 102)
+        assert_equal(result['transactions'], 1)
+        assert_equal(self.nodes[1].getbalance(), 10)
+
+        result = self.nodes[1].rescanblockchain(103)
+        assert_equal(result['start_height'], 103)
+        assert_equal(result['stop_height'], 103)
+        assert_equal(self.nodes[1].getbalance(), 17)
+
+        # the whole chain by default
+        result = self.nodes[1].rescanblockchain()
+        assert_equal(result['start_height'], 0)
+        assert_equal(result['stop_height'], 103)
+        assert_equal(result['transactions'], 2)
+        assert_equal(self.nodes[1].getbalance(), 17)
+
+        assert_raises(JSONRPCException, self.nodes[1].rescanblockchain, -1)
+        assert_raises(JSONRPCException, self.nodes[1].rescanblockchain, 0, 104)
+        assert_raises(JSONRPCException, self.nodes[1].rescanblockchain, 103, 102)
+
+        # there is no rescan to abort
+        assert_equal(self.nodes[1].abortrescan(), False)
+        assert_equal(self.nodes[1].getwalletinfo()['scanning'], False)
+        assert_equal(self.nodes[1].getwalletinfo()['balance'], 17)
+
+
+if __name__ == '__main__':
+    RescanTest ().main ()
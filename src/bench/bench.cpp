@@ -5,6 +5,7 @@
 #include "bench.h"
 
 #include <iostream>
+#include <regex>
 #include <sys/time.h>
 
 using namespace benchmark;
@@ -23,13 +24,18 @@ BenchRunner::BenchRunner(std::string name, BenchFunction func)
 }
 
 void
-BenchRunner::RunAll(double elapsedTimeForOne)
+BenchRunner::RunAll(const std::string& strFilter, double elapsedTimeForOne)
 {
+    std::regex reFilter(strFilter);
+
     std::cout << "Benchmark" << "," << "count" << "," << "min" << "," << "max" << "," << "average" << "\n";
 
     for (std::map<std::string,BenchFunction>::iterator it = benchmarks.begin();
          it != benchmarks.end(); ++it) {
 
+        if (!std::regex_match(it->first, reFilter))
+            continue;
+
         State state(it->first, elapsedTimeForOne);
         BenchFunction& func = it->second;
         func(state);
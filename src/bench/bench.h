@@ -61,7 +61,10 @@ namespace benchmark {
     public:
         BenchRunner(std::string name, BenchFunction func);
 
-        static void RunAll(double elapsedTimeForOne=1.0);
+        /** Run all benchmarks whose name matches the regular expression strFilter
+         *  and print one CSV line per benchmark, so runs can be compared with
+         *  contrib/devtools/bench-compare.py */
+        static void RunAll(const std::string& strFilter = ".*", double elapsedTimeForOne=1.0);
     };
 }
 
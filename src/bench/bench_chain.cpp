@@ -0,0 +1,86 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench_chain.h"
+
+#include "activemasternode.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "masternode-sync.h"
+#include "masternodeman.h"
+#include "net.h"
+#include "netbase.h"
+#include "random.h"
+#include "script/standard.h"
+#include "validation.h"
+
+namespace benchmark {
+
+BenchChain& BenchChain::Get()
+{
+    static BenchChain chain;
+    return chain;
+}
+
+BenchChain::BenchChain()
+{
+    keyMasternode.MakeNewKey(true);
+    pubKeyMasternode = keyMasternode.GetPubKey();
+    activeMasternode.keyMasternode = keyMasternode;
+    activeMasternode.pubKeyMasternode = pubKeyMasternode;
+
+    CScript scriptPubKey = GetScriptForDestination(pubKeyMasternode.GetID());
+
+    LOCK(cs_main);
+
+    pcoinsTip = new CCoinsViewCache(&viewDummy);
+
+    CBlockIndex* pindexPrev = NULL;
+    for (int nHeight = 0; nHeight <= CHAIN_HEIGHT; nHeight++) {
+        CBlockIndex* pindex = new CBlockIndex();
+        vecBlockIndex.emplace_back(pindex);
+        BlockMap::iterator mi = mapBlockIndex.insert(std::make_pair(GetRandHash(), pindex)).first;
+        pindex->phashBlock = &mi->first;
+        pindex->pprev = pindexPrev;
+        pindex->nHeight = nHeight;
+        pindex->nTime = GetTime() - (CHAIN_HEIGHT - nHeight) * 150;
+        pindex->BuildSkip();
+        pindexPrev = pindex;
+
+        COutPoint outpoint(GetRandHash(), 0);
+        pcoinsTip->AddCoin(outpoint, Coin(CTxOut(10 * COIN, scriptPubKey), nHeight, false), false);
+        vecCoins.push_back(outpoint);
+    }
+    chainActive.SetTip(pindexPrev);
+    pcoinsTip->SetBestBlock(pindexPrev->GetBlockHash());
+
+    // GetMasternodeRank(s) refuse to work until the list is synced
+    CConnman connman;
+    masternodeSync.Reset();
+    while (!masternodeSync.IsMasternodeListSynced())
+        masternodeSync.SwitchToNextAsset(connman);
+
+    vecMasternodeOutpoints.reserve(MASTERNODE_COUNT);
+    for (int i = 0; i < MASTERNODE_COUNT; i++) {
+        CService addr = LookupNumeric(strprintf("10.%d.%d.%d", (i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff).c_str(), Params().GetDefaultPort());
+        COutPoint outpoint(GetRandHash(), 0);
+        CMasternode mn(addr, outpoint, pubKeyMasternode, pubKeyMasternode, PROTOCOL_VERSION);
+        mnodeman.Add(mn);
+        vecMasternodeOutpoints.push_back(outpoint);
+    }
+}
+
+BenchChain::~BenchChain()
+{
+    mnodeman.Clear();
+
+    LOCK(cs_main);
+    chainActive.SetTip(NULL);
+    for (const auto& pindex : vecBlockIndex)
+        mapBlockIndex.erase(pindex->GetBlockHash());
+    delete pcoinsTip;
+    pcoinsTip = NULL;
+}
+
+} // namespace benchmark
@@ -0,0 +1,53 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SQUARE_BENCH_BENCH_CHAIN_H
+#define SQUARE_BENCH_BENCH_CHAIN_H
+
+#include "coins.h"
+#include "key.h"
+#include "primitives/transaction.h"
+
+#include <memory>
+#include <vector>
+
+class CBlockIndex;
+
+namespace benchmark {
+
+/**
+ * In-memory active chain, UTXO set and masternode list shared by the
+ * benchmarks which need the global node state (masternode ranks, InstantSend,
+ * governance, wallet). Nothing touches the disk; the state is built once, on
+ * first use, so filtered runs don't pay for it.
+ */
+class BenchChain
+{
+public:
+    static const int CHAIN_HEIGHT = 1000;
+    static const int MASTERNODE_COUNT = 5000;
+
+    // all synthetic masternodes share one masternode key, so votes signed
+    // with it are valid for any of them
+    CKey keyMasternode;
+    CPubKey pubKeyMasternode;
+    std::vector<COutPoint> vecMasternodeOutpoints;
+
+    // one spendable coin per block, vecCoins[h] was created at height h
+    std::vector<COutPoint> vecCoins;
+
+    static BenchChain& Get();
+
+    ~BenchChain();
+
+private:
+    std::vector<std::unique_ptr<CBlockIndex> > vecBlockIndex;
+    CCoinsView viewDummy;
+
+    BenchChain();
+};
+
+} // namespace benchmark
+
+#endif // SQUARE_BENCH_BENCH_CHAIN_H
@@ -4,18 +4,53 @@
 
 #include "bench.h"
 
+#include "chainparams.h"
 #include "key.h"
 #include "validation.h"
 #include "util.h"
 
+#include <iostream>
+#include <regex>
+
+static const char* DEFAULT_BENCH_FILTER = ".*";
+static const double DEFAULT_BENCH_TIME = 1.0;
+
 int
 main(int argc, char** argv)
 {
+    ParseParameters(argc, argv);
+
+    if (mapArgs.count("-?") || mapArgs.count("-h") || mapArgs.count("-help")) {
+        std::cout << "Usage: bench_square [options]\n\n"
+                  << HelpMessageOpt("-?", "Print this help message and exit")
+                  << HelpMessageOpt("-filter=<regex>", strprintf("Regular expression filter to select benchmark by name (default: %s)", DEFAULT_BENCH_FILTER))
+                  << HelpMessageOpt("-time=<n>", strprintf("Seconds to run each benchmark for (default: %.1f)", DEFAULT_BENCH_TIME));
+        return 0;
+    }
+
+    std::string strFilter = GetArg("-filter", DEFAULT_BENCH_FILTER);
+    double dTime = DEFAULT_BENCH_TIME;
+    if (mapArgs.count("-time")) {
+        dTime = atof(mapArgs["-time"].c_str());
+        if (dTime <= 0) {
+            std::cerr << "Error: Invalid -time value: " << mapArgs["-time"] << "\n";
+            return 1;
+        }
+    }
+
     ECC_Start();
+    ECCVerifyHandle globalVerifyHandle;
     SetupEnvironment();
     fPrintToDebugLog = false; // don't want to write to debug.log file
+    SelectParams(CBaseChainParams::MAIN);
 
-    benchmark::BenchRunner::RunAll();
+    try {
+        benchmark::BenchRunner::RunAll(strFilter, dTime);
+    } catch (const std::regex_error& e) {
+        std::cerr << "Error: Invalid -filter expression " << strFilter << ": " << e.what() << "\n";
+        ECC_Stop();
+        return 1;
+    }
 
     ECC_Stop();
 }
@@ -0,0 +1,70 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "coins.h"
+#include "random.h"
+#include "script/standard.h"
+
+#include <vector>
+
+/* Number of coins fetched or written per iteration */
+static const size_t BENCH_COINS = 1000;
+
+static void CreateCoins(CCoinsViewCache& cache, std::vector<COutPoint>& vOutpoints, size_t nCount)
+{
+    CScript scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 0x42) << OP_EQUALVERIFY << OP_CHECKSIG;
+    for (size_t i = 0; i < nCount; i++) {
+        COutPoint outpoint(GetRandHash(), i % 3);
+        cache.AddCoin(outpoint, Coin(CTxOut(COIN + i, scriptPubKey), 100000 + i, false), false);
+        vOutpoints.push_back(outpoint);
+    }
+}
+
+// Fetch coins which are only present in the parent cache, i.e. the pattern
+// of connecting a block on top of pcoinsTip
+static void CCoinsViewCache_FetchFromParent(benchmark::State& state)
+{
+    CCoinsView viewDummy;
+    CCoinsViewCache viewBase(&viewDummy);
+    std::vector<COutPoint> vOutpoints;
+    CreateCoins(viewBase, vOutpoints, BENCH_COINS * 10);
+
+    size_t nPos = 0;
+    while (state.KeepRunning()) {
+        CCoinsViewCache view(&viewBase);
+        for (size_t i = 0; i < BENCH_COINS; i++) {
+            const Coin& coin = view.AccessCoin(vOutpoints[nPos]);
+            assert(!coin.IsSpent());
+            nPos = (nPos + 1) % vOutpoints.size();
+        }
+    }
+}
+
+// Spend coins from the parent cache and create new ones, then flush the
+// child into the parent, like ConnectTip does for each block
+static void CCoinsViewCache_SpendAndFlush(benchmark::State& state)
+{
+    CCoinsView viewDummy;
+    CCoinsViewCache viewBase(&viewDummy);
+    std::vector<COutPoint> vOutpoints;
+    CreateCoins(viewBase, vOutpoints, BENCH_COINS * 10);
+
+    size_t nPos = 0;
+    while (state.KeepRunning()) {
+        CCoinsViewCache view(&viewBase);
+        for (size_t i = 0; i < BENCH_COINS; i++) {
+            Coin coin;
+            view.SpendCoin(vOutpoints[nPos], &coin);
+            vOutpoints[nPos].n += 3; // never seen before, see CreateCoins
+            view.AddCoin(vOutpoints[nPos], std::move(coin), false);
+            nPos = (nPos + 1) % vOutpoints.size();
+        }
+        view.Flush();
+    }
+}
+
+BENCHMARK(CCoinsViewCache_FetchFromParent);
+BENCHMARK(CCoinsViewCache_SpendAndFlush);
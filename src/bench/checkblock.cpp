@@ -0,0 +1,101 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "consensus/merkle.h"
+#include "consensus/validation.h"
+#include "random.h"
+#include "streams.h"
+#include "utiltime.h"
+#include "validation.h"
+
+// Blocks are synthesized rather than loaded from a mainnet dump, but are
+// shaped like typical full blocks: P2PKH spends with one or two inputs and
+// a payment plus change output each.
+
+/* Number of non-coinbase transactions in the benchmark block */
+static const int BENCH_BLOCK_TXS = 2000;
+
+static CBlock CreateBenchBlock()
+{
+    CBlock block;
+    block.nVersion = 0x20000000;
+    block.hashPrevBlock = GetRandHash();
+    block.nTime = GetTime();
+    block.nBits = 0x1b04864c;
+
+    CMutableTransaction txCoinbase;
+    txCoinbase.vin.resize(1);
+    txCoinbase.vin[0].scriptSig = CScript() << 100000 << OP_0;
+    txCoinbase.vout.resize(2);
+    txCoinbase.vout[0].nValue = 3 * COIN;
+    txCoinbase.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 0x01) << OP_EQUALVERIFY << OP_CHECKSIG;
+    txCoinbase.vout[1].nValue = 3 * COIN;
+    txCoinbase.vout[1].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 0x02) << OP_EQUALVERIFY << OP_CHECKSIG;
+    block.vtx.push_back(txCoinbase);
+
+    for (int i = 0; i < BENCH_BLOCK_TXS; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1 + i % 2);
+        for (CTxIn& txin : tx.vin) {
+            std::vector<unsigned char> vchSig(72), vchPubKey(33);
+            GetRandBytes(vchSig.data(), vchSig.size());
+            GetRandBytes(vchPubKey.data(), vchPubKey.size());
+            txin.prevout = COutPoint(GetRandHash(), i % 3);
+            txin.scriptSig = CScript() << vchSig << vchPubKey;
+        }
+        tx.vout.resize(2);
+        for (CTxOut& txout : tx.vout) {
+            std::vector<unsigned char> vchKeyID(20);
+            GetRandBytes(vchKeyID.data(), vchKeyID.size());
+            txout.nValue = GetRand(100 * COIN) + 1;
+            txout.scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vchKeyID << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        block.vtx.push_back(tx);
+    }
+
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    return block;
+}
+
+static void SerializeBenchBlock(CDataStream& stream)
+{
+    static const CBlock block(CreateBenchBlock());
+    stream << block;
+    char a = '\0';
+    stream.write(&a, 1); // Prevent compaction
+}
+
+static void DeserializeBlockTest(benchmark::State& state)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    SerializeBenchBlock(stream);
+    size_t nSize = stream.size() - 1;
+
+    while (state.KeepRunning()) {
+        CBlock block;
+        stream >> block;
+        assert(stream.Rewind(nSize));
+    }
+}
+
+static void DeserializeAndCheckBlockTest(benchmark::State& state)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    SerializeBenchBlock(stream);
+    size_t nSize = stream.size() - 1;
+
+    while (state.KeepRunning()) {
+        CBlock block; // Note that CBlock caches its checked state, so we need to recreate it here
+        stream >> block;
+        assert(stream.Rewind(nSize));
+
+        CValidationState validationState;
+        assert(CheckBlock(block, validationState, false));
+    }
+}
+
+BENCHMARK(DeserializeBlockTest);
+BENCHMARK(DeserializeAndCheckBlockTest);
@@ -0,0 +1,58 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "bench_chain.h"
+
+#include "chain.h"
+#include "random.h"
+#include "script/standard.h"
+#include "validation.h"
+#include "wallet/wallet.h"
+
+using benchmark::BenchChain;
+
+/* Number of confirmed transactions paying to the benchmark wallet */
+static const int BENCH_WALLET_TXS = 10000;
+
+// AvailableCoins walks every transaction of the wallet, this is the cost
+// paid by every send and balance query of a long running wallet
+static void AvailableCoins_LargeWallet(benchmark::State& state)
+{
+    BenchChain::Get();
+
+    CWallet wallet;
+    CKey key;
+    key.MakeNewKey(true);
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    {
+        LOCK2(cs_main, wallet.cs_wallet);
+        assert(wallet.AddKeyPubKey(key, key.GetPubKey()));
+
+        for (int i = 0; i < BENCH_WALLET_TXS; i++) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+            tx.vout.resize(2);
+            tx.vout[0].nValue = (i % 100 + 1) * COIN;
+            tx.vout[0].scriptPubKey = scriptPubKey;
+            tx.vout[1].nValue = COIN / 10;
+            tx.vout[1].scriptPubKey = scriptPubKey;
+
+            CWalletTx wtx(&wallet, tx);
+            wtx.hashBlock = chainActive[i % BenchChain::CHAIN_HEIGHT]->GetBlockHash();
+            wtx.nIndex = 0;
+            wtx.nOrderPos = i;
+            wallet.AddToWallet(wtx, true, NULL);
+        }
+    }
+
+    std::vector<COutput> vCoins;
+    while (state.KeepRunning()) {
+        wallet.AvailableCoins(vCoins);
+        assert(vCoins.size() == 2 * BENCH_WALLET_TXS);
+    }
+}
+
+BENCHMARK(AvailableCoins_LargeWallet);
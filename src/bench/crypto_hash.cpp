@@ -0,0 +1,41 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "hash.h"
+#include "random.h"
+#include "uint256.h"
+
+#include <vector>
+
+/* Number of 80 byte block headers hashed per iteration */
+static const size_t BENCH_HEADERS = 64;
+
+static void HashX11_Header(benchmark::State& state)
+{
+    std::vector<unsigned char> vchHeader(80);
+    GetRandBytes(vchHeader.data(), vchHeader.size());
+    uint256 hash;
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < BENCH_HEADERS; i++) {
+            hash = HashX11(vchHeader.begin(), vchHeader.end());
+            vchHeader[76] = hash.begin()[0];
+        }
+    }
+}
+
+static void HashX11Batch_Header(benchmark::State& state)
+{
+    std::vector<unsigned char> vchHeaders(80 * BENCH_HEADERS);
+    GetRandBytes(vchHeaders.data(), vchHeaders.size());
+    std::vector<uint256> vHashes(BENCH_HEADERS);
+    while (state.KeepRunning()) {
+        HashX11Batch(vchHeaders.data(), 80, 80, BENCH_HEADERS, vHashes.data());
+        vchHeaders[76] = vHashes[0].begin()[0];
+    }
+}
+
+BENCHMARK(HashX11_Header);
+BENCHMARK(HashX11Batch_Header);
@@ -0,0 +1,64 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "bench_chain.h"
+
+#include "governance.h"
+#include "governance-object.h"
+#include "governance-vote.h"
+#include "net.h"
+#include "utilstrencodings.h"
+#include "utiltime.h"
+
+using benchmark::BenchChain;
+
+static CGovernanceObject CreateWatchdog(BenchChain& chain)
+{
+    int64_t nTime = GetAdjustedTime();
+    std::string strData = strprintf("[[\"watchdog\",{\"created_at\":%d,\"type\":%d}]]", nTime, GOVERNANCE_OBJECT_WATCHDOG);
+    CGovernanceObject govobj(uint256(), 1, nTime, uint256(), HexStr(strData));
+    govobj.SetMasternodeVin(chain.vecMasternodeOutpoints[0]);
+    assert(govobj.Sign(chain.keyMasternode, chain.pubKeyMasternode));
+    return govobj;
+}
+
+// One funding vote from every masternode on a single object, the bulk of
+// what a node processes while a proposal collects votes. A watchdog is used
+// as the parent object as it needs no collateral transaction.
+static void ProcessVote_Governance(benchmark::State& state)
+{
+    BenchChain& chain = BenchChain::Get();
+    CConnman connman;
+
+    CGovernanceObject govobj = CreateWatchdog(chain);
+    CGovernanceObject govobjCopy(govobj);
+    governance.AddGovernanceObject(govobjCopy, connman);
+    assert(governance.HaveObjectForHash(govobj.GetHash()));
+
+    std::vector<CGovernanceVote> vecVotes;
+    vecVotes.reserve(chain.vecMasternodeOutpoints.size());
+    for (const COutPoint& outpoint : chain.vecMasternodeOutpoints) {
+        CGovernanceVote vote(outpoint, govobj.GetHash(), VOTE_SIGNAL_FUNDING, VOTE_OUTCOME_YES);
+        assert(vote.Sign(chain.keyMasternode, chain.pubKeyMasternode));
+        vecVotes.push_back(vote);
+    }
+
+    size_t nPos = 0;
+    while (state.KeepRunning()) {
+        CGovernanceException exception;
+        governance.ProcessVoteAndRelay(vecVotes[nPos], exception, connman);
+        if (++nPos == vecVotes.size()) {
+            // every masternode voted, start over with a fresh copy of the object
+            governance.Clear();
+            govobjCopy = govobj;
+            governance.AddGovernanceObject(govobjCopy, connman);
+            nPos = 0;
+        }
+    }
+
+    governance.Clear();
+}
+
+BENCHMARK(ProcessVote_Governance);
@@ -0,0 +1,68 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "bench_chain.h"
+
+#include "instantx.h"
+#include "masternodeman.h"
+#include "net.h"
+#include "netbase.h"
+#include "protocol.h"
+#include "random.h"
+#include "streams.h"
+
+#include <memory>
+
+using benchmark::BenchChain;
+
+/* Number of lock requests the pre-signed votes are spread over */
+static const int BENCH_LOCK_REQUESTS = 500;
+
+// Valid votes from the top masternodes for transactions we don't know yet,
+// i.e. what a node sees when votes arrive ahead of the lock request. Every
+// vote goes through deserialization, the rank check and signature
+// verification before it is recorded as an orphan.
+static void ProcessTxLockVote_Orphan(benchmark::State& state)
+{
+    BenchChain& chain = BenchChain::Get();
+
+    int nCoinHeight = BenchChain::CHAIN_HEIGHT - 10;
+    const COutPoint& outpoint = chain.vecCoins[nCoinHeight];
+
+    CMasternodeMan::rank_pair_vec_t vecRanks;
+    mnodeman.GetMasternodeRanks(vecRanks, nCoinHeight + 4, MIN_INSTANTSEND_PROTO_VERSION);
+    assert(vecRanks.size() >= COutPointLock::SIGNATURES_TOTAL);
+
+    std::vector<CDataStream> vecVotes;
+    for (int i = 0; i < BENCH_LOCK_REQUESTS; i++) {
+        uint256 txHash = GetRandHash();
+        for (int j = 0; j < COutPointLock::SIGNATURES_TOTAL; j++) {
+            CTxLockVote vote(txHash, outpoint, vecRanks[j].second.vin.prevout);
+            assert(vote.Sign());
+            vecVotes.emplace_back(SER_NETWORK, PROTOCOL_VERSION);
+            vecVotes.back() << vote;
+        }
+    }
+
+    CConnman connman;
+    CAddress addr(LookupNumeric("10.255.255.1", 9999), NODE_NETWORK);
+    CNode node(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, "", true);
+    node.nVersion = PROTOCOL_VERSION;
+    std::string strCommand = NetMsgType::TXLOCKVOTE;
+
+    std::unique_ptr<CInstantSend> pinstantsend(new CInstantSend());
+    size_t nPos = 0;
+    while (state.KeepRunning()) {
+        CDataStream vRecv(vecVotes[nPos]);
+        pinstantsend->ProcessMessage(&node, strCommand, vRecv, connman);
+        if (++nPos == vecVotes.size()) {
+            // all votes are known now, start over with a clean state
+            pinstantsend.reset(new CInstantSend());
+            nPos = 0;
+        }
+    }
+}
+
+BENCHMARK(ProcessTxLockVote_Orphan);
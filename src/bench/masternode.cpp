@@ -0,0 +1,58 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "bench_chain.h"
+
+#include "masternodeman.h"
+
+using benchmark::BenchChain;
+
+// Ranks for a height whose scores are already cached, e.g. repeated
+// GetMasternodeRank(s) calls for the current block
+static void GetMasternodeRanks_Cached(benchmark::State& state)
+{
+    BenchChain& chain = BenchChain::Get();
+    CMasternodeMan::rank_pair_vec_t vecRanks;
+    int nHeight = BenchChain::CHAIN_HEIGHT - 1;
+    mnodeman.GetMasternodeRanks(vecRanks, nHeight);
+    assert((int)vecRanks.size() == BenchChain::MASTERNODE_COUNT);
+    assert(chain.vecMasternodeOutpoints.size() == vecRanks.size());
+
+    while (state.KeepRunning()) {
+        mnodeman.GetMasternodeRanks(vecRanks, nHeight);
+    }
+}
+
+// Ranks for heights which always miss the score cache, so every call
+// calculates and sorts the scores of all masternodes
+static void GetMasternodeRanks_Uncached(benchmark::State& state)
+{
+    BenchChain::Get();
+    CMasternodeMan::rank_pair_vec_t vecRanks;
+    int nHeight = 0;
+
+    while (state.KeepRunning()) {
+        mnodeman.GetMasternodeRanks(vecRanks, nHeight);
+        // cycle through far more heights than the scores cache holds
+        nHeight = (nHeight + 1) % BenchChain::CHAIN_HEIGHT;
+    }
+}
+
+static void GetMasternodeRank_Cached(benchmark::State& state)
+{
+    BenchChain& chain = BenchChain::Get();
+    int nHeight = BenchChain::CHAIN_HEIGHT - 1;
+    size_t nPos = 0;
+    int nRank;
+
+    while (state.KeepRunning()) {
+        mnodeman.GetMasternodeRank(chain.vecMasternodeOutpoints[nPos], nRank, nHeight);
+        nPos = (nPos + 1) % chain.vecMasternodeOutpoints.size();
+    }
+}
+
+BENCHMARK(GetMasternodeRanks_Cached);
+BENCHMARK(GetMasternodeRanks_Uncached);
+BENCHMARK(GetMasternodeRank_Cached);
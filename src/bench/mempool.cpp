@@ -0,0 +1,67 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "policy/policy.h"
+#include "random.h"
+#include "txmempool.h"
+#include "utiltime.h"
+
+#include <list>
+#include <vector>
+
+/* Number of transactions accepted and mined per iteration */
+static const int BENCH_MEMPOOL_TXS = 1000;
+/* Length of the unconfirmed chains the transactions form */
+static const int BENCH_MEMPOOL_CHAIN = 5;
+
+// Independent payments plus short chains of unconfirmed spends, so both
+// the ancestor/descendant bookkeeping and the plain insert path are covered
+static std::vector<CTransaction> CreateMempoolTxs()
+{
+    std::vector<CTransaction> vtx;
+    CScript scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 0x42) << OP_EQUALVERIFY << OP_CHECKSIG;
+    for (int i = 0; i < BENCH_MEMPOOL_TXS; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        if (i % BENCH_MEMPOOL_CHAIN == 0) {
+            tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        } else {
+            tx.vin[0].prevout = COutPoint(vtx.back().GetHash(), 0);
+        }
+        tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 0x01) << std::vector<unsigned char>(33, 0x02);
+        tx.vout.resize(2);
+        tx.vout[0].nValue = 10 * COIN;
+        tx.vout[0].scriptPubKey = scriptPubKey;
+        tx.vout[1].nValue = COIN;
+        tx.vout[1].scriptPubKey = scriptPubKey;
+        vtx.push_back(tx);
+    }
+    return vtx;
+}
+
+static void MempoolAddAndRemoveForBlock(benchmark::State& state)
+{
+    std::vector<CTransaction> vtx = CreateMempoolTxs();
+    std::vector<CTxMemPoolEntry> vEntries;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        CAmount nFee = 1000 + (i * 7919) % 10000;
+        vEntries.push_back(CTxMemPoolEntry(vtx[i], nFee, GetTime(), 0.0, 100000, i % BENCH_MEMPOOL_CHAIN == 0,
+                                           11 * COIN, false, 1, LockPoints()));
+    }
+
+    CTxMemPool pool(CFeeRate(0));
+    unsigned int nHeight = 100000;
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < vtx.size(); i++) {
+            pool.addUnchecked(vtx[i].GetHash(), vEntries[i]);
+        }
+        std::list<CTransaction> conflicts;
+        pool.removeForBlock(vtx, ++nHeight, conflicts);
+        assert(pool.size() == 0);
+    }
+}
+
+BENCHMARK(MempoolAddAndRemoveForBlock);
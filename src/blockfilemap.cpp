@@ -0,0 +1,87 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+
+#include "compat.h"
+#include "util.h"
+#include "validation.h"
+
+#ifndef WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#endif
+
+CMappedFile::~CMappedFile()
+{
+#ifndef WIN32
+    munmap((void*)pdata, nSize);
+#endif
+}
+
+std::shared_ptr<const CMappedFile> CMappedFile::Open(const boost::filesystem::path& path)
+{
+#ifndef WIN32
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1)
+        return nullptr;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    void* pdata = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+    if (pdata == MAP_FAILED) {
+        LogPrintf("CMappedFile::%s -- mmap of %s failed: %s\n", __func__, path.string(), strerror(errno));
+        return nullptr;
+    }
+
+    return std::shared_ptr<const CMappedFile>(new CMappedFile((const unsigned char*)pdata, st.st_size));
+#else
+    return nullptr;
+#endif
+}
+
+std::shared_ptr<const CMappedFile> CBlockFileMap::Get(int nFile, size_t nMinSize)
+{
+    LOCK(cs);
+
+    for (auto it = listFiles.begin(); it != listFiles.end(); ++it) {
+        if (it->first != nFile) continue;
+        std::shared_ptr<const CMappedFile> file = it->second;
+        listFiles.erase(it);
+        if (file->size() < nMinSize) {
+            // the file grew since it was mapped
+            file = CMappedFile::Open(GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk"));
+            if (!file) return nullptr;
+        }
+        listFiles.push_front(std::make_pair(nFile, file));
+        return file->size() < nMinSize ? nullptr : file;
+    }
+
+    std::shared_ptr<const CMappedFile> file = CMappedFile::Open(GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk"));
+    if (!file) return nullptr;
+    listFiles.push_front(std::make_pair(nFile, file));
+    if (listFiles.size() > nMaxFiles)
+        listFiles.pop_back();
+    return file->size() < nMinSize ? nullptr : file;
+}
+
+void CBlockFileMap::Invalidate(int nFile)
+{
+    LOCK(cs);
+    listFiles.remove_if([nFile](const std::pair<int, std::shared_ptr<const CMappedFile> >& entry) { return entry.first == nFile; });
+}
+
+void CBlockFileMap::Clear()
+{
+    LOCK(cs);
+    listFiles.clear();
+}
@@ -0,0 +1,64 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BLOCKFILEMAP_H
+#define BLOCKFILEMAP_H
+
+#include "sync.h"
+
+#include <list>
+#include <memory>
+
+#include <boost/filesystem/path.hpp>
+
+/** A read-only memory mapping of a whole file, unmapped when the last reference goes away */
+class CMappedFile
+{
+private:
+    const unsigned char* pdata;
+    size_t nSize;
+
+    CMappedFile(const unsigned char* pdataIn, size_t nSizeIn) : pdata(pdataIn), nSize(nSizeIn) {}
+
+    // Disallow copies
+    CMappedFile(const CMappedFile&);
+    CMappedFile& operator=(const CMappedFile&);
+
+public:
+    ~CMappedFile();
+
+    /** Map the file at path as it is now, returns NULL if it can't be mapped (or mmap is unsupported) */
+    static std::shared_ptr<const CMappedFile> Open(const boost::filesystem::path& path);
+
+    const unsigned char* data() const { return pdata; }
+    size_t size() const { return nSize; }
+};
+
+/**
+ * Small LRU of memory mapped blk?????.dat files used by ReadBlockFromDisk.
+ * Block files grow while blocks are appended, a file is remapped when a read
+ * needs more than its current mapping covers. Readers keep the mapping alive
+ * through the shared pointer, so a file can be evicted or invalidated while
+ * another thread is still deserializing from it.
+ */
+class CBlockFileMap
+{
+private:
+    mutable CCriticalSection cs;
+    const size_t nMaxFiles;
+    // most recently used first
+    std::list<std::pair<int, std::shared_ptr<const CMappedFile> > > listFiles;
+
+public:
+    CBlockFileMap(size_t nMaxFilesIn) : nMaxFiles(nMaxFilesIn) {}
+
+    /** Mapping of block file nFile covering at least its first nMinSize bytes, NULL if there is none */
+    std::shared_ptr<const CMappedFile> Get(int nFile, size_t nMinSize);
+
+    /** Forget the mapping of a block file which is about to be truncated or removed */
+    void Invalidate(int nFile);
+
+    void Clear();
+};
+
+#endif // BLOCKFILEMAP_H
@@ -0,0 +1,65 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cache-database.h"
+
+#include "governance.h"
+#include "masternode-payments.h"
+#include "masternodeman.h"
+
+CCacheDB* pcachedb = NULL;
+
+CCacheDBCheckpoint::CCacheDBCheckpoint(CCacheDB& cachedbIn)
+    : cachedb(cachedbIn),
+      batch(cachedbIn.db),
+      mapHashesWritten(),
+      setKeysErased()
+{}
+
+bool CCacheDBCheckpoint::Commit()
+{
+    if(!cachedb.db.WriteBatch(batch, true)) return false;
+
+    for(std::set<std::string>::const_iterator it = setKeysErased.begin(); it != setKeysErased.end(); ++it) {
+        cachedb.mapValueHashes.erase(*it);
+    }
+    for(std::map<std::string, uint256>::const_iterator it = mapHashesWritten.begin(); it != mapHashesWritten.end(); ++it) {
+        cachedb.mapValueHashes[it->first] = it->second;
+    }
+    return true;
+}
+
+CCacheDB::CCacheDB(size_t nCacheSize, bool fMemory, bool fWipe)
+    : db(GetDataDir() / "cache", nCacheSize, fMemory, fWipe),
+      mapValueHashes()
+{
+    // know about all records, so that the ones which are never read
+    // (e.g. because their format changed) are erased by the next checkpoint
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    for(pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next()) {
+        std::vector<char> vchKey(pcursor->GetKeySize());
+        CFlatData key(vchKey);
+        if(pcursor->GetKey(key)) {
+            mapValueHashes[std::string(vchKey.begin(), vchKey.end())] = uint256();
+        }
+    }
+}
+
+bool WriteCacheDB(CCacheDB& cachedb)
+{
+    int64_t nStart = GetTimeMillis();
+
+    CCacheDBCheckpoint checkpoint(cachedb);
+    mnodeman.WriteCheckpoint(checkpoint);
+    mnpayments.WriteCheckpoint(checkpoint);
+    governance.WriteCheckpoint(checkpoint);
+
+    if(!checkpoint.Commit()) {
+        return error("%s: failed to write cache database checkpoint", __func__);
+    }
+
+    LogPrintf("Written cache database checkpoint, %d records written, %d erased  %dms\n",
+              checkpoint.GetWriteCount(), checkpoint.GetEraseCount(), GetTimeMillis() - nStart);
+    return true;
+}
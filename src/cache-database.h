@@ -0,0 +1,211 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef CACHE_DATABASE_H
+#define CACHE_DATABASE_H
+
+#include "dbwrapper.h"
+#include "hash.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+
+class CCacheDB;
+
+/** Max memory allocated to the cache database (MiB) */
+static const int64_t nCacheDBCache = 8;
+
+/** Seconds between two checkpoints of the masternode, payment and governance data */
+static const int CACHEDB_CHECKPOINT_SECONDS = 5 * 60;
+
+/** Global cache database, NULL until it was opened */
+extern CCacheDB* pcachedb;
+
+/**
+ * Changes of one checkpoint, written in one atomic batch.
+ * Records whose serialization didn't change since they were read or written
+ * last time are skipped, records missing from a written map are erased.
+ */
+class CCacheDBCheckpoint
+{
+private:
+    CCacheDB& cachedb;
+    CDBBatch batch;
+
+    std::map<std::string, uint256> mapHashesWritten;
+    std::set<std::string> setKeysErased;
+
+    static std::string GetKeyString(const CDataStream& ssKey) { return std::string(ssKey.begin(), ssKey.end()); }
+
+    template <typename K, typename V>
+    void WriteRecord(const K& key, const V& value, std::set<std::string>* psetKeys = NULL);
+
+public:
+    CCacheDBCheckpoint(CCacheDB& cachedbIn);
+
+    /// Store value as the only record of the section chSection
+    template <typename V>
+    void Write(char chSection, const V& value) { WriteRecord(chSection, value); }
+
+    /// Store the entries of mapIn, one record per entry, as the section chSection
+    template <typename K, typename V>
+    void WriteMap(char chSection, const std::map<K, V>& mapIn);
+
+    /// Write the batch and remember what is stored now
+    bool Commit();
+
+    size_t GetWriteCount() const { return mapHashesWritten.size(); }
+    size_t GetEraseCount() const { return setKeysErased.size(); }
+};
+
+/**
+ * Masternode, payment and governance data stored in a leveldb database
+ * (cache/), replacing the mncache.dat, mnpayments.dat and governance.dat
+ * dumps. The data is written periodically by checkpoints which only contain
+ * the entries that changed, so an unclean shutdown loses the changes since
+ * the last checkpoint instead of everything.
+ *
+ * Not thread safe, checkpoints are written and read by one thread at a time.
+ */
+class CCacheDB
+{
+    friend class CCacheDBCheckpoint;
+
+private:
+    CDBWrapper db;
+
+    /// hash of every stored record's value by serialized key
+    std::map<std::string, uint256> mapValueHashes;
+
+    // serialized through a CDataStream, some types need a stream with size()
+    template <typename V>
+    static uint256 GetValueHash(const V& value)
+    {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << value;
+        return Hash(ss.begin(), ss.end());
+    }
+
+public:
+    CCacheDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    bool IsEmpty() { return db.IsEmpty(); }
+
+    /// Read the only record of the section chSection
+    template <typename V>
+    bool Read(char chSection, V& value);
+
+    /**
+     * Read all entries of the section chSection, false if one of them couldn't
+     * be read. Unreadable records are replaced or erased by the next checkpoint.
+     */
+    template <typename K, typename V>
+    bool ReadMap(char chSection, std::map<K, V>& mapRet);
+
+    size_t GetRecordCount() const { return mapValueHashes.size(); }
+};
+
+template <typename K, typename V>
+void CCacheDBCheckpoint::WriteRecord(const K& key, const V& value, std::set<std::string>* psetKeys)
+{
+    CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+    ssKey << key;
+    std::string strKey = GetKeyString(ssKey);
+    if(psetKeys) psetKeys->insert(strKey);
+
+    uint256 hash = CCacheDB::GetValueHash(value);
+    std::map<std::string, uint256>::const_iterator it = cachedb.mapValueHashes.find(strKey);
+    if(it != cachedb.mapValueHashes.end() && it->second == hash) return;
+
+    batch.Write(key, value);
+    mapHashesWritten[strKey] = hash;
+}
+
+template <typename K, typename V>
+void CCacheDBCheckpoint::WriteMap(char chSection, const std::map<K, V>& mapIn)
+{
+    std::set<std::string> setKeys;
+    for(typename std::map<K, V>::const_iterator it = mapIn.begin(); it != mapIn.end(); ++it) {
+        WriteRecord(std::make_pair(chSection, it->first), it->second, &setKeys);
+    }
+
+    // every record of a section starts with the section's serialized char
+    std::map<std::string, uint256>::const_iterator it = cachedb.mapValueHashes.lower_bound(std::string(1, chSection));
+    for(; it != cachedb.mapValueHashes.end() && it->first[0] == chSection; ++it) {
+        if(setKeys.count(it->first)) continue;
+        std::vector<char> vchKey(it->first.begin(), it->first.end());
+        batch.Erase(CFlatData(vchKey));
+        setKeysErased.insert(it->first);
+    }
+}
+
+template <typename V>
+bool CCacheDB::Read(char chSection, V& value)
+{
+    if(!db.Read(chSection, value)) return false;
+
+    CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+    ssKey << chSection;
+    mapValueHashes[std::string(ssKey.begin(), ssKey.end())] = GetValueHash(value);
+    return true;
+}
+
+template <typename K, typename V>
+bool CCacheDB::ReadMap(char chSection, std::map<K, V>& mapRet)
+{
+    mapRet.clear();
+    bool fResult = true;
+
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(chSection);
+
+    for(; pcursor->Valid(); pcursor->Next()) {
+        std::pair<char, K> key;
+        if(!pcursor->GetKey(key) || key.first != chSection) break;
+
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey << key;
+        std::string strKey(ssKey.begin(), ssKey.end());
+
+        V value;
+        if(!pcursor->GetValue(value)) {
+            LogPrintf("CCacheDB::%s -- failed to read record of section '%c'\n", __func__, chSection);
+            mapValueHashes[strKey] = uint256();
+            fResult = false;
+            continue;
+        }
+
+        mapValueHashes[strKey] = GetValueHash(value);
+        mapRet.insert(std::make_pair(key.second, value));
+    }
+    return fResult;
+}
+
+/** Write a checkpoint of the masternode, payment and governance data */
+bool WriteCacheDB(CCacheDB& cachedb);
+
+/** Load what the last checkpoint wrote for objToLoad, like CFlatDB::Load */
+template <typename T>
+void LoadFromCacheDB(CCacheDB& cachedb, T& objToLoad, const std::string& strName)
+{
+    int64_t nStart = GetTimeMillis();
+
+    LogPrintf("Reading %s from cache database...\n", strName);
+    if(!objToLoad.ReadCheckpoint(cachedb)) {
+        LogPrintf("Error reading %s from cache database, will try to recreate\n", strName);
+        objToLoad.Clear();
+    }
+
+    LogPrintf("Loaded %s from cache database  %dms\n", strName, GetTimeMillis() - nStart);
+    LogPrintf("     %s\n", objToLoad.ToString());
+    LogPrintf("%s: Cleaning....\n", __func__);
+    objToLoad.CheckAndRemove();
+    LogPrintf("     %s\n", objToLoad.ToString());
+}
+
+#endif
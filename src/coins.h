@@ -263,6 +263,13 @@ public:
      */
     void Uncache(const COutPoint &outpoint);
 
+    /**
+     * Add a coin which was read from the backing view on another thread, unless the
+     * outpoint is already loaded in this cache. The caller must make sure the backing
+     * view was not written to since the coin was read.
+     */
+    void Prefetch(const COutPoint &outpoint, Coin&& coin);
+
     //! Calculate the size of the cache (in number of transaction outputs)
     unsigned int GetCacheSize() const;
 
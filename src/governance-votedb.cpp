@@ -4,17 +4,22 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "governance-votedb.h"
+#include "masternodeman.h"
 
 CGovernanceObjectVoteFile::CGovernanceObjectVoteFile()
     : nMemoryVotes(0),
       listVotes(),
-      mapVoteIndex()
+      mapVoteIndex(),
+      vecValidVoteInvs(),
+      nValidVotesListVersion(-1)
 {}
 
 CGovernanceObjectVoteFile::CGovernanceObjectVoteFile(const CGovernanceObjectVoteFile& other)
     : nMemoryVotes(other.nMemoryVotes),
       listVotes(other.listVotes),
-      mapVoteIndex()
+      mapVoteIndex(),
+      vecValidVoteInvs(),
+      nValidVotesListVersion(-1)
 {
     RebuildIndex();
 }
@@ -24,6 +29,10 @@ void CGovernanceObjectVoteFile::AddVote(const CGovernanceVote& vote)
     listVotes.push_front(vote);
     mapVoteIndex[vote.GetHash()] = listVotes.begin();
     ++nMemoryVotes;
+    // votes are validated before they are added, no need to rebuild the inventory
+    if(nValidVotesListVersion != -1) {
+        vecValidVoteInvs.push_back(CInv(MSG_GOVERNANCE_OBJECT_VOTE, vote.GetHash()));
+    }
 }
 
 bool CGovernanceObjectVoteFile::HasVote(const uint256& nHash) const
@@ -54,6 +63,23 @@ std::vector<CGovernanceVote> CGovernanceObjectVoteFile::GetVotes() const
     return vecResult;
 }
 
+const std::vector<CInv>& CGovernanceObjectVoteFile::GetValidVoteInvs()
+{
+    int nListVersion = mnodeman.GetListVersion();
+    if(nValidVotesListVersion == nListVersion) {
+        return vecValidVoteInvs;
+    }
+
+    vecValidVoteInvs.clear();
+    for(vote_l_cit it = listVotes.begin(); it != listVotes.end(); ++it) {
+        if(it->IsValid(true)) {
+            vecValidVoteInvs.push_back(CInv(MSG_GOVERNANCE_OBJECT_VOTE, it->GetHash()));
+        }
+    }
+    nValidVotesListVersion = nListVersion;
+    return vecValidVoteInvs;
+}
+
 void CGovernanceObjectVoteFile::RemoveVotesFromMasternode(const COutPoint& outpointMasternode)
 {
     vote_l_it it = listVotes.begin();
@@ -67,6 +93,7 @@ void CGovernanceObjectVoteFile::RemoveVotesFromMasternode(const COutPoint& outpo
             ++it;
         }
     }
+    nValidVotesListVersion = -1;
 }
 
 CGovernanceObjectVoteFile& CGovernanceObjectVoteFile::operator=(const CGovernanceObjectVoteFile& other)
@@ -74,6 +101,7 @@ CGovernanceObjectVoteFile& CGovernanceObjectVoteFile::operator=(const CGovernanc
     nMemoryVotes = other.nMemoryVotes;
     listVotes = other.listVotes;
     RebuildIndex();
+    nValidVotesListVersion = -1;
     return *this;
 }
 
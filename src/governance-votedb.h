@@ -10,6 +10,7 @@
 #include <map>
 
 #include "governance-vote.h"
+#include "protocol.h"
 #include "serialize.h"
 #include "uint256.h"
 
@@ -45,6 +46,12 @@ private:
 
     vote_m_t mapVoteIndex;
 
+    /// Inventory of the votes which were valid for masternode list nValidVotesListVersion
+    std::vector<CInv> vecValidVoteInvs;
+
+    /// -1 when vecValidVoteInvs has to be rebuilt
+    int nValidVotesListVersion;
+
 public:
     CGovernanceObjectVoteFile();
 
@@ -71,6 +78,13 @@ public:
 
     std::vector<CGovernanceVote> GetVotes() const;
 
+    /**
+     * Inventory of all currently valid votes, ready to be pushed to peers.
+     * Votes are only validated again when the masternode list changed since
+     * the last call, see CMasternodeMan::GetListVersion().
+     */
+    const std::vector<CInv>& GetValidVoteInvs();
+
     CGovernanceObjectVoteFile& operator=(const CGovernanceObjectVoteFile& other);
 
     void RemoveVotesFromMasternode(const COutPoint& outpointMasternode);
@@ -84,6 +98,7 @@ public:
         READWRITE(listVotes);
         if(ser_action.ForRead()) {
             RebuildIndex();
+            nValidVotesListVersion = -1;
         }
     }
 private:
@@ -3,6 +3,7 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "cache-database.h"
 #include "governance.h"
 #include "governance-object.h"
 #include "governance-vote.h"
@@ -23,6 +24,11 @@ const std::string CGovernanceManager::SERIALIZATION_VERSION_STRING = "CGovernanc
 const int CGovernanceManager::MAX_TIME_FUTURE_DEVIATION = 60*60;
 const int CGovernanceManager::RELIABLE_PROPAGATION_TIME = 60;
 
+// cache database sections
+static const char DB_GOVERNANCE_STATE = 'g';
+static const char DB_GOVERNANCE_OBJECTS = 'G';
+static const char DB_ERASED_OBJECTS = 'E';
+
 CGovernanceManager::CGovernanceManager()
     : nTimeLastDiff(0),
       nCachedBlockHeight(0),
@@ -750,6 +756,10 @@ void CGovernanceManager::Sync(CNode* pfrom, const uint256& nProp, const CBloomFi
 
     LogPrint("gobject", "CGovernanceManager::Sync -- syncing to peer=%d, nProp = %s\n", pfrom->id, nProp.ToString());
 
+    // collect the inventory under the locks, push it to the peer after releasing them
+    std::vector<CInv> vecObjectInvs;
+    std::vector<CInv> vecVoteInvs;
+
     {
         LOCK2(cs_main, cs);
 
@@ -769,8 +779,7 @@ void CGovernanceManager::Sync(CNode* pfrom, const uint256& nProp, const CBloomFi
 
                 // Push the inventory budget proposal message over to the other client
                 LogPrint("gobject", "CGovernanceManager::Sync -- syncing govobj: %s, peer=%d\n", strHash, pfrom->id);
-                pfrom->PushInventory(CInv(MSG_GOVERNANCE_OBJECT, it->first));
-                ++nObjCount;
+                vecObjectInvs.push_back(CInv(MSG_GOVERNANCE_OBJECT, it->first));
             }
         } else {
             // single valid object and its valid votes
@@ -792,21 +801,24 @@ void CGovernanceManager::Sync(CNode* pfrom, const uint256& nProp, const CBloomFi
 
             // Push the inventory budget proposal message over to the other client
             LogPrint("gobject", "CGovernanceManager::Sync -- syncing govobj: %s, peer=%d\n", strHash, pfrom->id);
-            pfrom->PushInventory(CInv(MSG_GOVERNANCE_OBJECT, it->first));
-            ++nObjCount;
+            vecObjectInvs.push_back(CInv(MSG_GOVERNANCE_OBJECT, it->first));
 
-            std::vector<CGovernanceVote> vecVotes = govobj.GetVoteFile().GetVotes();
-            for(size_t i = 0; i < vecVotes.size(); ++i) {
-                if(filter.contains(vecVotes[i].GetHash())) {
-                    continue;
-                }
-                if(!vecVotes[i].IsValid(true)) {
-                    continue;
-                }
-                pfrom->PushInventory(CInv(MSG_GOVERNANCE_OBJECT_VOTE, vecVotes[i].GetHash()));
-                ++nVoteCount;
-            }
+            // votes are only validated again when the masternode list changed
+            vecVoteInvs = govobj.GetVoteFile().GetValidVoteInvs();
+        }
+    }
+
+    for(size_t i = 0; i < vecObjectInvs.size(); ++i) {
+        pfrom->PushInventory(vecObjectInvs[i]);
+        ++nObjCount;
+    }
+
+    for(size_t i = 0; i < vecVoteInvs.size(); ++i) {
+        if(filter.contains(vecVoteInvs[i].hash)) {
+            continue;
         }
+        pfrom->PushInventory(vecVoteInvs[i]);
+        ++nVoteCount;
     }
 
     connman.PushMessage(pfrom, NetMsgType::SYNCSTATUSCOUNT, MASTERNODE_SYNC_GOVOBJ, nObjCount);
@@ -1306,6 +1318,55 @@ void CGovernanceManager::InitOnLoad()
     LogPrintf("     %s\n", ToString());
 }
 
+void CGovernanceManager::WriteCheckpoint(CCacheDBCheckpoint& checkpoint)
+{
+    LOCK(cs);
+
+    CDataStream ssState(SER_DISK, CLIENT_VERSION);
+    ssState << SERIALIZATION_VERSION_STRING;
+    ssState << mapInvalidVotes << mapOrphanVotes << mapWatchdogObjects;
+    ssState << nHashWatchdogCurrent << nTimeWatchdogCurrent << mapLastMasternodeObject;
+    checkpoint.Write(DB_GOVERNANCE_STATE, std::vector<unsigned char>(ssState.begin(), ssState.end()));
+
+    checkpoint.WriteMap(DB_GOVERNANCE_OBJECTS, mapObjects);
+    checkpoint.WriteMap(DB_ERASED_OBJECTS, mapErasedGovernanceObjects);
+}
+
+bool CGovernanceManager::ReadCheckpoint(CCacheDB& cachedb)
+{
+    LOCK(cs);
+
+    Clear();
+
+    std::vector<unsigned char> vchState;
+    if(!cachedb.Read(DB_GOVERNANCE_STATE, vchState)) {
+        // nothing stored yet
+        return true;
+    }
+
+    try {
+        CDataStream ssState(vchState, SER_DISK, CLIENT_VERSION);
+        std::string strVersion;
+        ssState >> strVersion;
+        if(strVersion != SERIALIZATION_VERSION_STRING) {
+            LogPrintf("CGovernanceManager::%s -- stored version %s is outdated, starting over\n", __func__, strVersion);
+            return true;
+        }
+        ssState >> mapInvalidVotes >> mapOrphanVotes >> mapWatchdogObjects;
+        ssState >> nHashWatchdogCurrent >> nTimeWatchdogCurrent >> mapLastMasternodeObject;
+    } catch (const std::exception& e) {
+        Clear();
+        return error("CGovernanceManager::%s -- failed to read state: %s", __func__, e.what());
+    }
+
+    if(!cachedb.ReadMap(DB_GOVERNANCE_OBJECTS, mapObjects) ||
+       !cachedb.ReadMap(DB_ERASED_OBJECTS, mapErasedGovernanceObjects)) {
+        Clear();
+        return false;
+    }
+    return true;
+}
+
 std::string CGovernanceManager::ToString() const
 {
     LOCK(cs);
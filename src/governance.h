@@ -20,6 +20,8 @@
 #include "timedata.h"
 #include "util.h"
 
+class CCacheDB;
+class CCacheDBCheckpoint;
 class CGovernanceManager;
 class CGovernanceTriggerManager;
 class CGovernanceObject;
@@ -339,6 +341,11 @@ public:
 
     std::string ToString() const;
 
+    /// Store the objects in the cache database, one record per object
+    void WriteCheckpoint(CCacheDBCheckpoint& checkpoint);
+    /// Load the objects from the cache database, false if they couldn't be read
+    bool ReadCheckpoint(CCacheDB& cachedb);
+
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
@@ -397,4 +397,19 @@ inline uint256 HashX11(const T1 pbegin, const T1 pend)
     return hash[10].trim256();
 }
 
+/** Number of inputs the batched X11 engine carries through each round at once. */
+static const size_t X11_BATCH_LANES = 8;
+
+/**
+ * Compute X11 over nCount inputs of nLen bytes each, the first starting at
+ * pbegin and the following ones nStride bytes apart, writing the results to
+ * phashes. Inputs are processed in groups of X11_BATCH_LANES: each of the
+ * eleven rounds runs over the whole group before the next one starts, so the
+ * round's code and lookup tables stay hot instead of being cycled through once
+ * per input. The lanes still run the portable sph kernels one after another,
+ * there is no SIMD backend. Results are identical to calling HashX11 on every
+ * input.
+ */
+void HashX11Batch(const unsigned char* pbegin, size_t nLen, size_t nStride, size_t nCount, uint256* phashes);
+
 #endif // BITCOIN_HASH_H
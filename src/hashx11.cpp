@@ -0,0 +1,86 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Kept out of hash.cpp, which is also part of libsquareconsensus and does not
+// link the sph_* kernels.
+
+#include "hash.h"
+
+#include <algorithm>
+
+namespace {
+/** Freshly initialized X11 round contexts, copied into place for every input */
+struct CX11InitialContexts
+{
+    sph_blake512_context     blake;
+    sph_bmw512_context       bmw;
+    sph_groestl512_context   groestl;
+    sph_skein512_context     skein;
+    sph_jh512_context        jh;
+    sph_keccak512_context    keccak;
+    sph_luffa512_context     luffa;
+    sph_cubehash512_context  cubehash;
+    sph_shavite512_context   shavite;
+    sph_simd512_context      simd;
+    sph_echo512_context      echo;
+
+    CX11InitialContexts()
+    {
+        sph_blake512_init(&blake);
+        sph_bmw512_init(&bmw);
+        sph_groestl512_init(&groestl);
+        sph_skein512_init(&skein);
+        sph_jh512_init(&jh);
+        sph_keccak512_init(&keccak);
+        sph_luffa512_init(&luffa);
+        sph_cubehash512_init(&cubehash);
+        sph_shavite512_init(&shavite);
+        sph_simd512_init(&simd);
+        sph_echo512_init(&echo);
+    }
+};
+}
+
+// Runs one X11 round over every lane of the current group, hashing each
+// 64-byte intermediate in place.
+#define X11_BATCH_ROUND(algo) do { \
+    for (size_t nLane = 0; nLane < nLanes; nLane++) { \
+        sph_##algo##512_context ctx = initial.algo; \
+        sph_##algo##512(&ctx, static_cast<const void*>(&lanes[nLane]), 64); \
+        sph_##algo##512_close(&ctx, static_cast<void*>(&lanes[nLane])); \
+    } \
+} while (0)
+
+void HashX11Batch(const unsigned char* pbegin, size_t nLen, size_t nStride, size_t nCount, uint256* phashes)
+{
+    static const CX11InitialContexts initial;
+    static const unsigned char pblank[1] = {};
+
+    uint512 lanes[X11_BATCH_LANES];
+
+    for (size_t nFirst = 0; nFirst < nCount; nFirst += X11_BATCH_LANES) {
+        const size_t nLanes = std::min(X11_BATCH_LANES, nCount - nFirst);
+
+        for (size_t nLane = 0; nLane < nLanes; nLane++) {
+            sph_blake512_context ctx = initial.blake;
+            sph_blake512(&ctx, nLen == 0 ? pblank : pbegin + (nFirst + nLane) * nStride, nLen);
+            sph_blake512_close(&ctx, static_cast<void*>(&lanes[nLane]));
+        }
+        X11_BATCH_ROUND(bmw);
+        X11_BATCH_ROUND(groestl);
+        X11_BATCH_ROUND(skein);
+        X11_BATCH_ROUND(jh);
+        X11_BATCH_ROUND(keccak);
+        X11_BATCH_ROUND(luffa);
+        X11_BATCH_ROUND(cubehash);
+        X11_BATCH_ROUND(shavite);
+        X11_BATCH_ROUND(simd);
+        X11_BATCH_ROUND(echo);
+
+        for (size_t nLane = 0; nLane < nLanes; nLane++)
+            phashes[nFirst + nLane] = lanes[nLane].trim256();
+    }
+}
+
+#undef X11_BATCH_ROUND
@@ -0,0 +1,357 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "indexbuilder.h"
+
+#include "chainparams.h"
+#include "spentindex.h"
+#include "txdb.h"
+#include "undo.h"
+#include "util.h"
+#include "validation.h"
+
+#include <boost/thread.hpp>
+
+CIndexBuilder indexbuilder;
+
+bool CIndexBuilder::Init(std::string& strError)
+{
+    LOCK2(cs_main, cs);
+
+    pblocktree->ReadIndexBuildProgress(progress);
+
+    // Whatever was switched off again since the last run is no longer built
+    int nEnabledIndexes = (fAddressIndex ? INDEX_BUILD_ADDRESS : 0) |
+                          (fSpentIndex ? INDEX_BUILD_SPENT : 0) |
+                          (fTimestampIndex ? INDEX_BUILD_TIMESTAMP : 0);
+    CIndexBuildProgress progressNew = progress;
+    progressNew.nIndexes &= nEnabledIndexes;
+
+    int nNewIndexes = 0;
+    if (!fAddressIndex && GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX))
+        nNewIndexes |= INDEX_BUILD_ADDRESS;
+    if (!fSpentIndex && GetBoolArg("-spentindex", DEFAULT_SPENTINDEX))
+        nNewIndexes |= INDEX_BUILD_SPENT;
+    if (!fTimestampIndex && GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX))
+        nNewIndexes |= INDEX_BUILD_TIMESTAMP;
+
+    if (nNewIndexes != 0) {
+        if (fHavePruned) {
+            strError = _("You need to rebuild the database using -reindex to enable -addressindex, -spentindex or -timestampindex on a pruned node");
+            return false;
+        }
+        // Indexes added to a build in progress start over from genesis,
+        // blocks which were indexed already are simply written again. The new
+        // indexes missed every block connected so far, so the build runs up
+        // to the tip even if an older build stopped short of it.
+        progressNew.nLiveHeight = chainActive.Height() + 1;
+        progressNew.nIndexes |= nNewIndexes;
+        progressNew.nHeight = 0;
+    }
+
+    if (!SetProgress(progressNew)) {
+        strError = _("Failed to write index build progress");
+        return false;
+    }
+
+    // Only flag the indexes as enabled once the build is recorded, from here on ConnectBlock maintains them
+    if (nNewIndexes & INDEX_BUILD_ADDRESS) {
+        // balances left from an address index which was switched off are counted again
+        if (!pblocktree->ResetAddressBalanceIndex(chainActive.Tip(), progressNew.nLiveHeight)) {
+            strError = _("Failed to reset address balance index");
+            return false;
+        }
+        fAddressIndex = true;
+        pblocktree->WriteFlag("addressindex", true);
+        // balances are built along with the address index
+        pblocktree->WriteFlag("addressbalanceindex", true);
+    }
+    if (nNewIndexes & INDEX_BUILD_SPENT) {
+        fSpentIndex = true;
+        pblocktree->WriteFlag("spentindex", true);
+    }
+    if (nNewIndexes & INDEX_BUILD_TIMESTAMP) {
+        fTimestampIndex = true;
+        pblocktree->WriteFlag("timestampindex", true);
+    }
+
+    if (!progress.IsNull())
+        LogPrintf("CIndexBuilder::Init -- %s\n", GetStatus());
+
+    return true;
+}
+
+bool CIndexBuilder::SetProgress(const CIndexBuildProgress& progressNew)
+{
+    AssertLockHeld(cs);
+
+    CIndexBuildProgress progressWrite = progressNew;
+    if (!progressWrite.IsNull() && progressWrite.nHeight >= progressWrite.nLiveHeight) {
+        LogPrintf("CIndexBuilder::SetProgress -- finished building indexes at height %d\n", progressWrite.nHeight);
+        progressWrite.SetNull();
+    }
+
+    if (progressWrite.IsNull()) {
+        if (!pblocktree->EraseIndexBuildProgress())
+            return false;
+    } else {
+        if (!pblocktree->WriteIndexBuildProgress(progressWrite))
+            return false;
+    }
+    progress = progressWrite;
+    return true;
+}
+
+void CIndexBuilder::BlockDisconnected(int nHeight)
+{
+    AssertLockHeld(cs_main);
+    LOCK(cs);
+
+    if (progress.IsNull() || nHeight >= progress.nLiveHeight)
+        return;
+
+    // DisconnectBlock removed whatever was indexed for this height already,
+    // the block replacing it gets indexed when it is connected.
+    CIndexBuildProgress progressNew = progress;
+    progressNew.nLiveHeight = nHeight;
+    progressNew.nHeight = std::min(progress.nHeight, nHeight);
+    if (!SetProgress(progressNew))
+        LogPrintf("CIndexBuilder::BlockDisconnected -- failed to write index build progress\n");
+}
+
+bool CIndexBuilder::IsBuilding(int nIndexes) const
+{
+    LOCK(cs);
+    return (progress.nIndexes & nIndexes) != 0;
+}
+
+CIndexBuildProgress CIndexBuilder::GetProgress() const
+{
+    LOCK(cs);
+    return progress;
+}
+
+std::string CIndexBuilder::GetStatus() const
+{
+    LOCK(cs);
+
+    if (progress.IsNull())
+        return "Indexes are up to date";
+
+    std::string strIndexes;
+    if (progress.nIndexes & INDEX_BUILD_ADDRESS)
+        strIndexes += "addressindex ";
+    if (progress.nIndexes & INDEX_BUILD_SPENT)
+        strIndexes += "spentindex ";
+    if (progress.nIndexes & INDEX_BUILD_TIMESTAMP)
+        strIndexes += "timestampindex ";
+
+    return strprintf("Building %s(block %d of %d)", strIndexes, progress.nHeight, progress.nLiveHeight);
+}
+
+/** A block of an index build batch, read and indexed by a worker thread */
+struct CIndexBuildBlock
+{
+    int nHeight;
+    const CBlockIndex* pindex;
+    CDiskBlockPos blockPos;
+    CDiskBlockPos undoPos;
+    uint256 hashPrevBlock;
+
+    bool fIndexed;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+
+    CIndexBuildBlock() : nHeight(0), pindex(NULL), fIndexed(false) {}
+};
+
+// Read the block and build its index entries, runs without holding any lock
+static void IndexBlock(CIndexBuildBlock& ib, int nIndexes, const Consensus::Params& consensusParams)
+{
+    const int nHeight = ib.nHeight;
+
+    // ConnectBlock doesn't index the genesis block
+    if (nHeight == 0) {
+        ib.fIndexed = true;
+        return;
+    }
+
+    CBlock block;
+    CBlockUndo blockUndo;
+    if (!ReadBlockFromDisk(block, ib.blockPos, consensusParams)) {
+        error("CIndexBuilder::%s -- failed to read block at height %d", __func__, nHeight);
+        return;
+    }
+    if (!UndoReadFromDisk(blockUndo, ib.undoPos, ib.hashPrevBlock)) {
+        error("CIndexBuilder::%s -- failed to read undo data at height %d", __func__, nHeight);
+        return;
+    }
+    if (blockUndo.vtxundo.size() + 1 != block.vtx.size()) {
+        error("CIndexBuilder::%s -- block and undo data inconsistent at height %d", __func__, nHeight);
+        return;
+    }
+
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = block.vtx[i];
+        const uint256 txhash = tx.GetHash();
+        int nType;
+        uint160 hashBytes;
+
+        if (i > 0) {
+            const CTxUndo& txundo = blockUndo.vtxundo[i-1];
+            if (txundo.vprevout.size() != tx.vin.size()) {
+                error("CIndexBuilder::%s -- transaction and undo data inconsistent at height %d", __func__, nHeight);
+                return;
+            }
+
+            for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                const COutPoint& outpoint = tx.vin[j].prevout;
+                const CTxOut& prevout = txundo.vprevout[j].out;
+                bool fHasAddress = GetIndexAddress(prevout.scriptPubKey, nType, hashBytes);
+
+                if ((nIndexes & INDEX_BUILD_ADDRESS) && fHasAddress)
+                    ib.addressIndex.push_back(std::make_pair(CAddressIndexKey(nType, hashBytes, nHeight, i, txhash, j, true), prevout.nValue * -1));
+
+                if (nIndexes & INDEX_BUILD_SPENT)
+                    ib.spentIndex.push_back(std::make_pair(CSpentIndexKey(outpoint.hash, outpoint.n), CSpentIndexValue(txhash, j, nHeight, prevout.nValue, nType, hashBytes)));
+            }
+        }
+
+        if (nIndexes & INDEX_BUILD_ADDRESS) {
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                const CTxOut& out = tx.vout[k];
+                if (!GetIndexAddress(out.scriptPubKey, nType, hashBytes))
+                    continue;
+
+                ib.addressIndex.push_back(std::make_pair(CAddressIndexKey(nType, hashBytes, nHeight, i, txhash, k, false), out.nValue));
+                ib.addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(nType, hashBytes, txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight)));
+            }
+        }
+    }
+    ib.fIndexed = true;
+}
+
+bool CIndexBuilder::GetBlocks(int nCount, std::vector<CIndexBuildBlock>& vBlocksRet, int& nIndexesRet) const
+{
+    LOCK2(cs_main, cs);
+
+    vBlocksRet.clear();
+    if (progress.IsNull())
+        return false;
+
+    nIndexesRet = progress.nIndexes;
+    for (int nHeight = progress.nHeight; nHeight < progress.nLiveHeight && (int)vBlocksRet.size() < nCount; nHeight++) {
+        const CBlockIndex* pindex = chainActive[nHeight];
+        if (pindex == NULL)
+            break;
+
+        CIndexBuildBlock ib;
+        ib.nHeight = nHeight;
+        ib.pindex = pindex;
+        ib.blockPos = pindex->GetBlockPos();
+        ib.undoPos = pindex->GetUndoPos();
+        if (pindex->pprev)
+            ib.hashPrevBlock = pindex->pprev->GetBlockHash();
+        vBlocksRet.push_back(ib);
+    }
+    return !vBlocksRet.empty();
+}
+
+bool CIndexBuilder::WriteBlock(const CIndexBuildBlock& ib, int nIndexes)
+{
+    LOCK2(cs_main, cs);
+
+    const int nHeight = ib.nHeight;
+
+    // The chain may have been reorganized while we were reading
+    if (chainActive[nHeight] != ib.pindex || nHeight != progress.nHeight || nHeight >= progress.nLiveHeight || nIndexes != progress.nIndexes)
+        return true;
+
+    if (!ib.fIndexed)
+        return false;
+
+    if (nHeight > 0) {
+        if (nIndexes & INDEX_BUILD_ADDRESS) {
+            // Outputs spent since are gone from the UTXO set, ConnectBlock removes the ones spent from now on
+            std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndexTip;
+            for (unsigned int i = 0; i < ib.addressUnspentIndex.size(); i++) {
+                if (pcoinsTip->HaveCoin(COutPoint(ib.addressUnspentIndex[i].first.txhash, ib.addressUnspentIndex[i].first.index)))
+                    addressUnspentIndexTip.push_back(ib.addressUnspentIndex[i]);
+            }
+
+            if (!pblocktree->WriteAddressIndex(ib.addressIndex, ib.pindex, true))
+                return error("CIndexBuilder::WriteBlock -- failed to write address index");
+            if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndexTip))
+                return error("CIndexBuilder::WriteBlock -- failed to write address unspent index");
+        }
+
+        if (nIndexes & INDEX_BUILD_SPENT)
+            if (!pblocktree->UpdateSpentIndex(ib.spentIndex))
+                return error("CIndexBuilder::WriteBlock -- failed to write spent index");
+
+        if (nIndexes & INDEX_BUILD_TIMESTAMP)
+            if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(ib.pindex->nTime, ib.pindex->GetBlockHash())))
+                return error("CIndexBuilder::WriteBlock -- failed to write timestamp index");
+    }
+
+    CIndexBuildProgress progressNew = progress;
+    progressNew.nHeight++;
+    return SetProgress(progressNew);
+}
+
+void CIndexBuilder::Run()
+{
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    int nThreads = std::max(1, std::min(GetNumCores(), MAX_INDEX_BUILD_THREADS));
+    int nLastLogHeight = 0;
+
+    while (IsBuilding()) {
+        boost::this_thread::interruption_point();
+
+        // Blocks are read and indexed in batches on several threads, then
+        // written one by one in chain order
+        std::vector<CIndexBuildBlock> vBlocks;
+        int nIndexes;
+        if (!GetBlocks(nThreads * INDEX_BUILD_BLOCKS_PER_THREAD, vBlocks, nIndexes))
+            return;
+
+        {
+            // the threads use vBlocks, don't leave before they are done
+            boost::this_thread::disable_interruption di;
+            boost::thread_group threadGroup;
+            for (int nThread = 0; nThread < nThreads; nThread++) {
+                threadGroup.create_thread([&vBlocks, nThread, nThreads, nIndexes, &consensusParams]() {
+                    for (size_t i = nThread; i < vBlocks.size(); i += nThreads)
+                        IndexBlock(vBlocks[i], nIndexes, consensusParams);
+                });
+            }
+            threadGroup.join_all();
+        }
+
+        BOOST_FOREACH(const CIndexBuildBlock& ib, vBlocks) {
+            if (!WriteBlock(ib, nIndexes)) {
+                LogPrintf("CIndexBuilder::Run -- stopped, %s\n", GetStatus());
+                return;
+            }
+            // Start over with a new batch if the chain or the build changed
+            if (GetProgress().nHeight != ib.nHeight + 1)
+                break;
+        }
+
+        CIndexBuildProgress progressNow = GetProgress();
+        if (progressNow.nHeight - nLastLogHeight >= 10000) {
+            LogPrintf("CIndexBuilder::Run -- %s\n", GetStatus());
+            nLastLogHeight = progressNow.nHeight;
+        }
+    }
+}
+
+void ThreadIndexBuilder()
+{
+    // Make this thread recognisable as the index building thread
+    RenameThread("square-indexer");
+
+    indexbuilder.Run();
+}
@@ -0,0 +1,92 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef INDEXBUILDER_H
+#define INDEXBUILDER_H
+
+#include "serialize.h"
+#include "sync.h"
+
+#include <string>
+#include <vector>
+
+class CIndexBuilder;
+struct CIndexBuildBlock;
+
+static const int INDEX_BUILD_ADDRESS    = (1 << 0);
+static const int INDEX_BUILD_SPENT      = (1 << 1);
+static const int INDEX_BUILD_TIMESTAMP  = (1 << 2);
+
+/** Maximum number of threads reading and indexing blocks */
+static const int MAX_INDEX_BUILD_THREADS = 8;
+/** Blocks every thread reads and indexes before the batch is written */
+static const int INDEX_BUILD_BLOCKS_PER_THREAD = 16;
+
+extern CIndexBuilder indexbuilder;
+
+/** Checkpoint of an index build, kept in the block tree database */
+struct CIndexBuildProgress
+{
+    int nIndexes;       // INDEX_BUILD_* flags of the indexes being built
+    int nHeight;        // next block to index
+    int nLiveHeight;    // blocks at this height and above were indexed when they were connected
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(nIndexes);
+        READWRITE(nHeight);
+        READWRITE(nLiveHeight);
+    }
+
+    CIndexBuildProgress() {
+        SetNull();
+    }
+
+    void SetNull() {
+        nIndexes = 0;
+        nHeight = 0;
+        nLiveHeight = 0;
+    }
+
+    bool IsNull() const {
+        return nIndexes == 0;
+    }
+};
+
+//
+// CIndexBuilder : builds -addressindex, -spentindex and -timestampindex for blocks
+// which were connected before the index was switched on, while the node keeps running.
+// New blocks are indexed by ConnectBlock as usual from the moment the index is enabled.
+//
+
+class CIndexBuilder
+{
+private:
+    // protects progress, which is only ever modified while also holding cs_main
+    mutable CCriticalSection cs;
+    CIndexBuildProgress progress;
+
+    bool GetBlocks(int nCount, std::vector<CIndexBuildBlock>& vBlocksRet, int& nIndexesRet) const;
+    bool WriteBlock(const CIndexBuildBlock& block, int nIndexes);
+    bool SetProgress(const CIndexBuildProgress& progressNew);
+
+public:
+    CIndexBuilder() {}
+
+    /// Enable indexes requested by arguments but missing from the database, or resume building them
+    bool Init(std::string& strError);
+    /// A block at nHeight was disconnected from the active chain
+    void BlockDisconnected(int nHeight);
+
+    bool IsBuilding(int nIndexes = INDEX_BUILD_ADDRESS | INDEX_BUILD_SPENT | INDEX_BUILD_TIMESTAMP) const;
+    CIndexBuildProgress GetProgress() const;
+    std::string GetStatus() const;
+
+    void Run();
+};
+
+void ThreadIndexBuilder();
+
+#endif
@@ -21,6 +21,7 @@
 #include "consensus/validation.h"
 #include "httpserver.h"
 #include "httprpc.h"
+#include "indexbuilder.h"
 #include "key.h"
 #include "validation.h"
 #include "miner.h"
@@ -48,6 +49,7 @@
 #endif
 
 #include "activemasternode.h"
+#include "cache-database.h"
 #include "dsnotificationinterface.h"
 #include "flat-database.h"
 #include "governance.h"
@@ -240,15 +242,18 @@ void PrepareShutdown()
     peerLogic.reset();
     g_connman.reset();
 
-    // STORE DATA CACHES INTO SERIALIZED DAT FILES
-    CFlatDB<CMasternodeMan> flatdb1("mncache.dat", "magicMasternodeCache");
-    flatdb1.Dump(mnodeman);
-    CFlatDB<CMasternodePayments> flatdb2("mnpayments.dat", "magicMasternodePaymentsCache");
-    flatdb2.Dump(mnpayments);
-    CFlatDB<CGovernanceManager> flatdb3("governance.dat", "magicGovernanceCache");
-    flatdb3.Dump(governance);
+    // STORE DATA CACHES INTO THE CACHE DATABASE AND SERIALIZED DAT FILES
+    if(pcachedb) {
+        WriteCacheDB(*pcachedb);
+        delete pcachedb;
+        pcachedb = NULL;
+    }
     CFlatDB<CNetFulfilledRequestManager> flatdb4("netfulfilled.dat", "magicFulfilledCache");
     flatdb4.Dump(netfulfilledman);
+    if(!fLiteMode) {
+        CFlatDB<CMasternodePayeeIndex> flatdb5("mnpayeeindex.dat", "magicMasternodePayeeIndex");
+        flatdb5.Dump(mnpayeeindex);
+    }
 
     UnregisterNodeSignals(GetNodeSignals());
 
@@ -265,6 +270,7 @@ void PrepareShutdown()
 
     {
         LOCK(cs_main);
+        ResetBlockPrefetch();
         if (pcoinsTip != NULL) {
             FlushStateToDisk();
         }
@@ -457,6 +463,11 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-proxy=<ip:port>", _("Connect through SOCKS5 proxy"));
     strUsage += HelpMessageOpt("-proxyrandomize", strprintf(_("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)"), DEFAULT_PROXYRANDOMIZE));
     strUsage += HelpMessageOpt("-seednode=<ip>", _("Connect to a node to retrieve peer addresses, and disconnect"));
+#ifdef HAVE_SYS_EPOLL_H
+    strUsage += HelpMessageOpt("-socketevents=<mode>", strprintf(_("Socket events mode, which must be one of: select, epoll (default: %s)"), DEFAULT_SOCKETEVENTS));
+#else
+    strUsage += HelpMessageOpt("-socketevents=<mode>", strprintf(_("Socket events mode, which must be one of: select (default: %s)"), DEFAULT_SOCKETEVENTS));
+#endif
     strUsage += HelpMessageOpt("-timeout=<n>", strprintf(_("Specify connection timeout in milliseconds (minimum: 1, default: %d)"), DEFAULT_CONNECT_TIMEOUT));
     strUsage += HelpMessageOpt("-torcontrol=<ip>:<port>", strprintf(_("Tor control port to use if onion listening enabled (default: %s)"), DEFAULT_TOR_CONTROL));
     strUsage += HelpMessageOpt("-torpassword=<pass>", _("Tor control port password (default: empty)"));
@@ -484,8 +495,13 @@ std::string HelpMessage(HelpMessageMode mode)
             CURRENCY_UNIT, FormatMoney(DEFAULT_TRANSACTION_MINFEE)));
     strUsage += HelpMessageOpt("-paytxfee=<amt>", strprintf(_("Fee (in %s/kB) to add to transactions you send (default: %s)"),
         CURRENCY_UNIT, FormatMoney(payTxFee.GetFeePerK())));
+    strUsage += HelpMessageOpt("-logwallet", strprintf(_("Store the wallet in an append-only log file instead of Berkeley DB, an existing wallet file is migrated on startup and kept as <file>.<time>.bdb (default: %u)"), DEFAULT_LOGWALLET));
+    strUsage += HelpMessageOpt("-payoutinterval=<n>", strprintf(_("Send the payments queued by queuepayouts every <n> seconds, 0 to send them on sendpayouts only (default: %u)"), DEFAULT_PAYOUT_INTERVAL));
+    strUsage += HelpMessageOpt("-payoutmaxoutputs=<n>", strprintf(_("Pay up to <n> queued payments with one transaction (default: %u)"), DEFAULT_PAYOUT_MAX_OUTPUTS));
+    strUsage += HelpMessageOpt("-payoutnotify=<cmd>", _("Execute command when a payout transaction is sent (%s in cmd is replaced by TxID)"));
     strUsage += HelpMessageOpt("-rescan", _("Rescan the block chain for missing wallet transactions on startup"));
     strUsage += HelpMessageOpt("-salvagewallet", _("Attempt to recover private keys from a corrupt wallet.dat on startup"));
+    strUsage += HelpMessageOpt("-signthreads=<n>", _("Sign the inputs of large transactions on up to <n> threads (default: number of cores)"));
     strUsage += HelpMessageOpt("-sendfreetransactions", strprintf(_("Send transactions as zero-fee transactions if possible (default: %u)"), DEFAULT_SEND_FREE_TRANSACTIONS));
     strUsage += HelpMessageOpt("-spendzeroconfchange", strprintf(_("Spend unconfirmed change when sending transactions (default: %u)"), DEFAULT_SPEND_ZEROCONF_CHANGE));
     strUsage += HelpMessageOpt("-txconfirmtarget=<n>", strprintf(_("If paytxfee is not set, include enough fee so transactions begin confirmation on average within n blocks (default: %u)"), DEFAULT_TX_CONFIRM_TARGET));
@@ -517,6 +533,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-zmqpubhashblock=<address>", _("Enable publish hash block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubhashtx=<address>", _("Enable publish hash transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubhashtxlock=<address>", _("Enable publish hash transaction (locked via InstantSend) in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubhashaddresstx=<address>", _("Enable publish hash of mempool transactions per address they spend from or pay to in <address> (requires -addressindex)"));
     strUsage += HelpMessageOpt("-zmqpubrawblock=<address>", _("Enable publish raw block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtx=<address>", _("Enable publish raw transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtxlock=<address>", _("Enable publish raw transaction (locked via InstantSend) in <address>"));
@@ -526,6 +543,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-uacomment=<cmt>", _("Append comment to the user agent string"));
     if (showDebug)
     {
+        strUsage += HelpMessageOpt("-blockmmap", strprintf("Read blocks from memory mapped block files (default: %u)", DEFAULT_BLOCK_MMAP));
+        strUsage += HelpMessageOpt("-blockprefetch", strprintf("Read the next block and the coins it spends on a separate thread while connecting blocks (default: %u)", DEFAULT_BLOCK_PREFETCH));
         strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), DEFAULT_CHECKBLOCKS));
         strUsage += HelpMessageOpt("-checklevel=<n>", strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), DEFAULT_CHECKLEVEL));
         strUsage += HelpMessageOpt("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. Also sets -checkmempool (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
@@ -1032,13 +1051,31 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 #endif
     }
 
+    SocketEventsMode socketEventsMode = SOCKETEVENTS_SELECT;
+    std::string strSocketEventsMode = GetArg("-socketevents", DEFAULT_SOCKETEVENTS);
+    if (strSocketEventsMode == "select") {
+        socketEventsMode = SOCKETEVENTS_SELECT;
+#ifdef HAVE_SYS_EPOLL_H
+    } else if (strSocketEventsMode == "epoll") {
+        socketEventsMode = SOCKETEVENTS_EPOLL;
+#endif
+    } else {
+        return InitError(strprintf(_("Invalid -socketevents ('%s') specified. Only these modes are supported: %s"), strSocketEventsMode,
+#ifdef HAVE_SYS_EPOLL_H
+                                   "select, epoll"));
+#else
+                                   "select"));
+#endif
+    }
+
     // Make sure enough file descriptors are available
     int nBind = std::max((int)mapArgs.count("-bind") + (int)mapArgs.count("-whitebind"), 1);
     int nUserMaxConnections = GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
     int nMaxConnections = std::max(nUserMaxConnections, 0);
 
-    // Trim requested connection counts, to fit into system limitations
-    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
+    // Trim requested connection counts, to fit into system limitations, only select() is limited to FD_SETSIZE
+    if (socketEventsMode == SOCKETEVENTS_SELECT)
+        nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
     int nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return InitError(_("Not enough file descriptors available."));
@@ -1078,6 +1115,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     }
     fCheckBlockIndex = GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
     fCheckpointsEnabled = GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
+    fBlockPrefetch = GetBoolArg("-blockprefetch", DEFAULT_BLOCK_PREFETCH);
+    fBlockMmap = GetBoolArg("-blockmmap", DEFAULT_BLOCK_MMAP);
 
     hashAssumeValid = uint256S(GetArg("-assumevalid", chainparams.GetConsensus().defaultAssumeValid.GetHex()));
     if (!hashAssumeValid.IsNull())
@@ -1281,6 +1320,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadHashSignatureCheck);
     }
 
     if (mapArgs.count("-sporkkey")) // spork priv key
@@ -1667,6 +1708,13 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     }
     LogPrintf(" block index %15dms\n", GetTimeMillis() - nStart);
 
+    // Additional indexes switched on for an existing database are built in the background
+    {
+        std::string strIndexError;
+        if (!indexbuilder.Init(strIndexError))
+            return InitError(strIndexError);
+    }
+
     boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_filein(fopen(est_path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
     // Allowed to fail as this file IS missing on first startup.
@@ -1675,6 +1723,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     fFeeEstimatesInitialized = true;
 
     // ********************************************************* Step 8: load wallet
+
+    // the wallet sorts its coins by denomination, set them up before it can be used
+    CPrivateSend::InitStandardDenominations();
+
 #ifdef ENABLE_WALLET
     if (fDisableWallet) {
         pwalletMain = NULL;
@@ -1885,6 +1937,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             vImportFiles.push_back(strFile);
     }
     threadGroup.create_thread(boost::bind(&ThreadImport, vImportFiles));
+    if (indexbuilder.IsBuilding())
+        threadGroup.create_thread(&ThreadIndexBuilder);
     if (chainActive.Tip() == NULL) {
         LogPrintf("Waiting for genesis block to be imported...\n");
         while (!fRequestShutdown && chainActive.Tip() == NULL)
@@ -1965,41 +2019,71 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("PrivateSend amount %d\n", privateSendClient.nPrivateSendAmount);
 #endif // ENABLE_WALLET
 
-    CPrivateSend::InitStandardDenominations();
-
     // ********************************************************* Step 11b: Load cache data
 
-    // LOAD SERIALIZED DAT FILES INTO DATA CACHES FOR INTERNAL USE
+    // LOAD THE CACHE DATABASE AND SERIALIZED DAT FILES INTO DATA CACHES FOR INTERNAL USE
 
     boost::filesystem::path pathDB = GetDataDir();
     std::string strDBName;
 
-    strDBName = "mncache.dat";
+    pcachedb = new CCacheDB(nCacheDBCache << 20);
+    // dat files written by older versions are only read to fill an empty cache database
+    bool fLoadDatFiles = pcachedb->IsEmpty();
+
     uiInterface.InitMessage(_("Loading masternode cache..."));
-    CFlatDB<CMasternodeMan> flatdb1(strDBName, "magicMasternodeCache");
-    if(!flatdb1.Load(mnodeman)) {
-        return InitError(_("Failed to load masternode cache from") + "\n" + (pathDB / strDBName).string());
+    if(fLoadDatFiles) {
+        strDBName = "mncache.dat";
+        CFlatDB<CMasternodeMan> flatdb1(strDBName, "magicMasternodeCache");
+        if(!flatdb1.Load(mnodeman)) {
+            return InitError(_("Failed to load masternode cache from") + "\n" + (pathDB / strDBName).string());
+        }
+    } else {
+        LoadFromCacheDB(*pcachedb, mnodeman, "masternode cache");
     }
 
     if(mnodeman.size()) {
-        strDBName = "mnpayments.dat";
         uiInterface.InitMessage(_("Loading masternode payment cache..."));
-        CFlatDB<CMasternodePayments> flatdb2(strDBName, "magicMasternodePaymentsCache");
-        if(!flatdb2.Load(mnpayments)) {
-            return InitError(_("Failed to load masternode payments cache from") + "\n" + (pathDB / strDBName).string());
+        if(fLoadDatFiles) {
+            strDBName = "mnpayments.dat";
+            CFlatDB<CMasternodePayments> flatdb2(strDBName, "magicMasternodePaymentsCache");
+            if(!flatdb2.Load(mnpayments)) {
+                return InitError(_("Failed to load masternode payments cache from") + "\n" + (pathDB / strDBName).string());
+            }
+        } else {
+            LoadFromCacheDB(*pcachedb, mnpayments, "masternode payment cache");
         }
 
-        strDBName = "governance.dat";
         uiInterface.InitMessage(_("Loading governance cache..."));
-        CFlatDB<CGovernanceManager> flatdb3(strDBName, "magicGovernanceCache");
-        if(!flatdb3.Load(governance)) {
-            return InitError(_("Failed to load governance cache from") + "\n" + (pathDB / strDBName).string());
+        if(fLoadDatFiles) {
+            strDBName = "governance.dat";
+            CFlatDB<CGovernanceManager> flatdb3(strDBName, "magicGovernanceCache");
+            if(!flatdb3.Load(governance)) {
+                return InitError(_("Failed to load governance cache from") + "\n" + (pathDB / strDBName).string());
+            }
+        } else {
+            LoadFromCacheDB(*pcachedb, governance, "governance cache");
         }
         governance.InitOnLoad();
     } else {
         uiInterface.InitMessage(_("Masternode cache is empty, skipping payments and governance cache..."));
     }
 
+    if(!fLiteMode) {
+        strDBName = "mnpayeeindex.dat";
+        uiInterface.InitMessage(_("Loading masternode payee index..."));
+        CFlatDB<CMasternodePayeeIndex> flatdb5(strDBName, "magicMasternodePayeeIndex");
+        LOCK(cs_main);
+        if(!flatdb5.Load(mnpayeeindex)) {
+            return InitError(_("Failed to load masternode payee index from") + "\n" + (pathDB / strDBName).string());
+        }
+        // blocks connected or disconnected since the index was saved (or while it was loading)
+        // are not reflected in it, rebuild it from the recent blocks then
+        if(chainActive.Tip() && mnpayeeindex.GetBestBlock() != chainActive.Tip()->GetBlockHash()) {
+            uiInterface.InitMessage(_("Rebuilding masternode payee index..."));
+            mnpayeeindex.Rebuild(chainActive.Tip(), chainparams.GetConsensus());
+        }
+    }
+
     strDBName = "netfulfilled.dat";
     uiInterface.InitMessage(_("Loading fulfilled requests cache..."));
     CFlatDB<CNetFulfilledRequestManager> flatdb4(strDBName, "magicFulfilledCache");
@@ -2069,6 +2153,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     connOptions.nSendBufferMaxSize = 1000*GetArg("-maxsendbuffer", DEFAULT_MAXSENDBUFFER);
     connOptions.nReceiveFloodSize = 1000*GetArg("-maxreceivebuffer", DEFAULT_MAXRECEIVEBUFFER);
 
+    connOptions.socketEventsMode = socketEventsMode;
+
     if (!connman.Start(scheduler, strNodeError, connOptions))
         return InitError(strNodeError);
 
@@ -2087,6 +2173,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
         // Run a thread to flush wallet periodically
         threadGroup.create_thread(boost::bind(&ThreadFlushWalletDB, boost::ref(pwalletMain->strWalletFile)));
+
+        // Run a thread to send queued payouts periodically
+        threadGroup.create_thread(boost::bind(&ThreadSendPayouts, boost::ref(connman)));
     }
 #endif
 
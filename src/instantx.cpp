@@ -69,17 +69,29 @@ void CInstantSend::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataSt
         // Ignore any InstantSend messages until masternode list is synced
         if(!masternodeSync.IsMasternodeListSynced()) return;
 
-        LOCK(cs_main);
-#ifdef ENABLE_WALLET
-        if (pwalletMain)
-            LOCK(pwalletMain->cs_wallet);
-#endif
-        LOCK(cs_instantsend);
+        {
+            LOCK(cs_instantsend);
+            if(mapTxLockVotes.count(nVoteHash)) return;
+        }
 
-        if(mapTxLockVotes.count(nVoteHash)) return;
-        mapTxLockVotes.insert(std::make_pair(nVoteHash, vote));
+        // Masternode rank and signature are checked before taking cs_main and
+        // cs_instantsend, so that vote storms don't stall block processing
+        bool fValid = vote.IsValid(pfrom, connman);
+
+        {
+            LOCK2(cs_main, cs_instantsend);
 
-        ProcessTxLockVote(pfrom, vote, connman);
+            if(!mapTxLockVotes.insert(std::make_pair(nVoteHash, vote)).second) return;
+
+            if(fValid) {
+                ProcessValidTxLockVote(pfrom, vote, connman);
+            } else {
+                // could be because of missing MN
+                LogPrint("instantsend", "CInstantSend::ProcessMessage -- Vote is invalid, txid=%s\n", vote.GetTxHash().ToString());
+            }
+        }
+
+        NotifyLockedTransactions();
 
         return;
     }
@@ -87,13 +99,22 @@ void CInstantSend::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataSt
 
 bool CInstantSend::ProcessTxLockRequest(const CTxLockRequest& txLockRequest, CConnman& connman)
 {
+    // cs_main might be held by the caller, which calls NotifyLockedTransactions() for the
+    // locks completed here once it released cs_main
     LOCK2(cs_main, cs_instantsend);
+    return ProcessTxLockRequestInternal(txLockRequest, connman);
+}
+
+bool CInstantSend::ProcessTxLockRequestInternal(const CTxLockRequest& txLockRequest, CConnman& connman)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_instantsend);
 
     uint256 txHash = txLockRequest.GetHash();
 
     // Check to see if we conflict with existing completed lock
     BOOST_FOREACH(const CTxIn& txin, txLockRequest.vin) {
-        std::map<COutPoint, uint256>::iterator it = mapLockedOutpoints.find(txin.prevout);
+        std::unordered_map<COutPoint, uint256, SaltedOutpointHasher>::iterator it = mapLockedOutpoints.find(txin.prevout);
         if(it != mapLockedOutpoints.end() && it->second != txLockRequest.GetHash()) {
             // Conflicting with complete lock, proceed to see if we should cancel them both
             LogPrintf("CInstantSend::ProcessTxLockRequest -- WARNING: Found conflicting completed Transaction Lock, txid=%s, completed lock txid=%s\n",
@@ -104,7 +125,7 @@ bool CInstantSend::ProcessTxLockRequest(const CTxLockRequest& txLockRequest, CCo
     // Check to see if there are votes for conflicting request,
     // if so - do not fail, just warn user
     BOOST_FOREACH(const CTxIn& txin, txLockRequest.vin) {
-        std::map<COutPoint, std::set<uint256> >::iterator it = mapVotedOutpoints.find(txin.prevout);
+        std::unordered_map<COutPoint, std::set<uint256>, SaltedOutpointHasher>::iterator it = mapVotedOutpoints.find(txin.prevout);
         if(it != mapVotedOutpoints.end()) {
             BOOST_FOREACH(const uint256& hash, it->second) {
                 if(hash != txLockRequest.GetHash()) {
@@ -126,7 +147,7 @@ bool CInstantSend::ProcessTxLockRequest(const CTxLockRequest& txLockRequest, CCo
     // Masternodes will sometimes propagate votes before the transaction is known to the client.
     // If this just happened - lock inputs, resolve conflicting locks, update transaction status
     // forcing external script notification.
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    candidate_map_t::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
     TryToFinalizeLockCandidate(itLockCandidate->second);
 
     return true;
@@ -140,7 +161,7 @@ bool CInstantSend::CreateTxLockCandidate(const CTxLockRequest& txLockRequest)
 
     uint256 txHash = txLockRequest.GetHash();
 
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    candidate_map_t::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
     if(itLockCandidate == mapTxLockCandidates.end()) {
         LogPrintf("CInstantSend::CreateTxLockCandidate -- new, txid=%s\n", txHash.ToString());
 
@@ -184,7 +205,7 @@ void CInstantSend::Vote(const uint256& txHash, CConnman& connman)
     AssertLockHeld(cs_main);
     LOCK(cs_instantsend);
 
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    candidate_map_t::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
     if (itLockCandidate == mapTxLockCandidates.end()) return;
     Vote(itLockCandidate->second, connman);
     // Let's see if our vote changed smth
@@ -230,14 +251,14 @@ void CInstantSend::Vote(CTxLockCandidate& txLockCandidate, CConnman& connman)
 
         LogPrint("instantsend", "CInstantSend::Vote -- In the top %d (%d)\n", nSignaturesTotal, nRank);
 
-        std::map<COutPoint, std::set<uint256> >::iterator itVoted = mapVotedOutpoints.find(itOutpointLock->first);
+        std::unordered_map<COutPoint, std::set<uint256>, SaltedOutpointHasher>::iterator itVoted = mapVotedOutpoints.find(itOutpointLock->first);
 
         // Check to see if we already voted for this outpoint,
         // refuse to vote twice or to include the same outpoint in another tx
         bool fAlreadyVoted = false;
         if(itVoted != mapVotedOutpoints.end()) {
             BOOST_FOREACH(const uint256& hash, itVoted->second) {
-                std::map<uint256, CTxLockCandidate>::iterator it2 = mapTxLockCandidates.find(hash);
+                candidate_map_t::iterator it2 = mapTxLockCandidates.find(hash);
                 if(it2->second.HasMasternodeVoted(itOutpointLock->first, activeMasternode.outpoint)) {
                     // we already voted for this outpoint to be included either in the same tx or in a competing one,
                     // skip it anyway
@@ -295,29 +316,35 @@ void CInstantSend::Vote(CTxLockCandidate& txLockCandidate, CConnman& connman)
 //received a consensus vote
 bool CInstantSend::ProcessTxLockVote(CNode* pfrom, CTxLockVote& vote, CConnman& connman)
 {
-    // cs_main, cs_wallet and cs_instantsend should be already locked
+    // cs_main and cs_instantsend should be already locked
     AssertLockHeld(cs_main);
-#ifdef ENABLE_WALLET
-    if (pwalletMain)
-        AssertLockHeld(pwalletMain->cs_wallet);
-#endif
     AssertLockHeld(cs_instantsend);
 
-    uint256 txHash = vote.GetTxHash();
-
     if(!vote.IsValid(pfrom, connman)) {
         // could be because of missing MN
-        LogPrint("instantsend", "CInstantSend::ProcessTxLockVote -- Vote is invalid, txid=%s\n", txHash.ToString());
+        LogPrint("instantsend", "CInstantSend::ProcessTxLockVote -- Vote is invalid, txid=%s\n", vote.GetTxHash().ToString());
         return false;
     }
 
+    return ProcessValidTxLockVote(pfrom, vote, connman);
+}
+
+//received a consensus vote which passed CTxLockVote::IsValid
+bool CInstantSend::ProcessValidTxLockVote(CNode* pfrom, CTxLockVote& vote, CConnman& connman)
+{
+    // cs_main and cs_instantsend should be already locked
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_instantsend);
+
+    uint256 txHash = vote.GetTxHash();
+
     // relay valid vote asap
     vote.Relay(connman);
 
     // Masternodes will sometimes propagate votes before the transaction is known to the client,
     // will actually process only after the lock request itself has arrived
 
-    std::map<uint256, CTxLockCandidate>::iterator it = mapTxLockCandidates.find(txHash);
+    candidate_map_t::iterator it = mapTxLockCandidates.find(txHash);
     if(it == mapTxLockCandidates.end() || !it->second.txLockRequest) {
         if(!mapTxLockVotesOrphan.count(vote.GetHash())) {
             // start timeout countdown after the very first vote
@@ -326,7 +353,7 @@ bool CInstantSend::ProcessTxLockVote(CNode* pfrom, CTxLockVote& vote, CConnman&
             LogPrint("instantsend", "CInstantSend::ProcessTxLockVote -- Orphan vote: txid=%s  masternode=%s new\n",
                     txHash.ToString(), vote.GetMasternodeOutpoint().ToStringShort());
             bool fReprocess = true;
-            std::map<uint256, CTxLockRequest>::iterator itLockRequest = mapLockRequestAccepted.find(txHash);
+            lockrequest_map_t::iterator itLockRequest = mapLockRequestAccepted.find(txHash);
             if(itLockRequest == mapLockRequestAccepted.end()) {
                 itLockRequest = mapLockRequestRejected.find(txHash);
                 if(itLockRequest == mapLockRequestRejected.end()) {
@@ -338,7 +365,7 @@ bool CInstantSend::ProcessTxLockVote(CNode* pfrom, CTxLockVote& vote, CConnman&
                 // We have enough votes for corresponding lock to complete,
                 // tx lock request should already be received at this stage.
                 LogPrint("instantsend", "CInstantSend::ProcessTxLockVote -- Found enough orphan votes, reprocessing Transaction Lock Request: txid=%s\n", txHash.ToString());
-                ProcessTxLockRequest(itLockRequest->second, connman);
+                ProcessTxLockRequestInternal(itLockRequest->second, connman);
                 return true;
             }
         } else {
@@ -376,14 +403,14 @@ bool CInstantSend::ProcessTxLockVote(CNode* pfrom, CTxLockVote& vote, CConnman&
 
     LogPrint("instantsend", "CInstantSend::ProcessTxLockVote -- Transaction Lock Vote, txid=%s\n", txHash.ToString());
 
-    std::map<COutPoint, std::set<uint256> >::iterator it1 = mapVotedOutpoints.find(vote.GetOutpoint());
+    std::unordered_map<COutPoint, std::set<uint256>, SaltedOutpointHasher>::iterator it1 = mapVotedOutpoints.find(vote.GetOutpoint());
     if(it1 != mapVotedOutpoints.end()) {
         BOOST_FOREACH(const uint256& hash, it1->second) {
             if(hash != txHash) {
                 // same outpoint was already voted to be locked by another tx lock request,
                 // let's see if it was the same masternode who voted on this outpoint
                 // for another tx lock request
-                std::map<uint256, CTxLockCandidate>::iterator it2 = mapTxLockCandidates.find(hash);
+                candidate_map_t::iterator it2 = mapTxLockCandidates.find(hash);
                 if(it2 !=mapTxLockCandidates.end() && it2->second.HasMasternodeVoted(vote.GetOutpoint(), vote.GetMasternodeOutpoint())) {
                     // yes, it was the same masternode
                     LogPrintf("CInstantSend::ProcessTxLockVote -- masternode sent conflicting votes! %s\n", vote.GetMasternodeOutpoint().ToStringShort());
@@ -425,21 +452,20 @@ bool CInstantSend::ProcessTxLockVote(CNode* pfrom, CTxLockVote& vote, CConnman&
 
 void CInstantSend::ProcessOrphanTxLockVotes(CConnman& connman)
 {
-    LOCK(cs_main);
-#ifdef ENABLE_WALLET
-    if (pwalletMain)
-        LOCK(pwalletMain->cs_wallet);
-#endif
-    LOCK(cs_instantsend);
+    {
+        LOCK2(cs_main, cs_instantsend);
 
-    std::map<uint256, CTxLockVote>::iterator it = mapTxLockVotesOrphan.begin();
-    while(it != mapTxLockVotesOrphan.end()) {
-        if(ProcessTxLockVote(NULL, it->second, connman)) {
-            mapTxLockVotesOrphan.erase(it++);
-        } else {
-            ++it;
+        vote_map_t::iterator it = mapTxLockVotesOrphan.begin();
+        while(it != mapTxLockVotesOrphan.end()) {
+            if(ProcessTxLockVote(NULL, it->second, connman)) {
+                mapTxLockVotesOrphan.erase(it++);
+            } else {
+                ++it;
+            }
         }
     }
+
+    NotifyLockedTransactions();
 }
 
 bool CInstantSend::IsEnoughOrphanVotesForTx(const CTxLockRequest& txLockRequest)
@@ -460,7 +486,7 @@ bool CInstantSend::IsEnoughOrphanVotesForTxAndOutPoint(const uint256& txHash, co
     // Scan orphan votes to check if this outpoint has enough orphan votes to be locked in some tx.
     LOCK2(cs_main, cs_instantsend);
     int nCountVotes = 0;
-    std::map<uint256, CTxLockVote>::iterator it = mapTxLockVotesOrphan.begin();
+    vote_map_t::iterator it = mapTxLockVotesOrphan.begin();
     while(it != mapTxLockVotesOrphan.end()) {
         if(it->second.GetTxHash() == txHash && it->second.GetOutpoint() == outpoint) {
             nCountVotes++;
@@ -477,12 +503,7 @@ void CInstantSend::TryToFinalizeLockCandidate(const CTxLockCandidate& txLockCand
 {
     if(!sporkManager.IsSporkActive(SPORK_2_INSTANTSEND_ENABLED)) return;
 
-    LOCK(cs_main);
-#ifdef ENABLE_WALLET
-    if (pwalletMain)
-        LOCK(pwalletMain->cs_wallet);
-#endif
-    LOCK(cs_instantsend);
+    LOCK2(cs_main, cs_instantsend);
 
     uint256 txHash = txLockCandidate.txLockRequest.GetHash();
     if(txLockCandidate.IsAllOutPointsReady() && !IsLockedInstantSendTransaction(txHash)) {
@@ -497,33 +518,45 @@ void CInstantSend::TryToFinalizeLockCandidate(const CTxLockCandidate& txLockCand
 
 void CInstantSend::UpdateLockedTransaction(const CTxLockCandidate& txLockCandidate)
 {
-    // cs_wallet and cs_instantsend should be already locked
-#ifdef ENABLE_WALLET
-    if (pwalletMain)
-        AssertLockHeld(pwalletMain->cs_wallet);
-#endif
     AssertLockHeld(cs_instantsend);
 
     uint256 txHash = txLockCandidate.GetHash();
 
     if(!IsLockedInstantSendTransaction(txHash)) return; // not a locked tx, do not update/notify
 
+    vecLockedTxToNotify.push_back(txLockCandidate.txLockRequest);
+
+    LogPrint("instantsend", "CInstantSend::UpdateLockedTransaction -- queued, txid=%s\n", txHash.ToString());
+}
+
+void CInstantSend::NotifyLockedTransactions()
+{
+    std::vector<CTxLockRequest> vecLockedTx;
+    {
+        LOCK(cs_instantsend);
+        vecLockedTx.swap(vecLockedTxToNotify);
+    }
+
+    for (const auto& txLockRequest : vecLockedTx) {
+        uint256 txHash = txLockRequest.GetHash();
+
 #ifdef ENABLE_WALLET
-    if(pwalletMain && pwalletMain->UpdatedTransaction(txHash)) {
-        // bumping this to update UI
-        nCompleteTXLocks++;
-        // notify an external script once threshold is reached
-        std::string strCmd = GetArg("-instantsendnotify", "");
-        if(!strCmd.empty()) {
-            boost::replace_all(strCmd, "%s", txHash.GetHex());
-            boost::thread t(runCommand, strCmd); // thread runs free
+        if(pwalletMain && pwalletMain->UpdatedTransaction(txHash)) {
+            // bumping this to update UI
+            nCompleteTXLocks++;
+            // notify an external script once threshold is reached
+            std::string strCmd = GetArg("-instantsendnotify", "");
+            if(!strCmd.empty()) {
+                boost::replace_all(strCmd, "%s", txHash.GetHex());
+                boost::thread t(runCommand, strCmd); // thread runs free
+            }
         }
-    }
 #endif
 
-    GetMainSignals().NotifyTransactionLock(txLockCandidate.txLockRequest);
+        GetMainSignals().NotifyTransactionLock(txLockRequest);
 
-    LogPrint("instantsend", "CInstantSend::UpdateLockedTransaction -- done, txid=%s\n", txHash.ToString());
+        LogPrint("instantsend", "CInstantSend::NotifyLockedTransactions -- done, txid=%s\n", txHash.ToString());
+    }
 }
 
 void CInstantSend::LockTransactionInputs(const CTxLockCandidate& txLockCandidate)
@@ -548,7 +581,7 @@ void CInstantSend::LockTransactionInputs(const CTxLockCandidate& txLockCandidate
 bool CInstantSend::GetLockedOutPointTxHash(const COutPoint& outpoint, uint256& hashRet)
 {
     LOCK(cs_instantsend);
-    std::map<COutPoint, uint256>::iterator it = mapLockedOutpoints.find(outpoint);
+    std::unordered_map<COutPoint, uint256, SaltedOutpointHasher>::iterator it = mapLockedOutpoints.find(outpoint);
     if(it == mapLockedOutpoints.end()) return false;
     hashRet = it->second;
     return true;
@@ -570,8 +603,8 @@ bool CInstantSend::ResolveConflicts(const CTxLockCandidate& txLockCandidate)
         if(GetLockedOutPointTxHash(txin.prevout, hashConflicting) && txHash != hashConflicting) {
             // completed lock which conflicts with another completed one?
             // this means that majority of MNs in the quorum for this specific tx input are malicious!
-            std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
-            std::map<uint256, CTxLockCandidate>::iterator itLockCandidateConflicting = mapTxLockCandidates.find(hashConflicting);
+            candidate_map_t::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+            candidate_map_t::iterator itLockCandidateConflicting = mapTxLockCandidates.find(hashConflicting);
             if(itLockCandidate == mapTxLockCandidates.end() || itLockCandidateConflicting == mapTxLockCandidates.end()) {
                 // safety check, should never really happen
                 LogPrintf("CInstantSend::ResolveConflicts -- ERROR: Found conflicting completed Transaction Lock, but one of txLockCandidate-s is missing, txid=%s, conflicting txid=%s\n",
@@ -635,7 +668,7 @@ int64_t CInstantSend::GetAverageMasternodeOrphanVoteTime()
     // NOTE: should never actually call this function when mapMasternodeOrphanVotes is empty
     if(mapMasternodeOrphanVotes.empty()) return 0;
 
-    std::map<COutPoint, int64_t>::iterator it = mapMasternodeOrphanVotes.begin();
+    std::unordered_map<COutPoint, int64_t, SaltedOutpointHasher>::iterator it = mapMasternodeOrphanVotes.begin();
     int64_t total = 0;
 
     while(it != mapMasternodeOrphanVotes.end()) {
@@ -652,7 +685,7 @@ void CInstantSend::CheckAndRemove()
 
     LOCK(cs_instantsend);
 
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.begin();
+    candidate_map_t::iterator itLockCandidate = mapTxLockCandidates.begin();
 
     // remove expired candidates
     while(itLockCandidate != mapTxLockCandidates.end()) {
@@ -674,20 +707,24 @@ void CInstantSend::CheckAndRemove()
         }
     }
 
-    // remove expired votes
-    std::map<uint256, CTxLockVote>::iterator itVote = mapTxLockVotes.begin();
+    // remove expired votes, invalid votes and votes for failed lock attempts in one pass
+    vote_map_t::iterator itVote = mapTxLockVotes.begin();
     while(itVote != mapTxLockVotes.end()) {
         if(itVote->second.IsExpired(nCachedBlockHeight)) {
             LogPrint("instantsend", "CInstantSend::CheckAndRemove -- Removing expired vote: txid=%s  masternode=%s\n",
                     itVote->second.GetTxHash().ToString(), itVote->second.GetMasternodeOutpoint().ToStringShort());
-            mapTxLockVotes.erase(itVote++);
+            itVote = mapTxLockVotes.erase(itVote);
+        } else if(itVote->second.IsFailed()) {
+            LogPrint("instantsend", "CInstantSend::CheckAndRemove -- Removing vote for failed lock attempt: txid=%s  masternode=%s\n",
+                    itVote->second.GetTxHash().ToString(), itVote->second.GetMasternodeOutpoint().ToStringShort());
+            itVote = mapTxLockVotes.erase(itVote);
         } else {
             ++itVote;
         }
     }
 
     // remove timed out orphan votes
-    std::map<uint256, CTxLockVote>::iterator itOrphanVote = mapTxLockVotesOrphan.begin();
+    vote_map_t::iterator itOrphanVote = mapTxLockVotesOrphan.begin();
     while(itOrphanVote != mapTxLockVotesOrphan.end()) {
         if(itOrphanVote->second.IsTimedOut()) {
             LogPrint("instantsend", "CInstantSend::CheckAndRemove -- Removing timed out orphan vote: txid=%s  masternode=%s\n",
@@ -699,20 +736,8 @@ void CInstantSend::CheckAndRemove()
         }
     }
 
-    // remove invalid votes and votes for failed lock attempts
-    itVote = mapTxLockVotes.begin();
-    while(itVote != mapTxLockVotes.end()) {
-        if(itVote->second.IsFailed()) {
-            LogPrint("instantsend", "CInstantSend::CheckAndRemove -- Removing vote for failed lock attempt: txid=%s  masternode=%s\n",
-                    itVote->second.GetTxHash().ToString(), itVote->second.GetMasternodeOutpoint().ToStringShort());
-            mapTxLockVotes.erase(itVote++);
-        } else {
-            ++itVote;
-        }
-    }
-
     // remove timed out masternode orphan votes (DOS protection)
-    std::map<COutPoint, int64_t>::iterator itMasternodeOrphan = mapMasternodeOrphanVotes.begin();
+    std::unordered_map<COutPoint, int64_t, SaltedOutpointHasher>::iterator itMasternodeOrphan = mapMasternodeOrphanVotes.begin();
     while(itMasternodeOrphan != mapMasternodeOrphanVotes.end()) {
         if(itMasternodeOrphan->second < GetTime()) {
             LogPrint("instantsend", "CInstantSend::CheckAndRemove -- Removing timed out orphan masternode vote: masternode=%s\n",
@@ -755,18 +780,34 @@ bool CInstantSend::GetTxLockRequest(const uint256& txHash, CTxLockRequest& txLoc
 {
     LOCK(cs_instantsend);
 
-    std::map<uint256, CTxLockCandidate>::iterator it = mapTxLockCandidates.find(txHash);
+    candidate_map_t::iterator it = mapTxLockCandidates.find(txHash);
     if(it == mapTxLockCandidates.end()) return false;
     txLockRequestRet = it->second.txLockRequest;
 
     return true;
 }
 
+void CInstantSend::GetTxLockRequests(std::vector<CTransaction>& vecTxRet)
+{
+    LOCK(cs_instantsend);
+
+    vecTxRet.clear();
+    vecTxRet.reserve(mapLockRequestAccepted.size() + mapLockRequestRejected.size());
+
+    lockrequest_map_t::iterator it = mapLockRequestAccepted.begin();
+    for(; it != mapLockRequestAccepted.end(); ++it) {
+        vecTxRet.push_back(it->second);
+    }
+    for(it = mapLockRequestRejected.begin(); it != mapLockRequestRejected.end(); ++it) {
+        vecTxRet.push_back(it->second);
+    }
+}
+
 bool CInstantSend::GetTxLockVote(const uint256& hash, CTxLockVote& txLockVoteRet)
 {
     LOCK(cs_instantsend);
 
-    std::map<uint256, CTxLockVote>::iterator it = mapTxLockVotes.find(hash);
+    vote_map_t::iterator it = mapTxLockVotes.find(hash);
     if(it == mapTxLockVotes.end()) return false;
     txLockVoteRet = it->second;
 
@@ -781,7 +822,7 @@ bool CInstantSend::IsInstantSendReadyToLock(const uint256& txHash)
     LOCK(cs_instantsend);
     // There must be a successfully verified lock request
     // and all outputs must be locked (i.e. have enough signatures)
-    std::map<uint256, CTxLockCandidate>::iterator it = mapTxLockCandidates.find(txHash);
+    candidate_map_t::iterator it = mapTxLockCandidates.find(txHash);
     return it != mapTxLockCandidates.end() && it->second.IsAllOutPointsReady();
 }
 
@@ -793,7 +834,7 @@ bool CInstantSend::IsLockedInstantSendTransaction(const uint256& txHash)
     LOCK(cs_instantsend);
 
     // there must be a lock candidate
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    candidate_map_t::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
     if(itLockCandidate == mapTxLockCandidates.end()) return false;
 
     // which should have outpoints
@@ -818,7 +859,7 @@ int CInstantSend::GetTransactionLockSignatures(const uint256& txHash)
 
     LOCK(cs_instantsend);
 
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    candidate_map_t::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
     if(itLockCandidate != mapTxLockCandidates.end()) {
         return itLockCandidate->second.CountVotes();
     }
@@ -837,7 +878,7 @@ bool CInstantSend::IsTxLockCandidateTimedOut(const uint256& txHash)
 
     LOCK(cs_instantsend);
 
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    candidate_map_t::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
     if (itLockCandidate != mapTxLockCandidates.end()) {
         return !itLockCandidate->second.IsAllOutPointsReady() &&
                 itLockCandidate->second.IsTimedOut();
@@ -850,7 +891,7 @@ void CInstantSend::Relay(const uint256& txHash, CConnman& connman)
 {
     LOCK(cs_instantsend);
 
-    std::map<uint256, CTxLockCandidate>::const_iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    candidate_map_t::const_iterator itLockCandidate = mapTxLockCandidates.find(txHash);
     if (itLockCandidate != mapTxLockCandidates.end()) {
         itLockCandidate->second.Relay(connman);
     }
@@ -889,7 +930,7 @@ void CInstantSend::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
     LogPrint("instantsend", "CInstantSend::SyncTransaction -- txid=%s nHeightNew=%d\n", txHash.ToString(), nHeightNew);
 
     // Check lock candidates
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    candidate_map_t::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
     if(itLockCandidate != mapTxLockCandidates.end()) {
         LogPrint("instantsend", "CInstantSend::SyncTransaction -- txid=%s nHeightNew=%d lock candidate updated\n",
                 txHash.ToString(), nHeightNew);
@@ -898,9 +939,9 @@ void CInstantSend::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
         std::map<COutPoint, COutPointLock>::iterator itOutpointLock = itLockCandidate->second.mapOutPointLocks.begin();
         while(itOutpointLock != itLockCandidate->second.mapOutPointLocks.end()) {
             // Check corresponding lock votes
-            std::vector<CTxLockVote> vVotes = itOutpointLock->second.GetVotes();
-            std::vector<CTxLockVote>::iterator itVote = vVotes.begin();
-            std::map<uint256, CTxLockVote>::iterator it;
+            const std::vector<CTxLockVote>& vVotes = itOutpointLock->second.GetVotes();
+            std::vector<CTxLockVote>::const_iterator itVote = vVotes.begin();
+            vote_map_t::iterator it;
             while(itVote != vVotes.end()) {
                 uint256 nVoteHash = itVote->GetHash();
                 LogPrint("instantsend", "CInstantSend::SyncTransaction -- txid=%s nHeightNew=%d vote %s updated\n",
@@ -916,7 +957,7 @@ void CInstantSend::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
     }
 
     // check orphan votes
-    std::map<uint256, CTxLockVote>::iterator itOrphanVote = mapTxLockVotesOrphan.begin();
+    vote_map_t::iterator itOrphanVote = mapTxLockVotesOrphan.begin();
     while(itOrphanVote != mapTxLockVotesOrphan.end()) {
         if(itOrphanVote->second.GetTxHash() == txHash) {
             LogPrint("instantsend", "CInstantSend::SyncTransaction -- txid=%s nHeightNew=%d vote %s updated\n",
@@ -927,6 +968,35 @@ void CInstantSend::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
     }
 }
 
+size_t CInstantSend::GetMemoryUsage()
+{
+    LOCK(cs_instantsend);
+
+    size_t nUsage = memusage::DynamicUsage(mapLockRequestAccepted) + memusage::DynamicUsage(mapLockRequestRejected) +
+                    memusage::DynamicUsage(mapTxLockVotes) + memusage::DynamicUsage(mapTxLockVotesOrphan) +
+                    memusage::DynamicUsage(mapTxLockCandidates) + memusage::DynamicUsage(mapVotedOutpoints) +
+                    memusage::DynamicUsage(mapLockedOutpoints) + memusage::DynamicUsage(mapMasternodeOrphanVotes);
+    for (const auto& requestPair : mapLockRequestAccepted) {
+        nUsage += RecursiveDynamicUsage(requestPair.second);
+    }
+    for (const auto& requestPair : mapLockRequestRejected) {
+        nUsage += RecursiveDynamicUsage(requestPair.second);
+    }
+    for (const auto& votePair : mapTxLockVotes) {
+        nUsage += votePair.second.DynamicMemoryUsage();
+    }
+    for (const auto& votePair : mapTxLockVotesOrphan) {
+        nUsage += votePair.second.DynamicMemoryUsage();
+    }
+    for (const auto& candidatePair : mapTxLockCandidates) {
+        nUsage += candidatePair.second.DynamicMemoryUsage();
+    }
+    for (const auto& votedPair : mapVotedOutpoints) {
+        nUsage += memusage::DynamicUsage(votedPair.second);
+    }
+    return nUsage;
+}
+
 std::string CInstantSend::ToString()
 {
     LOCK(cs_instantsend);
@@ -1119,34 +1189,34 @@ bool CTxLockVote::IsFailed() const
 
 bool COutPointLock::AddVote(const CTxLockVote& vote)
 {
-    if(mapMasternodeVotes.count(vote.GetMasternodeOutpoint()))
+    if(HasMasternodeVoted(vote.GetMasternodeOutpoint()))
         return false;
-    mapMasternodeVotes.insert(std::make_pair(vote.GetMasternodeOutpoint(), vote));
+    vecMasternodeVotes.push_back(vote);
     return true;
 }
 
-std::vector<CTxLockVote> COutPointLock::GetVotes() const
+bool COutPointLock::HasMasternodeVoted(const COutPoint& outpointMasternodeIn) const
 {
-    std::vector<CTxLockVote> vRet;
-    std::map<COutPoint, CTxLockVote>::const_iterator itVote = mapMasternodeVotes.begin();
-    while(itVote != mapMasternodeVotes.end()) {
-        vRet.push_back(itVote->second);
-        ++itVote;
+    for (const auto& vote : vecMasternodeVotes) {
+        if(vote.GetMasternodeOutpoint() == outpointMasternodeIn)
+            return true;
     }
-    return vRet;
+    return false;
 }
 
-bool COutPointLock::HasMasternodeVoted(const COutPoint& outpointMasternodeIn) const
+size_t COutPointLock::DynamicMemoryUsage() const
 {
-    return mapMasternodeVotes.count(outpointMasternodeIn);
+    size_t nUsage = memusage::DynamicUsage(vecMasternodeVotes);
+    for (const auto& vote : vecMasternodeVotes) {
+        nUsage += vote.DynamicMemoryUsage();
+    }
+    return nUsage;
 }
 
 void COutPointLock::Relay(CConnman& connman) const
 {
-    std::map<COutPoint, CTxLockVote>::const_iterator itVote = mapMasternodeVotes.begin();
-    while(itVote != mapMasternodeVotes.end()) {
-        itVote->second.Relay(connman);
-        ++itVote;
+    for (const auto& vote : vecMasternodeVotes) {
+        vote.Relay(connman);
     }
 }
 
@@ -1214,6 +1284,15 @@ bool CTxLockCandidate::IsTimedOut() const
     return GetTime() - nTimeCreated > INSTANTSEND_LOCK_TIMEOUT_SECONDS;
 }
 
+size_t CTxLockCandidate::DynamicMemoryUsage() const
+{
+    size_t nUsage = RecursiveDynamicUsage(txLockRequest) + memusage::DynamicUsage(mapOutPointLocks);
+    for (const auto& outpointLockPair : mapOutPointLocks) {
+        nUsage += outpointLockPair.second.DynamicMemoryUsage();
+    }
+    return nUsage;
+}
+
 void CTxLockCandidate::Relay(CConnman& connman) const
 {
     connman.RelayTransaction(txLockRequest);
@@ -6,8 +6,12 @@
 #define INSTANTX_H
 
 #include "chain.h"
+#include "coins.h"
 #include "net.h"
 #include "primitives/transaction.h"
+#include "txmempool.h"
+
+#include <unordered_map>
 
 class CTxLockVote;
 class COutPointLock;
@@ -48,26 +52,38 @@ private:
     // Keep track of current block height
     int nCachedBlockHeight;
 
+    // Hash tables keyed by salted txid/outpoint hashes, every vote and every lock
+    // request is looked up here, ordering is never needed
+    typedef std::unordered_map<uint256, CTxLockRequest, SaltedTxidHasher> lockrequest_map_t;
+    typedef std::unordered_map<uint256, CTxLockVote, SaltedTxidHasher> vote_map_t;
+    typedef std::unordered_map<uint256, CTxLockCandidate, SaltedTxidHasher> candidate_map_t;
+
     // maps for AlreadyHave
-    std::map<uint256, CTxLockRequest> mapLockRequestAccepted; // tx hash - tx
-    std::map<uint256, CTxLockRequest> mapLockRequestRejected; // tx hash - tx
-    std::map<uint256, CTxLockVote> mapTxLockVotes; // vote hash - vote
-    std::map<uint256, CTxLockVote> mapTxLockVotesOrphan; // vote hash - vote
+    lockrequest_map_t mapLockRequestAccepted; // tx hash - tx
+    lockrequest_map_t mapLockRequestRejected; // tx hash - tx
+    vote_map_t mapTxLockVotes; // vote hash - vote
+    vote_map_t mapTxLockVotesOrphan; // vote hash - vote
 
-    std::map<uint256, CTxLockCandidate> mapTxLockCandidates; // tx hash - lock candidate
+    candidate_map_t mapTxLockCandidates; // tx hash - lock candidate
 
-    std::map<COutPoint, std::set<uint256> > mapVotedOutpoints; // utxo - tx hash set
-    std::map<COutPoint, uint256> mapLockedOutpoints; // utxo - tx hash
+    std::unordered_map<COutPoint, std::set<uint256>, SaltedOutpointHasher> mapVotedOutpoints; // utxo - tx hash set
+    std::unordered_map<COutPoint, uint256, SaltedOutpointHasher> mapLockedOutpoints; // utxo - tx hash
 
     //track masternodes who voted with no txreq (for DOS protection)
-    std::map<COutPoint, int64_t> mapMasternodeOrphanVotes; // mn outpoint - time
+    std::unordered_map<COutPoint, int64_t, SaltedOutpointHasher> mapMasternodeOrphanVotes; // mn outpoint - time
 
+    // completed locks the wallet and listeners were not notified about yet,
+    // NotifyLockedTransactions() does it after cs_main and cs_instantsend are released
+    std::vector<CTxLockRequest> vecLockedTxToNotify;
+
+    bool ProcessTxLockRequestInternal(const CTxLockRequest& txLockRequest, CConnman& connman);
     bool CreateTxLockCandidate(const CTxLockRequest& txLockRequest);
     void CreateEmptyTxLockCandidate(const uint256& txHash);
     void Vote(CTxLockCandidate& txLockCandidate, CConnman& connman);
 
     //process consensus vote message
     bool ProcessTxLockVote(CNode* pfrom, CTxLockVote& vote, CConnman& connman);
+    bool ProcessValidTxLockVote(CNode* pfrom, CTxLockVote& vote, CConnman& connman);
     void ProcessOrphanTxLockVotes(CConnman& connman);
     bool IsEnoughOrphanVotesForTx(const CTxLockRequest& txLockRequest);
     bool IsEnoughOrphanVotesForTxAndOutPoint(const uint256& txHash, const COutPoint& outpoint);
@@ -75,7 +91,7 @@ private:
 
     void TryToFinalizeLockCandidate(const CTxLockCandidate& txLockCandidate);
     void LockTransactionInputs(const CTxLockCandidate& txLockCandidate);
-    //update UI and notify external script if any
+    //queue UI update and external script notification
     void UpdateLockedTransaction(const CTxLockCandidate& txLockCandidate);
     bool ResolveConflicts(const CTxLockCandidate& txLockCandidate);
 
@@ -88,6 +104,8 @@ public:
 
     bool ProcessTxLockRequest(const CTxLockRequest& txLockRequest, CConnman& connman);
     void Vote(const uint256& txHash, CConnman& connman);
+    //update UI and notify external script about the completed locks, cs_main must not be held
+    void NotifyLockedTransactions();
 
     bool AlreadyHave(const uint256& hash);
 
@@ -95,6 +113,8 @@ public:
     void RejectLockRequest(const CTxLockRequest& txLockRequest);
     bool HasTxLockRequest(const uint256& txHash);
     bool GetTxLockRequest(const uint256& txHash, CTxLockRequest& txLockRequestRet);
+    /// All accepted and rejected lock requests, used to reconstruct compact blocks
+    void GetTxLockRequests(std::vector<CTransaction>& vecTxRet);
 
     bool GetTxLockVote(const uint256& hash, CTxLockVote& txLockVoteRet);
 
@@ -117,6 +137,9 @@ public:
     void UpdatedBlockTip(const CBlockIndex *pindex);
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
 
+    /// Memory used by lock requests, candidates and votes
+    size_t GetMemoryUsage();
+
     std::string ToString();
 };
 
@@ -193,6 +216,8 @@ public:
     bool IsTimedOut() const;
     bool IsFailed() const;
 
+    size_t DynamicMemoryUsage() const { return memusage::DynamicUsage(vchMasternodeSignature); }
+
     bool Sign();
     bool CheckSignature() const;
 
@@ -203,7 +228,8 @@ class COutPointLock
 {
 private:
     COutPoint outpoint; // utxo
-    std::map<COutPoint, CTxLockVote> mapMasternodeVotes; // masternode outpoint - vote
+    // at most SIGNATURES_TOTAL votes, one per masternode, a linear search beats a map here
+    std::vector<CTxLockVote> vecMasternodeVotes;
     bool fAttacked = false;
 
 public:
@@ -212,18 +238,20 @@ public:
 
     COutPointLock(const COutPoint& outpointIn) :
         outpoint(outpointIn),
-        mapMasternodeVotes()
+        vecMasternodeVotes()
         {}
 
     COutPoint GetOutpoint() const { return outpoint; }
 
     bool AddVote(const CTxLockVote& vote);
-    std::vector<CTxLockVote> GetVotes() const;
+    const std::vector<CTxLockVote>& GetVotes() const { return vecMasternodeVotes; }
     bool HasMasternodeVoted(const COutPoint& outpointMasternodeIn) const;
-    int CountVotes() const { return fAttacked ? 0 : mapMasternodeVotes.size(); }
+    int CountVotes() const { return fAttacked ? 0 : vecMasternodeVotes.size(); }
     bool IsReady() const { return !fAttacked && CountVotes() >= SIGNATURES_REQUIRED; }
     void MarkAsAttacked() { fAttacked = true; }
 
+    size_t DynamicMemoryUsage() const;
+
     void Relay(CConnman& connman) const;
 };
 
@@ -258,6 +286,8 @@ public:
     bool IsExpired(int nHeight) const;
     bool IsTimedOut() const;
 
+    size_t DynamicMemoryUsage() const;
+
     void Relay(CConnman& connman) const;
 };
 
@@ -4,12 +4,15 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "activemasternode.h"
+#include "cache-database.h"
+#include "crypto/common.h"
 #include "governance-classes.h"
 #include "masternode-payments.h"
 #include "masternode-sync.h"
 #include "masternodeman.h"
 #include "messagesigner.h"
 #include "netfulfilledman.h"
+#include "random.h"
 #include "spork.h"
 #include "util.h"
 
@@ -18,10 +21,19 @@
 /** Object for who's going to get paid on which blocks */
 CMasternodePayments mnpayments;
 
+/** Object for who got paid in which recent blocks */
+CMasternodePayeeIndex mnpayeeindex;
+
+const std::string CMasternodePayeeIndex::SERIALIZATION_VERSION_STRING = "CMasternodePayeeIndex-Version-1";
+
 CCriticalSection cs_vecPayees;
 CCriticalSection cs_mapMasternodeBlocks;
 CCriticalSection cs_mapMasternodePaymentVotes;
 
+// cache database sections
+static const char DB_PAYMENT_VOTES = 'v';
+static const char DB_PAYMENT_BLOCKS = 'b';
+
 /**
 * IsBlockValueValid
 *
@@ -243,6 +255,24 @@ void CMasternodePayments::Clear()
     mapMasternodePaymentVotes.clear();
 }
 
+void CMasternodePayments::WriteCheckpoint(CCacheDBCheckpoint& checkpoint)
+{
+    LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePaymentVotes);
+    checkpoint.WriteMap(DB_PAYMENT_VOTES, mapMasternodePaymentVotes);
+    checkpoint.WriteMap(DB_PAYMENT_BLOCKS, mapMasternodeBlocks);
+}
+
+bool CMasternodePayments::ReadCheckpoint(CCacheDB& cachedb)
+{
+    LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePaymentVotes);
+    if(!cachedb.ReadMap(DB_PAYMENT_VOTES, mapMasternodePaymentVotes) ||
+       !cachedb.ReadMap(DB_PAYMENT_BLOCKS, mapMasternodeBlocks)) {
+        Clear();
+        return false;
+    }
+    return true;
+}
+
 bool CMasternodePayments::CanVote(COutPoint outMasternode, int nBlockHeight)
 {
     LOCK(cs_mapMasternodePaymentVotes);
@@ -1021,8 +1051,183 @@ void CMasternodePayments::UpdatedBlockTip(const CBlockIndex *pindex, CConnman& c
     nCachedBlockHeight = pindex->nHeight;
     LogPrint("mnpayments", "CMasternodePayments::UpdatedBlockTip -- nCachedBlockHeight=%d\n", nCachedBlockHeight);
 
+    mnpayeeindex.SetMaxDepth(GetStorageLimit());
+
     int nFutureBlock = nCachedBlockHeight + 10;
 
     CheckPreviousBlockVotes(nFutureBlock - 1);
     ProcessBlock(nFutureBlock, connman);
 }
+
+SaltedScriptIDHasher::SaltedScriptIDHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+size_t SaltedScriptIDHasher::operator()(const CScriptID& id) const
+{
+    const unsigned char* p = id.begin();
+    return CSipHasher(k0, k1).Write(ReadLE64(p)).Write(ReadLE64(p + 8)).Write(ReadLE32(p + 16)).Finalize();
+}
+
+void CMasternodePayeeIndex::Clear()
+{
+    LOCK(cs);
+    hashBestBlock.SetNull();
+    mapBlockPayees.clear();
+    mapPayeePayments.clear();
+}
+
+void CMasternodePayeeIndex::AddBlockPayments(int nHeight, int64_t nTime, const std::vector<CScriptID>& vecPayees)
+{
+    // keep payments in ascending height order, whatever was indexed at this height or above is stale
+    EraseBlocksFrom(nHeight);
+
+    if(vecPayees.empty()) return;
+
+    mapBlockPayees[nHeight] = std::make_pair(nTime, vecPayees);
+    for (const auto& payee : vecPayees) {
+        mapPayeePayments[payee].push_back(payment_t(nHeight, nTime));
+    }
+}
+
+void CMasternodePayeeIndex::EraseBlocksFrom(int nHeight)
+{
+    auto it = mapBlockPayees.lower_bound(nHeight);
+    for (auto itBlock = it; itBlock != mapBlockPayees.end(); ++itBlock) {
+        for (const auto& payee : itBlock->second.second) {
+            auto itPayee = mapPayeePayments.find(payee);
+            if(itPayee == mapPayeePayments.end()) continue;
+            std::vector<payment_t>& vecPayments = itPayee->second;
+            while(!vecPayments.empty() && vecPayments.back().first >= nHeight) {
+                vecPayments.pop_back();
+            }
+            if(vecPayments.empty()) mapPayeePayments.erase(itPayee);
+        }
+    }
+    mapBlockPayees.erase(it, mapBlockPayees.end());
+}
+
+void CMasternodePayeeIndex::EraseBlocksBelow(int nHeight)
+{
+    auto it = mapBlockPayees.begin();
+    while(it != mapBlockPayees.end() && it->first < nHeight) {
+        for (const auto& payee : it->second.second) {
+            auto itPayee = mapPayeePayments.find(payee);
+            if(itPayee == mapPayeePayments.end()) continue;
+            std::vector<payment_t>& vecPayments = itPayee->second;
+            auto itFirstKept = vecPayments.begin();
+            while(itFirstKept != vecPayments.end() && itFirstKept->first < nHeight) {
+                ++itFirstKept;
+            }
+            vecPayments.erase(vecPayments.begin(), itFirstKept);
+            if(vecPayments.empty()) mapPayeePayments.erase(itPayee);
+        }
+        mapBlockPayees.erase(it++);
+    }
+}
+
+void CMasternodePayeeIndex::CheckAndRemove()
+{
+    LOCK(cs);
+    if(mapBlockPayees.empty()) return;
+    EraseBlocksBelow(mapBlockPayees.rbegin()->first - nMaxDepth + 1);
+}
+
+bool CMasternodePayeeIndex::Rebuild(const CBlockIndex* pindexTip, const Consensus::Params& consensusParams)
+{
+    AssertLockHeld(cs_main);
+
+    LOCK(cs);
+
+    Clear();
+    if(!pindexTip) return true;
+
+    int64_t nStart = GetTimeMillis();
+
+    std::vector<const CBlockIndex*> vecToIndex;
+    for (const CBlockIndex* pindex = pindexTip; pindex && (int)vecToIndex.size() < nMaxDepth; pindex = pindex->pprev) {
+        // blocks below a pruned one can't be read either
+        if(!(pindex->nStatus & BLOCK_HAVE_DATA)) break;
+        vecToIndex.push_back(pindex);
+    }
+
+    for (auto it = vecToIndex.rbegin(); it != vecToIndex.rend(); ++it) {
+        CBlock block;
+        if(!ReadBlockFromDisk(block, *it, consensusParams)) {
+            Clear();
+            return error("CMasternodePayeeIndex::Rebuild -- failed to read block %s", (*it)->GetBlockHash().ToString());
+        }
+        BlockConnected(block, *it);
+    }
+    hashBestBlock = pindexTip->GetBlockHash();
+
+    LogPrintf("CMasternodePayeeIndex::Rebuild -- indexed %d blocks  %dms\n", vecToIndex.size(), GetTimeMillis() - nStart);
+    LogPrintf("CMasternodePayeeIndex::Rebuild -- %s\n", ToString());
+    return true;
+}
+
+void CMasternodePayeeIndex::BlockConnected(const CBlock& block, const CBlockIndex* pindex)
+{
+    if(fLiteMode) return; // disable all Square specific functionality
+    if(block.vtx.empty()) return;
+
+    const CTransaction& txCoinbase = block.vtx[0];
+    CAmount nMasternodePayment = GetMasternodePayment(pindex->nHeight, txCoinbase.GetValueOut());
+
+    // every coinbase output of exactly the masternode payment amount is a candidate,
+    // CMasternode::UpdateLastPaid only trusts the ones the network voted for
+    std::vector<CScriptID> vecPayees;
+    for (const auto& txout : txCoinbase.vout) {
+        if(txout.nValue != nMasternodePayment) continue;
+        CScriptID payee(txout.scriptPubKey);
+        if(std::find(vecPayees.begin(), vecPayees.end(), payee) == vecPayees.end()) {
+            vecPayees.push_back(payee);
+        }
+    }
+
+    LOCK(cs);
+    AddBlockPayments(pindex->nHeight, pindex->nTime, vecPayees);
+    EraseBlocksBelow(pindex->nHeight - nMaxDepth + 1);
+    hashBestBlock = pindex->GetBlockHash();
+}
+
+void CMasternodePayeeIndex::BlockDisconnected(const CBlockIndex* pindex)
+{
+    if(fLiteMode) return; // disable all Square specific functionality
+    LOCK(cs);
+    EraseBlocksFrom(pindex->nHeight);
+    hashBestBlock = pindex->pprev ? pindex->pprev->GetBlockHash() : uint256();
+}
+
+void CMasternodePayeeIndex::GetPayments(const CScript& payee, int nHeightMin, int nHeightMax, std::vector<payment_t>& vecPaymentsRet) const
+{
+    vecPaymentsRet.clear();
+
+    LOCK(cs);
+
+    auto it = mapPayeePayments.find(CScriptID(payee));
+    if(it == mapPayeePayments.end()) return;
+
+    for (const auto& payment : it->second) {
+        if(payment.first < nHeightMin) continue;
+        if(payment.first > nHeightMax) break;
+        vecPaymentsRet.push_back(payment);
+    }
+}
+
+void CMasternodePayeeIndex::SetMaxDepth(int nMaxDepthIn)
+{
+    LOCK(cs);
+    // never index less than what payment votes are kept for
+    nMaxDepth = std::max(nMaxDepthIn, MNPAYMENTS_MIN_BLOCKS_TO_STORE);
+}
+
+std::string CMasternodePayeeIndex::ToString() const
+{
+    LOCK(cs);
+
+    std::ostringstream info;
+
+    info << "Blocks: " << (int)mapBlockPayees.size() <<
+            ", Payees: " << (int)mapPayeePayments.size();
+
+    return info.str();
+}
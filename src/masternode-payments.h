@@ -11,14 +11,21 @@
 #include "key.h"
 #include "masternode.h"
 #include "net_processing.h"
+#include "script/standard.h"
 #include "utilstrencodings.h"
 
+#include <unordered_map>
+
+class CCacheDB;
+class CCacheDBCheckpoint;
+class CMasternodePayeeIndex;
 class CMasternodePayments;
 class CMasternodePaymentVote;
 class CMasternodeBlockPayees;
 
 static const int MNPAYMENTS_SIGNATURES_REQUIRED         = 6;
 static const int MNPAYMENTS_SIGNATURES_TOTAL            = 10;
+static const int MNPAYMENTS_MIN_BLOCKS_TO_STORE         = 5000;
 
 //! minimum peer version that can receive and send masternode payment messages,
 //  vote for masternode and be elected as a payment winner
@@ -32,6 +39,7 @@ extern CCriticalSection cs_mapMasternodeBlocks;
 extern CCriticalSection cs_mapMasternodePayeeVotes;
 
 extern CMasternodePayments mnpayments;
+extern CMasternodePayeeIndex mnpayeeindex;
 
 /// TODO: all 4 functions do not belong here really, they should be refactored/moved somewhere (main.cpp ?)
 bool IsBlockValueValid(const CBlock& block, int nBlockHeight, CAmount blockReward, std::string &strErrorRet);
@@ -182,7 +190,7 @@ public:
     std::map<COutPoint, int> mapMasternodesLastVote;
     std::map<COutPoint, int> mapMasternodesDidNotVote;
 
-    CMasternodePayments() : nStorageCoeff(1.25), nMinBlocksToStore(5000) {}
+    CMasternodePayments() : nStorageCoeff(1.25), nMinBlocksToStore(MNPAYMENTS_MIN_BLOCKS_TO_STORE) {}
 
     ADD_SERIALIZE_METHODS;
 
@@ -194,6 +202,11 @@ public:
 
     void Clear();
 
+    /// Store votes and block payees in the cache database, one record each
+    void WriteCheckpoint(CCacheDBCheckpoint& checkpoint);
+    /// Load votes and block payees from the cache database, false if they couldn't be read
+    bool ReadCheckpoint(CCacheDB& cachedb);
+
     bool AddPaymentVote(const CMasternodePaymentVote& vote);
     bool HasVerifiedPaymentVote(uint256 hashIn);
     bool ProcessBlock(int nBlockHeight, CConnman& connman);
@@ -224,4 +237,106 @@ public:
     void UpdatedBlockTip(const CBlockIndex *pindex, CConnman& connman);
 };
 
+class SaltedScriptIDHasher
+{
+private:
+    /** Salt */
+    const uint64_t k0, k1;
+
+public:
+    SaltedScriptIDHasher();
+
+    size_t operator()(const CScriptID& id) const;
+};
+
+//
+// Masternode Payee Index
+// Remembers which payees received the masternode payment in the recent blocks
+// of the active chain, so that last paid blocks of masternodes can be found
+// without reading these blocks back from disk
+//
+
+class CMasternodePayeeIndex
+{
+public:
+    // height and time of a block which paid the masternode payment to a payee
+    typedef std::pair<int, int64_t> payment_t;
+
+private:
+    static const std::string SERIALIZATION_VERSION_STRING;
+
+    mutable CCriticalSection cs;
+
+    // only blocks which are at most that deep in the active chain are indexed
+    int nMaxDepth;
+
+    // block this index is in sync with, null if it wasn't built yet
+    uint256 hashBestBlock;
+
+    // payees paid in every indexed block, keyed by height, see BlockConnected
+    std::map<int, std::pair<int64_t, std::vector<CScriptID> > > mapBlockPayees;
+
+    // all indexed payments of every payee, in ascending height order
+    std::unordered_map<CScriptID, std::vector<payment_t>, SaltedScriptIDHasher> mapPayeePayments;
+
+    void AddBlockPayments(int nHeight, int64_t nTime, const std::vector<CScriptID>& vecPayees);
+    void EraseBlocksFrom(int nHeight);
+    void EraseBlocksBelow(int nHeight);
+
+public:
+    CMasternodePayeeIndex() : nMaxDepth(MNPAYMENTS_MIN_BLOCKS_TO_STORE) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        LOCK(cs);
+        std::string strVersion;
+        if(ser_action.ForRead()) {
+            Clear();
+            READWRITE(strVersion);
+        }
+        else {
+            strVersion = SERIALIZATION_VERSION_STRING;
+            READWRITE(strVersion);
+        }
+
+        READWRITE(mapBlockPayees);
+        // written last, so that a truncated file leaves the index unsynced
+        READWRITE(hashBestBlock);
+
+        if(ser_action.ForRead()) {
+            if(strVersion != SERIALIZATION_VERSION_STRING) {
+                Clear();
+                return;
+            }
+            for (const auto& blockpair : mapBlockPayees) {
+                for (const auto& payee : blockpair.second.second) {
+                    mapPayeePayments[payee].push_back(payment_t(blockpair.first, blockpair.second.first));
+                }
+            }
+        }
+    }
+
+    void Clear();
+    // called by CFlatDB::Load, drops the blocks of a saved index which are deeper than nMaxDepth
+    void CheckAndRemove();
+
+    // (re)build the index from the last nMaxDepth blocks on disk, cs_main must be held
+    bool Rebuild(const CBlockIndex* pindexTip, const Consensus::Params& consensusParams);
+
+    void BlockConnected(const CBlock& block, const CBlockIndex* pindex);
+    void BlockDisconnected(const CBlockIndex* pindex);
+
+    // payments to payee in blocks nHeightMin..nHeightMax, in ascending height order
+    void GetPayments(const CScript& payee, int nHeightMin, int nHeightMax, std::vector<payment_t>& vecPaymentsRet) const;
+
+    void SetMaxDepth(int nMaxDepthIn);
+    uint256 GetBestBlock() const { LOCK(cs); return hashBestBlock; }
+    int GetBlockCount() const { LOCK(cs); return mapBlockPayees.size(); }
+    int GetPayeeCount() const { LOCK(cs); return mapPayeePayments.size(); }
+
+    std::string ToString() const;
+};
+
 #endif
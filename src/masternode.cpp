@@ -310,34 +310,24 @@ void CMasternode::UpdateLastPaid(const CBlockIndex *pindex, int nMaxBlocksToScan
 {
     if(!pindex) return;
 
-    const CBlockIndex *BlockReading = pindex;
-
     CScript mnpayee = GetScriptForDestination(pubKeyCollateralAddress.GetID());
     // LogPrint("masternode", "CMasternode::UpdateLastPaidBlock -- searching for block with payment to %s\n", vin.prevout.ToStringShort());
 
+    std::vector<CMasternodePayeeIndex::payment_t> vecPayments;
+    mnpayeeindex.GetPayments(mnpayee, std::max(nBlockLastPaid + 1, pindex->nHeight - nMaxBlocksToScanBack + 1), pindex->nHeight, vecPayments);
+
     LOCK(cs_mapMasternodeBlocks);
 
-    for (int i = 0; BlockReading && BlockReading->nHeight > nBlockLastPaid && i < nMaxBlocksToScanBack; i++) {
-        if(mnpayments.mapMasternodeBlocks.count(BlockReading->nHeight) &&
-            mnpayments.mapMasternodeBlocks[BlockReading->nHeight].HasPayeeWithVotes(mnpayee, 2))
+    for (auto it = vecPayments.rbegin(); it != vecPayments.rend(); ++it) {
+        int nHeight = it->first;
+        if(mnpayments.mapMasternodeBlocks.count(nHeight) &&
+            mnpayments.mapMasternodeBlocks[nHeight].HasPayeeWithVotes(mnpayee, 2))
         {
-            CBlock block;
-            if(!ReadBlockFromDisk(block, BlockReading, Params().GetConsensus())) // shouldn't really happen
-                continue;
-
-            CAmount nMasternodePayment = GetMasternodePayment(BlockReading->nHeight, block.vtx[0].GetValueOut());
-
-            BOOST_FOREACH(CTxOut txout, block.vtx[0].vout)
-                if(mnpayee == txout.scriptPubKey && nMasternodePayment == txout.nValue) {
-                    nBlockLastPaid = BlockReading->nHeight;
-                    nTimeLastPaid = BlockReading->nTime;
-                    LogPrint("masternode", "CMasternode::UpdateLastPaidBlock -- searching for block with payment to %s -- found new %d\n", vin.prevout.ToStringShort(), nBlockLastPaid);
-                    return;
-                }
+            nBlockLastPaid = nHeight;
+            nTimeLastPaid = it->second;
+            LogPrint("masternode", "CMasternode::UpdateLastPaidBlock -- searching for block with payment to %s -- found new %d\n", vin.prevout.ToStringShort(), nBlockLastPaid);
+            return;
         }
-
-        if (BlockReading->pprev == NULL) { assert(BlockReading); break; }
-        BlockReading = BlockReading->pprev;
     }
 
     // Last payment for this masternode wasn't found in latest mnpayments blocks
@@ -608,6 +598,13 @@ bool CMasternodeBroadcast::CheckOutpoint(int& nDos)
     return true;
 }
 
+std::string CMasternodeBroadcast::GetSignatureMessage() const
+{
+    return addr.ToString(false) + boost::lexical_cast<std::string>(sigTime) +
+            pubKeyCollateralAddress.GetID().ToString() + pubKeyMasternode.GetID().ToString() +
+            boost::lexical_cast<std::string>(nProtocolVersion);
+}
+
 bool CMasternodeBroadcast::Sign(const CKey& keyCollateralAddress)
 {
     std::string strError;
@@ -615,9 +612,7 @@ bool CMasternodeBroadcast::Sign(const CKey& keyCollateralAddress)
 
     sigTime = GetAdjustedTime();
 
-    strMessage = addr.ToString(false) + boost::lexical_cast<std::string>(sigTime) +
-                    pubKeyCollateralAddress.GetID().ToString() + pubKeyMasternode.GetID().ToString() +
-                    boost::lexical_cast<std::string>(nProtocolVersion);
+    strMessage = GetSignatureMessage();
 
     if(!CMessageSigner::SignMessage(strMessage, vchSig, keyCollateralAddress)) {
         LogPrintf("CMasternodeBroadcast::Sign -- SignMessage() failed\n");
@@ -638,9 +633,7 @@ bool CMasternodeBroadcast::CheckSignature(int& nDos)
     std::string strError = "";
     nDos = 0;
 
-    strMessage = addr.ToString(false) + boost::lexical_cast<std::string>(sigTime) +
-                    pubKeyCollateralAddress.GetID().ToString() + pubKeyMasternode.GetID().ToString() +
-                    boost::lexical_cast<std::string>(nProtocolVersion);
+    strMessage = GetSignatureMessage();
 
     LogPrint("masternode", "CMasternodeBroadcast::CheckSignature -- strMessage: %s  pubKeyCollateralAddress address: %s  sig: %s\n", strMessage, CBitcoinAddress(pubKeyCollateralAddress.GetID()).ToString(), EncodeBase64(&vchSig[0], vchSig.size()));
 
@@ -653,6 +646,11 @@ bool CMasternodeBroadcast::CheckSignature(int& nDos)
     return true;
 }
 
+void CMasternodeBroadcast::GetSignatureCheck(CHashSignatureCheck& checkRet) const
+{
+    checkRet = CHashSignatureCheck(CMessageSigner::GetMessageHash(GetSignatureMessage()), pubKeyCollateralAddress, vchSig);
+}
+
 void CMasternodeBroadcast::Relay(CConnman& connman)
 {
     // Do not relay until fully synced
@@ -675,14 +673,19 @@ CMasternodePing::CMasternodePing(const COutPoint& outpoint)
     sigTime = GetAdjustedTime();
 }
 
+std::string CMasternodePing::GetSignatureMessage() const
+{
+    // TODO: add sentinel data
+    return vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+}
+
 bool CMasternodePing::Sign(const CKey& keyMasternode, const CPubKey& pubKeyMasternode)
 {
     std::string strError;
     std::string strMasterNodeSignMessage;
 
-    // TODO: add sentinel data
     sigTime = GetAdjustedTime();
-    std::string strMessage = vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+    std::string strMessage = GetSignatureMessage();
 
     if(!CMessageSigner::SignMessage(strMessage, vchSig, keyMasternode)) {
         LogPrintf("CMasternodePing::Sign -- SignMessage() failed\n");
@@ -699,8 +702,7 @@ bool CMasternodePing::Sign(const CKey& keyMasternode, const CPubKey& pubKeyMaste
 
 bool CMasternodePing::CheckSignature(CPubKey& pubKeyMasternode, int &nDos)
 {
-    // TODO: add sentinel data
-    std::string strMessage = vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+    std::string strMessage = GetSignatureMessage();
     std::string strError = "";
     nDos = 0;
 
@@ -712,6 +714,11 @@ bool CMasternodePing::CheckSignature(CPubKey& pubKeyMasternode, int &nDos)
     return true;
 }
 
+void CMasternodePing::GetSignatureCheck(const CPubKey& pubKeyMasternode, CHashSignatureCheck& checkRet) const
+{
+    checkRet = CHashSignatureCheck(CMessageSigner::GetMessageHash(GetSignatureMessage()), pubKeyMasternode, vchSig);
+}
+
 bool CMasternodePing::SimpleCheck(int& nDos)
 {
     // don't ban by default
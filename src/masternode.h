@@ -13,6 +13,7 @@
 class CMasternode;
 class CMasternodeBroadcast;
 class CConnman;
+class CHashSignatureCheck;
 
 static const int MASTERNODE_CHECK_SECONDS               =   5;
 static const int MASTERNODE_MIN_MNB_SECONDS             =   5 * 60;
@@ -73,8 +74,12 @@ public:
 
     bool IsExpired() const { return GetAdjustedTime() - sigTime > MASTERNODE_NEW_START_REQUIRED_SECONDS; }
 
+    /// The message Sign signs, CheckSignature and GetSignatureCheck verify
+    std::string GetSignatureMessage() const;
     bool Sign(const CKey& keyMasternode, const CPubKey& pubKeyMasternode);
     bool CheckSignature(CPubKey& pubKeyMasternode, int &nDos);
+    /// Prepare the signature check for CHashSigner::VerifyHashes
+    void GetSignatureCheck(const CPubKey& pubKeyMasternode, CHashSignatureCheck& checkRet) const;
     bool SimpleCheck(int& nDos);
     bool CheckAndUpdate(CMasternode* pmn, bool fFromNewBroadcast, int& nDos, CConnman& connman);
     void Relay(CConnman& connman);
@@ -353,8 +358,12 @@ public:
     bool Update(CMasternode* pmn, int& nDos, CConnman& connman);
     bool CheckOutpoint(int& nDos);
 
+    /// The message Sign signs, CheckSignature and GetSignatureCheck verify
+    std::string GetSignatureMessage() const;
     bool Sign(const CKey& keyCollateralAddress);
     bool CheckSignature(int& nDos);
+    /// Prepare the signature check for CHashSigner::VerifyHashes
+    void GetSignatureCheck(CHashSignatureCheck& checkRet) const;
     void Relay(CConnman& connman);
 };
 
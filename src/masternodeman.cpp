@@ -5,6 +5,7 @@
 
 #include "activemasternode.h"
 #include "addrman.h"
+#include "cache-database.h"
 #include "governance.h"
 #include "masternode-payments.h"
 #include "masternode-sync.h"
@@ -20,7 +21,13 @@
 /** Masternode manager */
 CMasternodeMan mnodeman;
 
-const std::string CMasternodeMan::SERIALIZATION_VERSION_STRING = "CMasternodeMan-Version-7";
+const std::string CMasternodeMan::SERIALIZATION_VERSION_STRING = "CMasternodeMan-Version-8";
+
+// cache database sections
+static const char DB_MNMAN_STATE = 'm';
+static const char DB_MASTERNODES = 'M';
+static const char DB_SEEN_MNB = 'B';
+static const char DB_SEEN_MNP = 'P';
 
 struct CompareLastPaidBlock
 {
@@ -50,11 +57,61 @@ struct CompareByAddr
     }
 };
 
+const CMasternodeScoresCache::score_pair_vec_t& CMasternodeScoresCache::Get(const uint256& nBlockHash, std::map<COutPoint, CMasternode>& mapMasternodes)
+{
+    std::map<uint256, score_pair_vec_t>::iterator it = mapScores.find(nBlockHash);
+    if (it != mapScores.end())
+        return it->second;
+
+    if (listOrder.size() >= MAX_SIZE) {
+        mapScores.erase(listOrder.front());
+        listOrder.pop_front();
+    }
+
+    // calculate scores for all masternodes, protocol version is filtered by callers
+    score_pair_vec_t& vecScores = mapScores[nBlockHash];
+    listOrder.push_back(nBlockHash);
+    vecScores.reserve(mapMasternodes.size());
+    for (auto& mnpair : mapMasternodes) {
+        vecScores.push_back(std::make_pair(mnpair.second.CalculateScore(nBlockHash), &mnpair.second));
+    }
+
+    sort(vecScores.rbegin(), vecScores.rend(), CompareScoreMN());
+    return vecScores;
+}
+
+void CMasternodeScoresCache::Add(CMasternode* pmn)
+{
+    // scores are sorted best first, i.e. in reverse CompareScoreMN order
+    for (auto& cachepair : mapScores) {
+        score_pair_t scorePair = std::make_pair(pmn->CalculateScore(cachepair.first), pmn);
+        score_pair_vec_t::iterator itPos = std::lower_bound(cachepair.second.begin(), cachepair.second.end(), scorePair,
+            [](const score_pair_t& a, const score_pair_t& b) { return CompareScoreMN()(b, a); });
+        cachepair.second.insert(itPos, scorePair);
+    }
+}
+
+void CMasternodeScoresCache::Remove(const CMasternode* pmn)
+{
+    for (auto& cachepair : mapScores) {
+        score_pair_vec_t& vecScores = cachepair.second;
+        vecScores.erase(std::remove_if(vecScores.begin(), vecScores.end(),
+            [pmn](const score_pair_t& scorePair) { return scorePair.second == pmn; }), vecScores.end());
+    }
+}
+
+void CMasternodeScoresCache::Clear()
+{
+    mapScores.clear();
+    listOrder.clear();
+}
+
 CMasternodeMan::CMasternodeMan()
 : cs(),
   mapMasternodes(),
   mAskedUsForMasternodeList(),
   mWeAskedForMasternodeList(),
+  mWeAskedForMasternodeListDiff(),
   mWeAskedForMasternodeListEntry(),
   mWeAskedForVerification(),
   mMnbRecoveryRequests(),
@@ -63,7 +120,10 @@ CMasternodeMan::CMasternodeMan()
   fMasternodesAdded(false),
   fMasternodesRemoved(false),
   vecDirtyGovernanceObjectHashes(),
+  nListVersion(0),
   nLastWatchdogVoteTime(0),
+  mapListSnapshots(),
+  hashSyncedList(),
   mapSeenMasternodeBroadcast(),
   mapSeenMasternodePing(),
   nDsqCount(0)
@@ -77,7 +137,9 @@ bool CMasternodeMan::Add(CMasternode &mn)
 
     LogPrint("masternode", "CMasternodeMan::Add -- Adding new Masternode: addr=%s, %i now\n", mn.addr.ToString(), size() + 1);
     mapMasternodes[mn.vin.prevout] = mn;
+    scoresCache.Add(&mapMasternodes[mn.vin.prevout]);
     fMasternodesAdded = true;
+    ++nListVersion;
     return true;
 }
 
@@ -190,8 +252,10 @@ void CMasternodeMan::CheckAndRemove(CConnman& connman)
 
                 // and finally remove it from the list
                 it->second.FlagGovernanceItemsAsDirty();
+                scoresCache.Remove(&it->second);
                 mapMasternodes.erase(it++);
                 fMasternodesRemoved = true;
+                ++nListVersion;
             } else {
                 bool fAsk = (nAskForMnbRecovery > 0) &&
                             masternodeSync.IsSynced() &&
@@ -283,6 +347,16 @@ void CMasternodeMan::CheckAndRemove(CConnman& connman)
             }
         }
 
+        // forget about the diffs peers never finished sending
+        std::map<CNetAddr, CMasternodeListDiffRequest>::iterator itDiff = mWeAskedForMasternodeListDiff.begin();
+        while(itDiff != mWeAskedForMasternodeListDiff.end()){
+            if(!mWeAskedForMasternodeList.count(itDiff->first)){
+                mWeAskedForMasternodeListDiff.erase(itDiff++);
+            } else {
+                ++itDiff;
+            }
+        }
+
         // check which Masternodes we've asked for
         std::map<COutPoint, std::map<CNetAddr, int64_t> >::iterator it2 = mWeAskedForMasternodeListEntry.begin();
         while(it2 != mWeAskedForMasternodeListEntry.end()){
@@ -345,14 +419,74 @@ void CMasternodeMan::CheckAndRemove(CConnman& connman)
 void CMasternodeMan::Clear()
 {
     LOCK(cs);
+    scoresCache.Clear();
     mapMasternodes.clear();
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
+    mWeAskedForMasternodeListDiff.clear();
     mWeAskedForMasternodeListEntry.clear();
     mapSeenMasternodeBroadcast.clear();
     mapSeenMasternodePing.clear();
     nDsqCount = 0;
     nLastWatchdogVoteTime = 0;
+    mapListSnapshots.clear();
+    hashSyncedList.SetNull();
+    ++nListVersion;
+}
+
+void CMasternodeMan::WriteCheckpoint(CCacheDBCheckpoint& checkpoint)
+{
+    LOCK(cs);
+
+    CDataStream ssState(SER_DISK, CLIENT_VERSION);
+    ssState << SERIALIZATION_VERSION_STRING;
+    ssState << mAskedUsForMasternodeList << mWeAskedForMasternodeList << mWeAskedForMasternodeListEntry;
+    ssState << mMnbRecoveryRequests << mMnbRecoveryGoodReplies;
+    ssState << nLastWatchdogVoteTime << nDsqCount << hashSyncedList;
+    checkpoint.Write(DB_MNMAN_STATE, std::vector<unsigned char>(ssState.begin(), ssState.end()));
+
+    checkpoint.WriteMap(DB_MASTERNODES, mapMasternodes);
+    checkpoint.WriteMap(DB_SEEN_MNB, mapSeenMasternodeBroadcast);
+    checkpoint.WriteMap(DB_SEEN_MNP, mapSeenMasternodePing);
+}
+
+bool CMasternodeMan::ReadCheckpoint(CCacheDB& cachedb)
+{
+    LOCK(cs);
+
+    Clear();
+
+    std::vector<unsigned char> vchState;
+    if(!cachedb.Read(DB_MNMAN_STATE, vchState)) {
+        // nothing stored yet
+        return true;
+    }
+
+    try {
+        CDataStream ssState(vchState, SER_DISK, CLIENT_VERSION);
+        std::string strVersion;
+        ssState >> strVersion;
+        if(strVersion != SERIALIZATION_VERSION_STRING) {
+            LogPrintf("CMasternodeMan::%s -- stored version %s is outdated, starting over\n", __func__, strVersion);
+            return true;
+        }
+        ssState >> mAskedUsForMasternodeList >> mWeAskedForMasternodeList >> mWeAskedForMasternodeListEntry;
+        ssState >> mMnbRecoveryRequests >> mMnbRecoveryGoodReplies;
+        ssState >> nLastWatchdogVoteTime >> nDsqCount >> hashSyncedList;
+    } catch (const std::exception& e) {
+        Clear();
+        return error("CMasternodeMan::%s -- failed to read state: %s", __func__, e.what());
+    }
+
+    if(!cachedb.ReadMap(DB_MASTERNODES, mapMasternodes) ||
+       !cachedb.ReadMap(DB_SEEN_MNB, mapSeenMasternodeBroadcast) ||
+       !cachedb.ReadMap(DB_SEEN_MNP, mapSeenMasternodePing)) {
+        Clear();
+        return false;
+    }
+
+    ++nListVersion;
+    return true;
 }
 
 int CMasternodeMan::CountMasternodes(int nProtocolVersion)
@@ -414,13 +548,384 @@ void CMasternodeMan::DsegUpdate(CNode* pnode, CConnman& connman)
         }
     }
 
-    connman.PushMessage(pnode, NetMsgType::DSEG, CTxIn());
+    if(pnode->nVersion >= MNLISTDIFF_VERSION) {
+        // the changes since our last complete sync are enough if we still have that list
+        uint256 hashBase = mapMasternodes.empty() ? uint256() : hashSyncedList;
+        connman.PushMessage(pnode, NetMsgType::GETMNLISTDIFF, hashBase);
+        mWeAskedForMasternodeListDiff[pnode->addr] = CMasternodeListDiffRequest(hashBase);
+    } else {
+        connman.PushMessage(pnode, NetMsgType::DSEG, CTxIn());
+    }
     int64_t askAgain = GetTime() + DSEG_UPDATE_SECONDS;
     mWeAskedForMasternodeList[pnode->addr] = askAgain;
 
     LogPrint("masternode", "CMasternodeMan::DsegUpdate -- asked %s for the list\n", pnode->addr.ToString());
 }
 
+bool CMasternodeMan::AllowListRequest(CNode* pfrom)
+{
+    AssertLockHeld(cs);
+
+    //local network
+    if(pfrom->addr.IsRFC1918() || pfrom->addr.IsLocal()) return true;
+    if(Params().NetworkIDString() != CBaseChainParams::MAIN) return true;
+
+    std::map<CNetAddr, int64_t>::iterator it = mAskedUsForMasternodeList.find(pfrom->addr);
+    if (it != mAskedUsForMasternodeList.end() && it->second > GetTime()) {
+        Misbehaving(pfrom->GetId(), 34);
+        return false;
+    }
+    int64_t askAgain = GetTime() + DSEG_UPDATE_SECONDS;
+    mAskedUsForMasternodeList[pfrom->addr] = askAgain;
+    return true;
+}
+
+uint256 CMasternodeListSnapshot::GetHash() const
+{
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << vecEntries;
+    return ss.GetHash();
+}
+
+void CMasternodeListSnapshot::GetDiff(const CMasternodeListSnapshot& snapshotNew, std::vector<COutPoint>& vecMnbRet,
+                                      std::vector<COutPoint>& vecMnpRet, std::vector<COutPoint>& vecRemovedRet) const
+{
+    vecMnbRet.clear();
+    vecMnpRet.clear();
+    vecRemovedRet.clear();
+
+    // both lists are sorted by outpoint
+    std::vector<CMasternodeListEntry>::const_iterator itOld = vecEntries.begin();
+    std::vector<CMasternodeListEntry>::const_iterator itNew = snapshotNew.vecEntries.begin();
+    while(itOld != vecEntries.end() || itNew != snapshotNew.vecEntries.end()) {
+        if(itNew == snapshotNew.vecEntries.end() || (itOld != vecEntries.end() && itOld->outpoint < itNew->outpoint)) {
+            vecRemovedRet.push_back(itOld->outpoint);
+            ++itOld;
+        } else if(itOld == vecEntries.end() || itNew->outpoint < itOld->outpoint) {
+            vecMnbRet.push_back(itNew->outpoint);
+            ++itNew;
+        } else {
+            if(itNew->hashMnb != itOld->hashMnb) {
+                vecMnbRet.push_back(itNew->outpoint);
+            } else if(itNew->hashMnp != itOld->hashMnp) {
+                vecMnpRet.push_back(itNew->outpoint);
+            }
+            ++itOld;
+            ++itNew;
+        }
+    }
+}
+
+bool CMasternodeMan::PushMasternodeInventory(CNode* pfrom, CMasternode& mn)
+{
+    AssertLockHeld(cs);
+
+    if (mn.addr.IsRFC1918() || mn.addr.IsLocal()) return false; // do not send local network masternode
+    if (mn.IsUpdateRequired()) return false; // do not send outdated masternodes
+
+    LogPrint("masternode", "DSEG -- Sending Masternode entry: masternode=%s  addr=%s\n", mn.vin.prevout.ToStringShort(), mn.addr.ToString());
+    CMasternodeBroadcast mnb = CMasternodeBroadcast(mn);
+    CMasternodePing mnp = mn.lastPing;
+    uint256 hashMNB = mnb.GetHash();
+    uint256 hashMNP = mnp.GetHash();
+    pfrom->PushInventory(CInv(MSG_MASTERNODE_ANNOUNCE, hashMNB));
+    pfrom->PushInventory(CInv(MSG_MASTERNODE_PING, hashMNP));
+
+    mapSeenMasternodeBroadcast.insert(std::make_pair(hashMNB, std::make_pair(GetTime(), mnb)));
+    mapSeenMasternodePing.insert(std::make_pair(hashMNP, mnp));
+    return true;
+}
+
+void CMasternodeMan::PushListInventory(CNode* pfrom, CConnman& connman)
+{
+    AssertLockHeld(cs);
+
+    int nInvCount = 0;
+    for (auto& mnpair : mapMasternodes) {
+        if (PushMasternodeInventory(pfrom, mnpair.second)) nInvCount++;
+    }
+
+    connman.PushMessage(pfrom, NetMsgType::SYNCSTATUSCOUNT, MASTERNODE_SYNC_LIST, nInvCount);
+    LogPrintf("DSEG -- Sent %d Masternode invs to peer %d\n", nInvCount, pfrom->id);
+}
+
+CMasternodeListSnapshot CMasternodeMan::GetListSnapshot()
+{
+    AssertLockHeld(cs);
+
+    CMasternodeListSnapshot snapshot;
+    snapshot.nTime = GetTime();
+    snapshot.vecEntries.reserve(mapMasternodes.size());
+
+    // mapMasternodes is sorted by outpoint already
+    for (auto& mnpair : mapMasternodes) {
+        // same entries DSEG sends
+        if (mnpair.second.addr.IsRFC1918() || mnpair.second.addr.IsLocal()) continue; // do not send local network masternode
+        if (mnpair.second.IsUpdateRequired()) continue; // do not send outdated masternodes
+
+        snapshot.vecEntries.push_back(CMasternodeListEntry(mnpair.first, CMasternodeBroadcast(mnpair.second).GetHash(), mnpair.second.lastPing.GetHash()));
+    }
+
+    return snapshot;
+}
+
+void CMasternodeMan::PushListDiff(CNode* pfrom, const uint256& hashBase, CConnman& connman)
+{
+    AssertLockHeld(cs);
+
+    CMasternodeListSnapshot snapshot = GetListSnapshot();
+    uint256 hashNew = snapshot.GetHash();
+
+    // send the whole list if we don't know the base (anymore)
+    static const CMasternodeListSnapshot snapshotEmpty;
+    std::map<uint256, CMasternodeListSnapshot>::iterator itBase = hashBase.IsNull() ? mapListSnapshots.end() : mapListSnapshots.find(hashBase);
+    const CMasternodeListSnapshot& snapshotBase = itBase == mapListSnapshots.end() ? snapshotEmpty : itBase->second;
+
+    std::vector<COutPoint> vecMnb, vecMnp, vecRemoved;
+    snapshotBase.GetDiff(snapshot, vecMnb, vecMnp, vecRemoved);
+
+    // the peer takes a larger diff for junk, announce the list the old way instead
+    if(vecMnb.size() + vecMnp.size() + vecRemoved.size() > (size_t)MNLIST_DIFF_MAX_REQUEST_ENTRIES) {
+        LogPrintf("GETMNLISTDIFF -- diff of %d entries is too large, hashBase=%s, peer=%d\n",
+                    vecMnb.size() + vecMnp.size() + vecRemoved.size(), hashBase.ToString(), pfrom->id);
+        PushListInventory(pfrom, connman);
+        return;
+    }
+
+    CMasternodeListDiff diff;
+    diff.hashBase = itBase == mapListSnapshots.end() ? uint256() : hashBase;
+    diff.hashNew = hashNew;
+
+    int nMessages = 0;
+    size_t nMnb = 0, nMnp = 0, nRemoved = 0;
+    do {
+        diff.vecMnb.clear();
+        diff.vecMnp.clear();
+        diff.vecRemoved.clear();
+        for (; nMnb < vecMnb.size() && diff.size() < MNLIST_DIFF_MAX_ENTRIES; nMnb++) {
+            diff.vecMnb.push_back(CMasternodeBroadcast(mapMasternodes[vecMnb[nMnb]]));
+        }
+        for (; nMnp < vecMnp.size() && diff.size() < MNLIST_DIFF_MAX_ENTRIES; nMnp++) {
+            diff.vecMnp.push_back(mapMasternodes[vecMnp[nMnp]].lastPing);
+        }
+        for (; nRemoved < vecRemoved.size() && diff.size() < MNLIST_DIFF_MAX_ENTRIES; nRemoved++) {
+            diff.vecRemoved.push_back(vecRemoved[nRemoved]);
+        }
+        diff.fLast = nMnb == vecMnb.size() && nMnp == vecMnp.size() && nRemoved == vecRemoved.size();
+        connman.PushMessage(pfrom, NetMsgType::MNLISTDIFF, diff);
+        nMessages++;
+    } while(!diff.fLast);
+
+    // keep the list we just sent, it's the base of this peer's next request
+    mapListSnapshots[hashNew] = snapshot;
+    while((int)mapListSnapshots.size() > MNLIST_SNAPSHOTS_MAX) {
+        std::map<uint256, CMasternodeListSnapshot>::iterator itOldest = mapListSnapshots.begin();
+        for (std::map<uint256, CMasternodeListSnapshot>::iterator it = mapListSnapshots.begin(); it != mapListSnapshots.end(); ++it) {
+            if(it->second.nTime < itOldest->second.nTime) itOldest = it;
+        }
+        mapListSnapshots.erase(itOldest);
+    }
+
+    connman.PushMessage(pfrom, NetMsgType::SYNCSTATUSCOUNT, MASTERNODE_SYNC_LIST, (int)(vecMnb.size() + vecMnp.size()));
+    LogPrintf("GETMNLISTDIFF -- Sent %d new, %d pinged and %d removed Masternodes in %d messages to peer %d, hashBase=%s\n",
+                vecMnb.size(), vecMnp.size(), vecRemoved.size(), nMessages, pfrom->id, diff.hashBase.ToString());
+}
+
+void CMasternodeMan::ProcessListDiff(CNode* pfrom, CMasternodeListDiff& diff, CConnman& connman)
+{
+    bool fComplete;
+    {
+        LOCK(cs);
+        // we only take the diffs we asked for
+        std::map<CNetAddr, CMasternodeListDiffRequest>::iterator it = mWeAskedForMasternodeListDiff.find(pfrom->addr);
+        if(it == mWeAskedForMasternodeListDiff.end()) {
+            LogPrintf("MNLISTDIFF -- peer sent a diff we didn't ask for, peer=%d\n", pfrom->id);
+            Misbehaving(pfrom->GetId(), 20);
+            return;
+        }
+        CMasternodeListDiffRequest& request = it->second;
+        request.nParts++;
+        request.nEntries += diff.size();
+        if((!diff.hashBase.IsNull() && diff.hashBase != request.hashBase) || diff.size() > MNLIST_DIFF_MAX_ENTRIES ||
+                request.nParts > MNLIST_DIFF_MAX_PARTS || request.nEntries > MNLIST_DIFF_MAX_REQUEST_ENTRIES) {
+            LogPrintf("MNLISTDIFF -- invalid diff, hashBase=%s, size=%d, parts=%d, entries=%d, peer=%d\n",
+                        diff.hashBase.ToString(), diff.size(), request.nParts, request.nEntries, pfrom->id);
+            mWeAskedForMasternodeListDiff.erase(it);
+            Misbehaving(pfrom->GetId(), 20);
+            return;
+        }
+        fComplete = request.fComplete;
+        if(diff.fLast) {
+            mWeAskedForMasternodeListDiff.erase(it);
+        }
+    }
+
+    LogPrint("masternode", "MNLISTDIFF -- %d new, %d pinged and %d removed Masternodes, hashBase=%s, peer=%d\n",
+                diff.vecMnb.size(), diff.vecMnp.size(), diff.vecRemoved.size(), diff.hashBase.ToString(), pfrom->id);
+
+    // Drop the entries which fail the cheap checks before verifying any signature, so that
+    // junk costs no ECDSA. Seen entries are kept, they are handled without a signature check.
+    std::vector<CMasternodeBroadcast> vecMnb;
+    std::vector<CMasternodePing> vecMnp;
+    std::vector<CHashSignatureCheck> vChecksMnb, vChecksMnp;
+    {
+        LOCK2(cs_main, cs);
+        for (const auto& mnb : diff.vecMnb) {
+            if(mapSeenMasternodeBroadcast.count(mnb.GetHash())) {
+                vecMnb.push_back(mnb);
+                continue;
+            }
+            int nDos = 0;
+            CMasternodeBroadcast mnbCheck(mnb);
+            if(!mnbCheck.SimpleCheck(nDos)) {
+                LogPrint("masternode", "MNLISTDIFF -- SimpleCheck() failed, masternode=%s, peer=%d\n", mnb.vin.prevout.ToStringShort(), pfrom->id);
+                if(nDos > 0) Misbehaving(pfrom->GetId(), nDos);
+                continue;
+            }
+            if(!Find(mnb.vin.prevout) && CMasternode::CheckCollateral(mnb.vin.prevout) != CMasternode::COLLATERAL_OK) {
+                LogPrint("masternode", "MNLISTDIFF -- invalid collateral, masternode=%s, peer=%d\n", mnb.vin.prevout.ToStringShort(), pfrom->id);
+                continue;
+            }
+            vecMnb.push_back(mnb);
+            CHashSignatureCheck check;
+            mnb.GetSignatureCheck(check);
+            vChecksMnb.push_back(check);
+            if(!(mnb.lastPing == CMasternodePing())) {
+                mnb.lastPing.GetSignatureCheck(mnb.pubKeyMasternode, check);
+                vChecksMnp.push_back(check);
+            }
+        }
+        for (const auto& mnp : diff.vecMnp) {
+            if(mapSeenMasternodePing.count(mnp.GetHash())) continue;
+            int nDos = 0;
+            CMasternodePing mnpCheck(mnp);
+            CMasternode* pmn = Find(mnp.vin.prevout);
+            if(!pmn || !mnpCheck.SimpleCheck(nDos)) {
+                LogPrint("masternode", "MNLISTDIFF -- unknown masternode or SimpleCheck() failed, masternode=%s, peer=%d\n", mnp.vin.prevout.ToStringShort(), pfrom->id);
+                if(nDos > 0) Misbehaving(pfrom->GetId(), nDos);
+                continue;
+            }
+            vecMnp.push_back(mnp);
+            CHashSignatureCheck check;
+            mnp.GetSignatureCheck(pmn->pubKeyMasternode, check);
+            vChecksMnp.push_back(check);
+        }
+    }
+    if(vecMnb.size() != diff.vecMnb.size()) fComplete = false;
+
+    // Verify the remaining signatures at once on the signature check threads,
+    // the checks below then find valid ones in the signature cache.
+    if(!CHashSigner::VerifyHashes(vChecksMnb)) {
+        // the masternode collateral key is part of the broadcast, no honest peer sends one that doesn't match
+        LogPrintf("MNLISTDIFF -- bad Masternode announce signature, peer=%d\n", pfrom->id);
+        Misbehaving(pfrom->GetId(), 100);
+        return;
+    }
+    // a ping can fail against an outdated masternode key of ours, ProcessPing sorts those out one by one
+    CHashSigner::VerifyHashes(vChecksMnp);
+
+    for (auto& mnb : vecMnb) {
+        int nDos = 0;
+        if (CheckMnbAndUpdateMasternodeList(pfrom, mnb, nDos, connman)) {
+            // use announced Masternode as a peer
+            connman.AddNewAddress(CAddress(mnb.addr, NODE_NETWORK), pfrom->addr, 2*60*60);
+            // a known broadcast doesn't update the ping, do it separately
+            bool fNewerPing = false;
+            {
+                LOCK(cs);
+                CMasternode* pmn = Find(mnb.vin.prevout);
+                fNewerPing = pmn && pmn->lastPing.sigTime < mnb.lastPing.sigTime;
+            }
+            if(fNewerPing) {
+                ProcessPing(pfrom, mnb.lastPing, connman);
+            }
+        } else if(nDos > 0) {
+            Misbehaving(pfrom->GetId(), nDos);
+        }
+    }
+
+    for (auto& mnp : vecMnp) {
+        ProcessPing(pfrom, mnp, connman);
+    }
+
+    {
+        LOCK(cs);
+        // our list only matches hashNew if it has every broadcast and ping of the diff
+        for (const auto& mnb : diff.vecMnb) {
+            CMasternode* pmn = Find(mnb.vin.prevout);
+            if(!pmn || pmn->sigTime < mnb.sigTime) fComplete = false;
+        }
+        for (const auto& mnp : diff.vecMnp) {
+            CMasternode* pmn = Find(mnp.vin.prevout);
+            if(!pmn || pmn->lastPing.sigTime < mnp.sigTime) fComplete = false;
+        }
+    }
+
+    if(!diff.vecRemoved.empty()) {
+        // don't take the peer's word for it, just recheck these masternodes now
+        LOCK2(cs_main, cs);
+        for (const auto& outpoint : diff.vecRemoved) {
+            CMasternode* pmn = Find(outpoint);
+            if(pmn) pmn->Check(true);
+        }
+    }
+
+    LOCK(cs);
+    if(!diff.fLast) {
+        std::map<CNetAddr, CMasternodeListDiffRequest>::iterator it = mWeAskedForMasternodeListDiff.find(pfrom->addr);
+        if(it != mWeAskedForMasternodeListDiff.end()) it->second.fComplete = fComplete;
+    } else if(fComplete) {
+        hashSyncedList = diff.hashNew;
+        LogPrintf("MNLISTDIFF -- Masternode list synced up to %s, peer=%d\n", hashSyncedList.ToString(), pfrom->id);
+    } else {
+        // later diffs based on hashNew would never resend the entries we missed, ask for the whole list next time
+        hashSyncedList.SetNull();
+        LogPrintf("MNLISTDIFF -- Masternode list diff not fully applied, next sync is a full one, peer=%d\n", pfrom->id);
+    }
+}
+
+void CMasternodeMan::ProcessPing(CNode* pfrom, CMasternodePing& mnp, CConnman& connman)
+{
+    uint256 nHash = mnp.GetHash();
+
+    LogPrint("masternode", "MNPING -- Masternode ping, masternode=%s\n", mnp.vin.prevout.ToStringShort());
+
+    // Need LOCK2 here to ensure consistent locking order because the CheckAndUpdate call below locks cs_main
+    LOCK2(cs_main, cs);
+
+    if(mapSeenMasternodePing.count(nHash)) return; //seen
+    mapSeenMasternodePing.insert(std::make_pair(nHash, mnp));
+
+    LogPrint("masternode", "MNPING -- Masternode ping, masternode=%s new\n", mnp.vin.prevout.ToStringShort());
+
+    // see if we have this Masternode
+    CMasternode* pmn = Find(mnp.vin.prevout);
+
+    // if masternode uses sentinel ping instead of watchdog
+    // we shoud update nTimeLastWatchdogVote here if sentinel
+    // ping flag is actual
+    if(pmn && mnp.fSentinelIsCurrent)
+        UpdateWatchdogVoteTime(mnp.vin.prevout, mnp.sigTime);
+
+    // too late, new MNANNOUNCE is required
+    if(pmn && pmn->IsNewStartRequired()) return;
+
+    int nDos = 0;
+    if(mnp.CheckAndUpdate(pmn, false, nDos, connman)) return;
+
+    if(nDos > 0) {
+        // if anything significant failed, mark that node
+        Misbehaving(pfrom->GetId(), nDos);
+    } else if(pmn != NULL) {
+        // nothing significant failed, mn is a known one too
+        return;
+    }
+
+    // something significant is broken or mn is unknown,
+    // we might have to ask for a masternode entry once
+    AskForMN(pfrom, mnp.vin.prevout, connman);
+}
+
 CMasternode* CMasternodeMan::Find(const COutPoint &outpoint)
 {
     LOCK(cs);
@@ -622,14 +1127,13 @@ bool CMasternodeMan::GetMasternodeScores(const uint256& nBlockHash, CMasternodeM
     if (mapMasternodes.empty())
         return false;
 
-    // calculate scores
-    for (auto& mnpair : mapMasternodes) {
-        if (mnpair.second.nProtocolVersion >= nMinProtocol) {
-            vecMasternodeScoresRet.push_back(std::make_pair(mnpair.second.CalculateScore(nBlockHash), &mnpair.second));
+    // filter cached scores, they are sorted already
+    for (const auto& scorePair : scoresCache.Get(nBlockHash, mapMasternodes)) {
+        if (scorePair.second->nProtocolVersion >= nMinProtocol) {
+            vecMasternodeScoresRet.push_back(scorePair);
         }
     }
 
-    sort(vecMasternodeScoresRet.rbegin(), vecMasternodeScoresRet.rend(), CompareScoreMN());
     return !vecMasternodeScoresRet.empty();
 }
 
@@ -649,12 +1153,13 @@ bool CMasternodeMan::GetMasternodeRank(const COutPoint& outpoint, int& nRankRet,
 
     LOCK(cs);
 
-    score_pair_vec_t vecMasternodeScores;
-    if (!GetMasternodeScores(nBlockHash, vecMasternodeScores, nMinProtocol))
+    if (mapMasternodes.empty())
         return false;
 
+    // walk cached scores directly instead of copying them
     int nRank = 0;
-    for (auto& scorePair : vecMasternodeScores) {
+    for (const auto& scorePair : scoresCache.Get(nBlockHash, mapMasternodes)) {
+        if (scorePair.second->nProtocolVersion < nMinProtocol) continue;
         nRank++;
         if(scorePair.second->vin.prevout == outpoint) {
             nRankRet = nRank;
@@ -771,48 +1276,11 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         CMasternodePing mnp;
         vRecv >> mnp;
 
-        uint256 nHash = mnp.GetHash();
-
-        pfrom->setAskFor.erase(nHash);
+        pfrom->setAskFor.erase(mnp.GetHash());
 
         if(!masternodeSync.IsBlockchainSynced()) return;
 
-        LogPrint("masternode", "MNPING -- Masternode ping, masternode=%s\n", mnp.vin.prevout.ToStringShort());
-
-        // Need LOCK2 here to ensure consistent locking order because the CheckAndUpdate call below locks cs_main
-        LOCK2(cs_main, cs);
-
-        if(mapSeenMasternodePing.count(nHash)) return; //seen
-        mapSeenMasternodePing.insert(std::make_pair(nHash, mnp));
-
-        LogPrint("masternode", "MNPING -- Masternode ping, masternode=%s new\n", mnp.vin.prevout.ToStringShort());
-
-        // see if we have this Masternode
-        CMasternode* pmn = Find(mnp.vin.prevout);
-
-        // if masternode uses sentinel ping instead of watchdog
-        // we shoud update nTimeLastWatchdogVote here if sentinel
-        // ping flag is actual
-        if(pmn && mnp.fSentinelIsCurrent)
-            UpdateWatchdogVoteTime(mnp.vin.prevout, mnp.sigTime);
-
-        // too late, new MNANNOUNCE is required
-        if(pmn && pmn->IsNewStartRequired()) return;
-
-        int nDos = 0;
-        if(mnp.CheckAndUpdate(pmn, false, nDos, connman)) return;
-
-        if(nDos > 0) {
-            // if anything significant failed, mark that node
-            Misbehaving(pfrom->GetId(), nDos);
-        } else if(pmn != NULL) {
-            // nothing significant failed, mn is a known one too
-            return;
-        }
-
-        // something significant is broken or mn is unknown,
-        // we might have to ask for a masternode entry once
-        AskForMN(pfrom, mnp.vin.prevout, connman);
+        ProcessPing(pfrom, mnp, connman);
 
     } else if (strCommand == NetMsgType::DSEG) { //Get Masternode list or specific entry
         // Ignore such requests until we are fully synced.
@@ -828,39 +1296,18 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         LOCK(cs);
 
         if(vin == CTxIn()) { //only should ask for this once
-            //local network
-            bool isLocal = (pfrom->addr.IsRFC1918() || pfrom->addr.IsLocal());
-
-            if(!isLocal && Params().NetworkIDString() == CBaseChainParams::MAIN) {
-                std::map<CNetAddr, int64_t>::iterator it = mAskedUsForMasternodeList.find(pfrom->addr);
-                if (it != mAskedUsForMasternodeList.end() && it->second > GetTime()) {
-                    Misbehaving(pfrom->GetId(), 34);
-                    LogPrintf("DSEG -- peer already asked me for the list, peer=%d\n", pfrom->id);
-                    return;
-                }
-                int64_t askAgain = GetTime() + DSEG_UPDATE_SECONDS;
-                mAskedUsForMasternodeList[pfrom->addr] = askAgain;
+            if(!AllowListRequest(pfrom)) {
+                LogPrintf("DSEG -- peer already asked me for the list, peer=%d\n", pfrom->id);
+                return;
             }
-        } //else, asking for a specific node which is ok
-
-        int nInvCount = 0;
+            PushListInventory(pfrom, connman);
+            return;
+        }
 
+        //else, asking for a specific node which is ok
         for (auto& mnpair : mapMasternodes) {
-            if (vin != CTxIn() && vin != mnpair.second.vin) continue; // asked for specific vin but we are not there yet
-            if (mnpair.second.addr.IsRFC1918() || mnpair.second.addr.IsLocal()) continue; // do not send local network masternode
-            if (mnpair.second.IsUpdateRequired()) continue; // do not send outdated masternodes
-
-            LogPrint("masternode", "DSEG -- Sending Masternode entry: masternode=%s  addr=%s\n", mnpair.first.ToStringShort(), mnpair.second.addr.ToString());
-            CMasternodeBroadcast mnb = CMasternodeBroadcast(mnpair.second);
-            CMasternodePing mnp = mnpair.second.lastPing;
-            uint256 hashMNB = mnb.GetHash();
-            uint256 hashMNP = mnp.GetHash();
-            pfrom->PushInventory(CInv(MSG_MASTERNODE_ANNOUNCE, hashMNB));
-            pfrom->PushInventory(CInv(MSG_MASTERNODE_PING, hashMNP));
-            nInvCount++;
-
-            mapSeenMasternodeBroadcast.insert(std::make_pair(hashMNB, std::make_pair(GetTime(), mnb)));
-            mapSeenMasternodePing.insert(std::make_pair(hashMNP, mnp));
+            if (vin != mnpair.second.vin) continue; // asked for specific vin but we are not there yet
+            if (!PushMasternodeInventory(pfrom, mnpair.second)) continue;
 
             if (vin.prevout == mnpair.first) {
                 LogPrintf("DSEG -- Sent 1 Masternode inv to peer %d\n", pfrom->id);
@@ -868,14 +1315,40 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
             }
         }
 
-        if(vin == CTxIn()) {
-            connman.PushMessage(pfrom, NetMsgType::SYNCSTATUSCOUNT, MASTERNODE_SYNC_LIST, nInvCount);
-            LogPrintf("DSEG -- Sent %d Masternode invs to peer %d\n", nInvCount, pfrom->id);
-            return;
-        }
         // smth weird happen - someone asked us for vin we have no idea about?
         LogPrint("masternode", "DSEG -- No invs sent to peer %d\n", pfrom->id);
 
+    } else if (strCommand == NetMsgType::GETMNLISTDIFF) { //Get Masternode list changes since some list
+        // Same as DSEG, ignore such requests until we are fully synced
+        if (!masternodeSync.IsSynced()) return;
+
+        uint256 hashBase;
+        vRecv >> hashBase;
+
+        LogPrint("masternode", "GETMNLISTDIFF -- Masternode list diff, hashBase=%s, peer=%d\n", hashBase.ToString(), pfrom->id);
+
+        LOCK(cs);
+
+        if(!AllowListRequest(pfrom)) {
+            LogPrintf("GETMNLISTDIFF -- peer already asked me for the list, peer=%d\n", pfrom->id);
+            return;
+        }
+
+        PushListDiff(pfrom, hashBase, connman);
+
+    } else if (strCommand == NetMsgType::MNLISTDIFF) { //Masternode list changes
+
+        CMasternodeListDiff diff;
+        vRecv >> diff;
+
+        if(!masternodeSync.IsBlockchainSynced()) return;
+
+        ProcessListDiff(pfrom, diff, connman);
+
+        if(fMasternodesAdded) {
+            NotifyMasternodeUpdates(connman);
+        }
+
     } else if (strCommand == NetMsgType::MNVERIFY) { // Masternode Verify
 
         // Need LOCK2 here to ensure consistent locking order because the all functions below call GetBlockHash which locks cs_main
@@ -1342,9 +1815,11 @@ void CMasternodeMan::UpdateMasternodeList(CMasternodeBroadcast mnb, CConnman& co
         }
     } else {
         CMasternodeBroadcast mnbOld = mapSeenMasternodeBroadcast[CMasternodeBroadcast(*pmn).GetHash()].second;
+        CPubKey pubKeyMasternodeOld = pmn->pubKeyMasternode;
         if(pmn->UpdateFromNewBroadcast(mnb, connman)) {
             masternodeSync.BumpAssetLastTime("CMasternodeMan::UpdateMasternodeList - seen");
             mapSeenMasternodeBroadcast.erase(mnbOld.GetHash());
+            if(pmn->pubKeyMasternode != pubKeyMasternodeOld) ++nListVersion;
         }
     }
 }
@@ -1404,10 +1879,12 @@ bool CMasternodeMan::CheckMnbAndUpdateMasternodeList(CNode* pfrom, CMasternodeBr
         CMasternode* pmn = Find(mnb.vin.prevout);
         if(pmn) {
             CMasternodeBroadcast mnbOld = mapSeenMasternodeBroadcast[CMasternodeBroadcast(*pmn).GetHash()].second;
+            CPubKey pubKeyMasternodeOld = pmn->pubKeyMasternode;
             if(!mnb.Update(pmn, nDos, connman)) {
                 LogPrint("masternode", "CMasternodeMan::CheckMnbAndUpdateMasternodeList -- Update() failed, masternode=%s\n", mnb.vin.prevout.ToStringShort());
                 return false;
             }
+            if(pmn->pubKeyMasternode != pubKeyMasternodeOld) ++nListVersion;
             if(hash != mnbOld.GetHash()) {
                 mapSeenMasternodeBroadcast.erase(mnbOld.GetHash());
             }
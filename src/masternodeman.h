@@ -13,9 +13,136 @@ using namespace std;
 
 class CMasternodeMan;
 class CConnman;
+class CCacheDB;
+class CCacheDBCheckpoint;
 
 extern CMasternodeMan mnodeman;
 
+/**
+ * A masternode list entry as far as list sync is concerned:
+ * the hashes of its broadcast and of its last ping
+ */
+class CMasternodeListEntry
+{
+public:
+    COutPoint outpoint;
+    uint256 hashMnb;
+    uint256 hashMnp;
+
+    CMasternodeListEntry() {}
+    CMasternodeListEntry(const COutPoint& outpointIn, const uint256& hashMnbIn, const uint256& hashMnpIn) :
+        outpoint(outpointIn), hashMnb(hashMnbIn), hashMnp(hashMnpIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(outpoint);
+        READWRITE(hashMnb);
+        READWRITE(hashMnp);
+    }
+};
+
+/**
+ * The masternode list which is sent to peers (entries sorted by outpoint)
+ * at some point in time. The list hash commits to all of the entries, so
+ * nodes with the same list hash have the same list.
+ */
+class CMasternodeListSnapshot
+{
+public:
+    int64_t nTime;
+    std::vector<CMasternodeListEntry> vecEntries;
+
+    CMasternodeListSnapshot() : nTime(0) {}
+
+    uint256 GetHash() const;
+
+    /// Entries which have to be sent to turn this list into snapshotNew:
+    /// new or rebroadcasted masternodes, masternodes with a new ping only and removed masternodes
+    void GetDiff(const CMasternodeListSnapshot& snapshotNew, std::vector<COutPoint>& vecMnbRet,
+                 std::vector<COutPoint>& vecMnpRet, std::vector<COutPoint>& vecRemovedRet) const;
+};
+
+/**
+ * A part of the changes between two masternode lists, sent in reply to GETMNLISTDIFF.
+ * Large diffs are split in several messages, the last one has fLast set.
+ */
+class CMasternodeListDiff
+{
+public:
+    // list the changes apply to, null if the whole list is sent
+    uint256 hashBase;
+    // list after applying all parts of the diff
+    uint256 hashNew;
+    // new masternodes and the ones with a new broadcast, with their last pings
+    std::vector<CMasternodeBroadcast> vecMnb;
+    // masternodes which only have a new ping
+    std::vector<CMasternodePing> vecMnp;
+    std::vector<COutPoint> vecRemoved;
+    bool fLast;
+
+    CMasternodeListDiff() : fLast(false) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(hashBase);
+        READWRITE(hashNew);
+        READWRITE(vecMnb);
+        READWRITE(vecMnp);
+        READWRITE(vecRemoved);
+        READWRITE(fLast);
+    }
+
+    size_t size() const { return vecMnb.size() + vecMnp.size() + vecRemoved.size(); }
+};
+
+/** A GETMNLISTDIFF we sent and what we got in reply to it so far */
+struct CMasternodeListDiffRequest
+{
+    uint256 hashBase;
+    int nParts;
+    int nEntries;
+    // cleared when an entry of the reply couldn't be applied to our list
+    bool fComplete;
+
+    CMasternodeListDiffRequest() : nParts(0), nEntries(0), fComplete(true) {}
+    CMasternodeListDiffRequest(const uint256& hashBaseIn) : hashBase(hashBaseIn), nParts(0), nEntries(0), fComplete(true) {}
+};
+
+/**
+ * Masternode scores for the last MAX_SIZE block hashes, best first. Entries
+ * point into the masternode list and are patched as masternodes are added
+ * and removed, so that the whole list is only hashed and sorted once per
+ * block hash. Guarded by the lock of the list it points into.
+ */
+class CMasternodeScoresCache
+{
+public:
+    typedef std::pair<arith_uint256, CMasternode*> score_pair_t;
+    typedef std::vector<score_pair_t> score_pair_vec_t;
+
+    static const size_t MAX_SIZE = 32;
+
+private:
+    std::map<uint256, score_pair_vec_t> mapScores;
+    // block hashes in mapScores, oldest first
+    std::list<uint256> listOrder;
+
+public:
+    /// Scores of all of mapMasternodes for nBlockHash, computed on the first request
+    const score_pair_vec_t& Get(const uint256& nBlockHash, std::map<COutPoint, CMasternode>& mapMasternodes);
+    bool Has(const uint256& nBlockHash) const { return mapScores.count(nBlockHash); }
+    size_t size() const { return mapScores.size(); }
+
+    /// Keep cached scores in sync with the list
+    void Add(CMasternode* pmn);
+    void Remove(const CMasternode* pmn);
+    void Clear();
+};
+
 class CMasternodeMan
 {
 public:
@@ -42,6 +169,11 @@ private:
     static const int MNB_RECOVERY_WAIT_SECONDS      = 60;
     static const int MNB_RECOVERY_RETRY_SECONDS     = 3 * 60 * 60;
 
+    static const int MNLIST_DIFF_MAX_ENTRIES        = 1000;
+    // larger diffs are sent as DSEG would send the list, so a diff request takes at most MNLIST_DIFF_MAX_PARTS messages
+    static const int MNLIST_DIFF_MAX_REQUEST_ENTRIES = 10000;
+    static const int MNLIST_DIFF_MAX_PARTS          = MNLIST_DIFF_MAX_REQUEST_ENTRIES / MNLIST_DIFF_MAX_ENTRIES;
+    static const int MNLIST_SNAPSHOTS_MAX           = 16;
 
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
@@ -55,6 +187,8 @@ private:
     std::map<CNetAddr, int64_t> mAskedUsForMasternodeList;
     // who we asked for the Masternode list and the last time
     std::map<CNetAddr, int64_t> mWeAskedForMasternodeList;
+    // the diffs we are waiting for
+    std::map<CNetAddr, CMasternodeListDiffRequest> mWeAskedForMasternodeListDiff;
     // which Masternodes we've asked for
     std::map<COutPoint, std::map<CNetAddr, int64_t> > mWeAskedForMasternodeListEntry;
     // who we asked for the masternode verification
@@ -65,6 +199,9 @@ private:
     std::map<uint256, std::vector<CMasternodeBroadcast> > mMnbRecoveryGoodReplies;
     std::list< std::pair<CService, uint256> > listScheduledMnbRequestConnections;
 
+    // masternode scores per block hash, patched by Add/CheckAndRemove
+    CMasternodeScoresCache scoresCache;
+
     /// Set when masternodes are added, cleared when CGovernanceManager is notified
     bool fMasternodesAdded;
 
@@ -73,14 +210,34 @@ private:
 
     std::vector<uint256> vecDirtyGovernanceObjectHashes;
 
+    /// Bumped when masternodes are added or removed or change their masternode key
+    int nListVersion;
+
     int64_t nLastWatchdogVoteTime;
 
+    // lists we sent diffs up to, so that peers can ask for the changes since then
+    std::map<uint256, CMasternodeListSnapshot> mapListSnapshots;
+    // list of the last complete diff we got, the base of our next request
+    uint256 hashSyncedList;
+
     friend class CMasternodeSync;
     /// Find an entry
     CMasternode* Find(const COutPoint& outpoint);
 
     bool GetMasternodeScores(const uint256& nBlockHash, score_pair_vec_t& vecMasternodeScoresRet, int nMinProtocol = 0);
 
+    /// Full list requests are expensive, allow one per peer per DSEG_UPDATE_SECONDS
+    bool AllowListRequest(CNode* pfrom);
+    /// Announce a masternode's broadcast and ping to a peer, false if it isn't sent to peers
+    bool PushMasternodeInventory(CNode* pfrom, CMasternode& mn);
+    /// Announce the whole sendable list to a peer, what DSEG answers
+    void PushListInventory(CNode* pfrom, CConnman& connman);
+    /// Sendable part of the list
+    CMasternodeListSnapshot GetListSnapshot();
+    void PushListDiff(CNode* pfrom, const uint256& hashBase, CConnman& connman);
+    void ProcessListDiff(CNode* pfrom, CMasternodeListDiff& diff, CConnman& connman);
+    void ProcessPing(CNode* pfrom, CMasternodePing& mnp, CConnman& connman);
+
 public:
     // Keep track of all broadcasts I've seen
     std::map<uint256, std::pair<int64_t, CMasternodeBroadcast> > mapSeenMasternodeBroadcast;
@@ -114,9 +271,15 @@ public:
         READWRITE(mMnbRecoveryGoodReplies);
         READWRITE(nLastWatchdogVoteTime);
         READWRITE(nDsqCount);
+        READWRITE(hashSyncedList);
 
         READWRITE(mapSeenMasternodeBroadcast);
         READWRITE(mapSeenMasternodePing);
+        if(ser_action.ForRead()) {
+            // cached scores point into the old mapMasternodes
+            scoresCache.Clear();
+            ++nListVersion;
+        }
         if(ser_action.ForRead() && (strVersion != SERIALIZATION_VERSION_STRING)) {
             Clear();
         }
@@ -140,12 +303,17 @@ public:
 
     /// Check all Masternodes and remove inactive
     void CheckAndRemove(CConnman& connman);
-    /// This is dummy overload to be used for dumping/loading mncache.dat
+    /// This is dummy overload to be used for loading the masternode cache
     void CheckAndRemove() {}
 
     /// Clear Masternode vector
     void Clear();
 
+    /// Store the list in the cache database, one record per masternode and seen message
+    void WriteCheckpoint(CCacheDBCheckpoint& checkpoint);
+    /// Load the list from the cache database, false if it couldn't be read
+    bool ReadCheckpoint(CCacheDB& cachedb);
+
     /// Count Masternodes filtered by nProtocolVersion.
     /// Masternode nProtocolVersion should match or be above the one specified in param here.
     int CountMasternodes(int nProtocolVersion = -1);
@@ -194,6 +362,9 @@ public:
     /// Return the number of (unique) Masternodes
     int size() { return mapMasternodes.size(); }
 
+    /// Changes whenever data validated against the masternode list may have to be checked again
+    int GetListVersion() { LOCK(cs); return nListVersion; }
+
     std::string ToString() const;
 
     /// Update masternode list and maps using provided CMasternodeBroadcast
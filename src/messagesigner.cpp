@@ -4,12 +4,88 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "base58.h"
+#include "checkqueue.h"
 #include "hash.h"
-#include "validation.h" // For strMessageMagic
+#include "memusage.h"
+#include "random.h"
+#include "validation.h" // For strMessageMagic and nScriptCheckThreads
 #include "messagesigner.h"
 #include "tinyformat.h"
+#include "util.h"
 #include "utilstrencodings.h"
 
+#include <boost/thread.hpp>
+#include <boost/unordered_set.hpp>
+
+namespace {
+
+/** Maximum memory used by the hash signature cache */
+static const size_t MAX_HASH_SIG_CACHE_SIZE = 16 << 20;
+
+class CHashSignatureCacheHasher
+{
+public:
+    size_t operator()(const uint256& key) const {
+        return key.GetCheapHash();
+    }
+};
+
+/**
+ * Valid hash signature cache, modeled after CSignatureCache in script/sigcache.cpp.
+ * Masternode messages (votes, pings, dsq...) are relayed by many peers and some
+ * are re-checked after the masternode list changes, this avoids verifying the
+ * same signature over and over again.
+ */
+class CHashSignatureCache
+{
+private:
+    //! Entries are SHA256(nonce || hash || public key || signature):
+    uint256 nonce;
+    typedef boost::unordered_set<uint256, CHashSignatureCacheHasher> map_type;
+    map_type setValid;
+    boost::shared_mutex cs_hashsigcache;
+
+public:
+    CHashSignatureCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+    }
+
+    void ComputeEntry(uint256& entry, const uint256& hash, const CPubKey& pubkey, const std::vector<unsigned char>& vchSig)
+    {
+        CSHA256 hasher;
+        hasher.Write(nonce.begin(), 32).Write(hash.begin(), 32).Write(pubkey.begin(), pubkey.size());
+        if (!vchSig.empty())
+            hasher.Write(&vchSig[0], vchSig.size());
+        hasher.Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_hashsigcache);
+        return setValid.count(entry);
+    }
+
+    void Set(const uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_hashsigcache);
+        while (memusage::DynamicUsage(setValid) > MAX_HASH_SIG_CACHE_SIZE)
+        {
+            map_type::size_type s = GetRand(setValid.bucket_count());
+            map_type::local_iterator it = setValid.begin(s);
+            if (it != setValid.end(s)) {
+                setValid.erase(*it);
+            }
+        }
+
+        setValid.insert(entry);
+    }
+};
+
+CHashSignatureCache hashSignatureCache;
+
+}
+
 bool CMessageSigner::GetKeysFromSecret(const std::string strSecret, CKey& keyRet, CPubKey& pubkeyRet)
 {
     CBitcoinSecret vchSecret;
@@ -24,20 +100,20 @@ bool CMessageSigner::GetKeysFromSecret(const std::string strSecret, CKey& keyRet
 
 bool CMessageSigner::SignMessage(const std::string strMessage, std::vector<unsigned char>& vchSigRet, const CKey key)
 {
-    CHashWriter ss(SER_GETHASH, 0);
-    ss << strMessageMagic;
-    ss << strMessage;
-
-    return CHashSigner::SignHash(ss.GetHash(), key, vchSigRet);
+    return CHashSigner::SignHash(GetMessageHash(strMessage), key, vchSigRet);
 }
 
 bool CMessageSigner::VerifyMessage(const CPubKey pubkey, const std::vector<unsigned char>& vchSig, const std::string strMessage, std::string& strErrorRet)
+{
+    return CHashSigner::VerifyHash(GetMessageHash(strMessage), pubkey, vchSig, strErrorRet);
+}
+
+uint256 CMessageSigner::GetMessageHash(const std::string& strMessage)
 {
     CHashWriter ss(SER_GETHASH, 0);
     ss << strMessageMagic;
     ss << strMessage;
-
-    return CHashSigner::VerifyHash(ss.GetHash(), pubkey, vchSig, strErrorRet);
+    return ss.GetHash();
 }
 
 bool CHashSigner::SignHash(const uint256& hash, const CKey key, std::vector<unsigned char>& vchSigRet)
@@ -47,18 +123,52 @@ bool CHashSigner::SignHash(const uint256& hash, const CKey key, std::vector<unsi
 
 bool CHashSigner::VerifyHash(const uint256& hash, const CPubKey pubkey, const std::vector<unsigned char>& vchSig, std::string& strErrorRet)
 {
-    CPubKey pubkeyFromSig;
-    if(!pubkeyFromSig.RecoverCompact(hash, vchSig)) {
-        strErrorRet = "Error recovering public key.";
-        return false;
+    uint256 entry;
+    hashSignatureCache.ComputeEntry(entry, hash, pubkey, vchSig);
+    if(hashSignatureCache.Get(entry)) {
+        return true;
     }
 
-    if(pubkeyFromSig.GetID() != pubkey.GetID()) {
-        strErrorRet = strprintf("Keys don't match: pubkey=%s, pubkeyFromSig=%s, hash=%s, vchSig=%s",
-                    pubkey.GetID().ToString(), pubkeyFromSig.GetID().ToString(), hash.ToString(),
-                    EncodeBase64(&vchSig[0], vchSig.size()));
+    // we know the key already, check that the signature (and its recovery id) yields it
+    if(!pubkey.CheckRecoverCompact(hash, vchSig)) {
+        strErrorRet = strprintf("Signature doesn't match: pubkey=%s, hash=%s, vchSig=%s",
+                    pubkey.GetID().ToString(), hash.ToString(),
+                    vchSig.empty() ? "" : EncodeBase64(&vchSig[0], vchSig.size()));
         return false;
     }
 
+    hashSignatureCache.Set(entry);
     return true;
 }
+
+bool CHashSignatureCheck::operator()()
+{
+    std::string strError;
+    return CHashSigner::VerifyHash(hash, pubkey, vchSig, strError);
+}
+
+static CCheckQueue<CHashSignatureCheck> hashsigcheckqueue(128);
+// only one batch can be in flight at a time
+static CCriticalSection cs_hashsigcheckqueue;
+
+void ThreadHashSignatureCheck() {
+    RenameThread("square-sigcheck");
+    hashsigcheckqueue.Thread();
+}
+
+bool CHashSigner::VerifyHashes(std::vector<CHashSignatureCheck>& vChecks)
+{
+    // same worker count as script verification, see -par
+    if(!nScriptCheckThreads) {
+        bool fAllOk = true;
+        BOOST_FOREACH(CHashSignatureCheck& check, vChecks) {
+            fAllOk = check() && fAllOk;
+        }
+        return fAllOk;
+    }
+
+    LOCK(cs_hashsigcheckqueue);
+    CCheckQueueControl<CHashSignatureCheck> control(&hashsigcheckqueue);
+    control.Add(vChecks);
+    return control.Wait();
+}
@@ -7,6 +7,7 @@
 #define MESSAGESIGNER_H
 
 #include "key.h"
+#include "pubkey.h"
 
 /** Helper class for signing messages and checking their signatures
  */
@@ -19,6 +20,31 @@ public:
     static bool SignMessage(const std::string strMessage, std::vector<unsigned char>& vchSigRet, const CKey key);
     /// Verify the message signature, returns true if succcessful
     static bool VerifyMessage(const CPubKey pubkey, const std::vector<unsigned char>& vchSig, const std::string strMessage, std::string& strErrorRet);
+    /// Get the hash that is actually signed for the message
+    static uint256 GetMessageHash(const std::string& strMessage);
+};
+
+/** A hash signature to verify as part of a batch, see CHashSigner::VerifyHashes
+ */
+class CHashSignatureCheck
+{
+private:
+    uint256 hash;
+    CPubKey pubkey;
+    std::vector<unsigned char> vchSig;
+
+public:
+    CHashSignatureCheck() {}
+    CHashSignatureCheck(const uint256& hashIn, const CPubKey& pubkeyIn, const std::vector<unsigned char>& vchSigIn) :
+        hash(hashIn), pubkey(pubkeyIn), vchSig(vchSigIn) {}
+
+    bool operator()();
+
+    void swap(CHashSignatureCheck& check) {
+        std::swap(hash, check.hash);
+        std::swap(pubkey, check.pubkey);
+        vchSig.swap(check.vchSig);
+    }
 };
 
 /** Helper class for signing hashes and checking their signatures
@@ -28,8 +54,15 @@ class CHashSigner
 public:
     /// Sign the hash, returns true if successful
     static bool SignHash(const uint256& hash, const CKey key, std::vector<unsigned char>& vchSigRet);
-    /// Verify the hash signature, returns true if succcessful
+    /// Verify the hash signature against the known pubkey, returns true if succcessful.
+    /// Valid signatures are cached, so verifying the same one again is cheap.
     static bool VerifyHash(const uint256& hash, const CPubKey pubkey, const std::vector<unsigned char>& vchSig, std::string& strErrorRet);
+    /// Verify a batch of hash signatures on the signature check threads, returns true if all of them are valid.
+    /// Valid ones end up in the signature cache, so callers can verify them one by one afterwards for free.
+    static bool VerifyHashes(std::vector<CHashSignatureCheck>& vChecks);
 };
 
+/** Run an instance of the hash signature checking thread */
+void ThreadHashSignatureCheck();
+
 #endif
@@ -14,6 +14,7 @@
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "crypto/common.h"
 #include "hash.h"
 #include "validation.h"
 #include "net.h"
@@ -29,9 +30,13 @@
 #include "masternode-sync.h"
 #include "validationinterface.h"
 
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/member.hpp>
+#include <boost/multi_index/ordered_index.hpp>
 #include <boost/thread.hpp>
 #include <boost/tuple/tuple.hpp>
-#include <queue>
+
+#include <atomic>
 
 using namespace std;
 
@@ -42,284 +47,582 @@ using namespace std;
 
 //
 // Unconfirmed transactions in the memory pool often depend on other
-// transactions in the memory pool. When we select transactions from the
-// pool, we select by highest priority or fee rate, so we might consider
-// transactions that depend on transactions that aren't yet in the block.
+// transactions in the memory pool. Transactions are selected as packages of a
+// transaction together with its not yet included in-mempool ancestors, by
+// highest package fee rate, so a child paying a high fee pulls its low-fee
+// parents into the block (child-pays-for-parent). A small part of the block
+// can still be filled by coin-age priority, see -blockprioritysize.
 
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 
-class ScoreCompare
+namespace {
+
+/** A mempool transaction together with its ancestors which are not in the block yet */
+struct CTxPackageEntry
+{
+    CTxMemPool::txiter iter;
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
+    unsigned int nSigOpsWithAncestors;
+
+    CTxPackageEntry(CTxMemPool::txiter entry) :
+        iter(entry),
+        nSizeWithAncestors(entry->GetTxSize()),
+        nModFeesWithAncestors(entry->GetModifiedFee()),
+        nSigOpsWithAncestors(entry->GetSigOpCount())
+        {}
+};
+
+/** Sort packages by fee rate with ancestors, highest first */
+class CompareTxPackageByAncestorFee
 {
 public:
-    ScoreCompare() {}
+    bool operator()(const CTxPackageEntry& a, const CTxPackageEntry& b) const
+    {
+        double f1 = (double)a.nModFeesWithAncestors * b.nSizeWithAncestors;
+        double f2 = (double)b.nModFeesWithAncestors * a.nSizeWithAncestors;
+        if (f1 == f2) {
+            return CTxMemPool::CompareIteratorByHash()(a.iter, b.iter);
+        }
+        return f1 > f2;
+    }
+};
 
-    bool operator()(const CTxMemPool::txiter a, const CTxMemPool::txiter b)
+struct package_iter {};
+struct package_score {};
+
+typedef boost::multi_index_container<
+    CTxPackageEntry,
+    boost::multi_index::indexed_by<
+        boost::multi_index::ordered_unique<
+            boost::multi_index::tag<package_iter>,
+            boost::multi_index::member<CTxPackageEntry, CTxMemPool::txiter, &CTxPackageEntry::iter>,
+            CTxMemPool::CompareIteratorByHash
+        >,
+        boost::multi_index::ordered_unique<
+            boost::multi_index::tag<package_score>,
+            boost::multi_index::identity<CTxPackageEntry>,
+            CompareTxPackageByAncestorFee
+        >
+    >
+> indexed_package_set;
+
+struct update_for_parent_inclusion
+{
+    update_for_parent_inclusion(CTxMemPool::txiter it) : iter(it) {}
+
+    void operator() (CTxPackageEntry &e)
     {
-        return CompareTxMemPoolEntryByScore()(*b,*a); // Convert to less than
+        e.nSizeWithAncestors -= iter->GetTxSize();
+        e.nModFeesWithAncestors -= iter->GetModifiedFee();
+        e.nSigOpsWithAncestors -= iter->GetSigOpCount();
     }
+
+    private:
+        CTxMemPool::txiter iter;
 };
 
-int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
+/**
+ * Fills a block template with mempool transactions. It can continue from a
+ * template it filled before, as long as all of its transactions are still in
+ * the mempool. Requires cs_main and mempool.cs.
+ */
+class BlockAssembler
 {
-    int64_t nOldTime = pblock->nTime;
-    int64_t nNewTime = std::max(pindexPrev->GetMedianTimePast()+1, GetAdjustedTime());
+private:
+    const CChainParams& chainparams;
+    CBlockTemplate& blocktemplate;
+    const CBlockIndex* pindexPrev;
+
+    // Configuration
+    unsigned int nBlockMaxSize;
+    unsigned int nBlockMinSize;
+    unsigned int nMaxBlockSigOps;
+    bool fPrintPriority;
+
+    // Selection state
+    CTxMemPool::setEntries inBlock;
+    uint64_t nBlockSize;
+    uint64_t nBlockTx;
+    unsigned int nBlockSigOps;
+    CAmount nFees;
+    int nHeight;
+    int64_t nLockTimeCutoff;
+
+    // Statistics for -debug=bench
+    int nPackagesSelected;
+    int nDescendantsUpdated;
+
+    /** Ancestor package of iter without the transactions already in the block */
+    CTxPackageEntry GetPackageEntry(CTxMemPool::txiter iter, CTxMemPool::setEntries& ancestorsRet);
+    bool TestPackage(uint64_t nPackageSize, unsigned int nPackageSigOps, bool& fBlockFullRet);
+    bool TestPackageFinality(const CTxMemPool::setEntries& package);
+    /** Order package so that every transaction comes after its in-package parents */
+    void SortForBlock(const CTxMemPool::setEntries& package, std::vector<CTxMemPool::txiter>& sortedEntriesRet);
+    void AddToBlock(CTxMemPool::txiter iter);
+    /** Remove the transactions just added from the packages of their descendants */
+    void UpdatePackagesForAdded(const std::vector<CTxMemPool::txiter>& vecAdded, indexed_package_set& packages);
 
-    if (nOldTime < nNewTime)
-        pblock->nTime = nNewTime;
+public:
+    BlockAssembler(const CChainParams& chainparamsIn, CBlockTemplate& blocktemplateIn, const CBlockIndex* pindexPrevIn);
 
-    // Updating time can change work required on testnet:
-    if (consensusParams.fPowAllowMinDifficultyBlocks)
-        pblock->nBits = GetNextWorkRequired(pindexPrev, pblock, consensusParams);
+    /** Continue with the transactions blocktemplate already has, false if one of them left the mempool */
+    bool ResumeTemplate();
 
-    return nNewTime - nOldTime;
-}
+    void AddPriorityTxs();
+    /** Add the best packages, considering only transactions which entered the mempool at or after nTimeFrom */
+    void AddPackageTxs(int64_t nTimeFrom);
 
-CBlockTemplate* CreateNewBlock(const CChainParams& chainparams, const CScript& scriptPubKeyIn)
-{
-    // Create new block
-    std::unique_ptr<CBlockTemplate> pblocktemplate(new CBlockTemplate());
-    if(!pblocktemplate.get())
-        return NULL;
-    CBlock *pblock = &pblocktemplate->block; // pointer for convenience
+    /** Fill in coinbase, masternode/superblock payments and header */
+    void FinalizeTemplate();
 
-    // Create coinbase tx
-    CMutableTransaction txNew;
-    txNew.vin.resize(1);
-    txNew.vin[0].prevout.SetNull();
-    txNew.vout.resize(1);
-    txNew.vout[0].scriptPubKey = scriptPubKeyIn;
+    int GetPackagesSelected() const { return nPackagesSelected; }
+    int GetDescendantsUpdated() const { return nDescendantsUpdated; }
+};
 
+BlockAssembler::BlockAssembler(const CChainParams& chainparamsIn, CBlockTemplate& blocktemplateIn, const CBlockIndex* pindexPrevIn)
+    : chainparams(chainparamsIn),
+      blocktemplate(blocktemplateIn),
+      pindexPrev(pindexPrevIn)
+{
     // Largest block you're willing to create:
-    unsigned int nBlockMaxSize = GetArg("-blockmaxsize", DEFAULT_BLOCK_MAX_SIZE);
+    nBlockMaxSize = GetArg("-blockmaxsize", DEFAULT_BLOCK_MAX_SIZE);
     // Limit to between 1K and MAX_BLOCK_SIZE-1K for sanity:
     nBlockMaxSize = std::max((unsigned int)1000, std::min((unsigned int)(MaxBlockSize(fDIP0001ActiveAtTip)-1000), nBlockMaxSize));
 
-    // How much of the block should be dedicated to high-priority transactions,
-    // included regardless of the fees they pay
-    unsigned int nBlockPrioritySize = GetArg("-blockprioritysize", DEFAULT_BLOCK_PRIORITY_SIZE);
-    nBlockPrioritySize = std::min(nBlockMaxSize, nBlockPrioritySize);
-
     // Minimum block size you want to create; block will be filled with free transactions
     // until there are no more or the block reaches this size:
-    unsigned int nBlockMinSize = GetArg("-blockminsize", DEFAULT_BLOCK_MIN_SIZE);
+    nBlockMinSize = GetArg("-blockminsize", DEFAULT_BLOCK_MIN_SIZE);
     nBlockMinSize = std::min(nBlockMaxSize, nBlockMinSize);
 
-    // Collect memory pool transactions into the block
-    CTxMemPool::setEntries inBlock;
-    CTxMemPool::setEntries waitSet;
+    nMaxBlockSigOps = MaxBlockSigOps(fDIP0001ActiveAtTip);
+    fPrintPriority = GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
+
+    nBlockSize = 1000;
+    nBlockTx = 0;
+    nBlockSigOps = 100;
+    nFees = 0;
+    nHeight = pindexPrev->nHeight + 1;
+    nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
+                    ? pindexPrev->GetMedianTimePast()
+                    : blocktemplate.block.GetBlockTime();
+
+    nPackagesSelected = 0;
+    nDescendantsUpdated = 0;
+}
+
+bool BlockAssembler::ResumeTemplate()
+{
+    const CBlock& block = blocktemplate.block;
+    for (unsigned int i = 1; i < block.vtx.size(); i++) {
+        CTxMemPool::txiter it = mempool.mapTx.find(block.vtx[i].GetHash());
+        if (it == mempool.mapTx.end())
+            return false;
+        inBlock.insert(it);
+    }
+    nBlockSize = blocktemplate.nBlockSize;
+    nBlockTx = block.vtx.size() - 1;
+    nBlockSigOps = blocktemplate.nBlockSigOps;
+    nFees = -blocktemplate.vTxFees[0];
+    return true;
+}
+
+void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
+{
+    const CTransaction& tx = iter->GetTx();
+    CAmount nTxFees = iter->GetFee();
+    unsigned int nTxSigOps = iter->GetSigOpCount();
+
+    blocktemplate.block.vtx.push_back(tx);
+    blocktemplate.vTxFees.push_back(nTxFees);
+    blocktemplate.vTxSigOps.push_back(nTxSigOps);
+    nBlockSize += iter->GetTxSize();
+    ++nBlockTx;
+    nBlockSigOps += nTxSigOps;
+    nFees += nTxFees;
+    inBlock.insert(iter);
+
+    if (fPrintPriority)
+    {
+        double dPriority = iter->GetPriority(nHeight);
+        CAmount dummy;
+        mempool.ApplyDeltas(tx.GetHash(), dPriority, dummy);
+        LogPrintf("priority %.1f fee %s txid %s\n",
+                  dPriority, CFeeRate(iter->GetModifiedFee(), iter->GetTxSize()).ToString(), tx.GetHash().ToString());
+    }
+}
+
+void BlockAssembler::AddPriorityTxs()
+{
+    // How much of the block should be dedicated to high-priority transactions,
+    // included regardless of the fees they pay
+    unsigned int nBlockPrioritySize = GetArg("-blockprioritysize", DEFAULT_BLOCK_PRIORITY_SIZE);
+    nBlockPrioritySize = std::min(nBlockMaxSize, nBlockPrioritySize);
+    if (nBlockPrioritySize == 0)
+        return;
 
     // This vector will be sorted into a priority queue:
     vector<TxCoinAgePriority> vecPriority;
     TxCoinAgePriorityCompare pricomparer;
     std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash> waitPriMap;
     typedef std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash>::iterator waitPriIter;
-    double actualPriority = -1;
-
-    std::priority_queue<CTxMemPool::txiter, std::vector<CTxMemPool::txiter>, ScoreCompare> clearedTxs;
-    bool fPrintPriority = GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
-    uint64_t nBlockSize = 1000;
-    uint64_t nBlockTx = 0;
-    unsigned int nBlockSigOps = 100;
-    int lastFewTxs = 0;
-    CAmount nFees = 0;
 
+    vecPriority.reserve(mempool.mapTx.size());
+    for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
+         mi != mempool.mapTx.end(); ++mi)
     {
-        LOCK(cs_main);
+        double dPriority = mi->GetPriority(nHeight);
+        CAmount dummy;
+        mempool.ApplyDeltas(mi->GetTx().GetHash(), dPriority, dummy);
+        vecPriority.push_back(TxCoinAgePriority(dPriority, mi));
+    }
+    std::make_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
 
-        CBlockIndex* pindexPrev = chainActive.Tip();
-        const int nHeight = pindexPrev->nHeight + 1;
-        pblock->nTime = GetAdjustedTime();
-        const int64_t nMedianTimePast = pindexPrev->GetMedianTimePast();
-
-        // Add our coinbase tx as first transaction
-        pblock->vtx.push_back(txNew);
-        pblocktemplate->vTxFees.push_back(-1); // updated at end
-        pblocktemplate->vTxSigOps.push_back(-1); // updated at end
-        pblock->nVersion = ComputeBlockVersion(pindexPrev, chainparams.GetConsensus());
-        // -regtest only: allow overriding block.nVersion with
-        // -blockversion=N to test forking scenarios
-        if (chainparams.MineBlocksOnDemand())
-            pblock->nVersion = GetArg("-blockversion", pblock->nVersion);
-
-        int64_t nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
-                                ? nMedianTimePast
-                                : pblock->GetBlockTime();
+    while (!vecPriority.empty()) {
+        CTxMemPool::txiter iter = vecPriority.front().second;
+        double actualPriority = vecPriority.front().first;
+        std::pop_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+        vecPriority.pop_back();
 
+        // Wait for the parents, they may still come by priority
+        bool fOrphan = false;
+        BOOST_FOREACH(CTxMemPool::txiter parent, mempool.GetMemPoolParents(iter))
         {
-            LOCK(mempool.cs);
-
-            bool fPriorityBlock = nBlockPrioritySize > 0;
-            if (fPriorityBlock) {
-                vecPriority.reserve(mempool.mapTx.size());
-                for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
-                     mi != mempool.mapTx.end(); ++mi)
-                {
-                    double dPriority = mi->GetPriority(nHeight);
-                    CAmount dummy;
-                    mempool.ApplyDeltas(mi->GetTx().GetHash(), dPriority, dummy);
-                    vecPriority.push_back(TxCoinAgePriority(dPriority, mi));
-                }
-                std::make_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+            if (!inBlock.count(parent)) {
+                fOrphan = true;
+                break;
             }
+        }
+        if (fOrphan) {
+            waitPriMap.insert(std::make_pair(iter, actualPriority));
+            continue;
+        }
 
-            CTxMemPool::indexed_transaction_set::nth_index<3>::type::iterator mi = mempool.mapTx.get<3>().begin();
-            CTxMemPool::txiter iter;
+        unsigned int nTxSize = iter->GetTxSize();
+        if (nBlockSize + nTxSize >= nBlockPrioritySize || !AllowFree(actualPriority))
+            break;
 
-            while (mi != mempool.mapTx.get<3>().end() || !clearedTxs.empty())
-            {
-                bool priorityTx = false;
-                if (fPriorityBlock && !vecPriority.empty()) { // add a tx from priority queue to fill the blockprioritysize
-                    priorityTx = true;
-                    iter = vecPriority.front().second;
-                    actualPriority = vecPriority.front().first;
-                    std::pop_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
-                    vecPriority.pop_back();
-                }
-                else if (clearedTxs.empty()) { // add tx with next highest score
-                    iter = mempool.mapTx.project<0>(mi);
-                    mi++;
-                }
-                else {  // try to add a previously postponed child tx
-                    iter = clearedTxs.top();
-                    clearedTxs.pop();
-                }
+        if (!IsFinalTx(iter->GetTx(), nHeight, nLockTimeCutoff))
+            continue;
+        if (nBlockSigOps + iter->GetSigOpCount() >= nMaxBlockSigOps)
+            continue;
 
-                if (inBlock.count(iter))
-                    continue; // could have been added to the priorityBlock
+        AddToBlock(iter);
 
-                const CTransaction& tx = iter->GetTx();
+        // Add transactions that depend on this one to the priority queue
+        BOOST_FOREACH(CTxMemPool::txiter child, mempool.GetMemPoolChildren(iter))
+        {
+            waitPriIter wpiter = waitPriMap.find(child);
+            if (wpiter != waitPriMap.end()) {
+                vecPriority.push_back(TxCoinAgePriority(wpiter->second, child));
+                std::push_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+                waitPriMap.erase(wpiter);
+            }
+        }
+    }
+}
 
-                bool fOrphan = false;
-                BOOST_FOREACH(CTxMemPool::txiter parent, mempool.GetMemPoolParents(iter))
-                {
-                    if (!inBlock.count(parent)) {
-                        fOrphan = true;
-                        break;
-                    }
-                }
-                if (fOrphan) {
-                    if (priorityTx)
-                        waitPriMap.insert(std::make_pair(iter,actualPriority));
-                    else
-                        waitSet.insert(iter);
-                    continue;
-                }
+CTxPackageEntry BlockAssembler::GetPackageEntry(CTxMemPool::txiter iter, CTxMemPool::setEntries& ancestorsRet)
+{
+    static const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string strDummy;
+    CTxMemPool::setEntries setAncestors;
+    mempool.CalculateMemPoolAncestors(*iter, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, strDummy, false);
+
+    ancestorsRet.clear();
+    CTxPackageEntry package(iter);
+    BOOST_FOREACH(CTxMemPool::txiter ancestor, setAncestors) {
+        if (inBlock.count(ancestor))
+            continue;
+        ancestorsRet.insert(ancestor);
+        package.nSizeWithAncestors += ancestor->GetTxSize();
+        package.nModFeesWithAncestors += ancestor->GetModifiedFee();
+        package.nSigOpsWithAncestors += ancestor->GetSigOpCount();
+    }
+    return package;
+}
 
-                unsigned int nTxSize = iter->GetTxSize();
-                if (fPriorityBlock &&
-                    (nBlockSize + nTxSize >= nBlockPrioritySize || !AllowFree(actualPriority))) {
-                    fPriorityBlock = false;
-                    waitPriMap.clear();
-                }
-                if (!priorityTx &&
-                    (iter->GetModifiedFee() < ::minRelayTxFee.GetFee(nTxSize) && nBlockSize >= nBlockMinSize)) {
-                    break;
-                }
-                if (nBlockSize + nTxSize >= nBlockMaxSize) {
-                    if (nBlockSize >  nBlockMaxSize - 100 || lastFewTxs > 50) {
-                        break;
-                    }
-                    // Once we're within 1000 bytes of a full block, only look at 50 more txs
-                    // to try to fill the remaining space.
-                    if (nBlockSize > nBlockMaxSize - 1000) {
-                        lastFewTxs++;
-                    }
-                    continue;
-                }
+bool BlockAssembler::TestPackage(uint64_t nPackageSize, unsigned int nPackageSigOps, bool& fBlockFullRet)
+{
+    fBlockFullRet = false;
+    if (nBlockSize + nPackageSize >= nBlockMaxSize) {
+        fBlockFullRet = nBlockSize > nBlockMaxSize - 100;
+        return false;
+    }
+    if (nBlockSigOps + nPackageSigOps >= nMaxBlockSigOps) {
+        fBlockFullRet = nBlockSigOps > nMaxBlockSigOps - 2;
+        return false;
+    }
+    return true;
+}
 
-                if (!IsFinalTx(tx, nHeight, nLockTimeCutoff))
-                    continue;
+bool BlockAssembler::TestPackageFinality(const CTxMemPool::setEntries& package)
+{
+    BOOST_FOREACH(CTxMemPool::txiter it, package) {
+        if (!IsFinalTx(it->GetTx(), nHeight, nLockTimeCutoff))
+            return false;
+    }
+    return true;
+}
 
-                unsigned int nTxSigOps = iter->GetSigOpCount();
-                unsigned int nMaxBlockSigOps = MaxBlockSigOps(fDIP0001ActiveAtTip);
-                if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps) {
-                    if (nBlockSigOps > nMaxBlockSigOps - 2) {
-                        break;
-                    }
-                    continue;
-                }
+void BlockAssembler::SortForBlock(const CTxMemPool::setEntries& package, std::vector<CTxMemPool::txiter>& sortedEntriesRet)
+{
+    sortedEntriesRet.clear();
+    sortedEntriesRet.reserve(package.size());
+
+    CTxMemPool::setEntries setSorted;
+    std::vector<std::pair<CTxMemPool::txiter, bool> > vecStack;
+    BOOST_FOREACH(CTxMemPool::txiter it, package) {
+        vecStack.push_back(std::make_pair(it, false));
+        while (!vecStack.empty()) {
+            std::pair<CTxMemPool::txiter, bool> item = vecStack.back();
+            vecStack.pop_back();
+            if (setSorted.count(item.first))
+                continue;
+            if (item.second) {
+                // all parents are placed already
+                setSorted.insert(item.first);
+                sortedEntriesRet.push_back(item.first);
+                continue;
+            }
+            vecStack.push_back(std::make_pair(item.first, true));
+            BOOST_FOREACH(CTxMemPool::txiter parent, mempool.GetMemPoolParents(item.first)) {
+                if (package.count(parent) && !setSorted.count(parent))
+                    vecStack.push_back(std::make_pair(parent, false));
+            }
+        }
+    }
+}
 
-                CAmount nTxFees = iter->GetFee();
-                // Added
-                pblock->vtx.push_back(tx);
-                pblocktemplate->vTxFees.push_back(nTxFees);
-                pblocktemplate->vTxSigOps.push_back(nTxSigOps);
-                nBlockSize += nTxSize;
-                ++nBlockTx;
-                nBlockSigOps += nTxSigOps;
-                nFees += nTxFees;
-
-                if (fPrintPriority)
-                {
-                    double dPriority = iter->GetPriority(nHeight);
-                    CAmount dummy;
-                    mempool.ApplyDeltas(tx.GetHash(), dPriority, dummy);
-                    LogPrintf("priority %.1f fee %s txid %s\n",
-                              dPriority , CFeeRate(iter->GetModifiedFee(), nTxSize).ToString(), tx.GetHash().ToString());
-                }
+void BlockAssembler::UpdatePackagesForAdded(const std::vector<CTxMemPool::txiter>& vecAdded, indexed_package_set& packages)
+{
+    indexed_package_set::index<package_iter>::type& packagesByIter = packages.get<package_iter>();
+    // descendants whose package was calculated after vecAdded went into the block
+    CTxMemPool::setEntries setRecalculated;
+
+    BOOST_FOREACH(CTxMemPool::txiter it, vecAdded) {
+        CTxMemPool::setEntries setDescendants;
+        mempool.CalculateDescendants(it, setDescendants);
+        BOOST_FOREACH(CTxMemPool::txiter desc, setDescendants) {
+            if (inBlock.count(desc) || setRecalculated.count(desc))
+                continue;
+            ++nDescendantsUpdated;
+            indexed_package_set::index<package_iter>::type::iterator pit = packagesByIter.find(desc);
+            if (pit != packagesByIter.end()) {
+                packagesByIter.modify(pit, update_for_parent_inclusion(it));
+            } else {
+                // not considered yet or dropped because it didn't fit, smaller now
+                CTxMemPool::setEntries setDummy;
+                packages.insert(GetPackageEntry(desc, setDummy));
+                setRecalculated.insert(desc);
+            }
+        }
+    }
+}
 
-                inBlock.insert(iter);
+void BlockAssembler::AddPackageTxs(int64_t nTimeFrom)
+{
+    indexed_package_set packages;
+
+    CTxMemPool::setEntries setAncestors;
+    // newest first, so only the transactions which arrived since nTimeFrom are visited
+    typedef CTxMemPool::indexed_transaction_set::nth_index<2>::type::reverse_iterator entry_time_riter;
+    CTxMemPool::indexed_transaction_set::nth_index<2>::type& mapTxByTime = mempool.mapTx.get<2>();
+    for (entry_time_riter mi = mapTxByTime.rbegin(); mi != mapTxByTime.rend() && mi->GetTime() >= nTimeFrom; ++mi) {
+        CTxMemPool::txiter iter = mempool.mapTx.project<0>(std::prev(mi.base()));
+        if (!inBlock.count(iter))
+            packages.insert(GetPackageEntry(iter, setAncestors));
+    }
 
-                // Add transactions that depend on this one to the priority queue
-                BOOST_FOREACH(CTxMemPool::txiter child, mempool.GetMemPoolChildren(iter))
-                {
-                    if (fPriorityBlock) {
-                        waitPriIter wpiter = waitPriMap.find(child);
-                        if (wpiter != waitPriMap.end()) {
-                            vecPriority.push_back(TxCoinAgePriority(wpiter->second,child));
-                            std::push_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
-                            waitPriMap.erase(wpiter);
-                        }
-                    }
-                    else {
-                        if (waitSet.count(child)) {
-                            clearedTxs.push(child);
-                            waitSet.erase(child);
-                        }
-                    }
-                }
-            }
+    indexed_package_set::index<package_score>::type& packagesByScore = packages.get<package_score>();
+    std::vector<CTxMemPool::txiter> vecSorted;
+    int nLastFewPackages = 0;
+
+    while (!packagesByScore.empty()) {
+        CTxPackageEntry package = *packagesByScore.begin();
+        packagesByScore.erase(packagesByScore.begin());
+
+        if (package.nModFeesWithAncestors < ::minRelayTxFee.GetFee(package.nSizeWithAncestors) && nBlockSize >= nBlockMinSize) {
+            // Everything else we might consider has a lower fee rate
+            break;
+        }
 
+        bool fBlockFull;
+        if (!TestPackage(package.nSizeWithAncestors, package.nSigOpsWithAncestors, fBlockFull)) {
+            if (fBlockFull || nLastFewPackages > 50)
+                break;
+            // Once we're within 1000 bytes of a full block, only look at 50 more packages
+            // to try to fill the remaining space.
+            if (nBlockSize > nBlockMaxSize - 1000)
+                nLastFewPackages++;
+            continue;
         }
 
-        // NOTE: unlike in bitcoin, we need to pass PREVIOUS block height here
-        CAmount blockReward = nFees + GetBlockSubsidy(pindexPrev->nBits, pindexPrev->nHeight, Params().GetConsensus());
-
-        // Compute regular coinbase transaction.
-        txNew.vout[0].nValue = blockReward;
-        txNew.vin[0].scriptSig = CScript() << nHeight << OP_0;
-
-        // Update coinbase transaction with additional info about masternode and governance payments,
-        // get some info back to pass to getblocktemplate
-        FillBlockPayments(txNew, nHeight, blockReward, pblock->txoutMasternode, pblock->voutSuperblock);
-        // LogPrintf("CreateNewBlock -- nBlockHeight %d blockReward %lld txoutMasternode %s txNew %s",
-        //             nHeight, blockReward, pblock->txoutMasternode.ToString(), txNew.ToString());
-
-        nLastBlockTx = nBlockTx;
-        nLastBlockSize = nBlockSize;
-        LogPrintf("CreateNewBlock(): total size %u txs: %u fees: %ld sigops %d\n", nBlockSize, nBlockTx, nFees, nBlockSigOps);
-
-        // Update block coinbase
-        pblock->vtx[0] = txNew;
-        pblocktemplate->vTxFees[0] = -nFees;
-
-        // Fill in header
-        pblock->hashPrevBlock  = pindexPrev->GetBlockHash();
-        UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
-        pblock->nBits          = GetNextWorkRequired(pindexPrev, pblock, chainparams.GetConsensus());
-        pblock->nNonce         = 0;
-        pblocktemplate->vTxSigOps[0] = GetLegacySigOpCount(pblock->vtx[0]);
-
-        CValidationState state;
-        if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
-            throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
+        GetPackageEntry(package.iter, setAncestors);
+        setAncestors.insert(package.iter);
+        if (!TestPackageFinality(setAncestors))
+            continue;
+
+        SortForBlock(setAncestors, vecSorted);
+        BOOST_FOREACH(CTxMemPool::txiter it, vecSorted) {
+            AddToBlock(it);
+            packages.get<package_iter>().erase(it);
         }
+        ++nPackagesSelected;
+
+        UpdatePackagesForAdded(vecSorted, packages);
+    }
+}
+
+void BlockAssembler::FinalizeTemplate()
+{
+    CBlock* pblock = &blocktemplate.block;
+
+    // NOTE: unlike in bitcoin, we need to pass PREVIOUS block height here
+    CAmount blockReward = nFees + GetBlockSubsidy(pindexPrev->nBits, pindexPrev->nHeight, Params().GetConsensus());
+
+    // Compute regular coinbase transaction.
+    CMutableTransaction txNew;
+    txNew.vin.resize(1);
+    txNew.vin[0].prevout.SetNull();
+    txNew.vout.resize(1);
+    txNew.vout[0].scriptPubKey = blocktemplate.scriptPubKey;
+    txNew.vout[0].nValue = blockReward;
+    txNew.vin[0].scriptSig = CScript() << nHeight << OP_0;
+
+    // Update coinbase transaction with additional info about masternode and governance payments,
+    // get some info back to pass to getblocktemplate
+    FillBlockPayments(txNew, nHeight, blockReward, pblock->txoutMasternode, pblock->voutSuperblock);
+    // LogPrintf("CreateNewBlock -- nBlockHeight %d blockReward %lld txoutMasternode %s txNew %s",
+    //             nHeight, blockReward, pblock->txoutMasternode.ToString(), txNew.ToString());
+
+    nLastBlockTx = nBlockTx;
+    nLastBlockSize = nBlockSize;
+    LogPrintf("CreateNewBlock(): total size %u txs: %u fees: %ld sigops %d\n", nBlockSize, nBlockTx, nFees, nBlockSigOps);
+
+    // Update block coinbase
+    pblock->vtx[0] = txNew;
+    blocktemplate.vTxFees[0] = -nFees;
+    blocktemplate.nBlockSize = nBlockSize;
+    blocktemplate.nBlockSigOps = nBlockSigOps;
+
+    // Fill in header
+    pblock->hashPrevBlock  = pindexPrev->GetBlockHash();
+    UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
+    pblock->nBits          = GetNextWorkRequired(pindexPrev, pblock, chainparams.GetConsensus());
+    pblock->nNonce         = 0;
+    blocktemplate.vTxSigOps[0] = GetLegacySigOpCount(pblock->vtx[0]);
+}
+
+} // anonymous namespace
+
+int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
+{
+    int64_t nOldTime = pblock->nTime;
+    int64_t nNewTime = std::max(pindexPrev->GetMedianTimePast()+1, GetAdjustedTime());
+
+    if (nOldTime < nNewTime)
+        pblock->nTime = nNewTime;
+
+    // Updating time can change work required on testnet:
+    if (consensusParams.fPowAllowMinDifficultyBlocks)
+        pblock->nBits = GetNextWorkRequired(pindexPrev, pblock, consensusParams);
+
+    return nNewTime - nOldTime;
+}
+
+CBlockTemplate* CreateNewBlock(const CChainParams& chainparams, const CScript& scriptPubKeyIn)
+{
+    int64_t nTimeStart = GetTimeMicros();
+
+    // Create new block
+    std::unique_ptr<CBlockTemplate> pblocktemplate(new CBlockTemplate());
+    if(!pblocktemplate.get())
+        return NULL;
+    CBlock *pblock = &pblocktemplate->block; // pointer for convenience
+    pblocktemplate->scriptPubKey = scriptPubKeyIn;
+
+    LOCK(cs_main);
+
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    pblock->nTime = GetAdjustedTime();
+
+    // Add our coinbase tx as first transaction, filled in by FinalizeTemplate()
+    pblock->vtx.push_back(CTransaction());
+    pblocktemplate->vTxFees.push_back(-1); // updated at end
+    pblocktemplate->vTxSigOps.push_back(-1); // updated at end
+    pblock->nVersion = ComputeBlockVersion(pindexPrev, chainparams.GetConsensus());
+    // -regtest only: allow overriding block.nVersion with
+    // -blockversion=N to test forking scenarios
+    if (chainparams.MineBlocksOnDemand())
+        pblock->nVersion = GetArg("-blockversion", pblock->nVersion);
+
+    BlockAssembler assembler(chainparams, *pblocktemplate, pindexPrev);
+    {
+        LOCK(mempool.cs);
+        pblocktemplate->nTimeSelected = GetTime();
+        assembler.AddPriorityTxs();
+        assembler.AddPackageTxs(0);
+    }
+    int64_t nTimePackages = GetTimeMicros();
+
+    assembler.FinalizeTemplate();
+
+    CValidationState state;
+    if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
+        throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
     }
+    int64_t nTimeEnd = GetTimeMicros();
+
+    LogPrint("bench", "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n",
+             0.001 * (nTimePackages - nTimeStart), assembler.GetPackagesSelected(), assembler.GetDescendantsUpdated(),
+             0.001 * (nTimeEnd - nTimePackages), 0.001 * (nTimeEnd - nTimeStart));
 
     return pblocktemplate.release();
 }
 
+bool UpdateBlockTemplate(const CChainParams& chainparams, CBlockTemplate* pblocktemplate)
+{
+    int64_t nTimeStart = GetTimeMicros();
+
+    LOCK2(cs_main, mempool.cs);
+
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    if (pblocktemplate->block.hashPrevBlock != pindexPrev->GetBlockHash())
+        return false;
+
+    BlockAssembler assembler(chainparams, *pblocktemplate, pindexPrev);
+    if (!assembler.ResumeTemplate())
+        return false;
+
+    // Transactions which entered in the same second as the last selection are
+    // looked at again, the ones already in the block are skipped
+    int64_t nTimeFrom = pblocktemplate->nTimeSelected;
+    pblocktemplate->nTimeSelected = GetTime();
+    assembler.AddPackageTxs(nTimeFrom);
+
+    // The added transactions were validated when they entered the mempool and
+    // don't conflict with the ones already in the template, which passed
+    // TestBlockValidity when it was created
+    assembler.FinalizeTemplate();
+
+    LogPrint("bench", "UpdateBlockTemplate() packages: %.2fms (%d packages, %d updated descendants)\n",
+             0.001 * (GetTimeMicros() - nTimeStart), assembler.GetPackagesSelected(), assembler.GetDescendantsUpdated());
+    return true;
+}
+
+static void SetCoinbaseExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int nExtraNonce)
+{
+    unsigned int nHeight = pindexPrev->nHeight+1; // Height first in coinbase required for block.version=2
+    CMutableTransaction txCoinbase(pblock->vtx[0]);
+    txCoinbase.vin[0].scriptSig = (CScript() << nHeight << CScriptNum(nExtraNonce)) + COINBASE_FLAGS;
+    assert(txCoinbase.vin[0].scriptSig.size() <= 100);
+
+    pblock->vtx[0] = txCoinbase;
+    pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
+}
+
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
 {
     // Update nExtraNonce
@@ -330,13 +633,7 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
         hashPrevBlock = pblock->hashPrevBlock;
     }
     ++nExtraNonce;
-    unsigned int nHeight = pindexPrev->nHeight+1; // Height first in coinbase required for block.version=2
-    CMutableTransaction txCoinbase(pblock->vtx[0]);
-    txCoinbase.vin[0].scriptSig = (CScript() << nHeight << CScriptNum(nExtraNonce)) + COINBASE_FLAGS;
-    assert(txCoinbase.vin[0].scriptSig.size() <= 100);
-
-    pblock->vtx[0] = txCoinbase;
-    pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
+    SetCoinbaseExtraNonce(pblock, pindexPrev, nExtraNonce);
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -400,25 +697,128 @@ static bool ProcessBlockFound(const CBlock* pblock, const CChainParams& chainpar
     return true;
 }
 
-// ***TODO*** that part changed in bitcoin, we are using a mix with old one here for now
-void static BitcoinMiner(const CChainParams& chainparams, CConnman& connman)
+namespace {
+
+/**
+ * Block template shared by the miner threads. The first thread noticing a new
+ * tip, or new mempool transactions after a minute, creates it again and bumps
+ * the generation, which makes the other threads pick it up. Every copy handed
+ * out gets an extranonce of its own, so the threads search disjoint headers
+ * and each one can scan the whole nonce range of its copy.
+ */
+class CMinerWork
 {
-    LogPrintf("SquareMiner -- started\n");
+private:
+    CCriticalSection cs;
+    boost::shared_ptr<CReserveScript> coinbaseScript;
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    CBlockIndex* pindexPrev;
+    unsigned int nTransactionsUpdated;
+    int64_t nTimeCreated;
+    unsigned int nExtraNonce;
+    std::atomic<uint64_t> nGeneration;
+
+public:
+    CMinerWork() : pindexPrev(NULL), nTransactionsUpdated(0), nTimeCreated(0), nExtraNonce(0), nGeneration(0) {}
+
+    /** Whether work handed out as nGenerationIn should be replaced */
+    bool IsStale(uint64_t nGenerationIn)
+    {
+        if (nGenerationIn != nGeneration.load())
+            return true;
+        LOCK(cs);
+        return pindexPrev != chainActive.Tip() ||
+               (mempool.GetTransactionsUpdated() != nTransactionsUpdated && GetTime() - nTimeCreated > 60);
+    }
+
+    /** Copy the current block to blockRet with a fresh extranonce, creating the template first if it is stale */
+    bool GetBlock(const CChainParams& chainparams, CBlock& blockRet, CBlockIndex*& pindexPrevRet, uint64_t& nGenerationRet)
+    {
+        LOCK(cs);
+        if (!coinbaseScript) {
+            GetMainSignals().ScriptForMining(coinbaseScript);
+            // Throw an error if no script was provided.  This can happen
+            // due to some internal error but also if the keypool is empty.
+            // In the latter case, already the pointer is NULL.
+            if (!coinbaseScript || coinbaseScript->reserveScript.empty())
+                throw std::runtime_error("No coinbase script available (mining requires a wallet)");
+        }
+
+        CBlockIndex* pindexTip = chainActive.Tip();
+        if (!pindexTip)
+            return false;
+        if (!pblocktemplate || pindexPrev != pindexTip ||
+            (mempool.GetTransactionsUpdated() != nTransactionsUpdated && GetTime() - nTimeCreated > 60))
+        {
+            nTransactionsUpdated = mempool.GetTransactionsUpdated();
+            nTimeCreated = GetTime();
+            pblocktemplate.reset(CreateNewBlock(chainparams, coinbaseScript->reserveScript));
+            if (!pblocktemplate) {
+                LogPrintf("SquareMiner -- Keypool ran out, please call keypoolrefill before restarting the mining thread\n");
+                return false;
+            }
+            pindexPrev = pindexTip;
+            nExtraNonce = 0;
+            ++nGeneration;
+
+            LogPrintf("SquareMiner -- Running miner with %u transactions in block (%u bytes)\n", pblocktemplate->block.vtx.size(),
+                ::GetSerializeSize(pblocktemplate->block, SER_NETWORK, PROTOCOL_VERSION));
+        }
+
+        blockRet = pblocktemplate->block;
+        pindexPrevRet = pindexPrev;
+        nGenerationRet = nGeneration.load();
+        SetCoinbaseExtraNonce(&blockRet, pindexPrev, ++nExtraNonce);
+        return true;
+    }
+
+    void KeepScript()
+    {
+        LOCK(cs);
+        // mark script as important because it was used at least for one coinbase output
+        coinbaseScript->KeepScript();
+    }
+};
+
+CCriticalSection cs_minerstats;
+std::vector<double> vMinerHashesPerSec;
+
+void SetMinerHashesPerSec(int nThread, double dHashesPerSec)
+{
+    LOCK(cs_minerstats);
+    if (nThread < (int)vMinerHashesPerSec.size())
+        vMinerHashesPerSec[nThread] = dHashesPerSec;
+}
+
+/** Milliseconds between two hashrate samples of a miner thread */
+static const int64_t MINER_STATS_INTERVAL = 4000;
+
+} // anonymous namespace
+
+std::vector<double> GetMinerHashesPerSec()
+{
+    LOCK(cs_minerstats);
+    return vMinerHashesPerSec;
+}
+
+void static BitcoinMiner(const CChainParams& chainparams, CConnman& connman, boost::shared_ptr<CMinerWork> pwork, int nThread)
+{
+    LogPrintf("SquareMiner -- started thread %d\n", nThread);
     SetThreadPriority(THREAD_PRIORITY_LOWEST);
     RenameThread("square-miner");
 
-    unsigned int nExtraNonce = 0;
+    // Nonces are scanned X11_BATCH_LANES at a time through the batched X11
+    // engine. The first 76 bytes of the header only change with new work or
+    // a new nTime, so every lane keeps them and only the nonce is written.
+    static const size_t nHeaderSize = 80;
+    static const size_t nNonceOffset = 76;
+    unsigned char vchHeaders[X11_BATCH_LANES * nHeaderSize];
+    uint256 vHashes[X11_BATCH_LANES];
 
-    boost::shared_ptr<CReserveScript> coinbaseScript;
-    GetMainSignals().ScriptForMining(coinbaseScript);
+    uint64_t nHashesDone = 0;
+    int64_t nStatsStart = GetTimeMillis();
 
     try {
-        // Throw an error if no script was provided.  This can happen
-        // due to some internal error but also if the keypool is empty.
-        // In the latter case, already the pointer is NULL.
-        if (!coinbaseScript || coinbaseScript->reserveScript.empty())
-            throw std::runtime_error("No coinbase script available (mining requires a wallet)");
-
         while (true) {
             if (chainparams.MiningRequiresPeers()) {
                 // Busy-wait for the network to come online so we don't waste time mining
@@ -427,97 +827,110 @@ void static BitcoinMiner(const CChainParams& chainparams, CConnman& connman)
                     bool fvNodesEmpty = connman.GetNodeCount(CConnman::CONNECTIONS_ALL) == 0;
                     if (!fvNodesEmpty && !IsInitialBlockDownload() && masternodeSync.IsSynced())
                         break;
+                    SetMinerHashesPerSec(nThread, 0);
                     MilliSleep(1000);
                 } while (true);
             }
 
-
             //
-            // Create new block
+            // Get work
             //
-            unsigned int nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
-            CBlockIndex* pindexPrev = chainActive.Tip();
-            if(!pindexPrev) break;
-
-            std::unique_ptr<CBlockTemplate> pblocktemplate(CreateNewBlock(chainparams, coinbaseScript->reserveScript));
-            if (!pblocktemplate.get())
-            {
-                LogPrintf("SquareMiner -- Keypool ran out, please call keypoolrefill before restarting the mining thread\n");
+            CBlock block;
+            CBlockIndex* pindexPrev;
+            uint64_t nGeneration;
+            if (!pwork->GetBlock(chainparams, block, pindexPrev, nGeneration))
                 return;
-            }
-            CBlock *pblock = &pblocktemplate->block;
-            IncrementExtraNonce(pblock, pindexPrev, nExtraNonce);
-
-            LogPrintf("SquareMiner -- Running miner with %u transactions in block (%u bytes)\n", pblock->vtx.size(),
-                ::GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION));
 
             //
             // Search
             //
-            int64_t nStart = GetTime();
-            arith_uint256 hashTarget = arith_uint256().SetCompact(pblock->nBits);
+            arith_uint256 hashTarget = arith_uint256().SetCompact(block.nBits);
             while (true)
             {
-                unsigned int nHashesDone = 0;
-
-                uint256 hash;
-                while (true)
+                CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+                ssHeader << block.GetBlockHeader();
+                assert(ssHeader.size() == nHeaderSize);
+                for (size_t nLane = 0; nLane < X11_BATCH_LANES; nLane++)
+                    memcpy(&vchHeaders[nLane * nHeaderSize], &ssHeader[0], nNonceOffset);
+
+                // Scan 16k nonces between two checks for new work
+                uint32_t nNonceEnd = block.nNonce + 0x4000;
+                bool fFound = false;
+                while (block.nNonce < nNonceEnd)
                 {
-                    hash = pblock->GetHash();
-                    if (UintToArith256(hash) <= hashTarget)
-                    {
-                        // Found a solution
-                        SetThreadPriority(THREAD_PRIORITY_NORMAL);
-                        LogPrintf("SquareMiner:\n  proof-of-work found\n  hash: %s\n  target: %s\n", hash.GetHex(), hashTarget.GetHex());
-                        ProcessBlockFound(pblock, chainparams);
-                        SetThreadPriority(THREAD_PRIORITY_LOWEST);
-                        coinbaseScript->KeepScript();
-
-                        // In regression test mode, stop mining after a block is found. This
-                        // allows developers to controllably generate a block on demand.
-                        if (chainparams.MineBlocksOnDemand())
-                            throw boost::thread_interrupted();
-
-                        break;
+                    for (size_t nLane = 0; nLane < X11_BATCH_LANES; nLane++)
+                        WriteLE32(&vchHeaders[nLane * nHeaderSize + nNonceOffset], block.nNonce + nLane);
+                    HashX11Batch(vchHeaders, nHeaderSize, nHeaderSize, X11_BATCH_LANES, vHashes);
+                    nHashesDone += X11_BATCH_LANES;
+
+                    for (size_t nLane = 0; nLane < X11_BATCH_LANES; nLane++) {
+                        if (UintToArith256(vHashes[nLane]) <= hashTarget) {
+                            block.nNonce += nLane;
+                            fFound = true;
+                            break;
+                        }
                     }
-                    pblock->nNonce += 1;
-                    nHashesDone += 1;
-                    if ((pblock->nNonce & 0xFF) == 0)
+                    if (fFound)
                         break;
+                    block.nNonce += X11_BATCH_LANES;
+                }
+
+                if (fFound)
+                {
+                    // Found a solution
+                    SetThreadPriority(THREAD_PRIORITY_NORMAL);
+                    LogPrintf("SquareMiner:\n  proof-of-work found\n  hash: %s\n  target: %s\n", block.GetHash().GetHex(), hashTarget.GetHex());
+                    if (ProcessBlockFound(&block, chainparams))
+                        pwork->KeepScript();
+                    SetThreadPriority(THREAD_PRIORITY_LOWEST);
+
+                    // In regression test mode, stop mining after a block is found. This
+                    // allows developers to controllably generate a block on demand.
+                    if (chainparams.MineBlocksOnDemand())
+                        throw boost::thread_interrupted();
+
+                    break;
+                }
+
+                int64_t nNow = GetTimeMillis();
+                if (nNow - nStatsStart >= MINER_STATS_INTERVAL) {
+                    SetMinerHashesPerSec(nThread, 1000.0 * nHashesDone / (nNow - nStatsStart));
+                    nHashesDone = 0;
+                    nStatsStart = nNow;
                 }
 
-                // Check for stop or if block needs to be rebuilt
+                // Check for stop or if new work is needed
                 boost::this_thread::interruption_point();
                 // Regtest mode doesn't require peers
                 if (connman.GetNodeCount(CConnman::CONNECTIONS_ALL) == 0 && chainparams.MiningRequiresPeers())
                     break;
-                if (pblock->nNonce >= 0xffff0000)
+                if (block.nNonce >= 0xffff0000)
                     break;
-                if (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 60)
-                    break;
-                if (pindexPrev != chainActive.Tip())
+                if (pwork->IsStale(nGeneration))
                     break;
 
                 // Update nTime every few seconds
-                if (UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev) < 0)
+                if (UpdateTime(&block, chainparams.GetConsensus(), pindexPrev) < 0)
                     break; // Recreate the block if the clock has run backwards,
                            // so that we can use the correct time.
                 if (chainparams.GetConsensus().fPowAllowMinDifficultyBlocks)
                 {
-                    // Changing pblock->nTime can change work required on testnet:
-                    hashTarget.SetCompact(pblock->nBits);
+                    // Changing block.nTime can change work required on testnet:
+                    hashTarget.SetCompact(block.nBits);
                 }
             }
         }
     }
     catch (const boost::thread_interrupted&)
     {
-        LogPrintf("SquareMiner -- terminated\n");
+        LogPrintf("SquareMiner -- terminated thread %d\n", nThread);
+        SetMinerHashesPerSec(nThread, 0);
         throw;
     }
     catch (const std::runtime_error &e)
     {
         LogPrintf("SquareMiner -- runtime error: %s\n", e.what());
+        SetMinerHashesPerSec(nThread, 0);
         return;
     }
 }
@@ -532,14 +945,23 @@ void GenerateBitcoins(bool fGenerate, int nThreads, const CChainParams& chainpar
     if (minerThreads != NULL)
     {
         minerThreads->interrupt_all();
+        minerThreads->join_all();
         delete minerThreads;
         minerThreads = NULL;
     }
 
+    {
+        LOCK(cs_minerstats);
+        vMinerHashesPerSec.clear();
+        if (nThreads > 0 && fGenerate)
+            vMinerHashesPerSec.resize(nThreads, 0);
+    }
+
     if (nThreads == 0 || !fGenerate)
         return;
 
+    boost::shared_ptr<CMinerWork> pwork(new CMinerWork());
     minerThreads = new boost::thread_group();
     for (int i = 0; i < nThreads; i++)
-        minerThreads->create_thread(boost::bind(&BitcoinMiner, boost::cref(chainparams), boost::ref(connman)));
+        minerThreads->create_thread(boost::bind(&BitcoinMiner, boost::cref(chainparams), boost::ref(connman), pwork, i));
 }
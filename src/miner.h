@@ -7,6 +7,7 @@
 #define BITCOIN_MINER_H
 
 #include "primitives/block.h"
+#include "script/script.h"
 
 #include <stdint.h>
 
@@ -28,12 +29,29 @@ struct CBlockTemplate
     CBlock block;
     std::vector<CAmount> vTxFees;
     std::vector<int64_t> vTxSigOps;
+
+    // what UpdateBlockTemplate() needs to add transactions later on
+    CScript scriptPubKey;
+    uint64_t nBlockSize;
+    unsigned int nBlockSigOps;
+    int64_t nTimeSelected; // mempool transactions which entered before were considered already
+
+    CBlockTemplate() : nBlockSize(0), nBlockSigOps(0), nTimeSelected(0) {}
 };
 
 /** Run the miner threads */
 void GenerateBitcoins(bool fGenerate, int nThreads, const CChainParams& chainparams, CConnman& connman);
+/** Recent hashes per second of every miner thread, empty if the miner is off */
+std::vector<double> GetMinerHashesPerSec();
 /** Generate a new block, without valid proof-of-work */
 CBlockTemplate* CreateNewBlock(const CChainParams& chainparams, const CScript& scriptPubKeyIn);
+/**
+ * Add the transaction packages which entered the mempool since pblocktemplate
+ * was created or last updated. Returns false if the template has to be
+ * created again instead, because the tip changed or a selected transaction
+ * left the mempool.
+ */
+bool UpdateBlockTemplate(const CChainParams& chainparams, CBlockTemplate* pblocktemplate);
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
@@ -34,6 +34,10 @@
 #include <fcntl.h>
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -50,6 +54,9 @@
 // We add a random period time (0 to 1 seconds) to feeler connections to prevent synchronization.
 #define FEELER_SLEEP_WINDOW 1
 
+// How long to wait for socket events, nodes are checked for timeouts at least this often
+#define SOCKET_EVENTS_TIMEOUT_MS 50
+
 #if !defined(HAVE_MSG_NOSIGNAL) && !defined(MSG_NOSIGNAL)
 #define MSG_NOSIGNAL 0
 #endif
@@ -384,7 +391,8 @@ CNode* CConnman::ConnectNode(CAddress addrConnect, const char *pszDest, bool fCo
     if (pszDest ? ConnectSocketByName(addrConnect, hSocket, pszDest, Params().GetDefaultPort(), nConnectTimeout, &proxyConnectionFailed) :
                   ConnectSocket(addrConnect, hSocket, nConnectTimeout, &proxyConnectionFailed))
     {
-        if (!IsSelectableSocket(hSocket)) {
+        // Only select() is limited to sockets below FD_SETSIZE
+        if (socketEventsMode == SOCKETEVENTS_SELECT && !IsSelectableSocket(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
             return NULL;
@@ -415,6 +423,11 @@ CNode* CConnman::ConnectNode(CAddress addrConnect, const char *pszDest, bool fCo
 
         addrman.Attempt(addrConnect);
 
+        if (!RegisterSocketEvents(hSocket)) {
+            CloseSocket(hSocket);
+            return NULL;
+        }
+
         // Add node
         CNode* pnode = new CNode(GetNewNodeId(), nLocalServices, GetBestHeight(), hSocket, addrConnect, pszDest ? pszDest : "", false, true);
 
@@ -829,9 +842,11 @@ size_t CConnman::SocketSendData(CNode *pnode)
                 it++;
             } else {
                 // could not send full message; stop sending more
+                pnode->fCanSendData = false;
                 break;
             }
         } else {
+            pnode->fCanSendData = false;
             if (nBytes < 0) {
                 // error
                 int nErr = WSAGetLastError();
@@ -1054,7 +1069,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
         return;
     }
 
-    if (!IsSelectableSocket(hSocket))
+    if (socketEventsMode == SOCKETEVENTS_SELECT && !IsSelectableSocket(hSocket))
     {
         LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
         CloseSocket(hSocket);
@@ -1094,6 +1109,11 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
         return;
     }
 
+    if (!RegisterSocketEvents(hSocket)) {
+        CloseSocket(hSocket);
+        return;
+    }
+
     CNode* pnode = new CNode(GetNewNodeId(), nLocalServices, GetBestHeight(), hSocket, addr, "", true);
     pnode->fWhitelisted = whitelisted;
     GetNodeSignals().InitializeNode(pnode, *this);
@@ -1106,9 +1126,203 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
     }
 }
 
+bool CConnman::RegisterSocketEvents(SOCKET hSocket, bool fListenSocket)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (socketEventsMode == SOCKETEVENTS_EPOLL) {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        // Listen sockets stay level-triggered, we accept one connection per
+        // iteration and want to hear about the rest on the next one.
+        event.events = fListenSocket ? EPOLLIN : (EPOLLIN | EPOLLOUT | EPOLLET);
+        event.data.fd = hSocket;
+        if (epoll_ctl(epollfd, EPOLL_CTL_ADD, hSocket, &event) != 0) {
+            LogPrintf("%s -- epoll_ctl failed for socket %d: %s\n", __func__, hSocket, NetworkErrorString(WSAGetLastError()));
+            return false;
+        }
+    }
+#endif
+    return true;
+}
+
+bool CConnman::SocketEventsSelect(std::set<SOCKET>& setListenReady, bool fOnlyPoll)
+{
+    struct timeval timeout;
+    timeout.tv_sec  = 0;
+    timeout.tv_usec = fOnlyPoll ? 0 : SOCKET_EVENTS_TIMEOUT_MS * 1000; // frequency to poll pnode->vSend
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+
+    BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+        FD_SET(hListenSocket.socket, &fdsetRecv);
+        hSocketMax = std::max(hSocketMax, hListenSocket.socket);
+        have_fds = true;
+    }
+
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes)
+        {
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+            FD_SET(pnode->hSocket, &fdsetError);
+            hSocketMax = std::max(hSocketMax, pnode->hSocket);
+            have_fds = true;
+
+            // Implement the following logic:
+            // * If there is data to send, select() for sending data. As this only
+            //   happens when optimistic write failed, we choose to first drain the
+            //   write buffer in this case before receiving more. This avoids
+            //   needlessly queueing received data, if the remote peer is not themselves
+            //   receiving data. This means properly utilizing TCP flow control signalling.
+            // * Otherwise, if there is space left in the receive buffer, select() for
+            //   receiving data.
+            // * Hand off all complete messages to the processor, to be handled without
+            //   blocking here.
+            {
+                TRY_LOCK(pnode->cs_vSend, lockSend);
+                if (lockSend) {
+                    if (!pnode->vSendMsg.empty()) {
+                        FD_SET(pnode->hSocket, &fdsetSend);
+                        continue;
+                    }
+                }
+            }
+            {
+                if (!pnode->fPauseRecv)
+                    FD_SET(pnode->hSocket, &fdsetRecv);
+            }
+        }
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                         &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    if (interruptNet)
+        return false;
+
+    if (nSelect == SOCKET_ERROR)
+    {
+        if (have_fds)
+        {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            for (unsigned int i = 0; i <= hSocketMax; i++)
+                FD_SET(i, &fdsetRecv);
+        }
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        if (!interruptNet.sleep_for(std::chrono::milliseconds(SOCKET_EVENTS_TIMEOUT_MS)))
+            return false;
+    }
+
+    BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+        if (FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            setListenReady.insert(hListenSocket.socket);
+    }
+
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes)
+        {
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+            pnode->fHasRecvData = FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError);
+            pnode->fCanSendData = FD_ISSET(pnode->hSocket, &fdsetSend);
+        }
+    }
+
+    return true;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+bool CConnman::SocketEventsEpoll(std::set<SOCKET>& setListenReady, bool fOnlyPoll)
+{
+    const size_t maxEvents = 64;
+    epoll_event events[maxEvents];
+
+    int nEvents = epoll_wait(epollfd, events, maxEvents, fOnlyPoll ? 0 : SOCKET_EVENTS_TIMEOUT_MS);
+    if (interruptNet)
+        return false;
+
+    if (nEvents < 0) {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR)
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(nErr));
+        if (!interruptNet.sleep_for(std::chrono::milliseconds(SOCKET_EVENTS_TIMEOUT_MS)))
+            return false;
+        return true;
+    }
+
+    // Readiness is edge-triggered for nodes, so it is remembered in the node
+    // until recv() or send() reports that the socket ran dry.
+    std::map<SOCKET, uint32_t> mapNodeEvents;
+    for (int i = 0; i < nEvents; i++) {
+        SOCKET hSocket = events[i].data.fd;
+        bool fListenSocket = false;
+        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+            if (hListenSocket.socket == hSocket) {
+                fListenSocket = true;
+                break;
+            }
+        }
+        if (fListenSocket) {
+            if (events[i].events & EPOLLIN)
+                setListenReady.insert(hSocket);
+        } else {
+            mapNodeEvents[hSocket] |= events[i].events;
+        }
+    }
+
+    if (mapNodeEvents.empty())
+        return true;
+
+    std::vector<CNode*> vNodesCanSend;
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes)
+        {
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+            std::map<SOCKET, uint32_t>::const_iterator it = mapNodeEvents.find(pnode->hSocket);
+            if (it == mapNodeEvents.end())
+                continue;
+            if (it->second & (EPOLLIN | EPOLLERR | EPOLLHUP))
+                pnode->fHasRecvData = true;
+            if (it->second & EPOLLOUT) {
+                pnode->AddRef();
+                vNodesCanSend.push_back(pnode);
+            }
+        }
+    }
+
+    // fCanSendData is cleared by SocketSendData under cs_vSend, set it under
+    // the same lock so a concurrent partial send can't lose this edge.
+    BOOST_FOREACH(CNode* pnode, vNodesCanSend)
+    {
+        {
+            LOCK(pnode->cs_vSend);
+            pnode->fCanSendData = true;
+        }
+        pnode->Release();
+    }
+
+    return true;
+}
+#endif
+
 void CConnman::ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+    // Set when a node has more data to read than fit into one recv(), to look
+    // for new events without waiting
+    bool fOnlyPoll = false;
     while (!interruptNet)
     {
         //
@@ -1184,87 +1398,23 @@ void CConnman::ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
-        {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH(CNode* pnode, vNodes)
-            {
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is space left in the receive buffer, select() for
-                //   receiving data.
-                // * Hand off all complete messages to the processor, to be handled without
-                //   blocking here.
-                {
-                    TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend) {
-                        if (!pnode->vSendMsg.empty()) {
-                            FD_SET(pnode->hSocket, &fdsetSend);
-                            continue;
-                        }
-                    }
-                }
-                {
-                    if (!pnode->fPauseRecv)
-                        FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
-        }
-
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
-        if (interruptNet)
+        std::set<SOCKET> setListenReady;
+        bool fEventsOk;
+#ifdef HAVE_SYS_EPOLL_H
+        if (socketEventsMode == SOCKETEVENTS_EPOLL)
+            fEventsOk = SocketEventsEpoll(setListenReady, fOnlyPoll);
+        else
+#endif
+            fEventsOk = SocketEventsSelect(setListenReady, fOnlyPoll);
+        if (!fEventsOk)
             return;
 
-        if (nSelect == SOCKET_ERROR)
-        {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            if (!interruptNet.sleep_for(std::chrono::milliseconds(timeout.tv_usec/1000)))
-                return;
-        }
-
         //
         // Accept new connections
         //
         BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            if (hListenSocket.socket != INVALID_SOCKET && setListenReady.count(hListenSocket.socket))
             {
                 AcceptConnection(hListenSocket);
             }
@@ -1273,6 +1423,7 @@ void CConnman::ThreadSocketHandler()
         //
         // Service each socket
         //
+        fOnlyPoll = false;
         std::vector<CNode*> vNodesCopy = CopyNodeVector();
         BOOST_FOREACH(CNode* pnode, vNodesCopy)
         {
@@ -1284,7 +1435,21 @@ void CConnman::ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError))
+            bool fDoRecv = pnode->fHasRecvData;
+            if (fDoRecv && socketEventsMode == SOCKETEVENTS_EPOLL) {
+                // Readiness is remembered across iterations, apply the same
+                // policy SocketEventsSelect applies when building its fd sets:
+                // leave data in the socket while the process queue is full and
+                // drain the write buffer before receiving more.
+                if (pnode->fPauseRecv) {
+                    fDoRecv = false;
+                } else {
+                    TRY_LOCK(pnode->cs_vSend, lockSend);
+                    if (lockSend && !pnode->vSendMsg.empty())
+                        fDoRecv = false;
+                }
+            }
+            if (fDoRecv)
             {
                 {
                     {
@@ -1293,6 +1458,12 @@ void CConnman::ThreadSocketHandler()
                         int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
                         if (nBytes > 0)
                         {
+                            // a full buffer means there may be more to read, an edge-triggered
+                            // backend won't report it again
+                            if (nBytes < (int)sizeof(pchBuf))
+                                pnode->fHasRecvData = false;
+                            else
+                                fOnlyPoll = true;
                             bool notify = false;
                             if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
                                 pnode->CloseSocketDisconnect();
@@ -1325,6 +1496,8 @@ void CConnman::ThreadSocketHandler()
                         {
                             // error
                             int nErr = WSAGetLastError();
+                            if (nErr == WSAEWOULDBLOCK)
+                                pnode->fHasRecvData = false;
                             if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
                             {
                                 if (!pnode->fDisconnect)
@@ -1341,7 +1514,7 @@ void CConnman::ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend))
+            if (pnode->fCanSendData)
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend) {
@@ -2146,6 +2319,8 @@ CConnman::CConnman()
     nBestHeight = 0;
     clientInterface = NULL;
     flagInterruptMsgProc = false;
+    socketEventsMode = SOCKETEVENTS_SELECT;
+    epollfd = -1;
 }
 
 NodeId CConnman::GetNewNodeId()
@@ -2173,6 +2348,23 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
 
     SetBestHeight(connOptions.nBestHeight);
 
+    socketEventsMode = connOptions.socketEventsMode;
+#ifdef HAVE_SYS_EPOLL_H
+    if (socketEventsMode == SOCKETEVENTS_EPOLL) {
+        epollfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollfd == -1) {
+            strNodeError = strprintf("epoll_create1 failed: %s", NetworkErrorString(WSAGetLastError()));
+            return false;
+        }
+        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+            if (!RegisterSocketEvents(hListenSocket.socket, true)) {
+                strNodeError = _("Failed to register listen socket for socket events");
+                return false;
+            }
+        }
+    }
+#endif
+
     clientInterface = connOptions.uiInterface;
     if (clientInterface)
         clientInterface->InitMessage(_("Loading addresses..."));
@@ -2347,6 +2539,12 @@ void CConnman::Stop()
     vNodes.clear();
     vNodesDisconnected.clear();
     vhListenSocket.clear();
+#ifdef HAVE_SYS_EPOLL_H
+    if (epollfd != -1) {
+        close(epollfd);
+        epollfd = -1;
+    }
+#endif
     delete semOutbound;
     semOutbound = NULL;
     delete semMasternodeOutbound;
@@ -2716,6 +2914,8 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     nLocalServices = nLocalServicesIn;
     fPauseRecv = false;
     fPauseSend = false;
+    fHasRecvData = false;
+    fCanSendData = true;
     nProcessQueueSize = 0;
 
     GetRandBytes((unsigned char*)&nLocalHostNonce, sizeof(nLocalHostNonce));
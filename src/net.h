@@ -22,6 +22,7 @@
 
 #include <atomic>
 #include <deque>
+#include <set>
 #include <stdint.h>
 #include <thread>
 #include <memory>
@@ -86,6 +87,18 @@ static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
 
+/** How sockets are polled for readiness, see -socketevents */
+enum SocketEventsMode {
+    SOCKETEVENTS_SELECT = 0,
+    SOCKETEVENTS_EPOLL = 1,
+};
+/** -socketevents default */
+#ifdef HAVE_SYS_EPOLL_H
+static const char* const DEFAULT_SOCKETEVENTS = "epoll";
+#else
+static const char* const DEFAULT_SOCKETEVENTS = "select";
+#endif
+
 static const ServiceFlags REQUIRED_SERVICES = NODE_NETWORK;
 
 // NOTE: When adjusting this, update rpcnet:setban's help ("24h")
@@ -127,6 +140,7 @@ public:
         CClientUIInterface* uiInterface = nullptr;
         unsigned int nSendBufferMaxSize = 0;
         unsigned int nReceiveFloodSize = 0;
+        SocketEventsMode socketEventsMode = SOCKETEVENTS_SELECT;
     };
     CConnman();
     ~CConnman();
@@ -401,6 +415,13 @@ private:
     void ThreadMessageHandler();
     void AcceptConnection(const ListenSocket& hListenSocket);
     void ThreadSocketHandler();
+
+    // Wait for socket readiness and mark ready nodes, returns false if interrupted
+    bool SocketEventsSelect(std::set<SOCKET>& setListenReady, bool fOnlyPoll);
+#ifdef HAVE_SYS_EPOLL_H
+    bool SocketEventsEpoll(std::set<SOCKET>& setListenReady, bool fOnlyPoll);
+#endif
+    bool RegisterSocketEvents(SOCKET hSocket, bool fListenSocket = false);
     void ThreadDNSAddressSeed();
     void ThreadMnbRequestConnections();
 
@@ -461,6 +482,8 @@ private:
     unsigned int nReceiveFloodSize;
 
     std::vector<ListenSocket> vhListenSocket;
+    SocketEventsMode socketEventsMode;
+    int epollfd;
     bool fNetworkActive;
     banmap_t setBanned;
     CCriticalSection cs_setBanned;
@@ -719,6 +742,10 @@ public:
 
     std::atomic_bool fPauseRecv;
     std::atomic_bool fPauseSend;
+    // Socket readiness as last reported by the socket events backend. With
+    // edge-triggered epoll these stay set until a recv/send would block.
+    std::atomic_bool fHasRecvData;
+    std::atomic_bool fCanSendData; // only cleared while holding cs_vSend
 protected:
 
     mapMsgCmdSize mapSendBytesPerMsgCmd;
@@ -15,6 +15,25 @@ uint256 CBlockHeader::GetHash() const
     return HashX11(BEGIN(nVersion), END(nNonce));
 }
 
+void GetBlockHeaderHashes(const CBlockHeader* pheaders, size_t nCount, uint256* phashes)
+{
+    if (nCount == 0)
+        return;
+    // Headers are hashed straight from memory like GetHash() does, so each
+    // one spans nVersion..nNonce and consecutive ones are sizeof(CBlockHeader) apart.
+    const unsigned char* pbegin = (const unsigned char*)BEGIN(pheaders->nVersion);
+    const size_t nLen = END(pheaders->nNonce) - BEGIN(pheaders->nVersion);
+    HashX11Batch(pbegin, nLen, sizeof(CBlockHeader), nCount, phashes);
+}
+
+std::vector<uint256> GetBlockHeaderHashes(const std::vector<CBlockHeader>& vHeaders)
+{
+    std::vector<uint256> vHashes(vHeaders.size());
+    if (!vHeaders.empty())
+        GetBlockHeaderHashes(&vHeaders[0], vHeaders.size(), &vHashes[0]);
+    return vHashes;
+}
+
 std::string CBlock::ToString() const
 {
     std::stringstream s;
@@ -124,6 +124,10 @@ public:
     std::string ToString() const;
 };
 
+/** Compute the hashes of a run of headers at once, see HashX11Batch */
+void GetBlockHeaderHashes(const CBlockHeader* pheaders, size_t nCount, uint256* phashes);
+std::vector<uint256> GetBlockHeaderHashes(const std::vector<CBlockHeader>& vHeaders);
+
 
 /** Describes a place in the block chain to another node such that if the
  * other node doesn't have the same branch, it can find a recent common trunk.
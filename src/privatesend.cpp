@@ -5,6 +5,7 @@
 #include "privatesend.h"
 
 #include "activemasternode.h"
+#include "cache-database.h"
 #include "consensus/validation.h"
 #include "governance.h"
 #include "init.h"
@@ -482,6 +483,10 @@ void ThreadCheckPrivateSend(CConnman& connman)
             if(nTick % (60 * 5) == 0) {
                 governance.DoMaintenance(connman);
             }
+
+            if(pcachedb && nTick % CACHEDB_CHECKPOINT_SECONDS == 0) {
+                WriteCacheDB(*pcachedb);
+            }
         }
     }
 }
@@ -204,6 +204,30 @@ bool CPubKey::RecoverCompact(const uint256 &hash, const std::vector<unsigned cha
     return true;
 }
 
+bool CPubKey::CheckRecoverCompact(const uint256 &hash, const std::vector<unsigned char>& vchSig) const {
+    if (!IsValid() || vchSig.size() != 65)
+        return false;
+    int recid = (vchSig[0] - 27) & 3;
+    bool fComp = ((vchSig[0] - 27) & 4) != 0;
+    // RecoverCompact would produce a key with this compression, which has to be us
+    if (fComp != IsCompressed())
+        return false;
+    secp256k1_pubkey pubkey;
+    secp256k1_ecdsa_recoverable_signature sig;
+    if (!secp256k1_ecdsa_recoverable_signature_parse_compact(secp256k1_context_verify, &sig, &vchSig[1], recid)) {
+        return false;
+    }
+    /* (r,s) alone is valid for this key with any recovery id, nodes which use
+     * RecoverCompact reject a recovery id that yields another key though */
+    if (!secp256k1_ecdsa_recover(secp256k1_context_verify, &pubkey, &sig, hash.begin())) {
+        return false;
+    }
+    unsigned char pub[65];
+    size_t publen = 65;
+    secp256k1_ec_pubkey_serialize(secp256k1_context_verify, pub, &publen, &pubkey, fComp ? SECP256K1_EC_COMPRESSED : SECP256K1_EC_UNCOMPRESSED);
+    return publen == size() && memcmp(pub, begin(), publen) == 0;
+}
+
 bool CPubKey::IsFullyValid() const {
     if (!IsValid())
         return false;
@@ -185,6 +185,13 @@ public:
     //! Recover a public key from a compact signature.
     bool RecoverCompact(const uint256& hash, const std::vector<unsigned char>& vchSig);
 
+    /**
+     * Check that RecoverCompact recovers this public key from a compact
+     * signature (65 bytes), i.e. the signature is valid and the compression
+     * flag and the recovery id of its header byte match this key.
+     */
+    bool CheckRecoverCompact(const uint256& hash, const std::vector<unsigned char>& vchSig) const;
+
     //! Turn this public key into an uncompressed public key.
     bool Decompress();
 
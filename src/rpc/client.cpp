@@ -81,6 +81,9 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "sendmany", 5 },
     { "sendmany", 6 },
     { "sendmany", 7 },
+    { "queuepayouts", 0 },
+    { "getpayout", 0 },
+    { "cancelpayout", 0 },
     { "addmultisigaddress", 0 },
     { "addmultisigaddress", 1 },
     { "createmultisig", 0 },
@@ -112,6 +115,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "importaddress", 2 },
     { "importaddress", 3 },
     { "importpubkey", 2 },
+    { "rescanblockchain", 0 },
+    { "rescanblockchain", 1 },
     { "verifychain", 0 },
     { "verifychain", 1 },
     { "keypoolrefill", 0 },
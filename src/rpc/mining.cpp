@@ -121,6 +121,27 @@ UniValue getgenerate(const UniValue& params, bool fHelp)
     return GetBoolArg("-gen", DEFAULT_GENERATE);
 }
 
+UniValue gethashespersec(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "gethashespersec\n"
+            "\nReturns a recent hashes per second performance measurement of the internal miner.\n"
+            "See the getgenerate and setgenerate calls to turn generation on and off.\n"
+            "\nResult:\n"
+            "n            (numeric) The recent hashes per second when generation is on (will return 0 if generation is off)\n"
+            "\nExamples:\n"
+            + HelpExampleCli("gethashespersec", "")
+            + HelpExampleRpc("gethashespersec", "")
+        );
+
+    std::vector<double> vHashesPerSec = GetMinerHashesPerSec();
+    double dHashesPerSec = 0;
+    BOOST_FOREACH(double dThreadHashesPerSec, vHashesPerSec)
+        dHashesPerSec += dThreadHashesPerSec;
+    return (int64_t)dHashesPerSec;
+}
+
 UniValue generate(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 1)
@@ -253,6 +274,8 @@ UniValue getmininginfo(const UniValue& params, bool fHelp)
             "  \"testnet\": true|false      (boolean) If using testnet or not\n"
             "  \"chain\": \"xxxx\",         (string) current network name as defined in BIP70 (main, test, regtest)\n"
             "  \"generate\": true|false     (boolean) If the generation is on or off (see getgenerate or setgenerate calls)\n"
+            "  \"hashespersec\": n          (numeric) The recent hashes per second of the internal miner, summed over its threads\n"
+            "  \"threadhashespersec\": [ n, ... ] (array) The recent hashes per second of each miner thread\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getmininginfo", "")
@@ -274,6 +297,16 @@ UniValue getmininginfo(const UniValue& params, bool fHelp)
     obj.push_back(Pair("testnet",          Params().TestnetToBeDeprecatedFieldRPC()));
     obj.push_back(Pair("chain",            Params().NetworkIDString()));
     obj.push_back(Pair("generate",         getgenerate(params, false)));
+
+    std::vector<double> vHashesPerSec = GetMinerHashesPerSec();
+    double dHashesPerSec = 0;
+    UniValue threadHashesPerSec(UniValue::VARR);
+    BOOST_FOREACH(double dThreadHashesPerSec, vHashesPerSec) {
+        dHashesPerSec += dThreadHashesPerSec;
+        threadHashesPerSec.push_back((int64_t)dThreadHashesPerSec);
+    }
+    obj.push_back(Pair("hashespersec",     (int64_t)dHashesPerSec));
+    obj.push_back(Pair("threadhashespersec", threadHashesPerSec));
     return obj;
 }
 
@@ -567,6 +600,16 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
     static CBlockIndex* pindexPrev;
     static int64_t nStart;
     static CBlockTemplate* pblocktemplate;
+    if (pindexPrev == chainActive.Tip() && mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart <= 5)
+    {
+        // Only add the transactions which arrived since, as long as everything
+        // selected before is still in the mempool
+        unsigned int nTransactionsUpdatedNew = mempool.GetTransactionsUpdated();
+        if (UpdateBlockTemplate(Params(), pblocktemplate))
+            nTransactionsUpdatedLast = nTransactionsUpdatedNew;
+        else
+            pindexPrev = NULL;
+    }
     if (pindexPrev != chainActive.Tip() ||
         (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5))
     {
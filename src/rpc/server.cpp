@@ -306,6 +306,7 @@ static const CRPCCommand vRPCCommands[] =
     /* Coin generation */
     { "generating",         "getgenerate",            &getgenerate,            true  },
     { "generating",         "setgenerate",            &setgenerate,            true  },
+    { "generating",         "gethashespersec",        &gethashespersec,        true  },
     { "generating",         "generate",               &generate,               true  },
 
     /* Raw transactions */
@@ -372,11 +373,14 @@ static const CRPCCommand vRPCCommands[] =
     { "wallet",             "getaddressesbyaccount",  &getaddressesbyaccount,  true  },
     { "wallet",             "getbalance",             &getbalance,             false },
     { "wallet",             "getnewaddress",          &getnewaddress,          true  },
+    { "wallet",             "getpayout",              &getpayout,              true  },
     { "wallet",             "getrawchangeaddress",    &getrawchangeaddress,    true  },
     { "wallet",             "getreceivedbyaccount",   &getreceivedbyaccount,   false },
     { "wallet",             "getreceivedbyaddress",   &getreceivedbyaddress,   false },
     { "wallet",             "gettransaction",         &gettransaction,         false },
     { "wallet",             "abandontransaction",     &abandontransaction,     false },
+    { "wallet",             "abortrescan",            &abortrescan,            true  },
+    { "wallet",             "cancelpayout",           &cancelpayout,           true  },
     { "wallet",             "getunconfirmedbalance",  &getunconfirmedbalance,  false },
     { "wallet",             "getwalletinfo",          &getwalletinfo,          false },
     { "wallet",             "importprivkey",          &importprivkey,          true  },
@@ -388,6 +392,7 @@ static const CRPCCommand vRPCCommands[] =
     { "wallet",             "listaccounts",           &listaccounts,           false },
     { "wallet",             "listaddressgroupings",   &listaddressgroupings,   false },
     { "wallet",             "listlockunspent",        &listlockunspent,        false },
+    { "wallet",             "listpayouts",            &listpayouts,            true  },
     { "wallet",             "listreceivedbyaccount",  &listreceivedbyaccount,  false },
     { "wallet",             "listreceivedbyaddress",  &listreceivedbyaddress,  false },
     { "wallet",             "listsinceblock",         &listsinceblock,         false },
@@ -395,8 +400,11 @@ static const CRPCCommand vRPCCommands[] =
     { "wallet",             "listunspent",            &listunspent,            false },
     { "wallet",             "lockunspent",            &lockunspent,            true  },
     { "wallet",             "move",                   &movecmd,                false },
+    { "wallet",             "queuepayouts",           &queuepayouts,           true  },
+    { "wallet",             "rescanblockchain",       &rescanblockchain,       true  },
     { "wallet",             "sendfrom",               &sendfrom,               false },
     { "wallet",             "sendmany",               &sendmany,               false },
+    { "wallet",             "sendpayouts",            &sendpayouts,            false },
     { "wallet",             "sendtoaddress",          &sendtoaddress,          false },
     { "wallet",             "setaccount",             &setaccount,             true  },
     { "wallet",             "settxfee",               &settxfee,               true  },
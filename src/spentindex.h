@@ -235,6 +235,70 @@ struct CAddressUnspentValue {
     }
 };
 
+/** Running totals of all address index deltas for one address */
+struct CAddressBalanceValue {
+    CAmount balance;
+    CAmount received;
+    int txCount;
+    int utxoCount;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(balance);
+        READWRITE(received);
+        READWRITE(txCount);
+        READWRITE(utxoCount);
+    }
+
+    CAddressBalanceValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        balance = 0;
+        received = 0;
+        txCount = 0;
+        utxoCount = 0;
+    }
+
+    bool IsNull() const {
+        return (balance == 0 && received == 0 && txCount == 0 && utxoCount == 0);
+    }
+};
+
+/** The blocks counted by the address balance index, kept in a single record */
+struct CAddressBalanceBest {
+    uint256 hashBlock;  // last block connected on top of the chain, all blocks up to it are counted
+    int nBuildHeight;   // except the ones from nBuildHeight up to nLiveHeight which
+    int nLiveHeight;    // the index builder didn't get to yet
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(hashBlock);
+        READWRITE(nBuildHeight);
+        READWRITE(nLiveHeight);
+    }
+
+    CAddressBalanceBest() {
+        SetNull();
+    }
+
+    void SetNull() {
+        hashBlock.SetNull();
+        nBuildHeight = 0;
+        nLiveHeight = 0;
+    }
+
+    /** Whether a block of the chain up to hashBlock at this height is counted */
+    bool IsCounted(int nBlockHeight) const {
+        return nBlockHeight < nBuildHeight || nBlockHeight >= nLiveHeight;
+    }
+};
+
 struct CAddressIndexKey {
     unsigned int type;
     uint160 hashBytes;
@@ -369,5 +433,22 @@ struct CAddressIndexIteratorHeightKey {
     }
 };
 
+/** Address type and hash of a P2SH (2) or P2PKH (1) script, type 0 and a null hash for anything else */
+inline bool GetIndexAddress(const CScript& script, int& typeRet, uint160& hashRet)
+{
+    if (script.IsPayToScriptHash()) {
+        hashRet = uint160(std::vector<unsigned char>(script.begin()+2, script.begin()+22));
+        typeRet = 2;
+        return true;
+    }
+    if (script.IsPayToPublicKeyHash()) {
+        hashRet = uint160(std::vector<unsigned char>(script.begin()+3, script.begin()+23));
+        typeRet = 1;
+        return true;
+    }
+    hashRet.SetNull();
+    typeRet = 0;
+    return false;
+}
 
 #endif // BITCOIN_SPENTINDEX_H
@@ -341,6 +341,58 @@ public:
 
 
 
+/** Minimal stream for deserializing straight out of a read-only memory range,
+ *  e.g. a memory mapped file, without copying it into a CDataStream first.
+ *  The range must outlive the reader.
+ */
+class CSpanReader
+{
+private:
+    int nType;
+    int nVersion;
+
+    const char* pcur;
+    const char* pend;
+
+public:
+    CSpanReader(const unsigned char* pbegin, size_t nSize, int nTypeIn, int nVersionIn) :
+        nType(nTypeIn), nVersion(nVersionIn), pcur((const char*)pbegin), pend((const char*)pbegin + nSize) {}
+
+    //
+    // Stream subset
+    //
+    int GetType()                { return nType; }
+    int GetVersion()             { return nVersion; }
+
+    size_t size() const          { return pend - pcur; }
+    bool empty() const           { return pcur == pend; }
+
+    CSpanReader& read(char* pch, size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CSpanReader::read: end of data");
+        memcpy(pch, pcur, nSize);
+        pcur += nSize;
+        return (*this);
+    }
+
+    CSpanReader& ignore(size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CSpanReader::ignore: end of data");
+        pcur += nSize;
+        return (*this);
+    }
+
+    template<typename T>
+    CSpanReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
 /** Non-refcounted RAII wrapper for FILE*
  *
  * Will automatically close the file when it goes out of scope if not null.
@@ -0,0 +1,146 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chain.h"
+#include "random.h"
+#include "spentindex.h"
+#include "txdb.h"
+
+#include "test/test_square.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addressbalance_tests, BasicTestingSetup)
+
+static const uint160 hashAddress = uint160(std::vector<unsigned char>(20, 1));
+
+// A chain of block indexes with random hashes, branching off pindexFork
+struct TestChain {
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex> vBlocks;
+
+    TestChain(int nBlocks, const CBlockIndex* pindexFork = NULL) : vHashes(nBlocks), vBlocks(nBlocks) {
+        int nHeight = pindexFork ? pindexFork->nHeight + 1 : 0;
+        for (int i = 0; i < nBlocks; i++) {
+            vHashes[i] = GetRandHash();
+            vBlocks[i].phashBlock = &vHashes[i];
+            vBlocks[i].nHeight = nHeight + i;
+            vBlocks[i].pprev = i > 0 ? &vBlocks[i - 1] : const_cast<CBlockIndex*>(pindexFork);
+        }
+    }
+
+    const CBlockIndex* operator[](int nHeight) const {
+        return &vBlocks[nHeight - vBlocks[0].nHeight];
+    }
+};
+
+// A block paying nValue to the address in its coinbase
+static std::vector<std::pair<CAddressIndexKey, CAmount> > Deltas(const CBlockIndex* pindex, CAmount nValue)
+{
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vect;
+    vect.push_back(std::make_pair(CAddressIndexKey(1, hashAddress, pindex->nHeight, 0, pindex->GetBlockHash(), 0, false), nValue));
+    return vect;
+}
+
+static CAmount GetBalance(CBlockTreeDB& blocktree)
+{
+    CAddressBalanceValue value;
+    if (!blocktree.ReadAddressBalance(hashAddress, 1, value))
+        return 0;
+    return value.balance;
+}
+
+BOOST_AUTO_TEST_CASE(connect_disconnect_replay)
+{
+    CBlockTreeDB blocktree(1 << 20, true);
+    TestChain chain(4);
+
+    // the genesis block isn't connected
+    BOOST_CHECK(blocktree.WriteAddressIndex(Deltas(chain[1], 10), chain[1]));
+    BOOST_CHECK(blocktree.WriteAddressIndex(Deltas(chain[2], 20), chain[2]));
+    BOOST_CHECK_EQUAL(GetBalance(blocktree), 30);
+
+    // connected again after an unclean shutdown
+    BOOST_CHECK(blocktree.WriteAddressIndex(Deltas(chain[1], 10), chain[1]));
+    BOOST_CHECK(blocktree.WriteAddressIndex(Deltas(chain[2], 20), chain[2]));
+    BOOST_CHECK_EQUAL(GetBalance(blocktree), 30);
+
+    BOOST_CHECK(blocktree.EraseAddressIndex(Deltas(chain[2], 20), chain[2]));
+    BOOST_CHECK_EQUAL(GetBalance(blocktree), 10);
+    // disconnected again
+    BOOST_CHECK(blocktree.EraseAddressIndex(Deltas(chain[2], 20), chain[2]));
+    BOOST_CHECK_EQUAL(GetBalance(blocktree), 10);
+
+    // a block without deltas for the address moves the best block too
+    BOOST_CHECK(blocktree.WriteAddressIndex(std::vector<std::pair<CAddressIndexKey, CAmount> >(), chain[2]));
+    BOOST_CHECK(blocktree.WriteAddressIndex(Deltas(chain[3], 5), chain[3]));
+    BOOST_CHECK_EQUAL(GetBalance(blocktree), 15);
+}
+
+BOOST_AUTO_TEST_CASE(reorg_replay)
+{
+    CBlockTreeDB blocktree(1 << 20, true);
+    TestChain chainA(4);
+    TestChain chainB(3, chainA[1]);
+
+    for (int i = 1; i <= 3; i++)
+        BOOST_CHECK(blocktree.WriteAddressIndex(Deltas(chainA[i], 1), chainA[i]));
+    BOOST_CHECK_EQUAL(GetBalance(blocktree), 3);
+
+    // reorg to branch B, which has blocks at the same heights
+    BOOST_CHECK(blocktree.EraseAddressIndex(Deltas(chainA[3], 1), chainA[3]));
+    BOOST_CHECK(blocktree.EraseAddressIndex(Deltas(chainA[2], 1), chainA[2]));
+    BOOST_CHECK(blocktree.WriteAddressIndex(Deltas(chainB[2], 100), chainB[2]));
+    BOOST_CHECK(blocktree.WriteAddressIndex(Deltas(chainB[3], 100), chainB[3]));
+    BOOST_CHECK_EQUAL(GetBalance(blocktree), 201);
+
+    // crash before the chainstate was flushed: on restart the coins are still
+    // at A3, so the reorg is replayed from there
+    BOOST_CHECK(blocktree.EraseAddressIndex(Deltas(chainA[3], 1), chainA[3]));
+    BOOST_CHECK(blocktree.EraseAddressIndex(Deltas(chainA[2], 1), chainA[2]));
+    BOOST_CHECK_EQUAL(GetBalance(blocktree), 201);
+    BOOST_CHECK(blocktree.WriteAddressIndex(Deltas(chainB[2], 100), chainB[2]));
+    BOOST_CHECK(blocktree.WriteAddressIndex(Deltas(chainB[3], 100), chainB[3]));
+    BOOST_CHECK_EQUAL(GetBalance(blocktree), 201);
+
+    // a block of branch A isn't taken back while B is counted
+    BOOST_CHECK(blocktree.EraseAddressIndex(Deltas(chainA[3], 1), chainA[3]));
+    BOOST_CHECK_EQUAL(GetBalance(blocktree), 201);
+
+    // and the chain goes on from B
+    BOOST_CHECK(blocktree.WriteAddressIndex(Deltas(chainB[4], 1000), chainB[4]));
+    BOOST_CHECK_EQUAL(GetBalance(blocktree), 1201);
+    BOOST_CHECK(blocktree.EraseAddressIndex(Deltas(chainB[4], 1000), chainB[4]));
+    BOOST_CHECK(blocktree.EraseAddressIndex(Deltas(chainB[3], 100), chainB[3]));
+    BOOST_CHECK(blocktree.EraseAddressIndex(Deltas(chainB[2], 100), chainB[2]));
+    BOOST_CHECK_EQUAL(GetBalance(blocktree), 1);
+}
+
+BOOST_AUTO_TEST_CASE(index_builder)
+{
+    CBlockTreeDB blocktree(1 << 20, true);
+    TestChain chain(4);
+
+    // the builder indexes the blocks below height 3 while block 3 is connected
+    BOOST_CHECK(blocktree.ResetAddressBalanceIndex(chain[2], 3));
+    BOOST_CHECK(blocktree.WriteAddressIndex(Deltas(chain[3], 1), chain[3]));
+    BOOST_CHECK(blocktree.WriteAddressIndex(Deltas(chain[1], 10), chain[1], true));
+    BOOST_CHECK_EQUAL(GetBalance(blocktree), 11);
+
+    // blocks which weren't built yet are skipped when they are disconnected
+    BOOST_CHECK(blocktree.EraseAddressIndex(Deltas(chain[3], 1), chain[3]));
+    BOOST_CHECK(blocktree.EraseAddressIndex(Deltas(chain[2], 20), chain[2]));
+    BOOST_CHECK_EQUAL(GetBalance(blocktree), 10);
+
+    // built blocks aren't counted twice when the build starts over
+    BOOST_CHECK(blocktree.WriteAddressIndex(Deltas(chain[1], 10), chain[1], true));
+    BOOST_CHECK_EQUAL(GetBalance(blocktree), 10);
+    BOOST_CHECK(blocktree.WriteAddressIndex(Deltas(chain[2], 20), chain[2]));
+    BOOST_CHECK_EQUAL(GetBalance(blocktree), 30);
+
+    BOOST_CHECK(blocktree.ResetAddressBalanceIndex(chain[2], 3));
+    BOOST_CHECK_EQUAL(GetBalance(blocktree), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
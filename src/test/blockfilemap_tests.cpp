@@ -0,0 +1,133 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+#include "chainparams.h"
+#include "consensus/merkle.h"
+#include "pow.h"
+#include "random.h"
+#include "streams.h"
+#include "validation.h"
+
+#include "test/test_square.h"
+
+#include <boost/test/unit_test.hpp>
+
+struct BlockFileMapSetup : public TestingSetup {
+    BlockFileMapSetup() : TestingSetup(CBaseChainParams::REGTEST) {}
+    ~BlockFileMapSetup() { fBlockMmap = DEFAULT_BLOCK_MMAP; }
+};
+
+BOOST_FIXTURE_TEST_SUITE(blockfilemap_tests, BlockFileMapSetup)
+
+static CBlock CreateTestBlock(int nTxs)
+{
+    CBlock block;
+    block.nVersion = 42;
+    block.hashPrevBlock = GetRandHash();
+    block.nTime = GetTime();
+    block.nBits = 0x207fffff;
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << nTxs << OP_0;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42;
+    block.vtx.push_back(tx);
+    for (int i = 0; i < nTxs; i++) {
+        tx.vin[0].prevout = COutPoint(GetRandHash(), i);
+        block.vtx.push_back(tx);
+    }
+
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    while (!CheckProofOfWork(block.GetHash(), block.nBits, Params().GetConsensus())) ++block.nNonce;
+    return block;
+}
+
+static std::vector<unsigned char> SerializeBlock(const CBlock& block)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
+    return std::vector<unsigned char>(ss.begin(), ss.end());
+}
+
+static CDiskBlockPos WriteTestBlock(const CBlock& block, const CDiskBlockPos& posEnd)
+{
+    CDiskBlockPos pos(posEnd);
+    BOOST_CHECK(WriteBlockToDisk(block, pos, Params().MessageStart()));
+    return pos;
+}
+
+BOOST_AUTO_TEST_CASE(span_reader)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << uint32_t(42) << std::string("square");
+    std::vector<unsigned char> vch(ss.begin(), ss.end());
+
+    CSpanReader reader(vch.data(), vch.size(), SER_DISK, CLIENT_VERSION);
+    uint32_t n;
+    std::string str;
+    reader >> n >> str;
+    BOOST_CHECK_EQUAL(n, 42);
+    BOOST_CHECK_EQUAL(str, "square");
+    BOOST_CHECK(reader.empty());
+    BOOST_CHECK_THROW(reader >> n, std::ios_base::failure);
+
+    // a truncated range must not be read past
+    CSpanReader readerShort(vch.data(), vch.size() - 1, SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK_THROW(readerShort >> n >> str, std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(read_block_mapped_and_stdio)
+{
+    // block file 1 isn't used by the test chain
+    CBlock block1 = CreateTestBlock(10), block2 = CreateTestBlock(100);
+    CDiskBlockPos pos1 = WriteTestBlock(block1, CDiskBlockPos(1, 0));
+    unsigned int nSize1 = ::GetSerializeSize(block1, SER_DISK, CLIENT_VERSION);
+    CDiskBlockPos pos2 = WriteTestBlock(block2, CDiskBlockPos(1, pos1.nPos + nSize1));
+
+    for (bool fMmap : {true, false}) {
+        fBlockMmap = fMmap;
+
+        CBlock blockRead;
+        BOOST_CHECK(ReadBlockFromDisk(blockRead, pos1, Params().GetConsensus()));
+        BOOST_CHECK(blockRead.GetHash() == block1.GetHash());
+        BOOST_CHECK(ReadBlockFromDisk(blockRead, pos2, Params().GetConsensus()));
+        BOOST_CHECK(blockRead.GetHash() == block2.GetHash());
+        BOOST_CHECK_EQUAL(blockRead.vtx.size(), 101);
+
+        std::vector<unsigned char> vchBlock;
+        BOOST_CHECK(ReadRawBlockFromDisk(vchBlock, pos2));
+        BOOST_CHECK(vchBlock == SerializeBlock(block2));
+
+        // positions which don't point at a block record are rejected
+        BOOST_CHECK(!ReadRawBlockFromDisk(vchBlock, CDiskBlockPos(1, pos2.nPos + 1)));
+        BOOST_CHECK(!ReadRawBlockFromDisk(vchBlock, CDiskBlockPos(1, 4)));
+        BOOST_CHECK(!ReadBlockFromDisk(blockRead, CDiskBlockPos(1, pos2.nPos + 1), Params().GetConsensus()));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(read_block_after_file_grew)
+{
+    fBlockMmap = true;
+
+    CBlock block1 = CreateTestBlock(10), block2 = CreateTestBlock(1000);
+    CDiskBlockPos pos1 = WriteTestBlock(block1, CDiskBlockPos(1, 0));
+    unsigned int nSize1 = ::GetSerializeSize(block1, SER_DISK, CLIENT_VERSION);
+
+    // map the file while it only holds the first block
+    CBlock blockRead;
+    BOOST_CHECK(ReadBlockFromDisk(blockRead, pos1, Params().GetConsensus()));
+
+    // the second block lies beyond the current mapping
+    CDiskBlockPos pos2 = WriteTestBlock(block2, CDiskBlockPos(1, pos1.nPos + nSize1));
+    BOOST_CHECK(ReadBlockFromDisk(blockRead, pos2, Params().GetConsensus()));
+    BOOST_CHECK(blockRead.GetHash() == block2.GetHash());
+
+    std::vector<unsigned char> vchBlock;
+    BOOST_CHECK(ReadRawBlockFromDisk(vchBlock, pos2));
+    BOOST_CHECK(vchBlock == SerializeBlock(block2));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
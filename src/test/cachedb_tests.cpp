@@ -0,0 +1,111 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cache-database.h"
+#include "random.h"
+
+#include "test/test_square.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(cachedb_tests, TestingSetup)
+
+static const char DB_TEST_MAP = 't';
+static const char DB_TEST_MAP_OTHER = 'u';
+static const char DB_TEST_VALUE = 'T';
+
+BOOST_AUTO_TEST_CASE(checkpoints)
+{
+    std::map<uint256, int64_t> mapTest, mapOther, mapRead;
+    for (int i = 0; i < 10; i++)
+        mapTest[GetRandHash()] = i;
+    mapOther[GetRandHash()] = 100;
+    mapOther[GetRandHash()] = 101;
+
+    {
+        CCacheDB cachedb(1 << 20, false, true);
+        BOOST_CHECK(cachedb.IsEmpty());
+
+        CCacheDBCheckpoint checkpoint(cachedb);
+        checkpoint.Write(DB_TEST_VALUE, std::string("test"));
+        checkpoint.WriteMap(DB_TEST_MAP, mapTest);
+        checkpoint.WriteMap(DB_TEST_MAP_OTHER, mapOther);
+        BOOST_CHECK_EQUAL(checkpoint.GetWriteCount(), 13);
+        BOOST_CHECK(checkpoint.Commit());
+        BOOST_CHECK_EQUAL(cachedb.GetRecordCount(), 13);
+
+        // nothing changed
+        CCacheDBCheckpoint checkpoint2(cachedb);
+        checkpoint2.Write(DB_TEST_VALUE, std::string("test"));
+        checkpoint2.WriteMap(DB_TEST_MAP, mapTest);
+        checkpoint2.WriteMap(DB_TEST_MAP_OTHER, mapOther);
+        BOOST_CHECK_EQUAL(checkpoint2.GetWriteCount(), 0);
+        BOOST_CHECK_EQUAL(checkpoint2.GetEraseCount(), 0);
+        BOOST_CHECK(checkpoint2.Commit());
+
+        // one entry changed, one removed and one added
+        mapTest.begin()->second = -1;
+        mapTest.erase(mapTest.rbegin()->first);
+        mapTest[GetRandHash()] = 10;
+        CCacheDBCheckpoint checkpoint3(cachedb);
+        checkpoint3.WriteMap(DB_TEST_MAP, mapTest);
+        BOOST_CHECK_EQUAL(checkpoint3.GetWriteCount(), 2);
+        BOOST_CHECK_EQUAL(checkpoint3.GetEraseCount(), 1);
+
+        // uncommitted checkpoints change nothing
+        CCacheDBCheckpoint checkpointDropped(cachedb);
+        checkpointDropped.WriteMap(DB_TEST_MAP_OTHER, std::map<uint256, int64_t>());
+        BOOST_CHECK_EQUAL(checkpointDropped.GetEraseCount(), 2);
+
+        BOOST_CHECK(checkpoint3.Commit());
+        BOOST_CHECK_EQUAL(cachedb.GetRecordCount(), 13);
+    }
+
+    {
+        CCacheDB cachedb(1 << 20);
+        BOOST_CHECK(!cachedb.IsEmpty());
+
+        std::string strValue;
+        BOOST_CHECK(cachedb.Read(DB_TEST_VALUE, strValue));
+        BOOST_CHECK_EQUAL(strValue, "test");
+        BOOST_CHECK(cachedb.ReadMap(DB_TEST_MAP, mapRead));
+        BOOST_CHECK(mapRead == mapTest);
+
+        // what was read doesn't have to be written again
+        CCacheDBCheckpoint checkpoint(cachedb);
+        checkpoint.WriteMap(DB_TEST_MAP, mapRead);
+        BOOST_CHECK_EQUAL(checkpoint.GetWriteCount(), 0);
+        // unread records are known and erased when their section is written
+        checkpoint.WriteMap(DB_TEST_MAP_OTHER, std::map<uint256, int64_t>());
+        BOOST_CHECK_EQUAL(checkpoint.GetEraseCount(), 2);
+        BOOST_CHECK(checkpoint.Commit());
+
+        BOOST_CHECK(cachedb.ReadMap(DB_TEST_MAP_OTHER, mapRead));
+        BOOST_CHECK(mapRead.empty());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(unreadable_records)
+{
+    std::map<uint256, std::string> mapTest;
+    mapTest[GetRandHash()] = "a";
+    mapTest[GetRandHash()] = "b";
+
+    CCacheDB cachedb(1 << 20, false, true);
+    CCacheDBCheckpoint checkpoint(cachedb);
+    checkpoint.WriteMap(DB_TEST_MAP, mapTest);
+    BOOST_CHECK(checkpoint.Commit());
+
+    // a string isn't a valid uint256
+    std::map<uint256, uint256> mapRead;
+    BOOST_CHECK(!cachedb.ReadMap(DB_TEST_MAP, mapRead));
+    BOOST_CHECK(mapRead.empty());
+
+    // and is replaced by the next checkpoint even though the values didn't change
+    CCacheDBCheckpoint checkpoint2(cachedb);
+    checkpoint2.WriteMap(DB_TEST_MAP, mapTest);
+    BOOST_CHECK_EQUAL(checkpoint2.GetWriteCount(), 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -661,6 +661,42 @@ BOOST_AUTO_TEST_CASE(ccoins_access)
     CheckAccessCoin(VALUE1, VALUE2, VALUE2, DIRTY|FRESH, DIRTY|FRESH);
 }
 
+void CheckPrefetchCoin(CAmount cache_value, CAmount prefetch_value, CAmount expected_value, char cache_flags, char expected_flags)
+{
+    SingleEntryCacheTest test(ABSENT, cache_value, cache_flags);
+    Coin coin;
+    SetCoinsValue(prefetch_value, coin);
+    test.cache.Prefetch(OUTPOINT, std::move(coin));
+    test.cache.SelfTest();
+
+    CAmount result_value;
+    char result_flags;
+    GetCoinsMapEntry(test.cache.map(), result_value, result_flags);
+    BOOST_CHECK_EQUAL(result_value, expected_value);
+    BOOST_CHECK_EQUAL(result_flags, expected_flags);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_prefetch)
+{
+    /* Check Prefetch behavior, adding a coin read from the base view out of band
+     * to a cache, and checking the resulting entry in the cache. Entries which
+     * are already cached must be left alone, new ones must not be DIRTY.
+     *
+     *                 Cache   Prefetch Result  Cache        Result
+     *                 Value   Value    Value   Flags        Flags
+     */
+    CheckPrefetchCoin(ABSENT, PRUNED, ABSENT, NO_ENTRY   , NO_ENTRY   );
+    CheckPrefetchCoin(ABSENT, VALUE1, VALUE1, NO_ENTRY   , 0          );
+    CheckPrefetchCoin(PRUNED, VALUE1, PRUNED, 0          , 0          );
+    CheckPrefetchCoin(PRUNED, VALUE1, PRUNED, FRESH      , FRESH      );
+    CheckPrefetchCoin(PRUNED, VALUE1, PRUNED, DIRTY      , DIRTY      );
+    CheckPrefetchCoin(PRUNED, VALUE1, PRUNED, DIRTY|FRESH, DIRTY|FRESH);
+    CheckPrefetchCoin(VALUE2, VALUE1, VALUE2, 0          , 0          );
+    CheckPrefetchCoin(VALUE2, VALUE1, VALUE2, FRESH      , FRESH      );
+    CheckPrefetchCoin(VALUE2, VALUE1, VALUE2, DIRTY      , DIRTY      );
+    CheckPrefetchCoin(VALUE2, VALUE1, VALUE2, DIRTY|FRESH, DIRTY|FRESH);
+}
+
 void CheckSpendCoins(CAmount base_value, CAmount cache_value, CAmount expected_value, char cache_flags, char expected_flags)
 {
     SingleEntryCacheTest test(base_value, cache_value, cache_flags);
@@ -0,0 +1,76 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "governance-votedb.h"
+#include "masternodeman.h"
+#include "netbase.h"
+#include "random.h"
+#include "streams.h"
+
+#include "test/test_square.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(governance_votedb_tests, BasicTestingSetup)
+
+static CGovernanceVote CreateVote(const COutPoint& outpoint, const uint256& nParentHash, CKey& key)
+{
+    CPubKey pubKey = key.GetPubKey();
+    CGovernanceVote vote(outpoint, nParentHash, VOTE_SIGNAL_FUNDING, VOTE_OUTCOME_YES);
+    BOOST_CHECK(vote.Sign(key, pubKey));
+    return vote;
+}
+
+BOOST_AUTO_TEST_CASE(valid_vote_invs)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CService addr = LookupNumeric("10.0.0.1", 9999);
+    uint256 nParentHash = GetRandHash();
+
+    std::vector<COutPoint> vecOutpoints;
+    for (int i = 0; i < 3; i++) {
+        vecOutpoints.push_back(COutPoint(GetRandHash(), 0));
+        CMasternode mn(addr, vecOutpoints.back(), key.GetPubKey(), key.GetPubKey(), PROTOCOL_VERSION);
+        BOOST_CHECK(mnodeman.Add(mn));
+    }
+
+    CGovernanceObjectVoteFile fileVotes;
+    fileVotes.AddVote(CreateVote(vecOutpoints[0], nParentHash, key));
+    fileVotes.AddVote(CreateVote(vecOutpoints[1], nParentHash, key));
+    BOOST_CHECK_EQUAL(fileVotes.GetValidVoteInvs().size(), 2);
+
+    // new votes extend the cached inventory
+    CGovernanceVote vote = CreateVote(vecOutpoints[2], nParentHash, key);
+    fileVotes.AddVote(vote);
+    const std::vector<CInv>& vecInvs = fileVotes.GetValidVoteInvs();
+    BOOST_CHECK_EQUAL(vecInvs.size(), 3);
+    BOOST_CHECK(vecInvs.back().type == MSG_GOVERNANCE_OBJECT_VOTE);
+    BOOST_CHECK(vecInvs.back().hash == vote.GetHash());
+
+    fileVotes.RemoveVotesFromMasternode(vecOutpoints[0]);
+    BOOST_CHECK_EQUAL(fileVotes.GetValidVoteInvs().size(), 2);
+
+    // votes are checked again once their masternodes are gone
+    CGovernanceObjectVoteFile fileVotesCopy(fileVotes);
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << fileVotes;
+    mnodeman.Clear();
+    BOOST_CHECK(fileVotes.GetValidVoteInvs().empty());
+    BOOST_CHECK(fileVotesCopy.GetValidVoteInvs().empty());
+
+    CGovernanceObjectVoteFile fileVotesLoaded;
+    ss >> fileVotesLoaded;
+    BOOST_CHECK_EQUAL(fileVotesLoaded.GetVoteCount(), 2);
+    BOOST_CHECK(fileVotesLoaded.GetValidVoteInvs().empty());
+
+    CMasternode mn(addr, vecOutpoints[1], key.GetPubKey(), key.GetPubKey(), PROTOCOL_VERSION);
+    BOOST_CHECK(mnodeman.Add(mn));
+    BOOST_CHECK_EQUAL(fileVotes.GetValidVoteInvs().size(), 1);
+    BOOST_CHECK_EQUAL(fileVotesLoaded.GetValidVoteInvs().size(), 1);
+
+    mnodeman.Clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -85,4 +85,29 @@ BOOST_AUTO_TEST_CASE(siphash)
     }*/
 }
 
+BOOST_AUTO_TEST_CASE(x11_batch)
+{
+    // Batched X11 must match HashX11 for partial and full lane groups, with
+    // inputs laid out both back-to-back and with gaps between them.
+    std::vector<unsigned char> vData(96 * 19);
+    for (size_t i = 0; i < vData.size(); i++)
+        vData[i] = (unsigned char)(i * 7 + 3);
+
+    for (size_t nCount = 0; nCount <= 19; nCount++) {
+        std::vector<uint256> vHashes(nCount + 1);
+        HashX11Batch(&vData[0], 80, 96, nCount, &vHashes[0]);
+        for (size_t i = 0; i < nCount; i++)
+            BOOST_CHECK(vHashes[i] == HashX11(vData.begin() + i * 96, vData.begin() + i * 96 + 80));
+        BOOST_CHECK(vHashes[nCount].IsNull());
+    }
+
+    std::vector<uint256> vHashes(3);
+    HashX11Batch(&vData[0], 80, 80, 3, &vHashes[0]);
+    for (size_t i = 0; i < 3; i++)
+        BOOST_CHECK(vHashes[i] == HashX11(vData.begin() + i * 80, vData.begin() + (i + 1) * 80));
+
+    HashX11Batch(&vData[0], 0, 0, 1, &vHashes[0]);
+    BOOST_CHECK(vHashes[0] == HashX11(vData.begin(), vData.begin()));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
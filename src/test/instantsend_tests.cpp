@@ -0,0 +1,67 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "instantx.h"
+#include "random.h"
+
+#include "test/test_square.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(instantsend_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(outpointlock_votes)
+{
+    uint256 txHash = GetRandHash();
+    COutPoint outpoint(GetRandHash(), 0);
+    COutPointLock outpointLock(outpoint);
+    const int nRequired = COutPointLock::SIGNATURES_REQUIRED;
+
+    std::vector<COutPoint> vecMasternodes;
+    for (int i = 0; i < nRequired; i++)
+        vecMasternodes.push_back(COutPoint(GetRandHash(), i));
+
+    for (int i = 0; i < nRequired; i++) {
+        BOOST_CHECK(!outpointLock.IsReady());
+        BOOST_CHECK(!outpointLock.HasMasternodeVoted(vecMasternodes[i]));
+        BOOST_CHECK(outpointLock.AddVote(CTxLockVote(txHash, outpoint, vecMasternodes[i])));
+        BOOST_CHECK(outpointLock.HasMasternodeVoted(vecMasternodes[i]));
+    }
+    BOOST_CHECK(outpointLock.IsReady());
+    BOOST_CHECK_EQUAL(outpointLock.CountVotes(), nRequired);
+
+    // one vote per masternode
+    BOOST_CHECK(!outpointLock.AddVote(CTxLockVote(txHash, outpoint, vecMasternodes[2])));
+    BOOST_CHECK_EQUAL(outpointLock.GetVotes().size(), nRequired);
+    BOOST_CHECK(outpointLock.GetVotes()[2].GetMasternodeOutpoint() == vecMasternodes[2]);
+
+    outpointLock.MarkAsAttacked();
+    BOOST_CHECK_EQUAL(outpointLock.CountVotes(), 0);
+    BOOST_CHECK(!outpointLock.IsReady());
+}
+
+BOOST_AUTO_TEST_CASE(lockcandidate_memory_usage)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(2);
+    tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    tx.vin[1].prevout = COutPoint(GetRandHash(), 1);
+    tx.vout.resize(1);
+    CTxLockCandidate txLockCandidate((CTxLockRequest(tx)));
+    size_t nUsageEmpty = txLockCandidate.DynamicMemoryUsage();
+    BOOST_CHECK(nUsageEmpty > 0);
+
+    for (const auto& txin : tx.vin)
+        txLockCandidate.AddOutPointLock(txin.prevout);
+    size_t nUsageOutpoints = txLockCandidate.DynamicMemoryUsage();
+    BOOST_CHECK(nUsageOutpoints > nUsageEmpty);
+
+    CTxLockVote vote(txLockCandidate.GetHash(), tx.vin[1].prevout, COutPoint(GetRandHash(), 0));
+    BOOST_CHECK(txLockCandidate.AddVote(vote));
+    BOOST_CHECK(!txLockCandidate.AddVote(vote));
+    BOOST_CHECK_EQUAL(txLockCandidate.CountVotes(), 1);
+    BOOST_CHECK(txLockCandidate.DynamicMemoryUsage() > nUsageOutpoints);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -163,6 +163,37 @@ BOOST_AUTO_TEST_CASE(key_test1)
         BOOST_CHECK(rkey2  == pubkey2);
         BOOST_CHECK(rkey1C == pubkey1C);
         BOOST_CHECK(rkey2C == pubkey2C);
+
+        // compact signatures checked against a known key
+
+        BOOST_CHECK( pubkey1.CheckRecoverCompact (hashMsg, csign1));
+        BOOST_CHECK( pubkey2.CheckRecoverCompact (hashMsg, csign2));
+        BOOST_CHECK( pubkey1C.CheckRecoverCompact(hashMsg, csign1C));
+        BOOST_CHECK( pubkey2C.CheckRecoverCompact(hashMsg, csign2C));
+
+        BOOST_CHECK(!pubkey1.CheckRecoverCompact (hashMsg, csign2));
+        BOOST_CHECK(!pubkey2C.CheckRecoverCompact(hashMsg, csign1C));
+        BOOST_CHECK(!pubkey1.CheckRecoverCompact (hashMsg, csign1C));
+        BOOST_CHECK(!pubkey1C.CheckRecoverCompact(hashMsg, csign1));
+        BOOST_CHECK(!pubkey1.CheckRecoverCompact (Hash(strMsg.begin(), strMsg.end() - 1), csign1));
+
+        // a wrong recovery id doesn't recover the key, so it isn't accepted either
+
+        int nRecId1 = (csign1[0] - 27) & 3, nRecId1C = (csign1C[0] - 27) & 3;
+        for (int nRecId = 0; nRecId < 4; nRecId++) {
+            vector<unsigned char> csign1T = csign1, csign1CT = csign1C;
+            csign1T[0] = 27 + nRecId;
+            csign1CT[0] = 27 + nRecId + 4;
+            CPubKey rkey1T, rkey1CT;
+            if (nRecId != nRecId1) {
+                BOOST_CHECK(!rkey1T.RecoverCompact (hashMsg, csign1T)  || rkey1T  != pubkey1);
+                BOOST_CHECK(!pubkey1.CheckRecoverCompact (hashMsg, csign1T));
+            }
+            if (nRecId != nRecId1C) {
+                BOOST_CHECK(!rkey1CT.RecoverCompact(hashMsg, csign1CT) || rkey1CT != pubkey1C);
+                BOOST_CHECK(!pubkey1C.CheckRecoverCompact(hashMsg, csign1CT));
+            }
+        }
     }
 
     // test deterministic signing
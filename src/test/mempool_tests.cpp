@@ -473,4 +473,82 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolAddressIndexTest)
+{
+    TestMemPoolEntryHelper entry;
+    CTxMemPool pool(CFeeRate(0));
+    CCoinsView dummy;
+    CCoinsViewCache view(&dummy);
+
+    uint160 hashA(std::vector<unsigned char>(20, 0xaa));
+    uint160 hashB(std::vector<unsigned char>(20, 0xbb));
+    uint160 hashS(std::vector<unsigned char>(20, 0xcc));
+
+    // confirmed parent paying to P2PKH address A and P2SH address S
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(2);
+    txParent.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << ToByteVector(hashA) << OP_EQUALVERIFY << OP_CHECKSIG;
+    txParent.vout[0].nValue = 10000LL;
+    txParent.vout[1].scriptPubKey = CScript() << OP_HASH160 << ToByteVector(hashS) << OP_EQUAL;
+    txParent.vout[1].nValue = 20000LL;
+    AddCoins(view, txParent, 1);
+
+    // mempool tx spending A's coin and paying A and B
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].prevout = COutPoint(txParent.GetHash(), 0);
+    txChild.vout.resize(3);
+    txChild.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << ToByteVector(hashB) << OP_EQUALVERIFY << OP_CHECKSIG;
+    txChild.vout[0].nValue = 6000LL;
+    txChild.vout[1].scriptPubKey = txParent.vout[0].scriptPubKey;
+    txChild.vout[1].nValue = 3000LL;
+    txChild.vout[2].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[2].nValue = 1000LL;
+
+    CTxMemPool::addressDeltaVector vecDeltas;
+    CTxMemPool::getAddressDeltas(entry.Time(1234).FromTx(txChild), view, vecDeltas);
+    BOOST_CHECK_EQUAL(vecDeltas.size(), 3);
+    BOOST_CHECK_EQUAL(vecDeltas[0].first.spending, 1);
+    BOOST_CHECK_EQUAL(vecDeltas[0].second.amount, -10000LL);
+    BOOST_CHECK(vecDeltas[0].second.prevhash == txParent.GetHash());
+    BOOST_CHECK_EQUAL(vecDeltas[1].second.time, 1234);
+    pool.addAddressIndex(txChild.GetHash(), vecDeltas);
+
+    std::vector<std::pair<uint160, int> > vecAddresses;
+    BOOST_CHECK(pool.getTransactionAddresses(txChild.GetHash(), vecAddresses));
+    BOOST_CHECK_EQUAL(vecAddresses.size(), 2);
+    BOOST_CHECK(vecAddresses[0] == std::make_pair(hashA, 1));
+    BOOST_CHECK(vecAddresses[1] == std::make_pair(hashB, 1));
+    BOOST_CHECK(!pool.getTransactionAddresses(txParent.GetHash(), vecAddresses));
+
+    // an address asked for twice is only returned once
+    std::vector<std::pair<uint160, int> > vecQuery;
+    vecQuery.push_back(std::make_pair(hashA, 1));
+    vecQuery.push_back(std::make_pair(hashS, 2));
+    vecQuery.push_back(std::make_pair(hashA, 1));
+    std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > vecResults;
+    BOOST_CHECK(pool.getAddressIndex(vecQuery, vecResults));
+    BOOST_CHECK_EQUAL(vecResults.size(), 2);
+    CAmount nBalance = 0;
+    for (size_t i = 0; i < vecResults.size(); i++)
+        nBalance += vecResults[i].second.amount;
+    BOOST_CHECK_EQUAL(nBalance, -7000LL);
+
+    // visiting stops when asked to
+    int nVisited = 0;
+    pool.forEachAddressDelta(vecQuery, [&nVisited](const CMempoolAddressDeltaKey& key, const CMempoolAddressDelta& delta) {
+        nVisited++;
+        return false;
+    });
+    BOOST_CHECK_EQUAL(nVisited, 1);
+
+    pool.removeAddressIndex(txChild.GetHash());
+    vecResults.clear();
+    pool.getAddressIndex(vecQuery, vecResults);
+    BOOST_CHECK(vecResults.empty());
+    BOOST_CHECK(!pool.getTransactionAddresses(txChild.GetHash(), vecAddresses));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -388,4 +388,80 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+static CMutableTransaction CreateSignedSpend(const CKey& key, const CScript& scriptPubKey, const CTransaction& txFrom, CAmount nFee)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(txFrom.GetHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = txFrom.vout[0].nValue - nFee;
+    tx.vout[0].scriptPubKey = scriptPubKey;
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig;
+    return tx;
+}
+
+static bool ToMemPool(const CMutableTransaction& tx)
+{
+    LOCK(cs_main);
+    CValidationState state;
+    return AcceptToMemoryPool(mempool, state, tx, false, NULL, true, false);
+}
+
+BOOST_FIXTURE_TEST_CASE(CreateNewBlock_package_selection, TestChain100Setup)
+{
+    const CChainParams& chainparams = Params();
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    // fee rate only, no coin-age priority area
+    mapArgs["-blockprioritysize"] = "0";
+    // mature the second coinbase
+    CreateAndProcessBlock(std::vector<CMutableTransaction>(), scriptPubKey);
+
+    // a low fee parent whose child pays for both, and an unrelated transaction
+    // paying more than the parent but less than the package
+    CMutableTransaction txParent = CreateSignedSpend(coinbaseKey, scriptPubKey, coinbaseTxns[0], 1000);
+    CMutableTransaction txChild = CreateSignedSpend(coinbaseKey, scriptPubKey, txParent, 100000);
+    CMutableTransaction txOther = CreateSignedSpend(coinbaseKey, scriptPubKey, coinbaseTxns[1], 10000);
+    BOOST_CHECK(ToMemPool(txOther));
+    BOOST_CHECK(ToMemPool(txParent));
+    BOOST_CHECK(ToMemPool(txChild));
+
+    CBlockTemplate *pblocktemplate;
+    BOOST_CHECK(pblocktemplate = CreateNewBlock(chainparams, scriptPubKey));
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 4);
+    BOOST_CHECK(pblocktemplate->block.vtx[1].GetHash() == txParent.GetHash());
+    BOOST_CHECK(pblocktemplate->block.vtx[2].GetHash() == txChild.GetHash());
+    BOOST_CHECK(pblocktemplate->block.vtx[3].GetHash() == txOther.GetHash());
+    BOOST_CHECK_EQUAL(pblocktemplate->vTxFees[0], -111000);
+    delete pblocktemplate;
+
+    // transactions arriving later are appended to an existing template
+    mempool.clear();
+    BOOST_CHECK(ToMemPool(txOther));
+    BOOST_CHECK(pblocktemplate = CreateNewBlock(chainparams, scriptPubKey));
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 2);
+    BOOST_CHECK(ToMemPool(txParent));
+    BOOST_CHECK(ToMemPool(txChild));
+    BOOST_CHECK(UpdateBlockTemplate(chainparams, pblocktemplate));
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 4);
+    BOOST_CHECK(pblocktemplate->block.vtx[3].GetHash() == txChild.GetHash());
+    BOOST_CHECK_EQUAL(pblocktemplate->vTxFees[0], -111000);
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(TestBlockValidity(state, chainparams, pblocktemplate->block, chainActive.Tip(), false, false));
+    }
+
+    // but not once a selected transaction left the mempool
+    mempool.clear();
+    BOOST_CHECK(!UpdateBlockTemplate(chainparams, pblocktemplate));
+    delete pblocktemplate;
+
+    mapArgs.erase("-blockprioritysize");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,102 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternodeman.h"
+#include "random.h"
+#include "streams.h"
+
+#include "test/test_square.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(mnlistdiff_tests, BasicTestingSetup)
+
+static CMasternodeListSnapshot CreateSnapshot(int nEntries)
+{
+    CMasternodeListSnapshot snapshot;
+    for (int i = 0; i < nEntries; i++)
+        snapshot.vecEntries.push_back(CMasternodeListEntry(COutPoint(GetRandHash(), 0), GetRandHash(), GetRandHash()));
+    std::sort(snapshot.vecEntries.begin(), snapshot.vecEntries.end(),
+              [](const CMasternodeListEntry& a, const CMasternodeListEntry& b) { return a.outpoint < b.outpoint; });
+    return snapshot;
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_diff)
+{
+    CMasternodeListSnapshot snapshotBase = CreateSnapshot(100);
+    CMasternodeListSnapshot snapshotNew = snapshotBase;
+    std::vector<COutPoint> vecMnb, vecMnp, vecRemoved;
+
+    BOOST_CHECK(snapshotBase.GetHash() == snapshotNew.GetHash());
+    snapshotBase.GetDiff(snapshotNew, vecMnb, vecMnp, vecRemoved);
+    BOOST_CHECK(vecMnb.empty() && vecMnp.empty() && vecRemoved.empty());
+
+    // the whole list is new for an empty base
+    CMasternodeListSnapshot().GetDiff(snapshotNew, vecMnb, vecMnp, vecRemoved);
+    BOOST_CHECK_EQUAL(vecMnb.size(), 100);
+    BOOST_CHECK(vecMnp.empty() && vecRemoved.empty());
+
+    // rebroadcast, ping, remove and add some entries
+    snapshotNew.vecEntries[10].hashMnb = GetRandHash();
+    snapshotNew.vecEntries[10].hashMnp = GetRandHash();
+    snapshotNew.vecEntries[20].hashMnp = GetRandHash();
+    snapshotNew.vecEntries[30].hashMnp = GetRandHash();
+    COutPoint outpointRemoved = snapshotNew.vecEntries[0].outpoint;
+    COutPoint outpointRemoved2 = snapshotNew.vecEntries[99].outpoint;
+    snapshotNew.vecEntries.erase(snapshotNew.vecEntries.begin() + 99);
+    snapshotNew.vecEntries.erase(snapshotNew.vecEntries.begin());
+    CMasternodeListEntry entryAdded(COutPoint(snapshotBase.vecEntries[50].outpoint.hash, 1), GetRandHash(), GetRandHash());
+    snapshotNew.vecEntries.insert(snapshotNew.vecEntries.begin() + 50, entryAdded);
+    BOOST_CHECK(snapshotBase.GetHash() != snapshotNew.GetHash());
+
+    snapshotBase.GetDiff(snapshotNew, vecMnb, vecMnp, vecRemoved);
+    BOOST_CHECK_EQUAL(vecMnb.size(), 2);
+    BOOST_CHECK(vecMnb[0] == snapshotBase.vecEntries[10].outpoint);
+    BOOST_CHECK(vecMnb[1] == entryAdded.outpoint);
+    BOOST_CHECK_EQUAL(vecMnp.size(), 2);
+    BOOST_CHECK(vecMnp[0] == snapshotBase.vecEntries[20].outpoint);
+    BOOST_CHECK(vecMnp[1] == snapshotBase.vecEntries[30].outpoint);
+    BOOST_CHECK_EQUAL(vecRemoved.size(), 2);
+    BOOST_CHECK(vecRemoved[0] == outpointRemoved);
+    BOOST_CHECK(vecRemoved[1] == outpointRemoved2);
+
+    // and back
+    snapshotNew.GetDiff(snapshotBase, vecMnb, vecMnp, vecRemoved);
+    BOOST_CHECK_EQUAL(vecMnb.size(), 3);
+    BOOST_CHECK_EQUAL(vecMnp.size(), 2);
+    BOOST_CHECK_EQUAL(vecRemoved.size(), 1);
+    BOOST_CHECK(vecRemoved[0] == entryAdded.outpoint);
+}
+
+BOOST_AUTO_TEST_CASE(diff_serialization)
+{
+    CMasternodeListDiff diff;
+    diff.hashBase = GetRandHash();
+    diff.hashNew = GetRandHash();
+    diff.vecMnb.resize(2);
+    diff.vecMnb[1].vin = CTxIn(COutPoint(GetRandHash(), 1));
+    diff.vecMnb[1].sigTime = 12345;
+    diff.vecMnp.resize(1);
+    diff.vecMnp[0].vin = CTxIn(COutPoint(GetRandHash(), 2));
+    diff.vecRemoved.push_back(COutPoint(GetRandHash(), 3));
+    diff.fLast = true;
+    BOOST_CHECK_EQUAL(diff.size(), 4);
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << diff;
+    CMasternodeListDiff diff2;
+    ss >> diff2;
+    BOOST_CHECK(ss.empty());
+
+    BOOST_CHECK(diff2.hashBase == diff.hashBase);
+    BOOST_CHECK(diff2.hashNew == diff.hashNew);
+    BOOST_CHECK_EQUAL(diff2.vecMnb.size(), 2);
+    BOOST_CHECK(diff2.vecMnb[1].GetHash() == diff.vecMnb[1].GetHash());
+    BOOST_CHECK_EQUAL(diff2.vecMnp.size(), 1);
+    BOOST_CHECK(diff2.vecMnp[0].GetHash() == diff.vecMnp[0].GetHash());
+    BOOST_CHECK(diff2.vecRemoved == diff.vecRemoved);
+    BOOST_CHECK(diff2.fLast);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
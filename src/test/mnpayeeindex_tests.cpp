@@ -0,0 +1,214 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chain.h"
+#include "masternode-payments.h"
+#include "random.h"
+#include "streams.h"
+#include "validation.h"
+
+#include "test/test_square.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(mnpayeeindex_tests, BasicTestingSetup)
+
+static const CAmount BLOCK_VALUE = 50 * COIN;
+
+static CScript GetPayeeScript(int i)
+{
+    return CScript() << OP_DUP << OP_HASH160 << ToByteVector(uint160(std::vector<unsigned char>(20, i))) << OP_EQUALVERIFY << OP_CHECKSIG;
+}
+
+/** Coinbase paying the masternode payment to payee and the rest to a miner */
+static CBlock CreatePaymentBlock(int nHeight, const CScript& payee)
+{
+    CAmount nMasternodePayment = GetMasternodePayment(nHeight, BLOCK_VALUE);
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << nHeight << OP_0;
+    tx.vout.resize(2);
+    tx.vout[0].nValue = BLOCK_VALUE - nMasternodePayment;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    tx.vout[1].nValue = nMasternodePayment;
+    tx.vout[1].scriptPubKey = payee;
+
+    CBlock block;
+    block.vtx.push_back(tx);
+    return block;
+}
+
+struct TestChain {
+    std::vector<uint256> vecHashes;
+    std::vector<CBlockIndex> vecIndex;
+
+    TestChain(int nHeight) : vecHashes(nHeight + 1), vecIndex(nHeight + 1)
+    {
+        for (int i = 0; i <= nHeight; i++) {
+            vecHashes[i] = GetRandHash();
+            vecIndex[i].phashBlock = &vecHashes[i];
+            vecIndex[i].pprev = i ? &vecIndex[i - 1] : NULL;
+            vecIndex[i].nHeight = i;
+            vecIndex[i].nTime = 1500000000 + i * 150;
+        }
+    }
+};
+
+BOOST_AUTO_TEST_CASE(connect_disconnect)
+{
+    TestChain chain(30);
+    CMasternodePayeeIndex index;
+    std::vector<CMasternodePayeeIndex::payment_t> vecPayments;
+
+    // payees 0, 1 and 2 take turns
+    for (int i = 1; i <= 30; i++)
+        index.BlockConnected(CreatePaymentBlock(i, GetPayeeScript(i % 3)), &chain.vecIndex[i]);
+    BOOST_CHECK(index.GetBestBlock() == chain.vecHashes[30]);
+    BOOST_CHECK_EQUAL(index.GetBlockCount(), 30);
+    BOOST_CHECK_EQUAL(index.GetPayeeCount(), 3);
+
+    index.GetPayments(GetPayeeScript(1), 0, 30, vecPayments);
+    BOOST_CHECK_EQUAL(vecPayments.size(), 10);
+    BOOST_CHECK_EQUAL(vecPayments.front().first, 1);
+    BOOST_CHECK_EQUAL(vecPayments.back().first, 28);
+    BOOST_CHECK_EQUAL(vecPayments.back().second, chain.vecIndex[28].nTime);
+
+    index.GetPayments(GetPayeeScript(1), 5, 20, vecPayments);
+    BOOST_CHECK_EQUAL(vecPayments.size(), 5);
+    BOOST_CHECK_EQUAL(vecPayments.front().first, 7);
+    BOOST_CHECK_EQUAL(vecPayments.back().first, 19);
+
+    index.GetPayments(GetPayeeScript(3), 0, 30, vecPayments);
+    BOOST_CHECK(vecPayments.empty());
+
+    // outputs which don't pay exactly the masternode payment are not indexed
+    CMasternodePayeeIndex indexOther;
+    CBlock block = CreatePaymentBlock(30, GetPayeeScript(3));
+    CMutableTransaction tx(block.vtx[0]);
+    tx.vout[0].nValue += 1;
+    tx.vout[1].nValue -= 1;
+    block.vtx[0] = tx;
+    indexOther.BlockConnected(block, &chain.vecIndex[30]);
+    BOOST_CHECK(indexOther.GetBestBlock() == chain.vecHashes[30]);
+    BOOST_CHECK_EQUAL(indexOther.GetBlockCount(), 0);
+
+    // reorg the last two blocks, paying payee 3 instead
+    index.BlockDisconnected(&chain.vecIndex[30]);
+    index.BlockDisconnected(&chain.vecIndex[29]);
+    BOOST_CHECK(index.GetBestBlock() == chain.vecHashes[28]);
+    index.GetPayments(GetPayeeScript(2), 0, 30, vecPayments);
+    BOOST_CHECK_EQUAL(vecPayments.back().first, 26);
+    index.GetPayments(GetPayeeScript(0), 0, 30, vecPayments);
+    BOOST_CHECK_EQUAL(vecPayments.back().first, 27);
+
+    index.BlockConnected(CreatePaymentBlock(29, GetPayeeScript(3)), &chain.vecIndex[29]);
+    index.BlockConnected(CreatePaymentBlock(30, GetPayeeScript(3)), &chain.vecIndex[30]);
+    index.GetPayments(GetPayeeScript(3), 0, 30, vecPayments);
+    BOOST_CHECK_EQUAL(vecPayments.size(), 2);
+    BOOST_CHECK_EQUAL(vecPayments.back().first, 30);
+    BOOST_CHECK_EQUAL(index.GetPayeeCount(), 4);
+
+    // disconnecting everything empties the index
+    for (int i = 30; i >= 1; i--)
+        index.BlockDisconnected(&chain.vecIndex[i]);
+    BOOST_CHECK(index.GetBestBlock() == chain.vecHashes[0]);
+    BOOST_CHECK_EQUAL(index.GetBlockCount(), 0);
+    BOOST_CHECK_EQUAL(index.GetPayeeCount(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(max_depth)
+{
+    int nMaxDepth = MNPAYMENTS_MIN_BLOCKS_TO_STORE;
+    int nHeight = nMaxDepth + 100;
+    TestChain chain(nHeight);
+    CMasternodePayeeIndex index;
+    std::vector<CMasternodePayeeIndex::payment_t> vecPayments;
+
+    // lower than the minimum is ignored
+    index.SetMaxDepth(10);
+
+    for (int i = 1; i <= nHeight; i++)
+        index.BlockConnected(CreatePaymentBlock(i, GetPayeeScript(i < 50 ? 0 : i % 2 + 1)), &chain.vecIndex[i]);
+    BOOST_CHECK_EQUAL(index.GetBlockCount(), nMaxDepth);
+    // payee 0 was only paid in blocks which aren't deep enough anymore
+    BOOST_CHECK_EQUAL(index.GetPayeeCount(), 2);
+    index.GetPayments(GetPayeeScript(2), 0, nHeight, vecPayments);
+    BOOST_CHECK_EQUAL(vecPayments.front().first, nHeight - nMaxDepth + 1);
+
+    index.SetMaxDepth(nMaxDepth * 2);
+    index.BlockConnected(CreatePaymentBlock(nHeight, GetPayeeScript(0)), &chain.vecIndex[nHeight]);
+    BOOST_CHECK_EQUAL(index.GetBlockCount(), nMaxDepth);
+
+    // CFlatDB cleans a loaded index, which drops the blocks deeper than it keeps
+    CMasternodePayeeIndex indexDeep;
+    indexDeep.SetMaxDepth(nMaxDepth * 2);
+    for (int i = 1; i <= nHeight; i++)
+        indexDeep.BlockConnected(CreatePaymentBlock(i, GetPayeeScript(i < 50 ? 0 : i % 2 + 1)), &chain.vecIndex[i]);
+    BOOST_CHECK_EQUAL(indexDeep.GetBlockCount(), nHeight);
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << indexDeep;
+    CMasternodePayeeIndex indexLoaded;
+    ss >> indexLoaded;
+    indexLoaded.CheckAndRemove();
+    BOOST_CHECK_EQUAL(indexLoaded.GetBlockCount(), nMaxDepth);
+    BOOST_CHECK_EQUAL(indexLoaded.GetPayeeCount(), 2);
+    indexLoaded.GetPayments(GetPayeeScript(2), 0, nHeight, vecPayments);
+    BOOST_CHECK_EQUAL(vecPayments.front().first, nHeight - nMaxDepth + 1);
+}
+
+BOOST_AUTO_TEST_CASE(serialization)
+{
+    TestChain chain(10);
+    CMasternodePayeeIndex index;
+    for (int i = 1; i <= 10; i++)
+        index.BlockConnected(CreatePaymentBlock(i, GetPayeeScript(i % 4)), &chain.vecIndex[i]);
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << index;
+
+    CMasternodePayeeIndex index2;
+    ss >> index2;
+    BOOST_CHECK(index2.GetBestBlock() == chain.vecHashes[10]);
+    BOOST_CHECK_EQUAL(index2.GetBlockCount(), 10);
+    BOOST_CHECK_EQUAL(index2.GetPayeeCount(), 4);
+
+    std::vector<CMasternodePayeeIndex::payment_t> vecPayments, vecPayments2;
+    for (int i = 0; i < 4; i++) {
+        index.GetPayments(GetPayeeScript(i), 0, 10, vecPayments);
+        index2.GetPayments(GetPayeeScript(i), 0, 10, vecPayments2);
+        BOOST_CHECK(vecPayments == vecPayments2);
+    }
+
+    // rolling back the loaded index works the same
+    index2.BlockDisconnected(&chain.vecIndex[10]);
+    index2.GetPayments(GetPayeeScript(2), 0, 10, vecPayments);
+    BOOST_CHECK_EQUAL(vecPayments.size(), 2);
+    BOOST_CHECK_EQUAL(vecPayments.back().first, 6);
+
+    // a truncated index isn't in sync with any block
+    CDataStream ssTruncated(SER_DISK, CLIENT_VERSION);
+    ssTruncated << index;
+    ssTruncated.resize(ssTruncated.size() - 16);
+    CMasternodePayeeIndex index3;
+    BOOST_CHECK_THROW(ssTruncated >> index3, std::ios_base::failure);
+    BOOST_CHECK(index3.GetBestBlock().IsNull());
+}
+
+BOOST_AUTO_TEST_CASE(lite_mode)
+{
+    TestChain chain(2);
+    CMasternodePayeeIndex index;
+    index.BlockConnected(CreatePaymentBlock(1, GetPayeeScript(1)), &chain.vecIndex[1]);
+
+    // blocks are neither indexed nor taken back in lite mode
+    fLiteMode = true;
+    index.BlockConnected(CreatePaymentBlock(2, GetPayeeScript(2)), &chain.vecIndex[2]);
+    index.BlockDisconnected(&chain.vecIndex[1]);
+    fLiteMode = false;
+    BOOST_CHECK_EQUAL(index.GetBlockCount(), 1);
+    BOOST_CHECK(index.GetBestBlock() == chain.vecHashes[1]);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,136 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternodeman.h"
+#include "random.h"
+
+#include "test/test_square.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(mnscores_tests, BasicTestingSetup)
+
+typedef std::map<COutPoint, CMasternode> masternode_map_t;
+
+static CMasternode* AddMasternode(masternode_map_t& mapMasternodes)
+{
+    COutPoint outpoint(GetRandHash(), 0);
+    CMasternode& mn = mapMasternodes[outpoint];
+    mn.vin = CTxIn(outpoint);
+    return &mn;
+}
+
+static masternode_map_t CreateMasternodes(int nCount)
+{
+    masternode_map_t mapMasternodes;
+    for (int i = 0; i < nCount; i++)
+        AddMasternode(mapMasternodes);
+    return mapMasternodes;
+}
+
+// The scores of the whole list sorted best first, without the cache
+static CMasternodeScoresCache::score_pair_vec_t CalculateScores(masternode_map_t& mapMasternodes, const uint256& nBlockHash)
+{
+    CMasternodeScoresCache::score_pair_vec_t vecScores;
+    for (auto& mnpair : mapMasternodes)
+        vecScores.push_back(std::make_pair(mnpair.second.CalculateScore(nBlockHash), &mnpair.second));
+    std::sort(vecScores.begin(), vecScores.end(),
+              [](const CMasternodeScoresCache::score_pair_t& a, const CMasternodeScoresCache::score_pair_t& b) {
+                  return (a.first != b.first) ? (b.first < a.first) : (b.second->vin < a.second->vin);
+              });
+    return vecScores;
+}
+
+BOOST_AUTO_TEST_CASE(scores_cache_hits)
+{
+    masternode_map_t mapMasternodes = CreateMasternodes(50);
+    CMasternodeScoresCache cache;
+    uint256 hash1 = GetRandHash();
+    uint256 hash2 = GetRandHash();
+
+    BOOST_CHECK(!cache.Has(hash1));
+    const CMasternodeScoresCache::score_pair_vec_t& vecScores1 = cache.Get(hash1, mapMasternodes);
+    BOOST_CHECK(cache.Has(hash1));
+    BOOST_CHECK(vecScores1 == CalculateScores(mapMasternodes, hash1));
+
+    // the second request is served from the cache without looking at the list
+    AddMasternode(mapMasternodes);
+    BOOST_CHECK(&cache.Get(hash1, mapMasternodes) == &vecScores1);
+    BOOST_CHECK_EQUAL(vecScores1.size(), 50U);
+    BOOST_CHECK_EQUAL(cache.size(), 1U);
+
+    // a new block hash is scored for the whole list
+    const CMasternodeScoresCache::score_pair_vec_t& vecScores2 = cache.Get(hash2, mapMasternodes);
+    BOOST_CHECK_EQUAL(vecScores2.size(), 51U);
+    BOOST_CHECK(vecScores2 == CalculateScores(mapMasternodes, hash2));
+    BOOST_CHECK_EQUAL(cache.size(), 2U);
+
+    cache.Clear();
+    BOOST_CHECK_EQUAL(cache.size(), 0U);
+    BOOST_CHECK(!cache.Has(hash1) && !cache.Has(hash2));
+}
+
+BOOST_AUTO_TEST_CASE(scores_cache_add_remove)
+{
+    masternode_map_t mapMasternodes = CreateMasternodes(50);
+    CMasternodeScoresCache cache;
+    std::vector<uint256> vecHashes;
+    for (int i = 0; i < 3; i++) {
+        vecHashes.push_back(GetRandHash());
+        cache.Get(vecHashes.back(), mapMasternodes);
+    }
+
+    // added masternodes are scored for every cached block hash and take their place
+    for (int i = 0; i < 10; i++)
+        cache.Add(AddMasternode(mapMasternodes));
+    for (const auto& hash : vecHashes) {
+        BOOST_CHECK_EQUAL(cache.Get(hash, mapMasternodes).size(), 60U);
+        BOOST_CHECK(cache.Get(hash, mapMasternodes) == CalculateScores(mapMasternodes, hash));
+    }
+
+    // removed ones are dropped everywhere, the best and the worst of a list too
+    std::vector<COutPoint> vecRemove;
+    vecRemove.push_back(cache.Get(vecHashes[0], mapMasternodes).front().second->vin.prevout);
+    vecRemove.push_back(cache.Get(vecHashes[1], mapMasternodes).back().second->vin.prevout);
+    vecRemove.push_back(mapMasternodes.begin()->first);
+    for (const auto& outpoint : vecRemove) {
+        masternode_map_t::iterator it = mapMasternodes.find(outpoint);
+        if (it == mapMasternodes.end()) continue;
+        cache.Remove(&it->second);
+        mapMasternodes.erase(it);
+    }
+    for (const auto& hash : vecHashes) {
+        BOOST_CHECK_EQUAL(cache.Get(hash, mapMasternodes).size(), mapMasternodes.size());
+        BOOST_CHECK(cache.Get(hash, mapMasternodes) == CalculateScores(mapMasternodes, hash));
+    }
+    BOOST_CHECK_EQUAL(cache.size(), 3U);
+}
+
+BOOST_AUTO_TEST_CASE(scores_cache_eviction)
+{
+    masternode_map_t mapMasternodes = CreateMasternodes(10);
+    CMasternodeScoresCache cache;
+    const size_t nMaxSize = CMasternodeScoresCache::MAX_SIZE;
+    std::vector<uint256> vecHashes;
+    for (size_t i = 0; i <= nMaxSize; i++) {
+        vecHashes.push_back(GetRandHash());
+        cache.Get(vecHashes.back(), mapMasternodes);
+        BOOST_CHECK_EQUAL(cache.size(), std::min(i + 1, nMaxSize));
+    }
+
+    // the oldest block hash made room for the last one
+    BOOST_CHECK(!cache.Has(vecHashes[0]));
+    for (size_t i = 1; i < vecHashes.size(); i++)
+        BOOST_CHECK(cache.Has(vecHashes[i]));
+
+    // hits don't refresh a block hash, the next oldest is evicted now
+    cache.Get(vecHashes[1], mapMasternodes);
+    BOOST_CHECK(cache.Get(vecHashes[0], mapMasternodes) == CalculateScores(mapMasternodes, vecHashes[0]));
+    BOOST_CHECK(cache.Has(vecHashes[0]));
+    BOOST_CHECK(!cache.Has(vecHashes[1]));
+    BOOST_CHECK(cache.Has(vecHashes[2]));
+    BOOST_CHECK_EQUAL(cache.size(), nMaxSize);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
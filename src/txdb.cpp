@@ -7,6 +7,7 @@
 
 #include "chainparams.h"
 #include "hash.h"
+#include "indexbuilder.h"
 #include "pow.h"
 #include "uint256.h"
 #include "ui_interface.h"
@@ -14,6 +15,9 @@
 
 #include <stdint.h>
 
+#include <map>
+#include <set>
+
 #include <boost/thread.hpp>
 
 using namespace std;
@@ -26,6 +30,9 @@ static const char DB_ADDRESSINDEX = 'a';
 static const char DB_ADDRESSUNSPENTINDEX = 'u';
 static const char DB_TIMESTAMPINDEX = 's';
 static const char DB_SPENTINDEX = 'p';
+static const char DB_ADDRESSBALANCEINDEX = 'w';
+static const char DB_ADDRESSBALANCEBEST = 'W';
+static const char DB_INDEXBUILD = 'i';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
@@ -260,20 +267,176 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
     return true;
 }
 
-bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
+void CBlockTreeDB::ReadAddressBalanceBest(CAddressBalanceBest &best) {
+    if (!Read(DB_ADDRESSBALANCEBEST, best))
+        best.SetNull();
+}
+
+bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect, const CBlockIndex* pindex, bool fBuild) {
+    CAddressBalanceBest best;
+    ReadAddressBalanceBest(best);
+
     CDBBatch batch(*this);
+    // A block which is connected again after an unclean shutdown (or indexed
+    // again by the index builder) is counted already
+    if (fBuild) {
+        if (pindex->nHeight >= best.nBuildHeight && pindex->nHeight < best.nLiveHeight)
+            UpdateAddressBalances(batch, vect, true);
+        best.nBuildHeight = std::max(best.nBuildHeight, pindex->nHeight + 1);
+    } else {
+        // Only the block on top of the last counted one is new, comparing hashes
+        // keeps a block of another branch at the same height apart
+        uint256 hashPrev = pindex->pprev ? pindex->pprev->GetBlockHash() : uint256();
+        if (best.hashBlock.IsNull() || best.hashBlock == hashPrev) {
+            UpdateAddressBalances(batch, vect, true);
+            best.hashBlock = pindex->GetBlockHash();
+        }
+    }
+    batch.Write(DB_ADDRESSBALANCEBEST, best);
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
+bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect, const CBlockIndex* pindex) {
+    CAddressBalanceBest best;
+    ReadAddressBalanceBest(best);
+
     CDBBatch batch(*this);
+    // Only the last counted block can be taken back, any other one was
+    // disconnected already or never counted
+    if (best.hashBlock == pindex->GetBlockHash()) {
+        if (best.IsCounted(pindex->nHeight))
+            UpdateAddressBalances(batch, vect, false);
+        best.hashBlock = pindex->pprev ? pindex->pprev->GetBlockHash() : uint256();
+        // Like CIndexBuilder::BlockDisconnected, the block replacing it is indexed when it is connected
+        best.nBuildHeight = std::min(best.nBuildHeight, pindex->nHeight);
+        best.nLiveHeight = std::min(best.nLiveHeight, pindex->nHeight);
+        batch.Write(DB_ADDRESSBALANCEBEST, best);
+    }
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
     return WriteBatch(batch);
 }
 
+void CBlockTreeDB::UpdateAddressBalances(CDBBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, bool fConnect) {
+    std::map<std::pair<unsigned int, uint160>, CAddressBalanceValue> mapBalances;
+    std::set<std::pair<std::pair<unsigned int, uint160>, uint256> > setCountedTxes;
+    int nSign = fConnect ? 1 : -1;
+
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        std::pair<unsigned int, uint160> address = make_pair(it->first.type, it->first.hashBytes);
+        std::map<std::pair<unsigned int, uint160>, CAddressBalanceValue>::iterator mi = mapBalances.find(address);
+        if (mi == mapBalances.end()) {
+            CAddressBalanceValue value;
+            if (!Read(make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(address.first, address.second)), value))
+                value.SetNull();
+            mi = mapBalances.insert(make_pair(address, value)).first;
+        }
+
+        CAddressBalanceValue& value = mi->second;
+        value.balance += nSign * it->second;
+        if (it->second > 0)
+            value.received += nSign * it->second;
+        value.utxoCount += it->first.spending ? -nSign : nSign;
+        if (setCountedTxes.insert(make_pair(address, it->first.txhash)).second)
+            value.txCount += nSign;
+    }
+
+    for (std::map<std::pair<unsigned int, uint160>, CAddressBalanceValue>::const_iterator it=mapBalances.begin(); it!=mapBalances.end(); it++) {
+        CAddressIndexIteratorKey key(it->first.first, it->first.second);
+        if (it->second.IsNull()) {
+            batch.Erase(make_pair(DB_ADDRESSBALANCEINDEX, key));
+        } else {
+            batch.Write(make_pair(DB_ADDRESSBALANCEINDEX, key), it->second);
+        }
+    }
+}
+
+bool CBlockTreeDB::ReadAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &value) {
+    return Read(make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(type, addressHash)), value);
+}
+
+bool CBlockTreeDB::BuildAddressBalanceIndex(const uint256& hashBestBlock) {
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    CDBBatch batch(*this);
+
+    pcursor->Seek(DB_ADDRESSINDEX);
+
+    CAddressIndexKey prevKey;
+    CAddressBalanceValue value;
+    bool fHaveAddress = false;
+
+    while (true) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CAddressIndexKey> key;
+        bool fValid = pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX;
+
+        // Entries are sorted by address first, flush the totals once we move past one
+        if (fHaveAddress && (!fValid || key.second.type != prevKey.type || key.second.hashBytes != prevKey.hashBytes)) {
+            batch.Write(make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(prevKey.type, prevKey.hashBytes)), value);
+            value.SetNull();
+            fHaveAddress = false;
+            if (batch.SizeEstimate() > (1 << 24)) {
+                if (!WriteBatch(batch))
+                    return error("%s: failed to write address balance index", __func__);
+                batch.Clear();
+            }
+        }
+        if (!fValid)
+            break;
+
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("%s: failed to get address index value", __func__);
+
+        value.balance += nValue;
+        if (nValue > 0)
+            value.received += nValue;
+        value.utxoCount += key.second.spending ? -1 : 1;
+        // ...and then by height and position in the block, so all deltas of a tx are adjacent
+        if (!fHaveAddress || key.second.txhash != prevKey.txhash)
+            value.txCount++;
+
+        prevKey = key.second;
+        fHaveAddress = true;
+        pcursor->Next();
+    }
+
+    CAddressBalanceBest best;
+    best.hashBlock = hashBestBlock;
+    batch.Write(DB_ADDRESSBALANCEBEST, best);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ResetAddressBalanceIndex(const CBlockIndex* pindexTip, int nLiveHeight) {
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    CDBBatch batch(*this);
+
+    pcursor->Seek(DB_ADDRESSBALANCEINDEX);
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CAddressIndexIteratorKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSBALANCEINDEX)
+            break;
+        batch.Erase(key);
+        if (batch.SizeEstimate() > (1 << 24)) {
+            if (!WriteBatch(batch))
+                return error("%s: failed to erase address balance index", __func__);
+            batch.Clear();
+        }
+        pcursor->Next();
+    }
+
+    CAddressBalanceBest best;
+    if (pindexTip)
+        best.hashBlock = pindexTip->GetBlockHash();
+    best.nLiveHeight = nLiveHeight;
+    batch.Write(DB_ADDRESSBALANCEBEST, best);
+    return WriteBatch(batch);
+}
+
 bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
                                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                                     int start, int end) {
@@ -334,6 +497,18 @@ bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned i
     return true;
 }
 
+bool CBlockTreeDB::ReadIndexBuildProgress(CIndexBuildProgress &progress) {
+    return Read(DB_INDEXBUILD, progress);
+}
+
+bool CBlockTreeDB::WriteIndexBuildProgress(const CIndexBuildProgress &progress) {
+    return Write(DB_INDEXBUILD, progress);
+}
+
+bool CBlockTreeDB::EraseIndexBuildProgress() {
+    return Erase(DB_INDEXBUILD);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -20,6 +20,7 @@
 
 class CBlockIndex;
 class CCoinsViewDBCursor;
+struct CIndexBuildProgress;
 class uint256;
 
 //! Compensate for extra memory peak (x1.5-x1.9) at flush time.
@@ -128,16 +129,29 @@ public:
     bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
     bool ReadAddressUnspentIndex(uint160 addressHash, int type,
                                  std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
-    bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
-    bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
+    /** Write the deltas of the block pindex, fBuild if the index builder indexed it */
+    bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, const CBlockIndex* pindex, bool fBuild = false);
+    bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, const CBlockIndex* pindex);
     bool ReadAddressIndex(uint160 addressHash, int type,
                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                           int start = 0, int end = 0);
+    bool ReadAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &value);
+    /** Fill the address balance index from an address index which was built without it, up to hashBestBlock */
+    bool BuildAddressBalanceIndex(const uint256& hashBestBlock);
+    /** Drop all balances, the index builder counts the blocks below nLiveHeight again and pindexTip is the last one */
+    bool ResetAddressBalanceIndex(const CBlockIndex* pindexTip, int nLiveHeight);
     bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
     bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &vect);
+    bool ReadIndexBuildProgress(CIndexBuildProgress &progress);
+    bool WriteIndexBuildProgress(const CIndexBuildProgress &progress);
+    bool EraseIndexBuildProgress();
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+private:
+    void ReadAddressBalanceBest(CAddressBalanceBest &best);
+    /** Apply (or revert) address index deltas to the per-address balances, as part of batch */
+    void UpdateAddressBalances(CDBBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, bool fConnect);
 };
 
 #endif // BITCOIN_TXDB_H
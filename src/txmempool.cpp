@@ -416,62 +416,89 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     return true;
 }
 
-void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view)
+void CTxMemPool::getAddressDeltas(const CTxMemPoolEntry &entry, const CCoinsViewCache &view, addressDeltaVector &deltasRet)
 {
-    LOCK(cs);
     const CTransaction& tx = entry.GetTx();
-    std::vector<CMempoolAddressDeltaKey> inserted;
-
     uint256 txhash = tx.GetHash();
+    int addressType;
+    uint160 addressHash;
+
+    deltasRet.clear();
+    deltasRet.reserve(tx.vin.size() + tx.vout.size());
+
     for (unsigned int j = 0; j < tx.vin.size(); j++) {
-        const CTxIn input = tx.vin[j];
-        const Coin& coin = view.AccessCoin(input.prevout);
-        const CTxOut &prevout = coin.out;
-        if (prevout.scriptPubKey.IsPayToScriptHash()) {
-            vector<unsigned char> hashBytes(prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22);
-            CMempoolAddressDeltaKey key(2, uint160(hashBytes), txhash, j, 1);
+        const CTxIn& input = tx.vin[j];
+        const CTxOut &prevout = view.AccessCoin(input.prevout).out;
+        if (GetIndexAddress(prevout.scriptPubKey, addressType, addressHash)) {
+            CMempoolAddressDeltaKey key(addressType, addressHash, txhash, j, 1);
             CMempoolAddressDelta delta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n);
-            mapAddress.insert(make_pair(key, delta));
-            inserted.push_back(key);
-        } else if (prevout.scriptPubKey.IsPayToPublicKeyHash()) {
-            vector<unsigned char> hashBytes(prevout.scriptPubKey.begin()+3, prevout.scriptPubKey.begin()+23);
-            CMempoolAddressDeltaKey key(1, uint160(hashBytes), txhash, j, 1);
-            CMempoolAddressDelta delta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n);
-            mapAddress.insert(make_pair(key, delta));
-            inserted.push_back(key);
+            deltasRet.push_back(make_pair(key, delta));
         }
     }
 
     for (unsigned int k = 0; k < tx.vout.size(); k++) {
         const CTxOut &out = tx.vout[k];
-        if (out.scriptPubKey.IsPayToScriptHash()) {
-            vector<unsigned char> hashBytes(out.scriptPubKey.begin()+2, out.scriptPubKey.begin()+22);
-            CMempoolAddressDeltaKey key(2, uint160(hashBytes), txhash, k, 0);
-            mapAddress.insert(make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
-            inserted.push_back(key);
-        } else if (out.scriptPubKey.IsPayToPublicKeyHash()) {
-            vector<unsigned char> hashBytes(out.scriptPubKey.begin()+3, out.scriptPubKey.begin()+23);
-            std::pair<addressDeltaMap::iterator,bool> ret;
-            CMempoolAddressDeltaKey key(1, uint160(hashBytes), txhash, k, 0);
-            mapAddress.insert(make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
-            inserted.push_back(key);
+        if (GetIndexAddress(out.scriptPubKey, addressType, addressHash)) {
+            CMempoolAddressDeltaKey key(addressType, addressHash, txhash, k, 0);
+            deltasRet.push_back(make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
         }
     }
+}
 
-    mapAddressInserted.insert(make_pair(txhash, inserted));
+void CTxMemPool::addAddressIndex(const uint256 &txhash, const addressDeltaVector &deltas)
+{
+    LOCK(cs);
+    std::vector<CMempoolAddressDeltaKey>& inserted = mapAddressInserted[txhash];
+    inserted.reserve(deltas.size());
+
+    for (addressDeltaVector::const_iterator it = deltas.begin(); it != deltas.end(); it++) {
+        mapAddress.insert(*it);
+        inserted.push_back(it->first);
+    }
 }
 
-bool CTxMemPool::getAddressIndex(std::vector<std::pair<uint160, int> > &addresses,
-                                 std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results)
+void CTxMemPool::forEachAddressDelta(std::vector<std::pair<uint160, int> > addresses,
+                                     std::function<bool(const CMempoolAddressDeltaKey&, const CMempoolAddressDelta&)> fn)
 {
+    // the same address asked for twice is visited once
+    std::sort(addresses.begin(), addresses.end());
+    addresses.erase(std::unique(addresses.begin(), addresses.end()), addresses.end());
+
     LOCK(cs);
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
         addressDeltaMap::iterator ait = mapAddress.lower_bound(CMempoolAddressDeltaKey((*it).second, (*it).first));
         while (ait != mapAddress.end() && (*ait).first.addressBytes == (*it).first && (*ait).first.type == (*it).second) {
-            results.push_back(*ait);
+            if (!fn(ait->first, ait->second))
+                return;
             ait++;
         }
     }
+}
+
+bool CTxMemPool::getAddressIndex(std::vector<std::pair<uint160, int> > &addresses,
+                                 std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results)
+{
+    forEachAddressDelta(addresses, [&results](const CMempoolAddressDeltaKey& key, const CMempoolAddressDelta& delta) {
+        results.push_back(make_pair(key, delta));
+        return true;
+    });
+    return true;
+}
+
+bool CTxMemPool::getTransactionAddresses(const uint256 &txhash, std::vector<std::pair<uint160, int> > &addressesRet)
+{
+    addressesRet.clear();
+
+    LOCK(cs);
+    addressDeltaMapInserted::const_iterator it = mapAddressInserted.find(txhash);
+    if (it == mapAddressInserted.end())
+        return false;
+
+    for (std::vector<CMempoolAddressDeltaKey>::const_iterator kit = it->second.begin(); kit != it->second.end(); kit++) {
+        std::pair<uint160, int> address(kit->addressBytes, kit->type);
+        if (std::find(addressesRet.begin(), addressesRet.end(), address) == addressesRet.end())
+            addressesRet.push_back(address);
+    }
     return true;
 }
 
@@ -481,8 +508,8 @@ bool CTxMemPool::removeAddressIndex(const uint256 txhash)
     addressDeltaMapInserted::iterator it = mapAddressInserted.find(txhash);
 
     if (it != mapAddressInserted.end()) {
-        std::vector<CMempoolAddressDeltaKey> keys = (*it).second;
-        for (std::vector<CMempoolAddressDeltaKey>::iterator mit = keys.begin(); mit != keys.end(); mit++) {
+        const std::vector<CMempoolAddressDeltaKey>& keys = (*it).second;
+        for (std::vector<CMempoolAddressDeltaKey>::const_iterator mit = keys.begin(); mit != keys.end(); mit++) {
             mapAddress.erase(*mit);
         }
         mapAddressInserted.erase(it);
@@ -506,16 +533,7 @@ void CTxMemPool::addSpentIndex(const CTxMemPoolEntry &entry, const CCoinsViewCac
         uint160 addressHash;
         int addressType;
 
-        if (prevout.scriptPubKey.IsPayToScriptHash()) {
-            addressHash = uint160(vector<unsigned char> (prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22));
-            addressType = 2;
-        } else if (prevout.scriptPubKey.IsPayToPublicKeyHash()) {
-            addressHash = uint160(vector<unsigned char> (prevout.scriptPubKey.begin()+3, prevout.scriptPubKey.begin()+23));
-            addressType = 1;
-        } else {
-            addressHash.SetNull();
-            addressType = 0;
-        }
+        GetIndexAddress(prevout.scriptPubKey, addressType, addressHash);
 
         CSpentIndexKey key = CSpentIndexKey(input.prevout.hash, input.prevout.n);
         CSpentIndexValue value = CSpentIndexValue(txhash, j, -1, prevout.nValue, addressType, addressHash);
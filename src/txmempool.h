@@ -6,6 +6,7 @@
 #ifndef BITCOIN_TXMEMPOOL_H
 #define BITCOIN_TXMEMPOOL_H
 
+#include <functional>
 #include <list>
 #include <set>
 
@@ -479,9 +480,18 @@ public:
     bool addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, bool fCurrentEstimate = true);
     bool addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, setEntries &setAncestors, bool fCurrentEstimate = true);
 
-    void addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view);
+    typedef std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > addressDeltaVector;
+
+    /** Extract the address deltas of entry's inputs and outputs, done once when it is accepted */
+    static void getAddressDeltas(const CTxMemPoolEntry &entry, const CCoinsViewCache &view, addressDeltaVector &deltasRet);
+    void addAddressIndex(const uint256 &txhash, const addressDeltaVector &deltas);
+    /** Visit the deltas of each distinct address in turn, stops as soon as fn returns false */
+    void forEachAddressDelta(std::vector<std::pair<uint160, int> > addresses,
+                             std::function<bool(const CMempoolAddressDeltaKey&, const CMempoolAddressDelta&)> fn);
     bool getAddressIndex(std::vector<std::pair<uint160, int> > &addresses,
                          std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results);
+    /** Distinct addresses a transaction in the pool spends from or pays to, false if it isn't indexed */
+    bool getTransactionAddresses(const uint256 &txhash, std::vector<std::pair<uint160, int> > &addressesRet);
     bool removeAddressIndex(const uint256 txhash);
 
     void addSpentIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view);
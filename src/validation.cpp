@@ -8,13 +8,16 @@
 
 #include "alert.h"
 #include "arith_uint256.h"
+#include "blockfilemap.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "crypto/common.h"
 #include "hash.h"
+#include "indexbuilder.h"
 #include "init.h"
 #include "policy/policy.h"
 #include "pow.h"
@@ -40,6 +43,8 @@
 #include "masternodeman.h"
 #include "masternode-payments.h"
 
+#include <atomic>
+#include <future>
 #include <sstream>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -79,6 +84,8 @@ bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
 unsigned int nBytesPerSigOp = DEFAULT_BYTES_PER_SIGOP;
 bool fCheckBlockIndex = false;
+bool fBlockPrefetch = DEFAULT_BLOCK_PREFETCH;
+bool fBlockMmap = DEFAULT_BLOCK_MMAP;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
@@ -994,7 +1001,9 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
 
         // Add memory address index
         if (fAddressIndex) {
-            pool.addAddressIndex(entry, view);
+            CTxMemPool::addressDeltaVector vecAddressDeltas;
+            CTxMemPool::getAddressDeltas(entry, view, vecAddressDeltas);
+            pool.addAddressIndex(hash, vecAddressDeltas);
         }
 
         // Add memory spent index
@@ -1069,6 +1078,18 @@ bool GetAddressIndex(uint160 addressHash, int type,
     return true;
 }
 
+bool GetAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &value)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    // Addresses without any history have no entry
+    if (!pblocktree->ReadAddressBalance(addressHash, type, value))
+        value.SetNull();
+
+    return true;
+}
+
 bool GetAddressUnspent(uint160 addressHash, int type,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs)
 {
@@ -1169,21 +1190,65 @@ bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHea
     return true;
 }
 
+static CBlockFileMap mappedBlockFiles(MAX_MAPPED_BLOCK_FILES);
+
+/**
+ * Find the block record at pos in a memory mapped block file, i.e. the
+ * message start and size written by WriteBlockToDisk right before the block.
+ * Returns NULL if mapping is disabled or fails, or if the record doesn't look
+ * sane; callers fall back to reading through stdio then, which reports errors.
+ */
+static std::shared_ptr<const CMappedFile> MapBlockRecord(const CDiskBlockPos& pos, unsigned int& nSizeRet)
+{
+    static const size_t nHeaderSize = MESSAGE_START_SIZE + sizeof(uint32_t);
+
+    if (!fBlockMmap || pos.nPos < nHeaderSize)
+        return nullptr;
+
+    std::shared_ptr<const CMappedFile> file = mappedBlockFiles.Get(pos.nFile, pos.nPos);
+    if (!file)
+        return nullptr;
+
+    const unsigned char* pheader = file->data() + pos.nPos - nHeaderSize;
+    if (memcmp(pheader, Params().MessageStart(), MESSAGE_START_SIZE) != 0)
+        return nullptr;
+    nSizeRet = ReadLE32(pheader + MESSAGE_START_SIZE);
+    if (nSizeRet < 80 || nSizeRet > MAX_BLOCKFILE_SIZE)
+        return nullptr;
+
+    if ((uint64_t)pos.nPos + nSizeRet > file->size())
+        file = mappedBlockFiles.Get(pos.nFile, pos.nPos + nSizeRet);
+    return file;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+    unsigned int nSize;
+    std::shared_ptr<const CMappedFile> file = MapBlockRecord(pos, nSize);
+    if (file) {
+        // Deserialize straight from the mapping
+        try {
+            CSpanReader reader(file->data() + pos.nPos, nSize, SER_DISK, CLIENT_VERSION);
+            reader >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
+        }
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
 
-    // Read block
-    try {
-        filein >> block;
-    }
-    catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        // Read block
+        try {
+            filein >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
     }
 
     // Check the header
@@ -1203,6 +1268,54 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CDiskBlockPos& pos)
+{
+    vchBlock.clear();
+
+    unsigned int nSize;
+    std::shared_ptr<const CMappedFile> file = MapBlockRecord(pos, nSize);
+    if (file) {
+        vchBlock.assign(file->data() + pos.nPos, file->data() + pos.nPos + nSize);
+        return true;
+    }
+
+    if (pos.nPos < MESSAGE_START_SIZE + sizeof(uint32_t))
+        return error("%s: Invalid block position %s", __func__, pos.ToString());
+
+    // Open history file at the record header to read
+    CDiskBlockPos posHeader(pos.nFile, pos.nPos - MESSAGE_START_SIZE - sizeof(uint32_t));
+    CAutoFile filein(OpenBlockFile(posHeader, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+
+    try {
+        CMessageHeader::MessageStartChars messageStart;
+        filein >> FLATDATA(messageStart) >> nSize;
+        if (memcmp(messageStart, Params().MessageStart(), MESSAGE_START_SIZE) != 0)
+            return error("%s: Block magic mismatch at %s", __func__, pos.ToString());
+        if (nSize < 80 || nSize > MAX_BLOCKFILE_SIZE)
+            return error("%s: Block size %u out of range at %s", __func__, nSize, pos.ToString());
+        vchBlock.resize(nSize);
+        filein.read((char*)vchBlock.data(), nSize);
+    }
+    catch (const std::exception& e) {
+        return error("%s: I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+
+    return true;
+}
+
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CBlockIndex* pindex)
+{
+    if (!ReadRawBlockFromDisk(vchBlock, pindex->GetBlockPos()))
+        return false;
+    // The block isn't deserialized, at least make sure it is the one we asked for
+    if (HashX11(vchBlock.begin(), vchBlock.begin() + 80) != pindex->GetBlockHash())
+        return error("ReadRawBlockFromDisk(CBlockIndex*): hash doesn't match index for %s at %s",
+                pindex->ToString(), pindex->GetBlockPos().ToString());
+    return true;
+}
+
 double ConvertBitsToDouble(unsigned int nBits)
 {
     int nShift = (nBits >> 24) & 0xff;
@@ -1592,6 +1705,8 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     return true;
 }
 
+} // anon namespace
+
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
 {
     // Open history file to read
@@ -1618,6 +1733,8 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uin
     return true;
 }
 
+namespace {
+
 /** Abort with a message */
 bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
 {
@@ -1811,7 +1928,7 @@ static DisconnectResult DisconnectBlock(const CBlock& block, CValidationState& s
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
     if (fAddressIndex) {
-        if (!pblocktree->EraseAddressIndex(addressIndex)) {
+        if (!pblocktree->EraseAddressIndex(addressIndex, pindex)) {
             AbortNode(state, "Failed to delete address index");
             return DISCONNECT_FAILED;
         }
@@ -1832,8 +1949,11 @@ void static FlushBlockFile(bool fFinalize = false)
 
     FILE *fileOld = OpenBlockFile(posOld);
     if (fileOld) {
-        if (fFinalize)
+        if (fFinalize) {
+            // don't keep a mapping which extends past the end of the file
+            mappedBlockFiles.Invalidate(nLastBlockFile);
             TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
+        }
         FileCommit(fileOld);
         fclose(fileOld);
     }
@@ -2257,7 +2377,7 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
             return AbortNode(state, "Failed to write transaction index");
 
     if (fAddressIndex) {
-        if (!pblocktree->WriteAddressIndex(addressIndex)) {
+        if (!pblocktree->WriteAddressIndex(addressIndex, pindex)) {
             return AbortNode(state, "Failed to write address index");
         }
 
@@ -2291,6 +2411,9 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     return true;
 }
 
+/** Incremented whenever pcoinsTip is written to pcoinsdbview, coins read from it earlier may be stale */
+static std::atomic<uint64_t> nCoinsDBWriteSequence(0);
+
 /**
  * Update the on-disk chain state.
  * The caches and indexes are flushed depending on the mode we're called with
@@ -2382,6 +2505,7 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
         if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
             return state.Error("out of disk space");
         // Flush the chainstate (which may refer to block index entries).
+        nCoinsDBWriteSequence++;
         if (!pcoinsTip->Flush())
             return AbortNode(state, "Failed to write to coin database");
         nLastFlush = nNow;
@@ -2482,6 +2606,8 @@ bool static DisconnectTip(CValidationState& state, const Consensus::Params& cons
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         assert(view.Flush());
     }
+    indexbuilder.BlockDisconnected(pindexDelete->nHeight);
+    mnpayeeindex.BlockDisconnected(pindexDelete);
     LogPrint("bench", "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
@@ -2519,22 +2645,112 @@ static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
 static int64_t nTimePostConnect = 0;
+static int64_t nTimePrefetch = 0;
+
+/** A block read ahead of ConnectTip, together with the coins its inputs spend */
+struct CPrefetchedBlock
+{
+    std::shared_ptr<CBlock> pblock;
+    std::vector<std::pair<COutPoint, Coin> > vCoins;
+    int64_t nTime;
+
+    CPrefetchedBlock() : nTime(0) {}
+};
+
+// The block which is being prefetched and the coins database write it was started at,
+// protected by cs_main
+static const CBlockIndex* pindexPrefetch = NULL;
+static uint64_t nPrefetchWriteSequence = 0;
+static std::future<CPrefetchedBlock> futurePrefetch;
+
+static CPrefetchedBlock PrefetchBlock(const CBlockIndex* pindex, const CCoinsViewDB* pcoinsDB, const Consensus::Params& consensusParams)
+{
+    RenameThread("square-prefetch");
+    int64_t nTimeStart = GetTimeMicros();
+    CPrefetchedBlock prefetched;
+    // Deserializing the block also calculates and caches all transaction hashes
+    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+    if (!ReadBlockFromDisk(*pblock, pindex, consensusParams))
+        return prefetched;
+
+    // Outputs created in the block itself can't be in the database yet
+    std::set<uint256> setBlockTxids;
+    BOOST_FOREACH(const CTransaction& tx, pblock->vtx)
+        setBlockTxids.insert(tx.GetHash());
+    for (size_t i = 1; pcoinsDB && i < pblock->vtx.size(); i++) {
+        BOOST_FOREACH(const CTxIn& txin, pblock->vtx[i].vin) {
+            if (setBlockTxids.count(txin.prevout.hash))
+                continue;
+            Coin coin;
+            if (pcoinsDB->GetCoin(txin.prevout, coin))
+                prefetched.vCoins.push_back(std::make_pair(txin.prevout, std::move(coin)));
+        }
+    }
+    prefetched.pblock = pblock;
+    prefetched.nTime = GetTimeMicros() - nTimeStart;
+    return prefetched;
+}
+
+/** Wait for the pending prefetch, if any. Returns true if it was a successful one for pindex. */
+static bool GetPrefetchedBlock(const CBlockIndex* pindex, CPrefetchedBlock& prefetched)
+{
+    AssertLockHeld(cs_main);
+    if (!futurePrefetch.valid())
+        return false;
+    const CBlockIndex* pindexPrefetched = pindexPrefetch;
+    pindexPrefetch = NULL;
+    try {
+        prefetched = futurePrefetch.get();
+    } catch (const std::exception& e) {
+        // The caller will run into the same problem when reading the block itself
+        LogPrintf("%s: failed to prefetch block %s: %s\n", __func__, pindexPrefetched->GetBlockHash().ToString(), e.what());
+        return false;
+    }
+    return pindexPrefetched == pindex && prefetched.pblock;
+}
+
+void ResetBlockPrefetch()
+{
+    LOCK(cs_main);
+    CPrefetchedBlock prefetched;
+    GetPrefetchedBlock(NULL, prefetched);
+}
 
 /**
  * Connect a new block to chainActive. pblock is either NULL or a pointer to a CBlock
- * corresponding to pindexNew, to bypass loading it again from disk.
+ * corresponding to pindexNew, to bypass loading it again from disk. pindexNext is
+ * either NULL or the block expected to be connected after pindexNew, which is read
+ * and has its coins loaded on another thread while pindexNew is being connected.
  */
-bool static ConnectTip(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const CBlock* pblock)
+bool static ConnectTip(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const CBlock* pblock, const CBlockIndex* pindexNext)
 {
     assert(pindexNew->pprev == chainActive.Tip());
-    // Read block from disk.
+    // Read block from disk, unless it was prefetched while connecting the previous one.
     int64_t nTime1 = GetTimeMicros();
+    CPrefetchedBlock prefetched;
+    if (GetPrefetchedBlock(pindexNew, prefetched)) {
+        nTimePrefetch += prefetched.nTime;
+        // A flush of pcoinsTip may have raced with reading the coins, only the block can be used then
+        bool fCoinsValid = nPrefetchWriteSequence == nCoinsDBWriteSequence;
+        if (fCoinsValid) {
+            for (size_t i = 0; i < prefetched.vCoins.size(); i++)
+                pcoinsTip->Prefetch(prefetched.vCoins[i].first, std::move(prefetched.vCoins[i].second));
+        }
+        LogPrint("bench", "  - Prefetch block and %u coins%s: %.2fms in parallel [%.2fs]\n", (unsigned)prefetched.vCoins.size(), fCoinsValid ? "" : " (stale)", prefetched.nTime * 0.001, nTimePrefetch * 0.000001);
+        if (!pblock)
+            pblock = prefetched.pblock.get();
+    }
     CBlock block;
     if (!pblock) {
         if (!ReadBlockFromDisk(block, pindexNew, chainparams.GetConsensus()))
             return AbortNode(state, "Failed to read block");
         pblock = &block;
     }
+    if (fBlockPrefetch && pindexNext) {
+        pindexPrefetch = pindexNext;
+        nPrefetchWriteSequence = nCoinsDBWriteSequence;
+        futurePrefetch = std::async(std::launch::async, PrefetchBlock, pindexNext, pcoinsdbview, std::cref(chainparams.GetConsensus()));
+    }
     // Apply the block atomically to the chain state.
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
@@ -2552,6 +2768,7 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
         LogPrint("bench", "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
         assert(view.Flush());
     }
+    mnpayeeindex.BlockConnected(*pblock, pindexNew);
     int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
     LogPrint("bench", "  - Flush: %.2fms [%.2fs]\n", (nTime4 - nTime3) * 0.001, nTimeFlush * 0.000001);
     // Write the chain state to disk, if necessary.
@@ -2731,7 +2948,8 @@ static bool ActivateBestChainStep(CValidationState& state, const CChainParams& c
 
         // Connect new blocks.
         BOOST_REVERSE_FOREACH(CBlockIndex *pindexConnect, vpindexToConnect) {
-            if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : NULL)) {
+            const CBlockIndex* pindexNext = pindexConnect == pindexMostWork ? NULL : pindexMostWork->GetAncestor(pindexConnect->nHeight + 1);
+            if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : NULL, pindexNext)) {
                 if (state.IsInvalid()) {
                     // The block violates a consensus rule.
                     if (!state.CorruptionPossible())
@@ -3094,9 +3312,14 @@ bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigne
 }
 
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW)
+{
+    return CheckBlockHeader(block, fCheckPOW ? block.GetHash() : uint256(), state, fCheckPOW);
+}
+
+bool CheckBlockHeader(const CBlockHeader& block, const uint256& hash, CValidationState& state, bool fCheckPOW)
 {
     // Check proof of work matches claimed amount
-    if (fCheckPOW && !CheckProofOfWork(block.GetHash(), block.nBits, Params().GetConsensus()))
+    if (fCheckPOW && !CheckProofOfWork(hash, block.nBits, Params().GetConsensus()))
         return state.DoS(50, error("CheckBlockHeader(): proof of work failed"),
                          REJECT_INVALID, "high-hash");
 
@@ -3319,11 +3542,10 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     return true;
 }
 
-static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+static bool AcceptBlockHeader(const CBlockHeader& block, const uint256& hash, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
-    uint256 hash = block.GetHash();
     BlockMap::iterator miSelf = mapBlockIndex.find(hash);
     CBlockIndex *pindex = NULL;
 
@@ -3340,7 +3562,7 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
             return true;
         }
 
-        if (!CheckBlockHeader(block, state))
+        if (!CheckBlockHeader(block, hash, state))
             return false;
 
         // Get prev block index
@@ -3376,10 +3598,17 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
 // Exposed wrapper for AcceptBlockHeader
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
 {
+    // Hash the whole run in one batch before taking cs_main
+    return ProcessNewBlockHeaders(headers, GetBlockHeaderHashes(headers), state, chainparams, ppindex);
+}
+
+bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, const std::vector<uint256>& vHashes, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+{
+    assert(headers.size() == vHashes.size());
     {
         LOCK(cs_main);
-        for (const CBlockHeader& header : headers) {
-            if (!AcceptBlockHeader(header, state, chainparams, ppindex)) {
+        for (size_t i = 0; i < headers.size(); i++) {
+            if (!AcceptBlockHeader(headers[i], vHashes[i], state, chainparams, ppindex)) {
                 return false;
             }
         }
@@ -3397,7 +3626,8 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, const CCha
     CBlockIndex *pindexDummy = NULL;
     CBlockIndex *&pindex = ppindex ? *ppindex : pindexDummy;
 
-    if (!AcceptBlockHeader(block, state, chainparams, &pindex))
+    // A single block is hashed on its own, only runs of headers are hashed in batches
+    if (!AcceptBlockHeader(block, block.GetHash(), state, chainparams, &pindex))
         return false;
 
     // Try to process all requested blocks that we don't have, but only
@@ -3577,6 +3807,7 @@ void UnlinkPrunedFiles(std::set<int>& setFilesToPrune)
 {
     for (set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        mappedBlockFiles.Invalidate(*it);
         boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
         boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -3796,6 +4027,18 @@ bool static LoadBlockIndexDB()
     pblocktree->ReadFlag("addressindex", fAddressIndex);
     LogPrintf("%s: address index %s\n", __func__, fAddressIndex ? "enabled" : "disabled");
 
+    // Address indexes created before the address balance index existed need it filled in once
+    if (fAddressIndex) {
+        bool fAddressBalanceIndex = false;
+        pblocktree->ReadFlag("addressbalanceindex", fAddressBalanceIndex);
+        if (!fAddressBalanceIndex) {
+            LogPrintf("%s: building address balance index...\n", __func__);
+            if (!pblocktree->BuildAddressBalanceIndex(pcoinsTip->GetBestBlock()))
+                return error("%s: failed to build address balance index", __func__);
+            pblocktree->WriteFlag("addressbalanceindex", true);
+        }
+    }
+
     // Check whether we have a timestamp index
     pblocktree->ReadFlag("timestampindex", fTimestampIndex);
     LogPrintf("%s: timestamp index %s\n", __func__, fTimestampIndex ? "enabled" : "disabled");
@@ -3916,6 +4159,8 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
 void UnloadBlockIndex()
 {
     LOCK(cs_main);
+    ResetBlockPrefetch();
+    mappedBlockFiles.Clear();
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
     pindexBestInvalid = NULL;
@@ -3962,6 +4207,7 @@ bool InitBlockIndex(const CChainParams& chainparams)
     // Use the provided setting for -addressindex in the new database
     fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
     pblocktree->WriteFlag("addressindex", fAddressIndex);
+    pblocktree->WriteFlag("addressbalanceindex", fAddressIndex);
 
     // Use the provided setting for -timestampindex in the new database
     fTimestampIndex = GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
@@ -238,6 +238,7 @@ bool CCryptoKeyStore::Lock(bool fAllowMixing)
     if(!fAllowMixing) {
         LOCK(cs_KeyStore);
         vMasterKey.clear();
+        mapHDChangeKeys.clear();
     }
 
     fOnlyMixingAllowed = fAllowMixing;
@@ -506,6 +507,11 @@ bool CCryptoKeyStore::SetHDChain(const CHDChain& chain)
     if (chain.IsCrypted())
         return false;
 
+    LOCK(cs_KeyStore);
+    // updated account counters keep the cached keys valid, a new seed doesn't
+    if (chain.GetID() != hdChain.GetID())
+        mapHDChangeKeys.clear();
+
     hdChain = chain;
     return true;
 }
@@ -518,10 +524,36 @@ bool CCryptoKeyStore::SetCryptedHDChain(const CHDChain& chain)
     if (!chain.IsCrypted())
         return false;
 
+    LOCK(cs_KeyStore);
+    if (chain.GetID() != cryptedHDChain.GetID())
+        mapHDChangeKeys.clear();
+
     cryptedHDChain = chain;
     return true;
 }
 
+bool CCryptoKeyStore::DeriveHDChildExtKey(uint32_t nAccountIndex, bool fInternal, uint32_t nChildIndex, CExtKey& extKeyRet) const
+{
+    LOCK(cs_KeyStore);
+    hdchangekeyid_t changeKeyId = std::make_pair(nAccountIndex, fInternal ? 1 : 0);
+    HDChangeKeyMap::const_iterator it = mapHDChangeKeys.find(changeKeyId);
+    if (it == mapHDChangeKeys.end()) {
+        CHDChain hdChainTmp;
+        if (!GetHDChain(hdChainTmp))
+            return false;
+        if (!DecryptHDChain(hdChainTmp))
+            return false;
+        // make sure seed matches this chain
+        if (hdChainTmp.GetID() != hdChainTmp.GetSeedHash())
+            return false;
+
+        CExtKey changeKey;
+        hdChainTmp.DeriveChangeExtKey(nAccountIndex, fInternal, changeKey);
+        it = mapHDChangeKeys.insert(std::make_pair(changeKeyId, changeKey)).first;
+    }
+    return it->second.Derive(extKeyRet, nChildIndex);
+}
+
 bool CCryptoKeyStore::GetHDChain(CHDChain& hdChainRet) const
 {
     if(IsCrypted()) {
@@ -132,6 +132,13 @@ private:
     //! if fOnlyMixingAllowed is true, only mixing should be allowed in unlocked wallet
     bool fOnlyMixingAllowed;
 
+    //! account'/change extended keys of the HD chain by account and change index,
+    //! kept in locked memory and wiped together with vMasterKey
+    typedef std::pair<uint32_t, uint32_t> hdchangekeyid_t;
+    typedef std::map<hdchangekeyid_t, CExtKey, std::less<hdchangekeyid_t>,
+                     secure_allocator<std::pair<const hdchangekeyid_t, CExtKey> > > HDChangeKeyMap;
+    mutable HDChangeKeyMap mapHDChangeKeys;
+
 protected:
     bool SetCrypted();
 
@@ -143,6 +150,20 @@ protected:
     bool SetHDChain(const CHDChain& chain);
     bool SetCryptedHDChain(const CHDChain& chain);
 
+    /**
+     * Derive the HD key at m/44'/coin_type'/account'/change/nChildIndex. The
+     * seed is only decrypted, and the hardened account'/change part only
+     * derived, the first time an account's chain is used after unlocking.
+     * Fails if the wallet is locked.
+     */
+    bool DeriveHDChildExtKey(uint32_t nAccountIndex, bool fInternal, uint32_t nChildIndex, CExtKey& extKeyRet) const;
+    //! number of account'/change keys DeriveHDChildExtKey has cached
+    size_t CountHDChangeKeys() const
+    {
+        LOCK(cs_KeyStore);
+        return mapHDChangeKeys.size();
+    }
+
     bool Unlock(const CKeyingMaterial& vMasterKeyIn, bool fForMixingOnly = false);
 
 public:
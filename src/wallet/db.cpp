@@ -224,7 +224,7 @@ void CDBEnv::CheckpointLSN(const std::string& strFile)
 }
 
 
-CDB::CDB(const std::string& strFilename, const char* pszMode, bool fFlushOnCloseIn) : pdb(NULL), activeTxn(NULL)
+CDB::CDB(const std::string& strFilename, const char* pszMode, bool fFlushOnCloseIn) : pdb(NULL), activeTxn(NULL), plogdb(NULL), plogTxn(NULL)
 {
     int ret;
     fReadOnly = (!strchr(pszMode, '+') && !strchr(pszMode, 'w'));
@@ -237,6 +237,23 @@ CDB::CDB(const std::string& strFilename, const char* pszMode, bool fFlushOnClose
     if (fCreate)
         nFlags |= DB_CREATE;
 
+    {
+        // A file Berkeley DB has open can't be a log store, skip looking at its header then
+        LOCK(bitdb.cs_db);
+        if (!bitdb.IsMock() && (!bitdb.mapDb.count(strFilename) || bitdb.mapDb[strFilename] == NULL))
+            plogdb = logdbenv.Get(strFilename, fCreate && GetBoolArg("-logwallet", DEFAULT_LOGWALLET));
+    }
+    if (plogdb) {
+        strFile = strFilename;
+        if (fCreate && !Exists(string("version"))) {
+            bool fTmp = fReadOnly;
+            fReadOnly = false;
+            WriteVersion(CLIENT_VERSION);
+            fReadOnly = fTmp;
+        }
+        return;
+    }
+
     {
         LOCK(bitdb.cs_db);
         if (!bitdb.Open(GetDataDir()))
@@ -285,9 +302,14 @@ CDB::CDB(const std::string& strFilename, const char* pszMode, bool fFlushOnClose
 
 void CDB::Flush()
 {
-    if (activeTxn)
+    if (activeTxn || plogTxn)
         return;
 
+    if (plogdb) {
+        plogdb->Sync();
+        return;
+    }
+
     // Flush database activity from memory pool to disk log
     unsigned int nMinutes = 0;
     if (fReadOnly)
@@ -298,6 +320,15 @@ void CDB::Flush()
 
 void CDB::Close()
 {
+    if (plogdb) {
+        delete plogTxn;
+        plogTxn = NULL;
+        if (fFlushOnClose)
+            Flush();
+        plogdb = NULL;
+        logdbenv.Release(strFile);
+        return;
+    }
     if (!pdb)
         return;
     if (activeTxn)
@@ -337,8 +368,156 @@ bool CDBEnv::RemoveDb(const string& strFile)
     return (rc == 0);
 }
 
+bool CDB::ReadLog(const CDataStream& ssKey, CDataStream& ssValue)
+{
+    CSerializeData key(ssKey.begin(), ssKey.end());
+    CSerializeData value;
+    if (plogTxn) {
+        // see what the transaction changed first
+        CLogDBBatch::record_map_t::const_iterator it = plogTxn->mapRecords.find(key);
+        if (it != plogTxn->mapRecords.end()) {
+            if (it->second.first)
+                return false;
+            ssValue.write(it->second.second.data(), it->second.second.size());
+            return true;
+        }
+    }
+    if (!plogdb->Read(key, value))
+        return false;
+    ssValue.write(value.data(), value.size());
+    return true;
+}
+
+bool CDB::WriteLog(const CDataStream& ssKey, const CDataStream& ssValue, bool fOverwrite)
+{
+    if (!fOverwrite && ExistsLog(ssKey))
+        return false;
+
+    CSerializeData key(ssKey.begin(), ssKey.end());
+    CSerializeData value(ssValue.begin(), ssValue.end());
+    if (plogTxn) {
+        plogTxn->Write(key, value);
+        return true;
+    }
+    CLogDBBatch batch;
+    batch.Write(key, value);
+    return plogdb->Apply(batch);
+}
+
+bool CDB::EraseLog(const CDataStream& ssKey)
+{
+    CSerializeData key(ssKey.begin(), ssKey.end());
+    if (plogTxn) {
+        plogTxn->Erase(key);
+        return true;
+    }
+    if (!plogdb->Exists(key))
+        return true;
+    CLogDBBatch batch;
+    batch.Erase(key);
+    return plogdb->Apply(batch);
+}
+
+bool CDB::ExistsLog(const CDataStream& ssKey)
+{
+    CSerializeData key(ssKey.begin(), ssKey.end());
+    if (plogTxn) {
+        CLogDBBatch::record_map_t::const_iterator it = plogTxn->mapRecords.find(key);
+        if (it != plogTxn->mapRecords.end())
+            return !it->second.first;
+    }
+    return plogdb->Exists(key);
+}
+
+int CDB::ReadAtLogCursor(CDBCursor* pcursor, CDataStream& ssKey, CDataStream& ssValue, unsigned int fFlags)
+{
+    CSerializeData keyStart;
+    bool fAfter;
+    if (fFlags == DB_SET_RANGE) {
+        keyStart.assign(ssKey.begin(), ssKey.end());
+        fAfter = false;
+    } else if (fFlags == DB_NEXT) {
+        keyStart = pcursor->keyLast;
+        fAfter = pcursor->fStarted;
+    } else
+        return EINVAL;
+
+    // skip the records the transaction erased
+    CSerializeData key, value;
+    bool fFound = plogdb->Seek(keyStart, fAfter, key, value);
+    while (fFound && plogTxn) {
+        CLogDBBatch::record_map_t::const_iterator it = plogTxn->mapRecords.find(key);
+        if (it == plogTxn->mapRecords.end() || !it->second.first)
+            break;
+        CSerializeData keyErased = key;
+        fFound = plogdb->Seek(keyErased, true, key, value);
+    }
+
+    // and see what the transaction wrote, like ReadLog does
+    if (plogTxn) {
+        const CLogDBBatch::record_map_t& mapRecords = plogTxn->mapRecords;
+        CLogDBBatch::record_map_t::const_iterator it = fAfter ? mapRecords.upper_bound(keyStart) : mapRecords.lower_bound(keyStart);
+        while (it != mapRecords.end() && it->second.first)
+            ++it;
+        if (it != mapRecords.end() && (!fFound || !mapRecords.key_comp()(key, it->first))) {
+            key = it->first;
+            value = it->second.second;
+            fFound = true;
+        }
+    }
+    if (!fFound)
+        return DB_NOTFOUND;
+
+    pcursor->keyLast = key;
+    pcursor->fStarted = true;
+
+    ssKey.SetType(SER_DISK);
+    ssKey.clear();
+    ssKey.write(key.data(), key.size());
+    ssValue.SetType(SER_DISK);
+    ssValue.clear();
+    ssValue.write(value.data(), value.size());
+    return 0;
+}
+
+bool CDB::RewriteLog(const string& strFile, const char* pszSkip)
+{
+    LogPrintf("CDB::Rewrite: Rewriting %s...\n", strFile);
+    CDB db(strFile, "r+");
+    if (!db.plogdb)
+        return false;
+
+    CLogDBBatch batch;
+    if (pszSkip) {
+        size_t nSkip = strlen(pszSkip);
+        CDBCursor cursor(NULL);
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        ssKey.write(pszSkip, nSkip);
+        for (unsigned int fFlags = DB_SET_RANGE; db.ReadAtLogCursor(&cursor, ssKey, ssValue, fFlags) == 0; fFlags = DB_NEXT) {
+            if (ssKey.size() < nSkip || memcmp(ssKey.data(), pszSkip, nSkip) != 0)
+                break;
+            batch.Erase(CSerializeData(ssKey.begin(), ssKey.end()));
+        }
+    }
+    CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+    CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+    ssKey << string("version");
+    ssValue << CLIENT_VERSION;
+    batch.Write(CSerializeData(ssKey.begin(), ssKey.end()), CSerializeData(ssValue.begin(), ssValue.end()));
+
+    // compacting drops the old records from the file, like rewriting a Berkeley DB file does
+    bool fSuccess = db.plogdb->Apply(batch) && db.plogdb->Compact();
+    if (!fSuccess)
+        LogPrintf("CDB::Rewrite: Failed to rewrite log store %s\n", strFile);
+    return fSuccess;
+}
+
 bool CDB::Rewrite(const string& strFile, const char* pszSkip)
 {
+    if (!bitdb.IsMock() && CLogDB::IsLogFile(GetDataDir() / strFile))
+        return RewriteLog(strFile, pszSkip);
+
     while (true) {
         {
             LOCK(bitdb.cs_db);
@@ -366,17 +545,17 @@ bool CDB::Rewrite(const string& strFile, const char* pszSkip)
                         fSuccess = false;
                     }
 
-                    Dbc* pcursor = db.GetCursor();
+                    CDBCursor* pcursor = db.GetCursor();
                     if (pcursor)
                         while (fSuccess) {
                             CDataStream ssKey(SER_DISK, CLIENT_VERSION);
                             CDataStream ssValue(SER_DISK, CLIENT_VERSION);
                             int ret = db.ReadAtCursor(pcursor, ssKey, ssValue, DB_NEXT);
                             if (ret == DB_NOTFOUND) {
-                                pcursor->close();
+                                delete pcursor;
                                 break;
                             } else if (ret != 0) {
-                                pcursor->close();
+                                delete pcursor;
                                 fSuccess = false;
                                 break;
                             }
@@ -420,6 +599,73 @@ bool CDB::Rewrite(const string& strFile, const char* pszSkip)
     return false;
 }
 
+bool CDB::MigrateToLog(const string& strFile)
+{
+    int64_t nStart = GetTimeMillis();
+    boost::filesystem::path pathFile = GetDataDir() / strFile;
+    boost::filesystem::path pathLog = GetDataDir() / (strFile + ".log");
+    boost::filesystem::path pathBackup = GetDataDir() / strprintf("%s.%d.bdb", strFile, GetTime());
+    LogPrintf("CDB::MigrateToLog: Migrating %s to a log store...\n", strFile);
+
+    CLogDBBatch batch;
+    { // surround usage of db with extra {}
+        CDB db(strFile, "r");
+        CDBCursor* pcursor = db.GetCursor();
+        if (!pcursor) {
+            LogPrintf("CDB::MigrateToLog: Can't read %s\n", strFile);
+            return false;
+        }
+        while (true) {
+            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+            int ret = db.ReadAtCursor(pcursor, ssKey, ssValue, DB_NEXT);
+            if (ret == DB_NOTFOUND)
+                break;
+            if (ret != 0) {
+                delete pcursor;
+                LogPrintf("CDB::MigrateToLog: Error %d reading %s\n", ret, strFile);
+                return false;
+            }
+            batch.Write(CSerializeData(ssKey.begin(), ssKey.end()), CSerializeData(ssValue.begin(), ssValue.end()));
+        }
+        delete pcursor;
+    }
+
+    boost::system::error_code ec;
+    boost::filesystem::remove(pathLog, ec);
+    {
+        CLogDB logdb;
+        std::string strError;
+        if (!logdb.Open(pathLog, true, strError) || !logdb.Apply(batch)) {
+            LogPrintf("CDB::MigrateToLog: Can't write %s %s\n", pathLog.string(), strError);
+            logdb.Close();
+            boost::filesystem::remove(pathLog, ec);
+            return false;
+        }
+    }
+
+    {
+        // Flush log data to the dat file, so the old file can still be opened on its own
+        LOCK(bitdb.cs_db);
+        bitdb.CloseDb(strFile);
+        bitdb.CheckpointLSN(strFile);
+        bitdb.mapFileUseCount.erase(strFile);
+    }
+
+    try {
+        boost::filesystem::rename(pathFile, pathBackup);
+        boost::filesystem::rename(pathLog, pathFile);
+    } catch (const boost::filesystem::filesystem_error& e) {
+        LogPrintf("CDB::MigrateToLog: Failed to replace %s - %s\n", strFile, e.what());
+        if (!boost::filesystem::exists(pathFile) && boost::filesystem::exists(pathBackup))
+            boost::filesystem::rename(pathBackup, pathFile, ec);
+        return false;
+    }
+
+    LogPrintf("CDB::MigrateToLog: Migrated %d records, old file kept as %s  %dms\n",
+              batch.mapRecords.size(), pathBackup.string(), GetTimeMillis() - nStart);
+    return true;
+}
 
 void CDBEnv::Flush(bool fShutdown)
 {
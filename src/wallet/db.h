@@ -11,6 +11,7 @@
 #include "streams.h"
 #include "sync.h"
 #include "version.h"
+#include "wallet/logdb.h"
 
 #include <map>
 #include <string>
@@ -22,6 +23,7 @@
 
 static const unsigned int DEFAULT_WALLET_DBLOGSIZE = 100;
 static const bool DEFAULT_WALLET_PRIVDB = true;
+static const bool DEFAULT_LOGWALLET = false;
 
 extern unsigned int nWalletDBUpdated;
 
@@ -89,14 +91,36 @@ public:
 
 extern CDBEnv bitdb;
 
+/** Cursor of a CDB, iterates a Berkeley DB cursor or the records of a log store */
+class CDBCursor
+{
+public:
+    Dbc* pcursor;
+    /// key the log store cursor is at, valid if fStarted
+    CSerializeData keyLast;
+    bool fStarted;
+
+    explicit CDBCursor(Dbc* pcursorIn) : pcursor(pcursorIn), fStarted(false) {}
+    ~CDBCursor()
+    {
+        if (pcursor)
+            pcursor->close();
+    }
 
-/** RAII class that provides access to a Berkeley database */
+private:
+    CDBCursor(const CDBCursor&);
+    void operator=(const CDBCursor&);
+};
+
+/** RAII class that provides access to a Berkeley database or a log store */
 class CDB
 {
 protected:
     Db* pdb;
     std::string strFile;
     DbTxn* activeTxn;
+    CLogDB* plogdb;
+    CLogDBBatch* plogTxn;
     bool fReadOnly;
     bool fFlushOnClose;
 
@@ -111,17 +135,36 @@ private:
     CDB(const CDB&);
     void operator=(const CDB&);
 
+    bool ReadLog(const CDataStream& ssKey, CDataStream& ssValue);
+    bool WriteLog(const CDataStream& ssKey, const CDataStream& ssValue, bool fOverwrite);
+    bool EraseLog(const CDataStream& ssKey);
+    bool ExistsLog(const CDataStream& ssKey);
+    int ReadAtLogCursor(CDBCursor* pcursor, CDataStream& ssKey, CDataStream& ssValue, unsigned int fFlags);
+    static bool RewriteLog(const std::string& strFile, const char* pszSkip);
+
 protected:
     template <typename K, typename T>
     bool Read(const K& key, T& value)
     {
-        if (!pdb)
+        if (!pdb && !plogdb)
             return false;
 
         // Key
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+
+        if (plogdb) {
+            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+            if (!ReadLog(ssKey, ssValue))
+                return false;
+            try {
+                ssValue >> value;
+            } catch (const std::exception&) {
+                return false;
+            }
+            return true;
+        }
         Dbt datKey(ssKey.data(), ssKey.size());
 
         // Read
@@ -149,7 +192,7 @@ protected:
     template <typename K, typename T>
     bool Write(const K& key, const T& value, bool fOverwrite = true)
     {
-        if (!pdb)
+        if (!pdb && !plogdb)
             return false;
         if (fReadOnly)
             assert(!"Write called on database in read-only mode");
@@ -158,12 +201,14 @@ protected:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
-        Dbt datKey(ssKey.data(), ssKey.size());
 
         // Value
         CDataStream ssValue(SER_DISK, CLIENT_VERSION);
         ssValue.reserve(10000);
         ssValue << value;
+        if (plogdb)
+            return WriteLog(ssKey, ssValue, fOverwrite);
+        Dbt datKey(ssKey.data(), ssKey.size());
         Dbt datValue(ssValue.data(), ssValue.size());
 
         // Write
@@ -178,7 +223,7 @@ protected:
     template <typename K>
     bool Erase(const K& key)
     {
-        if (!pdb)
+        if (!pdb && !plogdb)
             return false;
         if (fReadOnly)
             assert(!"Erase called on database in read-only mode");
@@ -187,6 +232,8 @@ protected:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+        if (plogdb)
+            return EraseLog(ssKey);
         Dbt datKey(ssKey.data(), ssKey.size());
 
         // Erase
@@ -200,13 +247,15 @@ protected:
     template <typename K>
     bool Exists(const K& key)
     {
-        if (!pdb)
+        if (!pdb && !plogdb)
             return false;
 
         // Key
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+        if (plogdb)
+            return ExistsLog(ssKey);
         Dbt datKey(ssKey.data(), ssKey.size());
 
         // Exists
@@ -217,19 +266,26 @@ protected:
         return (ret == 0);
     }
 
-    Dbc* GetCursor()
+    /** Cursor to pass to ReadAtCursor, delete it when done */
+    CDBCursor* GetCursor()
     {
+        if (plogdb)
+            return new CDBCursor(NULL);
         if (!pdb)
             return NULL;
         Dbc* pcursor = NULL;
         int ret = pdb->cursor(NULL, &pcursor, 0);
         if (ret != 0)
             return NULL;
-        return pcursor;
+        return new CDBCursor(pcursor);
     }
 
-    int ReadAtCursor(Dbc* pcursor, CDataStream& ssKey, CDataStream& ssValue, unsigned int fFlags = DB_NEXT)
+    /** Read the record at DB_SET_RANGE ssKey or the DB_NEXT one, log stores support no other flags */
+    int ReadAtCursor(CDBCursor* pcursor, CDataStream& ssKey, CDataStream& ssValue, unsigned int fFlags = DB_NEXT)
     {
+        if (!pcursor->pcursor)
+            return ReadAtLogCursor(pcursor, ssKey, ssValue, fFlags);
+
         // Read at cursor
         Dbt datKey;
         if (fFlags == DB_SET || fFlags == DB_SET_RANGE || fFlags == DB_GET_BOTH || fFlags == DB_GET_BOTH_RANGE) {
@@ -243,7 +299,7 @@ protected:
         }
         datKey.set_flags(DB_DBT_MALLOC);
         datValue.set_flags(DB_DBT_MALLOC);
-        int ret = pcursor->get(&datKey, &datValue, fFlags);
+        int ret = pcursor->pcursor->get(&datKey, &datValue, fFlags);
         if (ret != 0)
             return ret;
         else if (datKey.get_data() == NULL || datValue.get_data() == NULL)
@@ -268,6 +324,12 @@ protected:
 public:
     bool TxnBegin()
     {
+        if (plogdb) {
+            if (plogTxn)
+                return false;
+            plogTxn = new CLogDBBatch();
+            return true;
+        }
         if (!pdb || activeTxn)
             return false;
         DbTxn* ptxn = bitdb.TxnBegin();
@@ -279,6 +341,14 @@ public:
 
     bool TxnCommit()
     {
+        if (plogdb) {
+            if (!plogTxn)
+                return false;
+            bool fResult = plogdb->Apply(*plogTxn);
+            delete plogTxn;
+            plogTxn = NULL;
+            return fResult;
+        }
         if (!pdb || !activeTxn)
             return false;
         int ret = activeTxn->commit(0);
@@ -288,6 +358,13 @@ public:
 
     bool TxnAbort()
     {
+        if (plogdb) {
+            if (!plogTxn)
+                return false;
+            delete plogTxn;
+            plogTxn = NULL;
+            return true;
+        }
         if (!pdb || !activeTxn)
             return false;
         int ret = activeTxn->abort();
@@ -307,6 +384,8 @@ public:
     }
 
     bool static Rewrite(const std::string& strFile, const char* pszSkip = NULL);
+    /** Copy a Berkeley DB strFile to a log store which replaces it, the old file is kept as a backup */
+    bool static MigrateToLog(const std::string& strFile);
 };
 
 #endif // BITCOIN_WALLET_DB_H
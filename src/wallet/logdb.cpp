@@ -0,0 +1,507 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/logdb.h"
+
+#include "clientversion.h"
+#include "crypto/common.h"
+#include "hash.h"
+#include "streams.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+#include <boost/version.hpp>
+
+CLogDBEnv logdbenv;
+
+static const char pchLogDBMagic[8] = {'s', 'q', 'r', 'l', 'o', 'g', 'd', 'b'};
+
+/** Magic followed by the format version */
+static const uint64_t LOGDB_HEADER_SIZE = sizeof(pchLogDBMagic) + 4;
+
+/** Decode records on several threads only if every thread gets at least this many */
+static const size_t LOGDB_MIN_RECORDS_PER_THREAD = 4096;
+
+/** A record as read from the file during replay */
+struct CLogDBRecord
+{
+    unsigned char nType;
+    CSerializeData key;
+    CSerializeData value;
+    bool fValid;
+
+    CLogDBRecord() : nType(0), fValid(false) {}
+};
+
+/** Payload offset and size of every record of a file */
+typedef std::vector<std::pair<uint64_t, uint32_t> > record_pos_t;
+
+static bool WriteHeader(FILE* file)
+{
+    unsigned char pchHeader[LOGDB_HEADER_SIZE];
+    memcpy(pchHeader, pchLogDBMagic, sizeof(pchLogDBMagic));
+    WriteLE32(pchHeader + sizeof(pchLogDBMagic), LOGDB_VERSION);
+    return fwrite(pchHeader, 1, sizeof(pchHeader), file) == sizeof(pchHeader);
+}
+
+/** Verify and deserialize the records nBegin to nEnd, invalid ones are left with fValid unset */
+static void DecodeRecords(const CSerializeData& vchFile, const record_pos_t& vPos, std::vector<CLogDBRecord>& vRecords, size_t nBegin, size_t nEnd)
+{
+    for (size_t i = nBegin; i < nEnd; i++) {
+        const char* pPayload = &vchFile[vPos[i].first];
+        const char* pPayloadEnd = pPayload + vPos[i].second;
+        uint256 hash = Hash(pPayload, pPayloadEnd);
+        if (memcmp(hash.begin(), pPayloadEnd, 4) != 0)
+            continue;
+
+        CLogDBRecord& record = vRecords[i];
+        try {
+            CDataStream ss(pPayload, pPayloadEnd, SER_DISK, CLIENT_VERSION);
+            ss >> record.nType;
+            record.key.resize(ReadCompactSize(ss));
+            ss.read(record.key.data(), record.key.size());
+            record.value.resize(ReadCompactSize(ss));
+            ss.read(record.value.data(), record.value.size());
+            unsigned char nType = record.nType & ~CLogDB::LOGDB_BATCH;
+            record.fValid = ss.empty() && (nType == CLogDB::LOGDB_WRITE || nType == CLogDB::LOGDB_ERASE);
+        } catch (const std::exception&) {
+            record.fValid = false;
+        }
+    }
+}
+
+CLogDB::CLogDB() : file(NULL), nFileSize(0), nLiveSize(0)
+{
+}
+
+void CLogDB::AppendRecord(CSerializeData& vch, unsigned char nType, const CSerializeData& key, const CSerializeData& value)
+{
+    CDataStream ssPayload(SER_DISK, CLIENT_VERSION);
+    ssPayload.reserve(GetRecordSize(key, value));
+    ssPayload << nType;
+    WriteCompactSize(ssPayload, key.size());
+    ssPayload.write(key.data(), key.size());
+    WriteCompactSize(ssPayload, value.size());
+    ssPayload.write(value.data(), value.size());
+
+    unsigned char pchSize[4];
+    WriteLE32(pchSize, ssPayload.size());
+    uint256 hash = Hash(ssPayload.begin(), ssPayload.end());
+    vch.insert(vch.end(), pchSize, pchSize + 4);
+    vch.insert(vch.end(), ssPayload.begin(), ssPayload.end());
+    vch.insert(vch.end(), hash.begin(), hash.begin() + 4);
+}
+
+uint64_t CLogDB::GetRecordSize(const CSerializeData& key, const CSerializeData& value)
+{
+    return 4 + 1 + GetSizeOfCompactSize(key.size()) + key.size() + GetSizeOfCompactSize(value.size()) + value.size() + 4;
+}
+
+bool CLogDB::IsLogFile(const boost::filesystem::path& path)
+{
+    FILE* file = fopen(path.string().c_str(), "rb");
+    if (!file)
+        return false;
+    char pchMagic[sizeof(pchLogDBMagic)];
+    bool fResult = fread(pchMagic, 1, sizeof(pchMagic), file) == sizeof(pchMagic) &&
+                   memcmp(pchMagic, pchLogDBMagic, sizeof(pchMagic)) == 0;
+    fclose(file);
+    return fResult;
+}
+
+bool CLogDB::Open(const boost::filesystem::path& path, bool fCreate, std::string& strError)
+{
+    LOCK(cs_logdb);
+    Close();
+
+    strPath = path.string();
+    bool fNew = !boost::filesystem::exists(path);
+    if (fNew && !fCreate) {
+        strError = strprintf("%s doesn't exist", strPath);
+        return false;
+    }
+
+    file = fopen(strPath.c_str(), fNew ? "wb+" : "rb+");
+    if (!file) {
+        strError = strprintf("can't open %s", strPath);
+        return false;
+    }
+
+    if (fNew) {
+        if (!WriteHeader(file) || fflush(file) != 0) {
+            strError = strprintf("can't write to %s", strPath);
+            Close();
+            return false;
+        }
+        FileCommit(file);
+        nFileSize = LOGDB_HEADER_SIZE;
+        return true;
+    }
+
+    fseek(file, 0, SEEK_END);
+    nFileSize = ftell(file);
+    if (!Replay(strError)) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool CLogDB::Replay(std::string& strError)
+{
+    int64_t nStart = GetTimeMillis();
+
+    CSerializeData vchFile(nFileSize);
+    rewind(file);
+    if (fread(vchFile.data(), 1, vchFile.size(), file) != vchFile.size()) {
+        strError = strprintf("can't read %s", strPath);
+        return false;
+    }
+    if (nFileSize < LOGDB_HEADER_SIZE || memcmp(vchFile.data(), pchLogDBMagic, sizeof(pchLogDBMagic)) != 0) {
+        strError = strprintf("%s is not a log store", strPath);
+        return false;
+    }
+    uint32_t nVersion = ReadLE32((const unsigned char*)&vchFile[sizeof(pchLogDBMagic)]);
+    if (nVersion > LOGDB_VERSION) {
+        strError = strprintf("%s requires a newer version (format %d)", strPath, nVersion);
+        return false;
+    }
+
+    // Find the record boundaries, a record running past the end of the file is torn
+    record_pos_t vPos;
+    uint64_t nPos = LOGDB_HEADER_SIZE;
+    while (nPos + 4 <= nFileSize) {
+        uint32_t nSize = ReadLE32((const unsigned char*)&vchFile[nPos]);
+        if (nPos + 4 + nSize + 4 > nFileSize)
+            break;
+        vPos.push_back(std::make_pair(nPos + 4, nSize));
+        nPos += 4 + nSize + 4;
+    }
+
+    // Checksums and deserialization don't depend on each other, spread them over all cores
+    std::vector<CLogDBRecord> vRecords(vPos.size());
+    size_t nThreads = std::min((size_t)std::max(GetNumCores(), 1), vPos.size() / LOGDB_MIN_RECORDS_PER_THREAD);
+    if (nThreads > 1) {
+        boost::thread_group threadGroup;
+        size_t nChunk = (vPos.size() + nThreads - 1) / nThreads;
+        for (size_t nBegin = 0; nBegin < vPos.size(); nBegin += nChunk) {
+            threadGroup.create_thread(boost::bind(&DecodeRecords, boost::cref(vchFile), boost::cref(vPos), boost::ref(vRecords),
+                                                  nBegin, std::min(nBegin + nChunk, vPos.size())));
+        }
+        threadGroup.join_all();
+    } else {
+        DecodeRecords(vchFile, vPos, vRecords, 0, vPos.size());
+    }
+
+    // Apply complete batches in order, everything from the first bad record on is dropped
+    uint64_t nGoodSize = LOGDB_HEADER_SIZE;
+    size_t nBatchBegin = 0;
+    for (size_t i = 0; i < vRecords.size() && vRecords[i].fValid; i++) {
+        if (vRecords[i].nType & LOGDB_BATCH)
+            continue;
+        for (size_t j = nBatchBegin; j <= i; j++) {
+            const CLogDBRecord& record = vRecords[j];
+            ApplyRecord((record.nType & ~LOGDB_BATCH) == LOGDB_ERASE, record.key, record.value);
+        }
+        nBatchBegin = i + 1;
+        nGoodSize = vPos[i].first + vPos[i].second + 4;
+    }
+
+    if (nGoodSize < nFileSize) {
+        // Usually just an append torn by a crash, but keep the original in case it's more
+        std::string strBackup = strprintf("%s.%d.bak", strPath, GetTime());
+        LogPrintf("CLogDB::%s -- %s: dropping %d bytes after offset %d, original saved as %s\n",
+                  __func__, strPath, nFileSize - nGoodSize, nGoodSize, strBackup);
+        FILE* fileBackup = fopen(strBackup.c_str(), "wb");
+        bool fBackup = fileBackup && fwrite(vchFile.data(), 1, vchFile.size(), fileBackup) == vchFile.size() && fflush(fileBackup) == 0;
+        if (fileBackup) {
+            FileCommit(fileBackup);
+            fclose(fileBackup);
+        }
+        if (!fBackup) {
+            strError = strprintf("can't write %s", strBackup);
+            return false;
+        }
+        if (!TruncateFile(file, nGoodSize)) {
+            strError = strprintf("can't truncate %s", strPath);
+            return false;
+        }
+        nFileSize = nGoodSize;
+    }
+    fseek(file, nFileSize, SEEK_SET);
+
+    LogPrintf("CLogDB::%s -- %s: %d records, %d live, %d bytes, %d threads  %dms\n",
+              __func__, strPath, vPos.size(), mapRecords.size(), nFileSize, std::max(nThreads, (size_t)1), GetTimeMillis() - nStart);
+    return true;
+}
+
+void CLogDB::ApplyRecord(bool fErase, const CSerializeData& key, const CSerializeData& value)
+{
+    record_map_t::iterator it = mapRecords.find(key);
+    if (it != mapRecords.end()) {
+        nLiveSize -= GetRecordSize(it->first, it->second);
+        if (fErase) {
+            mapRecords.erase(it);
+            return;
+        }
+        it->second = value;
+    } else {
+        if (fErase)
+            return;
+        mapRecords.insert(std::make_pair(key, value));
+    }
+    nLiveSize += GetRecordSize(key, value);
+}
+
+void CLogDB::Close()
+{
+    LOCK(cs_logdb);
+    if (file) {
+        FileCommit(file);
+        fclose(file);
+        file = NULL;
+    }
+    mapRecords.clear();
+    nFileSize = 0;
+    nLiveSize = 0;
+}
+
+bool CLogDB::Read(const CSerializeData& key, CSerializeData& valueRet) const
+{
+    LOCK(cs_logdb);
+    record_map_t::const_iterator it = mapRecords.find(key);
+    if (it == mapRecords.end())
+        return false;
+    valueRet = it->second;
+    return true;
+}
+
+bool CLogDB::Exists(const CSerializeData& key) const
+{
+    LOCK(cs_logdb);
+    return mapRecords.count(key);
+}
+
+bool CLogDB::Apply(const CLogDBBatch& batch)
+{
+    if (batch.IsEmpty())
+        return true;
+
+    CSerializeData vch;
+    size_t nLeft = batch.mapRecords.size();
+    for (CLogDBBatch::record_map_t::const_iterator it = batch.mapRecords.begin(); it != batch.mapRecords.end(); ++it) {
+        unsigned char nType = it->second.first ? LOGDB_ERASE : LOGDB_WRITE;
+        if (--nLeft)
+            nType |= LOGDB_BATCH;
+        AppendRecord(vch, nType, it->first, it->second.second);
+    }
+
+    LOCK(cs_logdb);
+    if (!file)
+        return false;
+    if (fwrite(vch.data(), 1, vch.size(), file) != vch.size() || fflush(file) != 0) {
+        LogPrintf("CLogDB::%s -- failed to append to %s\n", __func__, strPath);
+        // A partial batch would hide everything appended after it on the next replay
+        clearerr(file);
+        TruncateFile(file, nFileSize);
+        fseek(file, nFileSize, SEEK_SET);
+        return false;
+    }
+    nFileSize += vch.size();
+
+    for (CLogDBBatch::record_map_t::const_iterator it = batch.mapRecords.begin(); it != batch.mapRecords.end(); ++it)
+        ApplyRecord(it->second.first, it->first, it->second.second);
+    return true;
+}
+
+bool CLogDB::Seek(const CSerializeData& key, bool fAfter, CSerializeData& keyRet, CSerializeData& valueRet) const
+{
+    LOCK(cs_logdb);
+    record_map_t::const_iterator it = fAfter ? mapRecords.upper_bound(key) : mapRecords.lower_bound(key);
+    if (it == mapRecords.end())
+        return false;
+    keyRet = it->first;
+    valueRet = it->second;
+    return true;
+}
+
+void CLogDB::Sync()
+{
+    LOCK(cs_logdb);
+    if (file)
+        FileCommit(file);
+}
+
+bool CLogDB::NeedsCompaction() const
+{
+    LOCK(cs_logdb);
+    return file && nFileSize >= LOGDB_MIN_COMPACT_SIZE && nFileSize > LOGDB_HEADER_SIZE + nLiveSize * LOGDB_COMPACT_RATIO;
+}
+
+bool CLogDB::Compact()
+{
+    LOCK(cs_logdb);
+    if (!file)
+        return false;
+
+    int64_t nStart = GetTimeMillis();
+    uint64_t nOldSize = nFileSize;
+    std::string strCompact = strPath + ".compact";
+
+    FILE* fileCompact = fopen(strCompact.c_str(), "wb");
+    bool fSuccess = fileCompact && WriteHeader(fileCompact);
+    CSerializeData vch;
+    for (record_map_t::const_iterator it = mapRecords.begin(); fSuccess && it != mapRecords.end(); ++it) {
+        vch.clear();
+        AppendRecord(vch, LOGDB_WRITE, it->first, it->second);
+        fSuccess = fwrite(vch.data(), 1, vch.size(), fileCompact) == vch.size();
+    }
+    if (fSuccess)
+        fSuccess = fflush(fileCompact) == 0;
+    if (fileCompact) {
+        if (fSuccess)
+            FileCommit(fileCompact);
+        fclose(fileCompact);
+    }
+    if (!fSuccess) {
+        LogPrintf("CLogDB::%s -- failed to write %s\n", __func__, strCompact);
+        boost::system::error_code ec;
+        boost::filesystem::remove(strCompact, ec);
+        return false;
+    }
+
+    // Reopen after the rename, an open file can't be replaced on every platform
+    fclose(file);
+    if (!RenameOver(strCompact, strPath)) {
+        LogPrintf("CLogDB::%s -- failed to replace %s\n", __func__, strPath);
+        fSuccess = false;
+    }
+    file = fopen(strPath.c_str(), "rb+");
+    if (!file) {
+        LogPrintf("CLogDB::%s -- can't reopen %s\n", __func__, strPath);
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    nFileSize = ftell(file);
+
+    if (fSuccess)
+        LogPrintf("CLogDB::%s -- %s: %d -> %d bytes  %dms\n", __func__, strPath, nOldSize, nFileSize, GetTimeMillis() - nStart);
+    return fSuccess;
+}
+
+bool CLogDB::Copy(const boost::filesystem::path& pathDest) const
+{
+    LOCK(cs_logdb);
+    if (!file || fflush(file) != 0)
+        return false;
+
+    try {
+#if BOOST_VERSION >= 104000
+        boost::filesystem::copy_file(strPath, pathDest, boost::filesystem::copy_option::overwrite_if_exists);
+#else
+        boost::filesystem::copy_file(strPath, pathDest);
+#endif
+    } catch (const boost::filesystem::filesystem_error& e) {
+        LogPrintf("CLogDB::%s -- error copying %s to %s - %s\n", __func__, strPath, pathDest.string(), e.what());
+        return false;
+    }
+    return true;
+}
+
+size_t CLogDB::GetRecordCount() const
+{
+    LOCK(cs_logdb);
+    return mapRecords.size();
+}
+
+uint64_t CLogDB::GetFileSize() const
+{
+    LOCK(cs_logdb);
+    return nFileSize;
+}
+
+CLogDBEnv::~CLogDBEnv()
+{
+    for (std::map<std::string, CLogDB*>::iterator it = mapLogDb.begin(); it != mapLogDb.end(); ++it)
+        delete it->second;
+}
+
+CLogDB* CLogDBEnv::Get(const std::string& strFile, bool fCreate)
+{
+    LOCK(cs_logdbenv);
+    std::map<std::string, CLogDB*>::iterator it = mapLogDb.find(strFile);
+    if (it == mapLogDb.end()) {
+        boost::filesystem::path path = GetDataDir() / strFile;
+        if (boost::filesystem::exists(path) ? !CLogDB::IsLogFile(path) : !fCreate)
+            return NULL;
+
+        CLogDB* plogdb = new CLogDB();
+        std::string strError;
+        if (!plogdb->Open(path, fCreate, strError)) {
+            delete plogdb;
+            throw std::runtime_error(strprintf("CLogDB: can't open %s: %s", strFile, strError));
+        }
+        it = mapLogDb.insert(std::make_pair(strFile, plogdb)).first;
+    }
+    ++mapFileUseCount[strFile];
+    return it->second;
+}
+
+void CLogDBEnv::Release(const std::string& strFile)
+{
+    LOCK(cs_logdbenv);
+    std::map<std::string, int>::iterator it = mapFileUseCount.find(strFile);
+    if (it != mapFileUseCount.end() && it->second > 0)
+        --it->second;
+}
+
+void CLogDBEnv::FlushDb(const std::string& strFile, CLogDB* plogdb)
+{
+    int64_t nStart = GetTimeMillis();
+    plogdb->Sync();
+    if (plogdb->NeedsCompaction())
+        plogdb->Compact();
+    LogPrint("db", "CLogDBEnv::%s -- flushed %s  %dms\n", __func__, strFile, GetTimeMillis() - nStart);
+}
+
+void CLogDBEnv::Flush(bool fShutdown)
+{
+    LOCK(cs_logdbenv);
+    std::map<std::string, CLogDB*>::iterator it = mapLogDb.begin();
+    while (it != mapLogDb.end()) {
+        FlushDb(it->first, it->second);
+        if (fShutdown && mapFileUseCount[it->first] == 0) {
+            delete it->second;
+            mapFileUseCount.erase(it->first);
+            mapLogDb.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool CLogDBEnv::Flush(const std::string& strFile)
+{
+    LOCK(cs_logdbenv);
+    std::map<std::string, CLogDB*>::iterator it = mapLogDb.find(strFile);
+    if (it == mapLogDb.end())
+        return false;
+    FlushDb(it->first, it->second);
+    return true;
+}
+
+bool CLogDBEnv::Backup(const std::string& strFile, const boost::filesystem::path& pathDest)
+{
+    CLogDB* plogdb = Get(strFile, false);
+    if (!plogdb)
+        return false;
+    bool fResult = plogdb->Copy(pathDest);
+    Release(strFile);
+    return fResult;
+}
@@ -0,0 +1,157 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef WALLET_LOGDB_H
+#define WALLET_LOGDB_H
+
+#include "support/allocators/zeroafterfree.h"
+#include "sync.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <utility>
+
+#include <boost/filesystem/path.hpp>
+
+/** Version of the log store file format */
+static const uint32_t LOGDB_VERSION = 1;
+
+/** Don't compact log stores smaller than this */
+static const uint64_t LOGDB_MIN_COMPACT_SIZE = 1024 * 1024;
+
+/** Compact a log store once its file is this many times larger than its live records */
+static const int LOGDB_COMPACT_RATIO = 2;
+
+/** Serialized keys are ordered byte by byte, like Berkeley DB's btree does */
+struct CLogDBKeyCompare
+{
+    bool operator()(const CSerializeData& a, const CSerializeData& b) const
+    {
+        int r = memcmp(a.data(), b.data(), std::min(a.size(), b.size()));
+        return r < 0 || (r == 0 && a.size() < b.size());
+    }
+};
+
+/** Writes and erases applied to a log store atomically */
+class CLogDBBatch
+{
+public:
+    typedef std::map<CSerializeData, std::pair<bool, CSerializeData>, CLogDBKeyCompare> record_map_t;
+
+    /// pending change by key, the flag is set for erases
+    record_map_t mapRecords;
+
+    void Write(const CSerializeData& key, const CSerializeData& value) { mapRecords[key] = std::make_pair(false, value); }
+    void Erase(const CSerializeData& key) { mapRecords[key] = std::make_pair(true, CSerializeData()); }
+    bool IsEmpty() const { return mapRecords.empty(); }
+};
+
+/**
+ * Append-only key/value store used for wallet files instead of Berkeley DB.
+ *
+ * Every write or erase is appended to the file as a checksummed record, the
+ * current value of every key is kept in memory. Opening the file replays the
+ * log, a torn or corrupt tail (e.g. after a crash) is cut off. Once enough
+ * records are outdated the file is compacted by rewriting the live records to
+ * a new file which replaces the old one.
+ *
+ * Record layout: payload size (uint32), payload (type, key, value) and the
+ * first four bytes of the payload's hash. Records of a batch carry
+ * LOGDB_BATCH except for the last one, a batch without its last record is
+ * dropped as a whole.
+ */
+class CLogDB
+{
+public:
+    enum RecordType {
+        LOGDB_WRITE = 1,
+        LOGDB_ERASE = 2,
+        LOGDB_BATCH = 0x80
+    };
+
+private:
+    typedef std::map<CSerializeData, CSerializeData, CLogDBKeyCompare> record_map_t;
+
+    mutable CCriticalSection cs_logdb;
+    // Don't change into boost::filesystem::path, see CDBEnv::strPath
+    std::string strPath;
+    FILE* file;
+    record_map_t mapRecords;
+    /// size of the file, appends start here
+    uint64_t nFileSize;
+    /// size the live records take in a compacted file
+    uint64_t nLiveSize;
+
+    static void AppendRecord(CSerializeData& vch, unsigned char nType, const CSerializeData& key, const CSerializeData& value);
+    static uint64_t GetRecordSize(const CSerializeData& key, const CSerializeData& value);
+
+    bool Replay(std::string& strError);
+    void ApplyRecord(bool fErase, const CSerializeData& key, const CSerializeData& value);
+
+public:
+    CLogDB();
+    ~CLogDB() { Close(); }
+
+    /// True if path exists and starts with a log store header
+    static bool IsLogFile(const boost::filesystem::path& path);
+
+    bool Open(const boost::filesystem::path& path, bool fCreate, std::string& strError);
+    void Close();
+
+    bool Read(const CSerializeData& key, CSerializeData& valueRet) const;
+    bool Exists(const CSerializeData& key) const;
+    /// Append the batch to the file and apply it, nothing is applied on failure
+    bool Apply(const CLogDBBatch& batch);
+    /// Find the first record with a key not lower (fAfter: higher) than key
+    bool Seek(const CSerializeData& key, bool fAfter, CSerializeData& keyRet, CSerializeData& valueRet) const;
+
+    /// Make sure everything appended so far is on disk
+    void Sync();
+    /// Replace the file by one holding only the live records
+    bool Compact();
+    bool NeedsCompaction() const;
+    /// Copy the file as it is after the last complete batch
+    bool Copy(const boost::filesystem::path& pathDest) const;
+
+    size_t GetRecordCount() const;
+    uint64_t GetFileSize() const;
+};
+
+/** Log stores opened from the data directory, shared by all CDB instances */
+class CLogDBEnv
+{
+private:
+    CCriticalSection cs_logdbenv;
+    std::map<std::string, CLogDB*> mapLogDb;
+    std::map<std::string, int> mapFileUseCount;
+
+    void FlushDb(const std::string& strFile, CLogDB* plogdb);
+
+public:
+    ~CLogDBEnv();
+
+    /**
+     * Open strFile and count it as in use, NULL if the file is a Berkeley DB
+     * file (or doesn't exist and fCreate isn't set). Throws if the log store
+     * can't be read.
+     */
+    CLogDB* Get(const std::string& strFile, bool fCreate);
+    void Release(const std::string& strFile);
+
+    /// Sync and compact all open log stores, close the unused ones on shutdown
+    void Flush(bool fShutdown);
+    /// Sync and compact strFile, false if it isn't an open log store
+    bool Flush(const std::string& strFile);
+    /// Copy strFile to pathDest, see CLogDB::Copy
+    bool Backup(const std::string& strFile, const boost::filesystem::path& pathDest);
+};
+
+extern CLogDBEnv logdbenv;
+
+#endif // WALLET_LOGDB_H
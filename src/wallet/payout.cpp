@@ -0,0 +1,324 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/payout.h"
+
+#include "init.h"
+#include "util.h"
+#include "utilmoneystr.h"
+#include "utilstrencodings.h"
+#include "validation.h"
+#include "wallet/wallet.h"
+#include "wallet/walletdb.h"
+
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/replace.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/thread.hpp>
+
+std::string CPayout::GetStatusString() const
+{
+    switch (nStatus) {
+        case PAYOUT_QUEUED: return "queued";
+        case PAYOUT_SENT:   return "sent";
+        case PAYOUT_FAILED: return "failed";
+        default:            return "unknown";
+    }
+}
+
+void CPayoutQueue::Load(const CPayout& payout)
+{
+    LOCK(cs_payouts);
+    mapPayouts[payout.nId] = payout;
+    nNextId = std::max(nNextId, payout.nId + 1);
+}
+
+void CPayoutQueue::LoadNextId(int64_t nNextIdIn)
+{
+    LOCK(cs_payouts);
+    nNextId = std::max(nNextId, nNextIdIn);
+}
+
+void CPayoutQueue::LoadTransactions()
+{
+    // The transaction is written by CommitTransaction before SendBatch saves its payments
+    // as sent, if the node stopped in between they would be paid again by the next round
+    std::vector<int64_t> vIds;
+    {
+        LOCK2(pwallet->cs_wallet, cs_payouts);
+        for (std::map<uint256, CWalletTx>::const_iterator it = pwallet->mapWallet.begin(); it != pwallet->mapWallet.end(); ++it) {
+            const CWalletTx& wtx = it->second;
+            mapValue_t::const_iterator itIds = wtx.mapValue.find("payouts");
+            // an abandoned transaction pays nothing, its payments are sent again
+            if (itIds == wtx.mapValue.end() || wtx.isAbandoned())
+                continue;
+            std::vector<std::string> vstrIds;
+            boost::split(vstrIds, itIds->second, boost::is_any_of(","));
+            BOOST_FOREACH(const std::string& strId, vstrIds) {
+                std::map<int64_t, CPayout>::iterator itPayout = mapPayouts.find(atoi64(strId));
+                if (itPayout == mapPayouts.end() || itPayout->second.nStatus != CPayout::PAYOUT_QUEUED)
+                    continue;
+                CPayout& payout = itPayout->second;
+                payout.nStatus = CPayout::PAYOUT_SENT;
+                payout.txid = wtx.GetHash();
+                payout.strError = "";
+                payout.nTimeDone = wtx.GetTxTime();
+                vIds.push_back(payout.nId);
+            }
+        }
+    }
+    if (vIds.empty())
+        return;
+    LogPrintf("CPayoutQueue::%s -- %d queued payments were sent already\n", __func__, vIds.size());
+    Save(vIds);
+}
+
+void CPayoutQueue::Save(const std::vector<int64_t>& vIds)
+{
+    if (!pwallet->fFileBacked || vIds.empty())
+        return;
+
+    CWalletDB walletdb(pwallet->strWalletFile);
+    walletdb.TxnBegin();
+    {
+        LOCK(cs_payouts);
+        BOOST_FOREACH(int64_t nId, vIds) {
+            std::map<int64_t, CPayout>::const_iterator it = mapPayouts.find(nId);
+            if (it == mapPayouts.end())
+                walletdb.ErasePayout(nId);
+            else
+                walletdb.WritePayout(it->second);
+        }
+        walletdb.WritePayoutNextId(nNextId);
+    }
+    if (!walletdb.TxnCommit())
+        LogPrintf("CPayoutQueue::%s -- failed to write %d payments\n", __func__, vIds.size());
+}
+
+std::vector<int64_t> CPayoutQueue::Queue(const std::vector<std::pair<CScript, CAmount> >& vecPayments, const std::string& strComment)
+{
+    std::vector<int64_t> vIds;
+    {
+        LOCK(cs_payouts);
+        int64_t nNow = GetTime();
+        for (size_t i = 0; i < vecPayments.size(); i++) {
+            CPayout payout;
+            payout.nId = nNextId++;
+            payout.scriptPubKey = vecPayments[i].first;
+            payout.nAmount = vecPayments[i].second;
+            payout.strComment = strComment;
+            payout.nTimeQueued = nNow;
+            mapPayouts.insert(std::make_pair(payout.nId, payout));
+            vIds.push_back(payout.nId);
+        }
+    }
+    Save(vIds);
+    return vIds;
+}
+
+bool CPayoutQueue::Cancel(int64_t nId)
+{
+    // payments can't be cancelled while a round is sending them
+    {
+        LOCK2(pwallet->cs_wallet, cs_payouts);
+        std::map<int64_t, CPayout>::iterator it = mapPayouts.find(nId);
+        if (it == mapPayouts.end() || it->second.nStatus != CPayout::PAYOUT_QUEUED)
+            return false;
+        mapPayouts.erase(it);
+    }
+    Save(std::vector<int64_t>(1, nId));
+    return true;
+}
+
+bool CPayoutQueue::Get(int64_t nId, CPayout& payoutRet) const
+{
+    LOCK(cs_payouts);
+    std::map<int64_t, CPayout>::const_iterator it = mapPayouts.find(nId);
+    if (it == mapPayouts.end())
+        return false;
+    payoutRet = it->second;
+    return true;
+}
+
+std::vector<CPayout> CPayoutQueue::List(int nStatus) const
+{
+    LOCK(cs_payouts);
+    std::vector<CPayout> vPayouts;
+    for (std::map<int64_t, CPayout>::const_iterator it = mapPayouts.begin(); it != mapPayouts.end(); ++it) {
+        if (nStatus < 0 || it->second.nStatus == nStatus)
+            vPayouts.push_back(it->second);
+    }
+    return vPayouts;
+}
+
+size_t CPayoutQueue::GetQueuedCount() const
+{
+    LOCK(cs_payouts);
+    size_t nCount = 0;
+    for (std::map<int64_t, CPayout>::const_iterator it = mapPayouts.begin(); it != mapPayouts.end(); ++it) {
+        if (it->second.nStatus == CPayout::PAYOUT_QUEUED)
+            nCount++;
+    }
+    return nCount;
+}
+
+bool CPayoutQueue::SendBatch(const std::vector<int64_t>& vIds, CConnman* connman, std::vector<uint256>& vTxidsRet)
+{
+    std::vector<CRecipient> vecSend;
+    std::string strIds;
+    {
+        LOCK(cs_payouts);
+        BOOST_FOREACH(int64_t nId, vIds) {
+            const CPayout& payout = mapPayouts[nId];
+            CRecipient recipient = {payout.scriptPubKey, payout.nAmount, false};
+            vecSend.push_back(recipient);
+            strIds += (strIds.empty() ? "" : ",") + strprintf("%d", nId);
+        }
+    }
+
+    CWalletTx wtx;
+    wtx.mapValue["payouts"] = strIds;
+    CReserveKey keyChange(pwallet);
+    CAmount nFeeRequired = 0;
+    int nChangePosRet = -1;
+    std::string strFailReason;
+    if (!pwallet->CreateTransaction(vecSend, wtx, keyChange, nFeeRequired, nChangePosRet, strFailReason)) {
+        // Selection fails the same way for the fee as for the amounts
+        bool fInsufficientFunds = strFailReason == _("Insufficient funds.");
+        if (vIds.size() > 1) {
+            // Split the batch to find the payments which can't be sent, the others still go out.
+            // Without the funds for the first half the second one waits too, to keep the order.
+            std::vector<int64_t> vFirst(vIds.begin(), vIds.begin() + vIds.size() / 2);
+            std::vector<int64_t> vSecond(vIds.begin() + vIds.size() / 2, vIds.end());
+            return SendBatch(vFirst, connman, vTxidsRet) && SendBatch(vSecond, connman, vTxidsRet);
+        }
+
+        LogPrintf("CPayoutQueue::%s -- can't send payment %d: %s\n", __func__, vIds[0], strFailReason);
+        {
+            LOCK(cs_payouts);
+            CPayout& payout = mapPayouts[vIds[0]];
+            payout.strError = strFailReason;
+            // a payment only fails for good if it can't be sent with the funds there
+            if (!fInsufficientFunds && ++payout.nAttempts >= PAYOUT_MAX_ATTEMPTS) {
+                payout.nStatus = CPayout::PAYOUT_FAILED;
+                payout.nTimeDone = GetTime();
+            }
+        }
+        Save(vIds);
+        return !fInsufficientFunds;
+    }
+
+    // A transaction which was created but not accepted is in the wallet already and
+    // would be rebroadcast, abandon it so that its payments can be queued again.
+    // If it can't be abandoned it made it to the mempool or a block after all.
+    bool fCommitted = pwallet->CommitTransaction(wtx, keyChange, connman);
+    if (!fCommitted && !pwallet->AbandonTransaction(wtx.GetHash())) {
+        LogPrintf("CPayoutQueue::%s -- transaction %s was accepted after the commit failed\n", __func__, wtx.GetHash().ToString());
+        fCommitted = true;
+    }
+    {
+        LOCK(cs_payouts);
+        int64_t nNow = GetTime();
+        BOOST_FOREACH(int64_t nId, vIds) {
+            CPayout& payout = mapPayouts[nId];
+            payout.nStatus = fCommitted ? CPayout::PAYOUT_SENT : CPayout::PAYOUT_FAILED;
+            payout.txid = wtx.GetHash();
+            payout.strError = fCommitted ? "" : "Transaction commit failed, abandoned";
+            payout.nTimeDone = nNow;
+        }
+    }
+    Save(vIds);
+
+    LogPrintf("CPayoutQueue::%s -- %s %d payments with %s, fee %s\n", __func__, fCommitted ? "sent" : "failed to send",
+              vIds.size(), wtx.GetHash().ToString(), FormatMoney(nFeeRequired));
+    if (!fCommitted)
+        return true;
+    vTxidsRet.push_back(wtx.GetHash());
+
+    std::string strCmd = GetArg("-payoutnotify", "");
+    if (!strCmd.empty()) {
+        boost::replace_all(strCmd, "%s", wtx.GetHash().GetHex());
+        boost::thread t(runCommand, strCmd); // thread runs free
+    }
+    return true;
+}
+
+std::vector<uint256> CPayoutQueue::Process(CConnman* connman)
+{
+    std::vector<uint256> vTxids;
+    size_t nMaxOutputs = std::max(1, (int)GetArg("-payoutmaxoutputs", DEFAULT_PAYOUT_MAX_OUTPUTS));
+
+    LOCK2(cs_main, pwallet->cs_wallet);
+
+    std::vector<int64_t> vQueued, vExpired;
+    {
+        LOCK(cs_payouts);
+        int64_t nNow = GetTime();
+        std::map<int64_t, CPayout>::iterator it = mapPayouts.begin();
+        while (it != mapPayouts.end()) {
+            if (it->second.nStatus == CPayout::PAYOUT_QUEUED) {
+                vQueued.push_back(it->first);
+                ++it;
+            } else if (nNow - it->second.nTimeDone > PAYOUT_KEEP_SECONDS) {
+                vExpired.push_back(it->first);
+                mapPayouts.erase(it++);
+            } else {
+                ++it;
+            }
+        }
+    }
+    Save(vExpired);
+
+    if (vQueued.empty())
+        return vTxids;
+    if (pwallet->IsLocked()) {
+        LogPrintf("CPayoutQueue::%s -- wallet is locked, %d payments stay queued\n", __func__, vQueued.size());
+        return vTxids;
+    }
+
+    for (size_t nBegin = 0; nBegin < vQueued.size(); nBegin += nMaxOutputs) {
+        std::vector<int64_t> vBatch(vQueued.begin() + nBegin, vQueued.begin() + std::min(nBegin + nMaxOutputs, vQueued.size()));
+
+        CAmount nTotal = 0;
+        {
+            LOCK(cs_payouts);
+            BOOST_FOREACH(int64_t nId, vBatch)
+                nTotal += mapPayouts[nId].nAmount;
+        }
+        // The rest stays queued in order until the wallet has the funds, fee included
+        if (nTotal > pwallet->GetBalance() || !SendBatch(vBatch, connman, vTxids)) {
+            LogPrintf("CPayoutQueue::%s -- insufficient funds, the remaining payments stay queued\n", __func__);
+            break;
+        }
+    }
+    return vTxids;
+}
+
+void ThreadSendPayouts(CConnman& connman)
+{
+    int64_t nInterval = GetArg("-payoutinterval", DEFAULT_PAYOUT_INTERVAL);
+    if (nInterval <= 0 || !pwalletMain)
+        return;
+
+    static bool fOneThread;
+    if (fOneThread)
+        return;
+    fOneThread = true;
+
+    // Make this thread recognisable as the payout thread
+    RenameThread("square-payouts");
+
+    int64_t nLastRound = GetTime();
+    while (true) {
+        MilliSleep(1000);
+
+        if (GetTime() - nLastRound < nInterval)
+            continue;
+        nLastRound = GetTime();
+
+        if (IsInitialBlockDownload() || ShutdownRequested() || !pwalletMain->payoutQueue.GetQueuedCount())
+            continue;
+        pwalletMain->payoutQueue.Process(&connman);
+    }
+}
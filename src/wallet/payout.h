@@ -0,0 +1,137 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef WALLET_PAYOUT_H
+#define WALLET_PAYOUT_H
+
+#include "amount.h"
+#include "script/script.h"
+#include "serialize.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+class CConnman;
+class CWallet;
+
+/** Default for -payoutinterval, seconds between two payout rounds */
+static const int DEFAULT_PAYOUT_INTERVAL = 60;
+/** Default for -payoutmaxoutputs, payments per payout transaction */
+static const int DEFAULT_PAYOUT_MAX_OUTPUTS = 500;
+/** Rounds a payment which can't be sent on its own stays queued before it fails, insufficient funds don't count */
+static const int PAYOUT_MAX_ATTEMPTS = 3;
+/** Sent and failed payments are forgotten after this many seconds */
+static const int64_t PAYOUT_KEEP_SECONDS = 7 * 24 * 60 * 60;
+
+/** A payment of the payout queue, see CPayoutQueue */
+class CPayout
+{
+public:
+    enum Status {
+        PAYOUT_QUEUED = 0,
+        PAYOUT_SENT = 1,
+        PAYOUT_FAILED = 2
+    };
+
+    int64_t nId;
+    CScript scriptPubKey;
+    CAmount nAmount;
+    std::string strComment;
+    int64_t nTimeQueued;
+    int nStatus;
+    int nAttempts;
+    /// transaction paying it, once sent (or created but rejected)
+    uint256 txid;
+    std::string strError;
+    int64_t nTimeDone;
+
+    CPayout() :
+        nId(0),
+        scriptPubKey(),
+        nAmount(0),
+        strComment(),
+        nTimeQueued(0),
+        nStatus(PAYOUT_QUEUED),
+        nAttempts(0),
+        txid(),
+        strError(),
+        nTimeDone(0)
+        {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(nId);
+        READWRITE(*(CScriptBase*)(&scriptPubKey));
+        READWRITE(nAmount);
+        READWRITE(strComment);
+        READWRITE(nTimeQueued);
+        READWRITE(nStatus);
+        READWRITE(nAttempts);
+        READWRITE(txid);
+        READWRITE(strError);
+        READWRITE(nTimeDone);
+    }
+
+    std::string GetStatusString() const;
+};
+
+/**
+ * Payments queued by the payout RPCs and sent in rounds, every -payoutinterval
+ * seconds or on sendpayouts. A round pays up to -payoutmaxoutputs queued
+ * payments with one transaction, so coins are selected and inputs signed once
+ * per batch instead of once per payment. If a batch can't be created it is
+ * split to find the payments which can't be sent (e.g. dust). Payments the
+ * wallet lacks the funds for stay queued.
+ *
+ * Payments are kept in the wallet file until they are sent, failed and sent
+ * ones are forgotten after PAYOUT_KEEP_SECONDS. Every payout transaction lists
+ * the ids it pays in its "payouts" value, which is how payments are found to
+ * be sent when the node stopped between the commit and saving the payments.
+ */
+class CPayoutQueue
+{
+private:
+    CWallet* pwallet;
+    mutable CCriticalSection cs_payouts;
+    std::map<int64_t, CPayout> mapPayouts;
+    int64_t nNextId;
+
+    void Save(const std::vector<int64_t>& vIds);
+    /// Send a batch of payments, false if the wallet lacks the funds for (part of) it
+    bool SendBatch(const std::vector<int64_t>& vIds, CConnman* connman, std::vector<uint256>& vTxidsRet);
+
+public:
+    explicit CPayoutQueue(CWallet* pwalletIn) : pwallet(pwalletIn), nNextId(1) {}
+
+    /// Add a payment read from the wallet file (used by LoadWallet)
+    void Load(const CPayout& payout);
+    /// Set the next id read from the wallet file, ids aren't reused after payments were forgotten
+    void LoadNextId(int64_t nNextIdIn);
+    /// Mark the queued payments which a payout transaction of the wallet pays as sent (used by LoadWallet)
+    void LoadTransactions();
+
+    /// Queue payments to scriptPubKey/amount pairs, returns their ids
+    std::vector<int64_t> Queue(const std::vector<std::pair<CScript, CAmount> >& vecPayments, const std::string& strComment);
+    /// Drop a payment which wasn't sent yet
+    bool Cancel(int64_t nId);
+
+    bool Get(int64_t nId, CPayout& payoutRet) const;
+    /// All payments, nStatus < 0 for every status
+    std::vector<CPayout> List(int nStatus = -1) const;
+    size_t GetQueuedCount() const;
+
+    /// Send the queued payments, returns the txids of the transactions sent
+    std::vector<uint256> Process(CConnman* connman);
+};
+
+/** Send the queued payments every -payoutinterval seconds */
+void ThreadSendPayouts(CConnman& connman);
+
+#endif // WALLET_PAYOUT_H
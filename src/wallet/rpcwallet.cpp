@@ -1146,6 +1146,217 @@ UniValue sendmany(const UniValue& params, bool fHelp)
     return wtx.GetHash().GetHex();
 }
 
+static void PayoutToJSON(const CPayout& payout, UniValue& entry)
+{
+    entry.push_back(Pair("id", payout.nId));
+    CTxDestination dest;
+    if (ExtractDestination(payout.scriptPubKey, dest))
+        entry.push_back(Pair("address", CBitcoinAddress(dest).ToString()));
+    entry.push_back(Pair("amount", ValueFromAmount(payout.nAmount)));
+    if (!payout.strComment.empty())
+        entry.push_back(Pair("comment", payout.strComment));
+    entry.push_back(Pair("status", payout.GetStatusString()));
+    if (!payout.txid.IsNull())
+        entry.push_back(Pair("txid", payout.txid.GetHex()));
+    if (!payout.strError.empty())
+        entry.push_back(Pair("error", payout.strError));
+    entry.push_back(Pair("timequeued", payout.nTimeQueued));
+    if (payout.nTimeDone)
+        entry.push_back(Pair("timedone", payout.nTimeDone));
+}
+
+static const std::string strPayoutHelp =
+    "{\n"
+    "  \"id\": n,                 (numeric) The payment id\n"
+    "  \"address\":\"address\",     (string) The square address paid\n"
+    "  \"amount\": x.xxx,         (numeric) The amount in " + CURRENCY_UNIT + "\n"
+    "  \"comment\": \"...\",        (string) The comment given to queuepayouts, if any\n"
+    "  \"status\": \"status\",      (string) \"queued\", \"sent\" or \"failed\"\n"
+    "  \"txid\": \"txid\",          (string) The transaction paying it, once sent\n"
+    "  \"error\": \"...\",          (string) Why it couldn't be sent, if it wasn't\n"
+    "  \"timequeued\": ttt,       (numeric) The time it was queued in seconds since epoch\n"
+    "  \"timedone\": ttt          (numeric) The time it was sent or failed in seconds since epoch\n"
+    "}\n";
+
+UniValue queuepayouts(const UniValue& params, bool fHelp)
+{
+    if (!EnsureWalletIsAvailable(fHelp))
+        return NullUniValue;
+
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error(
+            "queuepayouts {\"address\":amount,...} ( \"comment\" )\n"
+            "\nQueue payments to be sent with the next payout round. A round pays up to -payoutmaxoutputs\n"
+            "(default: " + std::to_string(DEFAULT_PAYOUT_MAX_OUTPUTS) + ") queued payments with one transaction, rounds run every\n"
+            "-payoutinterval (default: " + std::to_string(DEFAULT_PAYOUT_INTERVAL) + ") seconds or on sendpayouts.\n"
+            "\nArguments:\n"
+            "1. \"amounts\"               (string, required) A json object with addresses and amounts\n"
+            "    {\n"
+            "      \"address\":amount     (numeric or string) The square address is the key, the numeric amount (can be string) in " + CURRENCY_UNIT + " is the value\n"
+            "      ,...\n"
+            "    }\n"
+            "2. \"comment\"               (string, optional) A comment stored with the payments\n"
+            "\nResult:\n"
+            "[ n, ... ]                 (array of numeric) The ids of the payments, in the order of the addresses\n"
+            "\nExamples:\n"
+            + HelpExampleCli("queuepayouts", "\"{\\\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\\\":0.01,\\\"XuQQkwA4FYkq2XERzMY2CiAZhJTEDAbtcg\\\":0.02}\" \"pool\"")
+            + HelpExampleRpc("queuepayouts", "\"{\\\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\\\":0.01,\\\"XuQQkwA4FYkq2XERzMY2CiAZhJTEDAbtcg\\\":0.02}\", \"pool\"")
+        );
+
+    UniValue sendTo = params[0].get_obj();
+    std::string strComment;
+    if (params.size() > 1 && !params[1].isNull())
+        strComment = params[1].get_str();
+
+    set<CBitcoinAddress> setAddress;
+    std::vector<std::pair<CScript, CAmount> > vecPayments;
+
+    vector<string> keys = sendTo.getKeys();
+    BOOST_FOREACH(const string& name_, keys)
+    {
+        CBitcoinAddress address(name_);
+        if (!address.IsValid())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, string("Invalid Square address: ")+name_);
+
+        if (setAddress.count(address))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, string("Invalid parameter, duplicated address: ")+name_);
+        setAddress.insert(address);
+
+        CAmount nAmount = AmountFromValue(sendTo[name_]);
+        if (nAmount <= 0)
+            throw JSONRPCError(RPC_TYPE_ERROR, "Invalid amount for send");
+        vecPayments.push_back(std::make_pair(GetScriptForDestination(address.Get()), nAmount));
+    }
+
+    UniValue result(UniValue::VARR);
+    BOOST_FOREACH(int64_t nId, pwalletMain->payoutQueue.Queue(vecPayments, strComment))
+        result.push_back(nId);
+    return result;
+}
+
+UniValue getpayout(const UniValue& params, bool fHelp)
+{
+    if (!EnsureWalletIsAvailable(fHelp))
+        return NullUniValue;
+
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getpayout id\n"
+            "\nGet a payment queued with queuepayouts. Sent and failed payments are kept for "
+            + std::to_string(PAYOUT_KEEP_SECONDS / (24 * 60 * 60)) + " days.\n"
+            "\nArguments:\n"
+            "1. id    (numeric, required) The payment id\n"
+            "\nResult:\n"
+            + strPayoutHelp +
+            "\nExamples:\n"
+            + HelpExampleCli("getpayout", "1")
+            + HelpExampleRpc("getpayout", "1")
+        );
+
+    CPayout payout;
+    if (!pwalletMain->payoutQueue.Get(params[0].get_int64(), payout))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid or unknown payment id");
+
+    UniValue entry(UniValue::VOBJ);
+    PayoutToJSON(payout, entry);
+    return entry;
+}
+
+UniValue listpayouts(const UniValue& params, bool fHelp)
+{
+    if (!EnsureWalletIsAvailable(fHelp))
+        return NullUniValue;
+
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "listpayouts ( \"status\" )\n"
+            "\nList the payments queued with queuepayouts.\n"
+            "\nArguments:\n"
+            "1. \"status\"    (string, optional) Only list \"queued\", \"sent\" or \"failed\" payments\n"
+            "\nResult:\n"
+            "[\n"
+            + strPayoutHelp +
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("listpayouts", "")
+            + HelpExampleCli("listpayouts", "\"failed\"")
+            + HelpExampleRpc("listpayouts", "\"queued\"")
+        );
+
+    int nStatus = -1;
+    if (params.size() > 0 && !params[0].isNull()) {
+        std::string strStatus = params[0].get_str();
+        if (strStatus == "queued")
+            nStatus = CPayout::PAYOUT_QUEUED;
+        else if (strStatus == "sent")
+            nStatus = CPayout::PAYOUT_SENT;
+        else if (strStatus == "failed")
+            nStatus = CPayout::PAYOUT_FAILED;
+        else
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid status: " + strStatus);
+    }
+
+    UniValue result(UniValue::VARR);
+    BOOST_FOREACH(const CPayout& payout, pwalletMain->payoutQueue.List(nStatus)) {
+        UniValue entry(UniValue::VOBJ);
+        PayoutToJSON(payout, entry);
+        result.push_back(entry);
+    }
+    return result;
+}
+
+UniValue cancelpayout(const UniValue& params, bool fHelp)
+{
+    if (!EnsureWalletIsAvailable(fHelp))
+        return NullUniValue;
+
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "cancelpayout id\n"
+            "\nDrop a queued payment which wasn't sent yet.\n"
+            "\nArguments:\n"
+            "1. id    (numeric, required) The payment id\n"
+            "\nExamples:\n"
+            + HelpExampleCli("cancelpayout", "1")
+            + HelpExampleRpc("cancelpayout", "1")
+        );
+
+    if (!pwalletMain->payoutQueue.Cancel(params[0].get_int64()))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown payment id or payment isn't queued anymore");
+
+    return NullUniValue;
+}
+
+UniValue sendpayouts(const UniValue& params, bool fHelp)
+{
+    if (!EnsureWalletIsAvailable(fHelp))
+        return NullUniValue;
+
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "sendpayouts\n"
+            "\nRun a payout round now, sending the queued payments the wallet has the funds for."
+            + HelpRequiringPassphrase() + "\n"
+            "\nResult:\n"
+            "[ \"txid\", ... ]          (array of string) The transactions sent, use getpayout or listpayouts\n"
+            "                         for the status of every payment\n"
+            "\nExamples:\n"
+            + HelpExampleCli("sendpayouts", "")
+            + HelpExampleRpc("sendpayouts", "")
+        );
+
+    if (pwalletMain->GetBroadcastTransactions() && !g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    EnsureWalletIsUnlocked();
+
+    UniValue result(UniValue::VARR);
+    BOOST_FOREACH(const uint256& txid, pwalletMain->payoutQueue.Process(g_connman.get()))
+        result.push_back(txid.GetHex());
+    return result;
+}
+
 // Defined in rpc/misc.cpp
 extern CScript _createmultisig_redeemScript(const UniValue& params);
 
@@ -1934,6 +2145,98 @@ UniValue abandontransaction(const UniValue& params, bool fHelp)
     return NullUniValue;
 }
 
+UniValue rescanblockchain(const UniValue& params, bool fHelp)
+{
+    if (!EnsureWalletIsAvailable(fHelp))
+        return NullUniValue;
+
+    if (fHelp || params.size() > 2)
+        throw runtime_error(
+            "rescanblockchain (start_height stop_height)\n"
+            "\nRescan the local blockchain for wallet related transactions.\n"
+            "\nArguments:\n"
+            "1. start_height    (numeric, optional, default=0) block height where the rescan should start\n"
+            "2. stop_height     (numeric, optional, default=tip) the last block height that should be scanned\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"start_height\": n,     (numeric) the block height where the rescan has started\n"
+            "  \"stop_height\": n,      (numeric) the last block height that has been scanned\n"
+            "  \"transactions\": n,     (numeric) how many wallet transactions were added or updated\n"
+            "}\n"
+            "\nNote: This call can take minutes to complete, see getwalletinfo for its progress and abortrescan to stop it.\n"
+            "\nExamples:\n"
+            + HelpExampleCli("rescanblockchain", "100000 120000")
+            + HelpExampleRpc("rescanblockchain", "100000, 120000")
+        );
+
+    CBlockIndex *pindexStart = NULL;
+    CBlockIndex *pindexStop = NULL;
+    {
+        LOCK(cs_main);
+        pindexStart = chainActive.Genesis();
+        pindexStop = chainActive.Tip();
+
+        if (params.size() > 0 && !params[0].isNull()) {
+            int nHeight = params[0].get_int();
+            if (nHeight < 0 || nHeight > chainActive.Height())
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid start_height");
+            pindexStart = chainActive[nHeight];
+        }
+
+        if (params.size() > 1 && !params[1].isNull()) {
+            int nHeight = params[1].get_int();
+            if (nHeight < 0 || nHeight > chainActive.Height())
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid stop_height");
+            if (nHeight < pindexStart->nHeight)
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "stop_height must be greater than start_height");
+            pindexStop = chainActive[nHeight];
+        }
+
+        // all blocks of the range have to be there
+        if (fPruneMode) {
+            for (CBlockIndex* pindex = pindexStop; pindex; pindex = pindex->pprev) {
+                if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+                    throw JSONRPCError(RPC_MISC_ERROR, "Can't rescan beyond pruned data. Use RPC call getblockchaininfo to determine your pruned height.");
+                if (pindex == pindexStart)
+                    break;
+            }
+        }
+    }
+
+    int nTransactions = pwalletMain->ScanForWalletTransactions(pindexStart, true, pindexStop);
+    if (pwalletMain->IsAbortingRescan())
+        throw JSONRPCError(RPC_MISC_ERROR, "Rescan aborted by user.");
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("start_height", pindexStart->nHeight));
+    obj.push_back(Pair("stop_height", pindexStop->nHeight));
+    obj.push_back(Pair("transactions", nTransactions));
+    return obj;
+}
+
+UniValue abortrescan(const UniValue& params, bool fHelp)
+{
+    if (!EnsureWalletIsAvailable(fHelp))
+        return NullUniValue;
+
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "abortrescan\n"
+            "\nStop the current wallet rescan, e.g. one started by rescanblockchain or importprivkey.\n"
+            "\nResult:\n"
+            "true|false    (boolean) whether a rescan was running\n"
+            "\nExamples:\n"
+            + HelpExampleCli("abortrescan", "")
+            + HelpExampleRpc("abortrescan", "")
+        );
+
+    // no wallet lock, the rescan holds it
+    if (!pwalletMain->IsScanning() || pwalletMain->IsAbortingRescan())
+        return false;
+    pwalletMain->AbortRescan();
+    return true;
+}
+
 
 UniValue backupwallet(const UniValue& params, bool fHelp)
 {
@@ -2406,13 +2709,46 @@ UniValue getwalletinfo(const UniValue& params, bool fHelp)
             "      }\n"
             "      ,...\n"
             "    ]\n"
+            "  \"scanning\":                 (json object) the running rescan, false if there is none. A rescan holds\n"
+            "                               the wallet until it is done, the fields which need the wallet are left\n"
+            "                               out while it does, only unlocked_until, paytxfee and scanning are returned\n"
+            "    {\n"
+            "      \"start_height\": xxxx,      (numeric) the first block of the rescan\n"
+            "      \"stop_height\": xxxx,       (numeric) the last block of the rescan\n"
+            "      \"height\": xxxx,            (numeric) the block being scanned\n"
+            "      \"progress\": x.xxxx,        (numeric) how much of the range was scanned, between 0 and 1\n"
+            "      \"duration\": xxxx,          (numeric) milliseconds since the rescan started\n"
+            "    }\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getwalletinfo", "")
             + HelpExampleRpc("getwalletinfo", "")
         );
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
+    UniValue scanning(false);
+    int nStartHeight, nStopHeight, nHeight;
+    int64_t nDuration;
+    bool fScanning = pwalletMain->GetScanProgress(nStartHeight, nStopHeight, nHeight, nDuration);
+    if (fScanning) {
+        scanning = UniValue(UniValue::VOBJ);
+        scanning.push_back(Pair("start_height", nStartHeight));
+        scanning.push_back(Pair("stop_height", nStopHeight));
+        scanning.push_back(Pair("height", nHeight));
+        scanning.push_back(Pair("progress", nStopHeight > nStartHeight ? (double)(nHeight - nStartHeight) / (nStopHeight - nStartHeight) : 0.0));
+        scanning.push_back(Pair("duration", nDuration));
+    }
+
+    // a rescan holds cs_main and the wallet lock until it is done, don't wait for them then
+    CCriticalBlock lockMain(cs_main, "cs_main", __FILE__, __LINE__, fScanning);
+    CCriticalBlock lockWallet(pwalletMain->cs_wallet, "pwalletMain->cs_wallet", __FILE__, __LINE__, fScanning);
+    if (!lockMain || !lockWallet) {
+        UniValue obj(UniValue::VOBJ);
+        if (pwalletMain->IsCrypted())
+            obj.push_back(Pair("unlocked_until", nWalletUnlockTime));
+        obj.push_back(Pair("paytxfee",      ValueFromAmount(payTxFee.GetFeePerK())));
+        obj.push_back(Pair("scanning", scanning));
+        return obj;
+    }
 
     CHDChain hdChainCurrent;
     bool fHDEnabled = pwalletMain->GetHDChain(hdChainCurrent);
@@ -2450,6 +2786,7 @@ UniValue getwalletinfo(const UniValue& params, bool fHelp)
         }
         obj.push_back(Pair("hdaccounts", accounts));
     }
+    obj.push_back(Pair("scanning", scanning));
     return obj;
 }
 
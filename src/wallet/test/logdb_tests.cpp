@@ -0,0 +1,340 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/logdb.h"
+
+#include "random.h"
+#include "util.h"
+#include "wallet/db.h"
+#include "wallet/wallet.h"
+#include "wallet/walletdb.h"
+
+#include "test/test_square.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+struct LogDBTestingSetup : public BasicTestingSetup {
+    boost::filesystem::path pathTemp;
+    boost::filesystem::path pathLog;
+
+    LogDBTestingSetup()
+    {
+        pathTemp = GetTempPath() / strprintf("test_square_logdb_%lu_%i", (unsigned long)GetTime(), (int)GetRand(100000));
+        boost::filesystem::create_directories(pathTemp);
+        pathLog = pathTemp / "wallet.dat";
+    }
+
+    ~LogDBTestingSetup()
+    {
+        boost::filesystem::remove_all(pathTemp);
+    }
+};
+
+/** Wallets in a real data directory, the mock Berkeley DB environment never opens log stores */
+struct LogWalletTestingSetup : public LogDBTestingSetup {
+    LogWalletTestingSetup()
+    {
+        ClearDatadirCache();
+        mapArgs["-datadir"] = pathTemp.string();
+        mapArgs["-logwallet"] = "1";
+        mapArgs["-keypool"] = "1";
+    }
+
+    ~LogWalletTestingSetup()
+    {
+        logdbenv.Flush(true);
+        bitdb.Flush(true);
+        bitdb.Reset();
+        mapArgs.erase("-datadir");
+        mapArgs.erase("-logwallet");
+        mapArgs.erase("-keypool");
+        ClearDatadirCache();
+    }
+};
+
+static CSerializeData Data(const std::string& str)
+{
+    return CSerializeData(str.begin(), str.end());
+}
+
+static std::string Str(const CSerializeData& vch)
+{
+    return std::string(vch.begin(), vch.end());
+}
+
+static void Open(CLogDB& logdb, const boost::filesystem::path& path)
+{
+    std::string strError;
+    BOOST_REQUIRE_MESSAGE(logdb.Open(path, true, strError), strError);
+}
+
+static std::string ReadFile(const boost::filesystem::path& path)
+{
+    std::string str;
+    FILE* file = fopen(path.string().c_str(), "rb");
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0)
+        str.append(buf, n);
+    fclose(file);
+    return str;
+}
+
+static CKey AddNewKey(CWallet& wallet)
+{
+    LOCK(wallet.cs_wallet);
+    CKey key;
+    key.MakeNewKey(true);
+    BOOST_REQUIRE(wallet.AddKeyPubKey(key, key.GetPubKey()));
+    return key;
+}
+
+static void Append(const boost::filesystem::path& path, const std::string& str)
+{
+    FILE* file = fopen(path.string().c_str(), "ab");
+    fwrite(str.data(), 1, str.size(), file);
+    fclose(file);
+}
+
+BOOST_FIXTURE_TEST_SUITE(logdb_tests, LogDBTestingSetup)
+
+BOOST_AUTO_TEST_CASE(write_read_reopen)
+{
+    CLogDB logdb;
+    Open(logdb, pathLog);
+    BOOST_CHECK(CLogDB::IsLogFile(pathLog));
+
+    CLogDBBatch batch;
+    batch.Write(Data("b"), Data("2"));
+    batch.Write(Data("a"), Data("1"));
+    batch.Write(Data("c"), Data("3"));
+    BOOST_CHECK(logdb.Apply(batch));
+
+    CLogDBBatch batch2;
+    batch2.Erase(Data("c"));
+    batch2.Write(Data("a"), Data("4"));
+    batch2.Write(Data("ab"), Data(""));
+    BOOST_CHECK(logdb.Apply(batch2));
+    logdb.Close();
+
+    Open(logdb, pathLog);
+    CSerializeData key, value;
+    BOOST_CHECK_EQUAL(logdb.GetRecordCount(), 3U);
+    BOOST_CHECK(logdb.Read(Data("a"), value) && Str(value) == "4");
+    BOOST_CHECK(logdb.Read(Data("ab"), value) && value.empty());
+    BOOST_CHECK(!logdb.Exists(Data("c")));
+
+    // keys are ordered byte by byte, shorter ones first
+    BOOST_CHECK(logdb.Seek(Data(""), false, key, value) && Str(key) == "a");
+    BOOST_CHECK(logdb.Seek(key, true, key, value) && Str(key) == "ab");
+    BOOST_CHECK(logdb.Seek(key, true, key, value) && Str(key) == "b");
+    BOOST_CHECK(!logdb.Seek(key, true, key, value));
+    BOOST_CHECK(logdb.Seek(Data("aa"), false, key, value) && Str(key) == "ab");
+
+    // not a log store
+    Append(pathTemp / "bdb.dat", std::string(100, '\0'));
+    BOOST_CHECK(!CLogDB::IsLogFile(pathTemp / "bdb.dat"));
+    BOOST_CHECK(!CLogDB::IsLogFile(pathTemp / "missing.dat"));
+}
+
+BOOST_AUTO_TEST_CASE(torn_tail)
+{
+    CLogDB logdb;
+    Open(logdb, pathLog);
+    CLogDBBatch batch;
+    batch.Write(Data("a"), Data("1"));
+    BOOST_CHECK(logdb.Apply(batch));
+    uint64_t nGoodSize = logdb.GetFileSize();
+
+    CLogDBBatch batch2;
+    batch2.Write(Data("b"), Data("2"));
+    batch2.Write(Data("c"), Data("3"));
+    batch2.Write(Data("d"), Data("4"));
+    BOOST_CHECK(logdb.Apply(batch2));
+    uint64_t nFullSize = logdb.GetFileSize();
+    logdb.Close();
+
+    // the last record of a batch is missing, the whole batch is dropped
+    boost::filesystem::resize_file(pathLog, nFullSize - 3);
+    Open(logdb, pathLog);
+    BOOST_CHECK_EQUAL(logdb.GetRecordCount(), 1U);
+    BOOST_CHECK(!logdb.Exists(Data("b")));
+    BOOST_CHECK_EQUAL(logdb.GetFileSize(), nGoodSize);
+    BOOST_CHECK(logdb.Apply(batch2));
+    logdb.Close();
+
+    // garbage after the last record is cut off, records before it survive
+    Append(pathLog, "garbage");
+    Open(logdb, pathLog);
+    BOOST_CHECK_EQUAL(logdb.GetRecordCount(), 4U);
+    BOOST_CHECK_EQUAL(logdb.GetFileSize(), nFullSize);
+    logdb.Close();
+
+    // the original files were kept
+    int nBackups = 0;
+    for (boost::filesystem::directory_iterator it(pathTemp); it != boost::filesystem::directory_iterator(); ++it) {
+        if (it->path().extension() == ".bak")
+            nBackups++;
+    }
+    BOOST_CHECK(nBackups >= 1);
+}
+
+BOOST_AUTO_TEST_CASE(compact)
+{
+    CLogDB logdb;
+    Open(logdb, pathLog);
+    std::string strValue(1000, 'x');
+    for (int i = 0; i < 2000; i++) {
+        CLogDBBatch batch;
+        batch.Write(Data(strprintf("key%d", i % 10)), Data(strValue + strprintf("%d", i)));
+        BOOST_CHECK(logdb.Apply(batch));
+    }
+    BOOST_CHECK(logdb.NeedsCompaction());
+    uint64_t nOldSize = logdb.GetFileSize();
+
+    BOOST_CHECK(logdb.Compact());
+    BOOST_CHECK(!logdb.NeedsCompaction());
+    BOOST_CHECK(logdb.GetFileSize() < nOldSize / 100);
+    BOOST_CHECK(!boost::filesystem::exists(pathLog.string() + ".compact"));
+
+    // appends go on after compaction
+    CLogDBBatch batch;
+    batch.Erase(Data("key0"));
+    BOOST_CHECK(logdb.Apply(batch));
+    logdb.Close();
+
+    Open(logdb, pathLog);
+    CSerializeData value;
+    BOOST_CHECK_EQUAL(logdb.GetRecordCount(), 9U);
+    BOOST_CHECK(logdb.Read(Data("key9"), value) && Str(value) == strValue + "1999");
+}
+
+BOOST_AUTO_TEST_CASE(replay_many)
+{
+    // enough records to be decoded on several threads
+    CLogDB logdb;
+    Open(logdb, pathLog);
+    CLogDBBatch batch;
+    for (int i = 0; i < 50000; i++)
+        batch.Write(Data(strprintf("key%05d", i)), Data(strprintf("value%d", i)));
+    BOOST_CHECK(logdb.Apply(batch));
+    for (int i = 0; i < 50000; i += 2) {
+        CLogDBBatch batchErase;
+        batchErase.Erase(Data(strprintf("key%05d", i)));
+        BOOST_CHECK(logdb.Apply(batchErase));
+    }
+    logdb.Close();
+
+    Open(logdb, pathLog);
+    BOOST_CHECK_EQUAL(logdb.GetRecordCount(), 25000U);
+    CSerializeData key, value;
+    BOOST_CHECK(logdb.Seek(Data(""), false, key, value) && Str(key) == "key00001" && Str(value) == "value1");
+    BOOST_CHECK(logdb.Read(Data("key49999"), value) && Str(value) == "value49999");
+}
+
+BOOST_AUTO_TEST_CASE(copy)
+{
+    CLogDB logdb;
+    Open(logdb, pathLog);
+    CLogDBBatch batch;
+    batch.Write(Data("a"), Data("1"));
+    BOOST_CHECK(logdb.Apply(batch));
+    BOOST_CHECK(logdb.Copy(pathTemp / "backup.dat"));
+
+    CLogDB logdbCopy;
+    Open(logdbCopy, pathTemp / "backup.dat");
+    CSerializeData value;
+    BOOST_CHECK(logdbCopy.Read(Data("a"), value) && Str(value) == "1");
+}
+
+BOOST_FIXTURE_TEST_CASE(wallet_load_encrypt, LogWalletTestingSetup)
+{
+    bool fFirstRun;
+    CKey key;
+    {
+        CWallet wallet("wallet.dat");
+        BOOST_CHECK_EQUAL(wallet.LoadWallet(fFirstRun), DB_LOAD_OK);
+        BOOST_CHECK(CLogDB::IsLogFile(pathLog));
+        key = AddNewKey(wallet);
+    }
+    std::string strSecret(key.begin(), key.end());
+    BOOST_CHECK(ReadFile(pathLog).find(strSecret) != std::string::npos);
+
+    {
+        CWallet wallet("wallet.dat");
+        BOOST_CHECK_EQUAL(wallet.LoadWallet(fFirstRun), DB_LOAD_OK);
+        BOOST_CHECK(wallet.HaveKey(key.GetPubKey().GetID()));
+        BOOST_CHECK(wallet.EncryptWallet("passphrase"));
+    }
+    // the rewrite after encrypting dropped the plaintext key from the file
+    BOOST_CHECK(ReadFile(pathLog).find(strSecret) == std::string::npos);
+
+    CWallet wallet("wallet.dat");
+    BOOST_CHECK_EQUAL(wallet.LoadWallet(fFirstRun), DB_LOAD_OK);
+    BOOST_CHECK(wallet.IsCrypted());
+    BOOST_CHECK(wallet.HaveKey(key.GetPubKey().GetID()));
+    BOOST_CHECK(wallet.Unlock("passphrase"));
+    CKey keyLoaded;
+    BOOST_CHECK(wallet.GetKey(key.GetPubKey().GetID(), keyLoaded) && keyLoaded == key);
+}
+
+BOOST_FIXTURE_TEST_CASE(wallet_txn_cursor, LogWalletTestingSetup)
+{
+    CWalletDB walletdb("wallet.dat", "cr+");
+    CAccountingEntry acentry;
+    acentry.strAccount = "a";
+    acentry.nCreditDebit = 1;
+    BOOST_CHECK(walletdb.WriteAccountingEntry_Backend(acentry));
+    BOOST_CHECK_EQUAL(walletdb.GetAccountCreditDebit("a"), 1);
+
+    // the cursor sees what the running transaction wrote
+    BOOST_CHECK(walletdb.TxnBegin());
+    acentry.nCreditDebit = 2;
+    BOOST_CHECK(walletdb.WriteAccountingEntry_Backend(acentry));
+    BOOST_CHECK_EQUAL(walletdb.GetAccountCreditDebit("a"), 3);
+    BOOST_CHECK_EQUAL(walletdb.GetAccountCreditDebit("*"), 3);
+    BOOST_CHECK(walletdb.TxnAbort());
+    BOOST_CHECK_EQUAL(walletdb.GetAccountCreditDebit("a"), 1);
+
+    BOOST_CHECK(walletdb.TxnBegin());
+    BOOST_CHECK(walletdb.WriteAccountingEntry_Backend(acentry));
+    BOOST_CHECK(walletdb.TxnCommit());
+    BOOST_CHECK_EQUAL(walletdb.GetAccountCreditDebit("a"), 3);
+}
+
+BOOST_FIXTURE_TEST_CASE(wallet_migrate, LogWalletTestingSetup)
+{
+    mapArgs["-logwallet"] = "0";
+    bool fFirstRun;
+    CKey key;
+    {
+        CWallet wallet("wallet.dat");
+        BOOST_CHECK_EQUAL(wallet.LoadWallet(fFirstRun), DB_LOAD_OK);
+        key = AddNewKey(wallet);
+    }
+    // write the Berkeley DB file out, like the flush thread does
+    bitdb.Flush(false);
+    BOOST_CHECK(boost::filesystem::exists(pathLog));
+    BOOST_CHECK(!CLogDB::IsLogFile(pathLog));
+
+    mapArgs["-logwallet"] = "1";
+    BOOST_CHECK(CDB::MigrateToLog("wallet.dat"));
+    BOOST_CHECK(CLogDB::IsLogFile(pathLog));
+
+    // the Berkeley DB file was kept
+    int nBackups = 0;
+    for (boost::filesystem::directory_iterator it(pathTemp); it != boost::filesystem::directory_iterator(); ++it) {
+        if (it->path().extension() == ".bdb")
+            nBackups++;
+    }
+    BOOST_CHECK_EQUAL(nBackups, 1);
+
+    CWallet wallet("wallet.dat");
+    BOOST_CHECK_EQUAL(wallet.LoadWallet(fFirstRun), DB_LOAD_OK);
+    CKey keyLoaded;
+    BOOST_CHECK(wallet.GetKey(key.GetPubKey().GetID(), keyLoaded) && keyLoaded == key);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
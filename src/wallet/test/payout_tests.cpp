@@ -0,0 +1,277 @@
+// Copyright (c) 2018- The Square Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/payout.h"
+
+#include "policy/policy.h"
+#include "random.h"
+#include "script/interpreter.h"
+#include "script/standard.h"
+#include "streams.h"
+#include "validation.h"
+#include "wallet/wallet.h"
+
+#include "test/test_square.h"
+
+#include <boost/test/unit_test.hpp>
+
+extern CWallet* pwalletMain;
+
+BOOST_FIXTURE_TEST_SUITE(payout_tests, TestingSetup)
+
+static std::vector<std::pair<CScript, CAmount> > Payments(int nCount)
+{
+    std::vector<std::pair<CScript, CAmount> > vecPayments;
+    for (int i = 0; i < nCount; i++)
+        vecPayments.push_back(std::make_pair(CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i) << OP_EQUALVERIFY << OP_CHECKSIG, (i + 1) * COIN));
+    return vecPayments;
+}
+
+BOOST_AUTO_TEST_CASE(queue_cancel)
+{
+    CWallet wallet;
+    std::vector<int64_t> vIds = wallet.payoutQueue.Queue(Payments(3), "test");
+    BOOST_CHECK_EQUAL(vIds.size(), 3U);
+    BOOST_CHECK_EQUAL(vIds[0], 1);
+    BOOST_CHECK_EQUAL(vIds[2], 3);
+
+    CPayout payout;
+    BOOST_CHECK(wallet.payoutQueue.Get(2, payout));
+    BOOST_CHECK_EQUAL(payout.nAmount, 2 * COIN);
+    BOOST_CHECK_EQUAL(payout.strComment, "test");
+    BOOST_CHECK_EQUAL(payout.GetStatusString(), "queued");
+    BOOST_CHECK(!wallet.payoutQueue.Get(4, payout));
+
+    BOOST_CHECK(wallet.payoutQueue.Cancel(2));
+    BOOST_CHECK(!wallet.payoutQueue.Cancel(2));
+    BOOST_CHECK_EQUAL(wallet.payoutQueue.GetQueuedCount(), 2U);
+    BOOST_CHECK_EQUAL(wallet.payoutQueue.List(CPayout::PAYOUT_QUEUED).size(), 2U);
+    BOOST_CHECK(wallet.payoutQueue.List(CPayout::PAYOUT_SENT).empty());
+
+    // ids aren't reused
+    BOOST_CHECK_EQUAL(wallet.payoutQueue.Queue(Payments(1), "")[0], 4);
+
+    // without funds the payments stay queued
+    BOOST_CHECK(wallet.payoutQueue.Process(NULL).empty());
+    BOOST_CHECK_EQUAL(wallet.payoutQueue.GetQueuedCount(), 3U);
+}
+
+BOOST_AUTO_TEST_CASE(load)
+{
+    CPayout payout;
+    payout.nId = 7;
+    payout.scriptPubKey = Payments(1)[0].first;
+    payout.nAmount = COIN;
+    payout.nStatus = CPayout::PAYOUT_SENT;
+    payout.txid = GetRandHash();
+    payout.nTimeDone = GetTime();
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << payout;
+    CPayout payout2;
+    ss >> payout2;
+    BOOST_CHECK_EQUAL(payout2.nId, 7);
+    BOOST_CHECK(payout2.scriptPubKey == payout.scriptPubKey);
+    BOOST_CHECK(payout2.txid == payout.txid);
+    BOOST_CHECK_EQUAL(payout2.GetStatusString(), "sent");
+
+    CWallet wallet;
+    wallet.payoutQueue.Load(payout2);
+    wallet.payoutQueue.LoadNextId(5);
+    BOOST_CHECK_EQUAL(wallet.payoutQueue.GetQueuedCount(), 0U);
+    BOOST_CHECK_EQUAL(wallet.payoutQueue.List().size(), 1U);
+    BOOST_CHECK_EQUAL(wallet.payoutQueue.Queue(Payments(1), "")[0], 8);
+
+    // sent payments are kept for a while
+    wallet.payoutQueue.Process(NULL);
+    BOOST_CHECK(wallet.payoutQueue.Get(7, payout2));
+}
+
+// A wallet with the mature coinbases of 40 blocks, paying to a P2PK script each,
+// which puts what it sends into the mempool
+struct PayoutTestingSetup : public TestChain100Setup {
+    PayoutTestingSetup() {
+        {
+            LOCK(pwalletMain->cs_wallet);
+            pwalletMain->AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey());
+        }
+        pwalletMain->SetBroadcastTransactions(true);
+        pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true);
+        CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+        for (int i = 0; i < 40; i++)
+            CreateAndProcessBlock(std::vector<CMutableTransaction>(), scriptPubKey);
+    }
+};
+
+static void CheckSignatures(const CTransaction& tx)
+{
+    LOCK(pwalletMain->cs_wallet);
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        const CWalletTx* pprev = pwalletMain->GetWalletTx(tx.vin[i].prevout.hash);
+        BOOST_REQUIRE(pprev != NULL);
+        const CScript& scriptPubKey = pprev->vout[tx.vin[i].prevout.n].scriptPubKey;
+        BOOST_CHECK(VerifyScript(tx.vin[i].scriptSig, scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, i)));
+    }
+}
+
+static CTransaction GetWalletTx(const uint256& txid)
+{
+    LOCK(pwalletMain->cs_wallet);
+    const CWalletTx* pwtx = pwalletMain->GetWalletTx(txid);
+    BOOST_REQUIRE(pwtx != NULL);
+    return *pwtx;
+}
+
+BOOST_FIXTURE_TEST_CASE(send_signed_on_threads, PayoutTestingSetup)
+{
+    // enough inputs for two signing threads, even on a single core
+    mapArgs["-signthreads"] = "2";
+    CAmount nValue = coinbaseTxns[0].vout[0].nValue / 2;
+    std::vector<std::pair<CScript, CAmount> > vecPayments = Payments(70);
+    for (size_t i = 0; i < vecPayments.size(); i++)
+        vecPayments[i].second = nValue;
+    std::vector<int64_t> vIds = pwalletMain->payoutQueue.Queue(vecPayments, "");
+
+    std::vector<uint256> vTxids = pwalletMain->payoutQueue.Process(NULL);
+    mapArgs.erase("-signthreads");
+    BOOST_REQUIRE_EQUAL(vTxids.size(), 1U);
+    CTransaction tx = GetWalletTx(vTxids[0]);
+    BOOST_CHECK(tx.vin.size() >= 2 * SIGN_INPUTS_PER_THREAD);
+    BOOST_CHECK(tx.vout.size() == vIds.size() || tx.vout.size() == vIds.size() + 1);
+    CheckSignatures(tx);
+    BOOST_CHECK(mempool.exists(tx.GetHash()));
+
+    BOOST_CHECK_EQUAL(pwalletMain->payoutQueue.GetQueuedCount(), 0U);
+    BOOST_FOREACH(int64_t nId, vIds) {
+        CPayout payout;
+        BOOST_CHECK(pwalletMain->payoutQueue.Get(nId, payout));
+        BOOST_CHECK_EQUAL(payout.GetStatusString(), "sent");
+        BOOST_CHECK(payout.txid == tx.GetHash());
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(send_batches, PayoutTestingSetup)
+{
+    mapArgs["-payoutmaxoutputs"] = "10";
+    std::vector<int64_t> vIds = pwalletMain->payoutQueue.Queue(Payments(25), "");
+    std::vector<uint256> vTxids = pwalletMain->payoutQueue.Process(NULL);
+    mapArgs.erase("-payoutmaxoutputs");
+
+    BOOST_REQUIRE_EQUAL(vTxids.size(), 3U);
+    const size_t nOutputs[] = {10, 10, 5};
+    for (int i = 0; i < 3; i++) {
+        CTransaction tx = GetWalletTx(vTxids[i]);
+        // the payments and the change
+        BOOST_CHECK_EQUAL(tx.vout.size(), nOutputs[i] + 1);
+        CheckSignatures(tx);
+    }
+    CPayout payout;
+    BOOST_CHECK(pwalletMain->payoutQueue.Get(vIds[9], payout));
+    BOOST_CHECK(payout.txid == vTxids[0]);
+    BOOST_CHECK(pwalletMain->payoutQueue.Get(vIds[10], payout));
+    BOOST_CHECK(payout.txid == vTxids[1]);
+}
+
+BOOST_FIXTURE_TEST_CASE(send_split, PayoutTestingSetup)
+{
+    // the dust payment fails the batch, the others are sent without it
+    std::vector<std::pair<CScript, CAmount> > vecPayments = Payments(3);
+    vecPayments[1].second = 100;
+    std::vector<int64_t> vIds = pwalletMain->payoutQueue.Queue(vecPayments, "");
+
+    BOOST_CHECK_EQUAL(pwalletMain->payoutQueue.Process(NULL).size(), 2U);
+    CPayout payout;
+    BOOST_CHECK(pwalletMain->payoutQueue.Get(vIds[0], payout));
+    BOOST_CHECK_EQUAL(payout.GetStatusString(), "sent");
+    BOOST_CHECK(pwalletMain->payoutQueue.Get(vIds[2], payout));
+    BOOST_CHECK_EQUAL(payout.GetStatusString(), "sent");
+    BOOST_CHECK(pwalletMain->payoutQueue.Get(vIds[1], payout));
+    BOOST_CHECK_EQUAL(payout.GetStatusString(), "queued");
+    BOOST_CHECK_EQUAL(payout.nAttempts, 1);
+
+    for (int i = 1; i < PAYOUT_MAX_ATTEMPTS; i++)
+        BOOST_CHECK(pwalletMain->payoutQueue.Process(NULL).empty());
+    BOOST_CHECK(pwalletMain->payoutQueue.Get(vIds[1], payout));
+    BOOST_CHECK_EQUAL(payout.GetStatusString(), "failed");
+    BOOST_CHECK_EQUAL(payout.nAttempts, PAYOUT_MAX_ATTEMPTS);
+}
+
+BOOST_FIXTURE_TEST_CASE(send_insufficient_funds, PayoutTestingSetup)
+{
+    // the whole balance leaves nothing for the fee
+    std::vector<std::pair<CScript, CAmount> > vecPayments = Payments(1);
+    vecPayments[0].second = pwalletMain->GetBalance();
+    std::vector<int64_t> vIds = pwalletMain->payoutQueue.Queue(vecPayments, "");
+
+    for (int i = 0; i <= PAYOUT_MAX_ATTEMPTS; i++)
+        BOOST_CHECK(pwalletMain->payoutQueue.Process(NULL).empty());
+    CPayout payout;
+    BOOST_CHECK(pwalletMain->payoutQueue.Get(vIds[0], payout));
+    BOOST_CHECK_EQUAL(payout.GetStatusString(), "queued");
+    BOOST_CHECK_EQUAL(payout.nAttempts, 0);
+    BOOST_CHECK(!payout.strError.empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(load_committed, PayoutTestingSetup)
+{
+    // the wallet file may hold the queue of earlier cases
+    size_t nQueued = pwalletMain->payoutQueue.GetQueuedCount();
+    std::vector<int64_t> vIds = pwalletMain->payoutQueue.Queue(Payments(3), "");
+
+    // what SendBatch commits for the first two payments, the node stops before they are saved
+    std::vector<CRecipient> vecSend;
+    for (int i = 0; i < 2; i++) {
+        CPayout payout;
+        BOOST_REQUIRE(pwalletMain->payoutQueue.Get(vIds[i], payout));
+        CRecipient recipient = {payout.scriptPubKey, payout.nAmount, false};
+        vecSend.push_back(recipient);
+    }
+    CWalletTx wtx;
+    wtx.mapValue["payouts"] = strprintf("%d,%d", vIds[0], vIds[1]);
+    CReserveKey keyChange(pwalletMain);
+    CAmount nFeeRequired;
+    int nChangePosRet = -1;
+    std::string strFailReason;
+    BOOST_REQUIRE(pwalletMain->CreateTransaction(vecSend, wtx, keyChange, nFeeRequired, nChangePosRet, strFailReason));
+    BOOST_REQUIRE(pwalletMain->CommitTransaction(wtx, keyChange, NULL));
+    BOOST_CHECK_EQUAL(pwalletMain->payoutQueue.GetQueuedCount(), nQueued + 3);
+
+    // the restarted wallet finds the payments of the transaction sent
+    CWallet wallet(pwalletMain->strWalletFile);
+    bool fFirstRun;
+    BOOST_CHECK_EQUAL(wallet.LoadWallet(fFirstRun), DB_LOAD_OK);
+    CPayout payout;
+    for (int i = 0; i < 2; i++) {
+        BOOST_CHECK(wallet.payoutQueue.Get(vIds[i], payout));
+        BOOST_CHECK_EQUAL(payout.GetStatusString(), "sent");
+        BOOST_CHECK(payout.txid == wtx.GetHash());
+    }
+    BOOST_CHECK(wallet.payoutQueue.Get(vIds[2], payout));
+    BOOST_CHECK_EQUAL(payout.GetStatusString(), "queued");
+    BOOST_CHECK_EQUAL(wallet.payoutQueue.GetQueuedCount(), nQueued + 1);
+
+    // and saved them, a second restart doesn't need the transaction
+    CWallet walletReloaded(pwalletMain->strWalletFile);
+    BOOST_CHECK_EQUAL(walletReloaded.LoadWallet(fFirstRun), DB_LOAD_OK);
+    BOOST_CHECK(walletReloaded.payoutQueue.Get(vIds[0], payout));
+    BOOST_CHECK_EQUAL(payout.GetStatusString(), "sent");
+
+    // the payments of an abandoned payout transaction stay queued
+    CWalletTx wtxAbandoned;
+    wtxAbandoned.mapValue["payouts"] = strprintf("%d", vIds[2]);
+    vecSend.resize(1);
+    BOOST_REQUIRE(pwalletMain->payoutQueue.Get(vIds[2], payout));
+    vecSend[0].scriptPubKey = payout.scriptPubKey;
+    vecSend[0].nAmount = payout.nAmount;
+    pwalletMain->SetBroadcastTransactions(false);
+    BOOST_REQUIRE(pwalletMain->CreateTransaction(vecSend, wtxAbandoned, keyChange, nFeeRequired, nChangePosRet, strFailReason));
+    BOOST_REQUIRE(pwalletMain->CommitTransaction(wtxAbandoned, keyChange, NULL));
+    BOOST_REQUIRE(pwalletMain->AbandonTransaction(wtxAbandoned.GetHash()));
+    CWallet walletAbandoned(pwalletMain->strWalletFile);
+    BOOST_CHECK_EQUAL(walletAbandoned.LoadWallet(fFirstRun), DB_LOAD_OK);
+    BOOST_CHECK(walletAbandoned.payoutQueue.Get(vIds[2], payout));
+    BOOST_CHECK_EQUAL(payout.GetStatusString(), "queued");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,15 @@
 
 #include "wallet/wallet.h"
 
+#include "chainparams.h"
+#include "consensus/consensus.h"
+#include "consensus/validation.h"
+#include "privatesend.h"
+#include "random.h"
+#include "script/sign.h"
+#include "validation.h"
+
+#include <algorithm>
 #include <set>
 #include <stdint.h>
 #include <utility>
@@ -21,6 +30,8 @@
 // we repeat those tests this many times and only complain if all iterations of the test fail
 #define RANDOM_REPEATS 5
 
+extern CWallet* pwalletMain;
+
 using namespace std;
 
 typedef set<pair<const CWalletTx*,unsigned int> > CoinSet;
@@ -361,4 +372,491 @@ BOOST_AUTO_TEST_CASE(ApproximateBestSubset)
     BOOST_CHECK_EQUAL(setCoinsRet.size(), 101);
 }
 
+// A transaction spending output n of txFrom, signed with keystore, to scriptPubKey
+static CMutableTransaction SpendTo(const CKeyStore& keystore, const CTransaction& txFrom, unsigned int n, const CScript& scriptPubKey)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(txFrom.GetHash(), n);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = txFrom.vout[n].nValue - 10000;
+    tx.vout[0].scriptPubKey = scriptPubKey;
+    BOOST_CHECK(SignSignature(keystore, txFrom, tx, 0));
+    return tx;
+}
+
+BOOST_FIXTURE_TEST_CASE(rescan_filter, TestChain100Setup)
+{
+    CBasicKeyStore keystoreCoinbase;
+    keystoreCoinbase.AddKey(coinbaseKey);
+    CScript scriptCoinbase = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+
+    CKey keyP2PKH, keyP2PK, keyP2SH, keyWatch, keyOther;
+    keyP2PKH.MakeNewKey(true);
+    keyP2PK.MakeNewKey(false);
+    keyP2SH.MakeNewKey(true);
+    keyWatch.MakeNewKey(true);
+    keyOther.MakeNewKey(true);
+    CScript scriptP2PKH = GetScriptForDestination(keyP2PKH.GetPubKey().GetID());
+    CScript scriptRedeem = GetScriptForDestination(keyP2SH.GetPubKey().GetID());
+    CScript scriptWatch = GetScriptForDestination(keyWatch.GetPubKey().GetID());
+    CScript scriptOther = GetScriptForDestination(keyOther.GetPubKey().GetID());
+
+    // fan a mature coinbase out, then pay every kind of wallet output and an unrelated one
+    CMutableTransaction txFanOut;
+    txFanOut.vin.resize(1);
+    txFanOut.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    for (int i = 0; i < 5; i++)
+        txFanOut.vout.push_back(CTxOut(coinbaseTxns[0].vout[0].nValue / 10, scriptCoinbase));
+    BOOST_CHECK(SignSignature(keystoreCoinbase, coinbaseTxns[0], txFanOut, 0));
+
+    std::vector<CMutableTransaction> vTxns;
+    vTxns.push_back(txFanOut);
+    vTxns.push_back(SpendTo(keystoreCoinbase, txFanOut, 0, scriptP2PKH));
+    vTxns.push_back(SpendTo(keystoreCoinbase, txFanOut, 1, GetScriptForRawPubKey(keyP2PK.GetPubKey())));
+    vTxns.push_back(SpendTo(keystoreCoinbase, txFanOut, 2, GetScriptForDestination(CScriptID(scriptRedeem))));
+    vTxns.push_back(SpendTo(keystoreCoinbase, txFanOut, 3, scriptWatch));
+    vTxns.push_back(SpendTo(keystoreCoinbase, txFanOut, 4, scriptOther));
+    CreateAndProcessBlock(vTxns, scriptCoinbase);
+
+    // a spend of a wallet output to a script the wallet doesn't know
+    CBasicKeyStore keystoreP2PKH;
+    keystoreP2PKH.AddKey(keyP2PKH);
+    std::vector<CMutableTransaction> vTxnsSpend;
+    vTxnsSpend.push_back(SpendTo(keystoreP2PKH, vTxns[1], 0, scriptOther));
+    CreateAndProcessBlock(vTxnsSpend, scriptCoinbase);
+    BOOST_REQUIRE_EQUAL(chainActive.Height(), COINBASE_MATURITY + 2);
+
+    CWallet walletScan("wallet_rescan.dat");
+    bool fFirstRun;
+    BOOST_CHECK_EQUAL(walletScan.LoadWallet(fFirstRun), DB_LOAD_OK);
+    {
+        LOCK(walletScan.cs_wallet);
+        walletScan.AddKeyPubKey(keyP2PKH, keyP2PKH.GetPubKey());
+        walletScan.AddKeyPubKey(keyP2PK, keyP2PK.GetPubKey());
+        walletScan.AddKeyPubKey(keyP2SH, keyP2SH.GetPubKey());
+        walletScan.AddCScript(scriptRedeem);
+        walletScan.AddWatchOnly(scriptWatch);
+    }
+    BOOST_CHECK_EQUAL(walletScan.ScanForWalletTransactions(chainActive.Genesis(), true), 5);
+
+    LOCK(walletScan.cs_wallet);
+    BOOST_CHECK(!walletScan.mapWallet.count(vTxns[0].GetHash()));
+    for (int i = 1; i <= 4; i++)
+        BOOST_CHECK(walletScan.mapWallet.count(vTxns[i].GetHash()));
+    BOOST_CHECK(!walletScan.mapWallet.count(vTxns[5].GetHash()));
+    BOOST_CHECK(walletScan.mapWallet.count(vTxnsSpend[0].GetHash()));
+    BOOST_CHECK(walletScan.IsSpent(vTxns[1].GetHash(), 0));
+}
+
+// What AvailableCoins returns, found by going through every output of the wallet
+static std::set<COutPoint> AvailableCoinsFullScan(const CWallet& walletIn, bool fOnlyConfirmed, AvailableCoinsType nCoinType)
+{
+    std::set<COutPoint> setCoins;
+    LOCK2(cs_main, walletIn.cs_wallet);
+    for (std::map<uint256, CWalletTx>::const_iterator it = walletIn.mapWallet.begin(); it != walletIn.mapWallet.end(); ++it) {
+        const CWalletTx& wtx = it->second;
+        if (!CheckFinalTx(wtx) || (fOnlyConfirmed && !wtx.IsTrusted()))
+            continue;
+        if (wtx.IsCoinBase() && wtx.GetBlocksToMaturity() > 0)
+            continue;
+        if (wtx.GetDepthInMainChain(false) == 0 && !wtx.InMempool())
+            continue;
+        for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+            CAmount nValue = wtx.vout[i].nValue;
+            bool fFound = true;
+            if (nCoinType == ONLY_DENOMINATED)
+                fFound = CPrivateSend::IsDenominatedAmount(nValue);
+            else if (nCoinType == ONLY_NONDENOMINATED)
+                fFound = !CPrivateSend::IsCollateralAmount(nValue) && !CPrivateSend::IsDenominatedAmount(nValue);
+            else if (nCoinType == ONLY_1000)
+                fFound = nValue == 1000*COIN;
+            else if (nCoinType == ONLY_PRIVATESEND_COLLATERAL)
+                fFound = CPrivateSend::IsCollateralAmount(nValue);
+            if (fFound && !walletIn.IsSpent(it->first, i) && walletIn.IsMine(wtx.vout[i]) != ISMINE_NO &&
+                (!walletIn.IsLockedCoin(it->first, i) || nCoinType == ONLY_1000) && nValue > 0)
+                setCoins.insert(COutPoint(it->first, i));
+        }
+    }
+    return setCoins;
+}
+
+static void CheckAvailableCoins(const CWallet& walletIn)
+{
+    const AvailableCoinsType types[] = {ALL_COINS, ONLY_DENOMINATED, ONLY_NONDENOMINATED, ONLY_1000, ONLY_PRIVATESEND_COLLATERAL};
+    for (int nConfirmed = 0; nConfirmed < 2; nConfirmed++) {
+        BOOST_FOREACH(AvailableCoinsType nCoinType, types) {
+            std::vector<COutput> vCoinsAvailable;
+            walletIn.AvailableCoins(vCoinsAvailable, nConfirmed, NULL, false, nCoinType);
+            std::set<COutPoint> setCoins;
+            BOOST_FOREACH(const COutput& out, vCoinsAvailable)
+                setCoins.insert(COutPoint(out.tx->GetHash(), out.i));
+            BOOST_CHECK_EQUAL(setCoins.size(), vCoinsAvailable.size());
+            BOOST_CHECK(setCoins == AvailableCoinsFullScan(walletIn, nConfirmed, nCoinType));
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(available_coins_index, TestChain100Setup)
+{
+    CPrivateSend::InitStandardDenominations();
+    {
+        LOCK(pwalletMain->cs_wallet);
+        pwalletMain->AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey());
+    }
+    // unconfirmed transactions only count while they are in the mempool
+    pwalletMain->SetBroadcastTransactions(true);
+    pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true);
+    CScript scriptCoinbase = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+    for (int i = 0; i < 5; i++)
+        CreateAndProcessBlock(std::vector<CMutableTransaction>(), scriptCoinbase);
+    CheckAvailableCoins(*pwalletMain);
+
+    // pay the wallet one coin of every kind, unconfirmed first
+    std::vector<CRecipient> vecSend;
+    const CAmount amounts[] = {1000*COIN, CPrivateSend::GetStandardDenominations().front(), CPrivateSend::GetSmallestDenomination(),
+                               CPrivateSend::GetCollateralAmount(), 3*COIN};
+    BOOST_FOREACH(CAmount nAmount, amounts) {
+        CRecipient recipient = {scriptCoinbase, nAmount, false};
+        vecSend.push_back(recipient);
+    }
+    CWalletTx wtx;
+    CReserveKey reservekey(pwalletMain);
+    CAmount nFee;
+    int nChangePos = -1;
+    std::string strError;
+    BOOST_REQUIRE(pwalletMain->CreateTransaction(vecSend, wtx, reservekey, nFee, nChangePos, strError));
+    BOOST_REQUIRE(pwalletMain->CommitTransaction(wtx, reservekey, NULL));
+    CheckAvailableCoins(*pwalletMain);
+
+    std::vector<COutput> vCoins1000;
+    pwalletMain->AvailableCoins(vCoins1000, false, NULL, false, ONLY_1000);
+    BOOST_CHECK_EQUAL(vCoins1000.size(), 1U);
+
+    // confirmed
+    std::vector<CMutableTransaction> vTxns(1, CMutableTransaction(wtx));
+    CreateAndProcessBlock(vTxns, scriptCoinbase);
+    BOOST_CHECK(pwalletMain->GetWalletTx(wtx.GetHash())->GetDepthInMainChain() == 1);
+    CheckAvailableCoins(*pwalletMain);
+
+    // disconnected, the transaction goes back to the mempool
+    CBlockIndex* pindexTip = chainActive.Tip();
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(InvalidateBlock(state, Params().GetConsensus(), pindexTip));
+    }
+    BOOST_CHECK(pwalletMain->GetWalletTx(wtx.GetHash())->GetDepthInMainChain() == 0);
+    CheckAvailableCoins(*pwalletMain);
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(ReconsiderBlock(state, pindexTip));
+    }
+    CValidationState state;
+    BOOST_CHECK(ActivateBestChain(state, Params()));
+    BOOST_CHECK(chainActive.Tip() == pindexTip);
+    CheckAvailableCoins(*pwalletMain);
+
+    // a wallet transaction conflicting with a block
+    CWalletTx wtxConflicted;
+    BOOST_REQUIRE(pwalletMain->CreateTransaction(vecSend, wtxConflicted, reservekey, nFee, nChangePos, strError));
+    BOOST_REQUIRE(pwalletMain->CommitTransaction(wtxConflicted, reservekey, NULL));
+    CheckAvailableCoins(*pwalletMain);
+
+    const CWalletTx* pwtxPrev = pwalletMain->GetWalletTx(wtxConflicted.vin[0].prevout.hash);
+    BOOST_REQUIRE(pwtxPrev != NULL);
+    CMutableTransaction txSpend;
+    txSpend.vin.resize(1);
+    txSpend.vin[0].prevout = wtxConflicted.vin[0].prevout;
+    txSpend.vout.push_back(CTxOut(pwtxPrev->vout[txSpend.vin[0].prevout.n].nValue - 10000, CScript() << OP_TRUE));
+    BOOST_CHECK(SignSignature(*pwalletMain, *pwtxPrev, txSpend, 0));
+    CreateAndProcessBlock(std::vector<CMutableTransaction>(1, txSpend), scriptCoinbase);
+    BOOST_CHECK(pwalletMain->GetWalletTx(wtxConflicted.GetHash())->GetDepthInMainChain() < 0);
+    CheckAvailableCoins(*pwalletMain);
+}
+
+// Reads the PrivateSend rounds records of a wallet file
+class CRoundsWalletDB : public CWalletDB
+{
+public:
+    CRoundsWalletDB(const std::string& strFilename) : CWalletDB(strFilename, "r") {}
+
+    bool HasRounds(const COutPoint& outpoint)
+    {
+        return Exists(std::make_pair(std::string("psrounds"), outpoint));
+    }
+};
+
+// A transaction paying a denomination to scriptPubKey, spending prevout
+static CTransaction DenominatedTx(const COutPoint& prevout, const CScript& scriptPubKey)
+{
+    CMutableTransaction tx;
+    tx.vin.push_back(CTxIn(prevout));
+    tx.vout.push_back(CTxOut(CPrivateSend::GetSmallestDenomination(), scriptPubKey));
+    return tx;
+}
+
+static bool AddTx(CWallet& walletIn, const CTransaction& tx)
+{
+    LOCK2(cs_main, walletIn.cs_wallet);
+    if (walletIn.IsMine(tx) || walletIn.IsFromMe(tx))
+        return walletIn.AddToWalletIfInvolvingMe(tx, NULL, true);
+    // a transaction the wallet learns about with the keys of its outputs
+    CWalletDB walletdb(walletIn.strWalletFile);
+    return walletIn.AddToWallet(CWalletTx(&walletIn, tx), false, &walletdb);
+}
+
+static int GetRounds(const CWallet& walletIn, const COutPoint& outpoint)
+{
+    LOCK(walletIn.cs_wallet);
+    return walletIn.GetRealOutpointPrivateSendRounds(outpoint, 0);
+}
+
+BOOST_AUTO_TEST_CASE(privatesend_rounds_cache)
+{
+    CPrivateSend::InitStandardDenominations();
+    CKey key, keyImported;
+    key.MakeNewKey(true);
+    keyImported.MakeNewKey(true);
+    CScript script = GetScriptForDestination(key.GetPubKey().GetID());
+    CScript scriptImported = GetScriptForDestination(keyImported.GetPubKey().GetID());
+
+    CWallet walletRounds("wallet_rounds.dat");
+    bool fFirstRun;
+    BOOST_CHECK_EQUAL(walletRounds.LoadWallet(fFirstRun), DB_LOAD_OK);
+    {
+        LOCK(walletRounds.cs_wallet);
+        walletRounds.AddKeyPubKey(key, key.GetPubKey());
+    }
+
+    // the parent arrives after its child, which gets the round of the parent then
+    CTransaction txParent = DenominatedTx(COutPoint(GetRandHash(), 0), script);
+    CTransaction txChild = DenominatedTx(COutPoint(txParent.GetHash(), 0), script);
+    BOOST_CHECK(AddTx(walletRounds, txChild));
+    BOOST_CHECK_EQUAL(GetRounds(walletRounds, COutPoint(txChild.GetHash(), 0)), 0);
+    BOOST_CHECK(AddTx(walletRounds, txParent));
+    BOOST_CHECK_EQUAL(GetRounds(walletRounds, COutPoint(txParent.GetHash(), 0)), 0);
+    BOOST_CHECK_EQUAL(GetRounds(walletRounds, COutPoint(txChild.GetHash(), 0)), 1);
+
+    // the input only counts once its key is imported, MarkDirty wipes what was computed without it
+    CTransaction txOther = DenominatedTx(COutPoint(GetRandHash(), 0), scriptImported);
+    CTransaction txOtherChild = DenominatedTx(COutPoint(txOther.GetHash(), 0), script);
+    BOOST_CHECK(AddTx(walletRounds, txOther));
+    BOOST_CHECK(AddTx(walletRounds, txOtherChild));
+    BOOST_CHECK_EQUAL(GetRounds(walletRounds, COutPoint(txOtherChild.GetHash(), 0)), 0);
+    {
+        LOCK(walletRounds.cs_wallet);
+        walletRounds.AddKeyPubKey(keyImported, keyImported.GetPubKey());
+    }
+    BOOST_CHECK_EQUAL(GetRounds(walletRounds, COutPoint(txOtherChild.GetHash(), 0)), 0);
+    {
+        CRoundsWalletDB walletdb("wallet_rounds.dat");
+        BOOST_CHECK(walletdb.HasRounds(COutPoint(txChild.GetHash(), 0)));
+    }
+    walletRounds.MarkDirty();
+    {
+        // the records are wiped with the cache
+        CRoundsWalletDB walletdb("wallet_rounds.dat");
+        BOOST_CHECK(!walletdb.HasRounds(COutPoint(txChild.GetHash(), 0)));
+    }
+    BOOST_CHECK_EQUAL(GetRounds(walletRounds, COutPoint(txOtherChild.GetHash(), 0)), 1);
+    BOOST_CHECK_EQUAL(GetRounds(walletRounds, COutPoint(txChild.GetHash(), 0)), 1);
+
+    // lookups don't write the wallet file, the next flush does
+    {
+        CRoundsWalletDB walletdb("wallet_rounds.dat");
+        BOOST_CHECK(!walletdb.HasRounds(COutPoint(txChild.GetHash(), 0)));
+    }
+    walletRounds.Flush(false);
+    {
+        CRoundsWalletDB walletdb("wallet_rounds.dat");
+        BOOST_CHECK(walletdb.HasRounds(COutPoint(txChild.GetHash(), 0)));
+        BOOST_CHECK(walletdb.HasRounds(COutPoint(txParent.GetHash(), 0)));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(privatesend_rounds_reload)
+{
+    CPrivateSend::InitStandardDenominations();
+    CKey key;
+    key.MakeNewKey(true);
+    CScript script = GetScriptForDestination(key.GetPubKey().GetID());
+    CTransaction txParent = DenominatedTx(COutPoint(GetRandHash(), 0), script);
+    CTransaction txChild = DenominatedTx(COutPoint(txParent.GetHash(), 0), script);
+
+    bool fFirstRun;
+    {
+        CWallet walletRounds("wallet_reload.dat");
+        BOOST_CHECK_EQUAL(walletRounds.LoadWallet(fFirstRun), DB_LOAD_OK);
+        {
+            LOCK(walletRounds.cs_wallet);
+            walletRounds.AddKeyPubKey(key, key.GetPubKey());
+        }
+        BOOST_CHECK(AddTx(walletRounds, txParent));
+        BOOST_CHECK(AddTx(walletRounds, txChild));
+        BOOST_CHECK_EQUAL(GetRounds(walletRounds, COutPoint(txChild.GetHash(), 0)), 1);
+        walletRounds.Flush(false);
+    }
+    {
+        CRoundsWalletDB walletdb("wallet_reload.dat");
+        BOOST_CHECK(walletdb.HasRounds(COutPoint(txParent.GetHash(), 0)));
+        BOOST_CHECK(walletdb.HasRounds(COutPoint(txChild.GetHash(), 0)));
+    }
+
+    // the parent is zapped, its rounds are dropped when the wallet is loaded again
+    {
+        CWalletDB walletdb("wallet_reload.dat");
+        BOOST_CHECK(walletdb.EraseTx(txParent.GetHash()));
+    }
+    {
+        CWallet walletRounds("wallet_reload.dat");
+        BOOST_CHECK_EQUAL(walletRounds.LoadWallet(fFirstRun), DB_LOAD_OK);
+        BOOST_CHECK(!walletRounds.GetWalletTx(txParent.GetHash()));
+        // the child keeps the rounds it had
+        BOOST_CHECK_EQUAL(GetRounds(walletRounds, COutPoint(txChild.GetHash(), 0)), 1);
+    }
+    CRoundsWalletDB walletdb("wallet_reload.dat");
+    BOOST_CHECK(!walletdb.HasRounds(COutPoint(txParent.GetHash(), 0)));
+    BOOST_CHECK(walletdb.HasRounds(COutPoint(txChild.GetHash(), 0)));
+}
+
+// Exposes the HD derivation of the key store
+class CHDTestKeyStore : public CCryptoKeyStore
+{
+public:
+    using CCryptoKeyStore::CountHDChangeKeys;
+    using CCryptoKeyStore::DeriveHDChildExtKey;
+    using CCryptoKeyStore::EncryptHDChain;
+    using CCryptoKeyStore::EncryptKeys;
+    using CCryptoKeyStore::SetHDChain;
+    using CCryptoKeyStore::Unlock;
+};
+
+static CHDChain NewHDChain()
+{
+    SecureVector vchSeed(32);
+    GetRandBytes(&vchSeed[0], vchSeed.size());
+    CHDChain chain;
+    BOOST_CHECK(chain.SetSeed(vchSeed, true));
+    return chain;
+}
+
+// Every key derived through the cache matches the one derived from the seed
+static void CheckDerivedKeys(const CHDTestKeyStore& keystore, CHDChain chain)
+{
+    for (uint32_t nAccount = 0; nAccount < 2; nAccount++) {
+        for (int nInternal = 0; nInternal < 2; nInternal++) {
+            // the second round is served from the cache
+            for (int nRound = 0; nRound < 2; nRound++) {
+                for (uint32_t nChild = 0; nChild < 3; nChild++) {
+                    CExtKey extKey, extKeyExpected;
+                    BOOST_CHECK(keystore.DeriveHDChildExtKey(nAccount, nInternal, nChild, extKey));
+                    chain.DeriveChildExtKey(nAccount, nInternal, nChild, extKeyExpected);
+                    BOOST_CHECK(extKey == extKeyExpected);
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(hd_derive_cache)
+{
+    CHDChain chainA = NewHDChain();
+    CHDChain chainB = NewHDChain();
+
+    CHDTestKeyStore keystore;
+    CExtKey extKey;
+    BOOST_CHECK(!keystore.DeriveHDChildExtKey(0, false, 0, extKey));
+    BOOST_CHECK(keystore.SetHDChain(chainA));
+    BOOST_CHECK_EQUAL(keystore.CountHDChangeKeys(), 0U);
+    CheckDerivedKeys(keystore, chainA);
+    // one account'/change key for each of the two accounts and change indexes
+    BOOST_CHECK_EQUAL(keystore.CountHDChangeKeys(), 4U);
+
+    // updated counters keep the cache, a new seed wipes it
+    CHDChain chainUpdated = chainA;
+    CHDAccount acc;
+    BOOST_CHECK(chainUpdated.GetAccount(0, acc));
+    acc.nExternalChainCounter = 5;
+    BOOST_CHECK(chainUpdated.SetAccount(0, acc));
+    BOOST_CHECK(keystore.SetHDChain(chainUpdated));
+    BOOST_CHECK_EQUAL(keystore.CountHDChangeKeys(), 4U);
+    CheckDerivedKeys(keystore, chainA);
+    BOOST_CHECK(keystore.SetHDChain(chainB));
+    BOOST_CHECK_EQUAL(keystore.CountHDChangeKeys(), 0U);
+    CheckDerivedKeys(keystore, chainB);
+    BOOST_CHECK_EQUAL(keystore.CountHDChangeKeys(), 4U);
+
+    // the cache is wiped when the wallet is locked
+    CKeyingMaterial vMasterKey(32);
+    GetRandBytes(&vMasterKey[0], vMasterKey.size());
+    BOOST_CHECK(keystore.EncryptKeys(vMasterKey));
+    BOOST_CHECK(keystore.EncryptHDChain(vMasterKey));
+    BOOST_CHECK(keystore.Lock());
+    BOOST_CHECK_EQUAL(keystore.CountHDChangeKeys(), 0U);
+    BOOST_CHECK(!keystore.DeriveHDChildExtKey(0, false, 0, extKey));
+    BOOST_CHECK(!keystore.DeriveHDChildExtKey(1, true, 2, extKey));
+    BOOST_CHECK(keystore.Unlock(vMasterKey));
+    CheckDerivedKeys(keystore, chainB);
+    BOOST_CHECK_EQUAL(keystore.CountHDChangeKeys(), 4U);
+    BOOST_CHECK(keystore.Lock());
+    BOOST_CHECK_EQUAL(keystore.CountHDChangeKeys(), 0U);
+    BOOST_CHECK(!keystore.DeriveHDChildExtKey(0, false, 0, extKey));
+}
+
+static uint32_t GetExternalChainCounter(const CWallet& walletIn)
+{
+    CHDChain chain;
+    CHDAccount acc;
+    BOOST_CHECK(walletIn.GetHDChain(chain));
+    BOOST_CHECK(chain.GetAccount(0, acc));
+    return acc.nExternalChainCounter;
+}
+
+BOOST_AUTO_TEST_CASE(hd_generate_batch)
+{
+    const unsigned int nCount = 10;
+    CHDChain chain = NewHDChain();
+    std::vector<CPubKey> vecBatch, vecSingle;
+    bool fFirstRun;
+
+    {
+        CWallet walletBatch("wallet_hd_batch.dat");
+        BOOST_CHECK_EQUAL(walletBatch.LoadWallet(fFirstRun), DB_LOAD_OK);
+        LOCK(walletBatch.cs_wallet);
+        BOOST_CHECK(walletBatch.SetHDChain(chain, false));
+        walletBatch.GenerateNewKeys(0, false, nCount, vecBatch);
+        BOOST_CHECK_EQUAL(GetExternalChainCounter(walletBatch), nCount);
+    }
+    {
+        CWallet walletSingle("wallet_hd_single.dat");
+        BOOST_CHECK_EQUAL(walletSingle.LoadWallet(fFirstRun), DB_LOAD_OK);
+        LOCK(walletSingle.cs_wallet);
+        BOOST_CHECK(walletSingle.SetHDChain(chain, false));
+        for (unsigned int i = 0; i < nCount; i++)
+            vecSingle.push_back(walletSingle.GenerateNewKey(0, false));
+        BOOST_CHECK_EQUAL(GetExternalChainCounter(walletSingle), nCount);
+    }
+    BOOST_CHECK_EQUAL(vecBatch.size(), nCount);
+    BOOST_CHECK(vecBatch == vecSingle);
+
+    // the batch wrote the keys and the counter
+    CWallet walletBatch("wallet_hd_batch.dat");
+    BOOST_CHECK_EQUAL(walletBatch.LoadWallet(fFirstRun), DB_LOAD_OK);
+    LOCK(walletBatch.cs_wallet);
+    BOOST_CHECK_EQUAL(GetExternalChainCounter(walletBatch), nCount);
+    BOOST_FOREACH(const CPubKey& pubkey, vecBatch) {
+        CPubKey pubkeyRet;
+        BOOST_CHECK(walletBatch.HaveKey(pubkey.GetID()));
+        BOOST_CHECK(walletBatch.GetPubKey(pubkey.GetID(), pubkeyRet));
+        BOOST_CHECK(pubkeyRet == pubkey);
+    }
+
+    // keys derived afterwards continue the chain
+    CPubKey pubkeyNext = walletBatch.GenerateNewKey(0, false);
+    BOOST_CHECK(std::find(vecBatch.begin(), vecBatch.end(), pubkeyNext) == vecBatch.end());
+    BOOST_CHECK_EQUAL(GetExternalChainCounter(walletBatch), nCount + 1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -34,6 +34,7 @@
 #include "spork.h"
 
 #include <assert.h>
+#include <memory>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
@@ -101,6 +102,23 @@ const CWalletTx* CWallet::GetWalletTx(const uint256& hash) const
     return &(it->second);
 }
 
+void CWallet::GenerateNewKeys(uint32_t nAccountIndex, bool fInternal, unsigned int nCount, std::vector<CPubKey>& vecPubKeysRet)
+{
+    AssertLockHeld(cs_wallet); // mapKeyMetadata
+    vecPubKeysRet.clear();
+
+    if (!IsHDEnabled()) {
+        for (unsigned int i = 0; i < nCount; i++)
+            vecPubKeysRet.push_back(GenerateNewKey(nAccountIndex, fInternal));
+        return;
+    }
+
+    std::vector<CKey> vecSecrets;
+    DeriveNewChildKeys(CKeyMetadata(GetTime()), vecSecrets, nAccountIndex, fInternal, nCount);
+    BOOST_FOREACH(const CKey& secret, vecSecrets)
+        vecPubKeysRet.push_back(secret.GetPubKey());
+}
+
 CPubKey CWallet::GenerateNewKey(uint32_t nAccountIndex, bool fInternal)
 {
     AssertLockHeld(cs_wallet); // mapKeyMetadata
@@ -140,43 +158,54 @@ CPubKey CWallet::GenerateNewKey(uint32_t nAccountIndex, bool fInternal)
 
 void CWallet::DeriveNewChildKey(const CKeyMetadata& metadata, CKey& secretRet, uint32_t nAccountIndex, bool fInternal)
 {
-    CHDChain hdChainTmp;
-    if (!GetHDChain(hdChainTmp)) {
-        throw std::runtime_error(std::string(__func__) + ": GetHDChain failed");
-    }
+    std::vector<CKey> vecSecrets;
+    DeriveNewChildKeys(metadata, vecSecrets, nAccountIndex, fInternal, 1);
+    secretRet = vecSecrets[0];
+}
 
-    if (!DecryptHDChain(hdChainTmp))
-        throw std::runtime_error(std::string(__func__) + ": DecryptHDChainSeed failed");
-    // make sure seed matches this chain
-    if (hdChainTmp.GetID() != hdChainTmp.GetSeedHash())
-        throw std::runtime_error(std::string(__func__) + ": Wrong HD chain!");
+void CWallet::DeriveNewChildKeys(const CKeyMetadata& metadata, std::vector<CKey>& vecSecretsRet, uint32_t nAccountIndex, bool fInternal, unsigned int nCount)
+{
+    AssertLockHeld(cs_wallet); // mapKeyMetadata
+    vecSecretsRet.clear();
+    if (nCount == 0)
+        return;
+
+    CHDChain hdChainCurrent;
+    if (!GetHDChain(hdChainCurrent))
+        throw std::runtime_error(std::string(__func__) + ": GetHDChain failed");
 
     CHDAccount acc;
-    if (!hdChainTmp.GetAccount(nAccountIndex, acc))
+    if (!hdChainCurrent.GetAccount(nAccountIndex, acc))
         throw std::runtime_error(std::string(__func__) + ": Wrong HD account!");
 
-    // derive child key at next index, skip keys already known to the wallet
-    CExtKey childKey;
+    std::vector<CExtPubKey> vecExtPubKeys;
+    vecSecretsRet.reserve(nCount);
+    vecExtPubKeys.reserve(nCount);
+
     uint32_t nChildIndex = fInternal ? acc.nInternalChainCounter : acc.nExternalChainCounter;
-    do {
-        hdChainTmp.DeriveChildExtKey(nAccountIndex, fInternal, nChildIndex, childKey);
-        // increment childkey index
-        nChildIndex++;
-    } while (HaveKey(childKey.key.GetPubKey().GetID()));
-    secretRet = childKey.key;
-
-    CPubKey pubkey = secretRet.GetPubKey();
-    assert(secretRet.VerifyPubKey(pubkey));
-
-    // store metadata
-    mapKeyMetadata[pubkey.GetID()] = metadata;
-    if (!nTimeFirstKey || metadata.nCreateTime < nTimeFirstKey)
-        nTimeFirstKey = metadata.nCreateTime;
-
-    // update the chain model in the database
-    CHDChain hdChainCurrent;
-    GetHDChain(hdChainCurrent);
+    while (vecSecretsRet.size() < nCount) {
+        // derive child key at next index, skip keys already known to the wallet
+        CExtKey childKey;
+        do {
+            if (!DeriveHDChildExtKey(nAccountIndex, fInternal, nChildIndex, childKey))
+                throw std::runtime_error(std::string(__func__) + ": DeriveHDChildExtKey failed");
+            // increment childkey index
+            nChildIndex++;
+        } while (HaveKey(childKey.key.GetPubKey().GetID()));
+
+        CPubKey pubkey = childKey.key.GetPubKey();
+        assert(childKey.key.VerifyPubKey(pubkey));
+
+        // store metadata
+        mapKeyMetadata[pubkey.GetID()] = metadata;
+        if (!nTimeFirstKey || metadata.nCreateTime < nTimeFirstKey)
+            nTimeFirstKey = metadata.nCreateTime;
+
+        vecSecretsRet.push_back(childKey.key);
+        vecExtPubKeys.push_back(childKey.Neuter());
+    }
 
+    // update the chain model in the database, once for the whole batch
     if (fInternal) {
         acc.nInternalChainCounter = nChildIndex;
     }
@@ -196,8 +225,10 @@ void CWallet::DeriveNewChildKey(const CKeyMetadata& metadata, CKey& secretRet, u
             throw std::runtime_error(std::string(__func__) + ": SetHDChain failed");
     }
 
-    if (!AddHDPubKey(childKey.Neuter(), fInternal))
-        throw std::runtime_error(std::string(__func__) + ": AddHDPubKey failed");
+    BOOST_FOREACH(const CExtPubKey& extPubKey, vecExtPubKeys) {
+        if (!AddHDPubKey(extPubKey, fInternal))
+            throw std::runtime_error(std::string(__func__) + ": AddHDPubKey failed");
+    }
 }
 
 bool CWallet::GetPubKey(const CKeyID &address, CPubKey& vchPubKeyOut) const
@@ -221,18 +252,11 @@ bool CWallet::GetKey(const CKeyID &address, CKey& keyOut) const
     if (mi != mapHdPubKeys.end())
     {
         // if the key has been found in mapHdPubKeys, derive it on the fly
+        // from the cached account'/change key
         const CHDPubKey &hdPubKey = (*mi).second;
-        CHDChain hdChainCurrent;
-        if (!GetHDChain(hdChainCurrent))
-            throw std::runtime_error(std::string(__func__) + ": GetHDChain failed");
-        if (!DecryptHDChain(hdChainCurrent))
-            throw std::runtime_error(std::string(__func__) + ": DecryptHDChainSeed failed");
-        // make sure seed matches this chain
-        if (hdChainCurrent.GetID() != hdChainCurrent.GetSeedHash())
-            throw std::runtime_error(std::string(__func__) + ": Wrong HD chain!");
-
         CExtKey extkey;
-        hdChainCurrent.DeriveChildExtKey(hdPubKey.nAccountIndex, hdPubKey.nChangeIndex != 0, hdPubKey.extPubKey.nChild, extkey);
+        if (!DeriveHDChildExtKey(hdPubKey.nAccountIndex, hdPubKey.nChangeIndex != 0, hdPubKey.extPubKey.nChild, extkey))
+            throw std::runtime_error(std::string(__func__) + ": DeriveHDChildExtKey failed");
         keyOut = extkey.key;
 
         return true;
@@ -589,6 +613,12 @@ set<uint256> CWallet::GetConflicts(const uint256& txid) const
 
 void CWallet::Flush(bool shutdown)
 {
+    {
+        // PrivateSend rounds computed by lookups since the last transaction was added
+        LOCK(cs_wallet);
+        SavePrivateSendRounds();
+    }
+    logdbenv.Flush(shutdown);
     bitdb.Flush(shutdown);
 }
 
@@ -615,6 +645,14 @@ bool CWallet::Verify(const string& walletFile, string& warningString, string& er
         }
     }
     
+    // Log stores cut off what they can't read when they are opened
+    if (CLogDB::IsLogFile(GetDataDir() / walletFile))
+    {
+        if (GetBoolArg("-salvagewallet", false))
+            warningString += strprintf(_("Warning: -salvagewallet is not supported for the log wallet %s, unreadable records are dropped when it is opened"), walletFile);
+        return true;
+    }
+
     if (GetBoolArg("-salvagewallet", false))
     {
         // Recover readable keypairs:
@@ -634,6 +672,9 @@ bool CWallet::Verify(const string& walletFile, string& warningString, string& er
         }
         if (r == CDBEnv::RECOVER_FAIL)
             errorString += _("wallet.dat corrupt, salvage failed");
+
+        if (r != CDBEnv::RECOVER_FAIL && GetBoolArg("-logwallet", DEFAULT_LOGWALLET) && !CDB::MigrateToLog(walletFile))
+            warningString += _("Warning: failed to migrate wallet.dat to the log wallet format, keeping Berkeley DB");
     }
     
     return true;
@@ -721,6 +762,94 @@ void CWallet::AddToSpends(const uint256& wtxid)
         AddToSpends(txin.prevout, wtxid);
 }
 
+WalletCoinType CWallet::GetWalletCoinType(CAmount nValue)
+{
+    if (CPrivateSend::IsDenominatedAmount(nValue))
+        return WALLET_COIN_DENOMINATED;
+    if (CPrivateSend::IsCollateralAmount(nValue))
+        return WALLET_COIN_COLLATERAL;
+    if (nValue == 1000*COIN)
+        return WALLET_COIN_1000;
+    return WALLET_COIN_OTHER;
+}
+
+/** Which buckets of the coin index hold the coins AvailableCoins looks for */
+static bool IsWalletCoinTypeAvailable(WalletCoinType nType, AvailableCoinsType nCoinType)
+{
+    switch (nCoinType) {
+        case ONLY_DENOMINATED:
+            return nType == WALLET_COIN_DENOMINATED;
+        case ONLY_NONDENOMINATED:
+            // do not use collateral amounts
+            return nType == WALLET_COIN_1000 || nType == WALLET_COIN_OTHER;
+        case ONLY_1000:
+            return nType == WALLET_COIN_1000;
+        case ONLY_PRIVATESEND_COLLATERAL:
+            return nType == WALLET_COIN_COLLATERAL;
+        default:
+            return true;
+    }
+}
+
+bool CWallet::IsSpentInChain(const COutPoint& outpoint) const
+{
+    std::pair<TxSpends::const_iterator, TxSpends::const_iterator> range = mapTxSpends.equal_range(outpoint);
+    for (TxSpends::const_iterator it = range.first; it != range.second; ++it) {
+        std::map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(it->second);
+        if (mit != mapWallet.end() && mit->second.GetDepthInMainChain(false) > 0)
+            return true;
+    }
+    return false;
+}
+
+void CWallet::UpdateWalletCoin(const COutPoint& outpoint, const CTxOut& txout) const
+{
+    std::set<COutPoint>& setCoins = setWalletCoins[GetWalletCoinType(txout.nValue)];
+    if (IsMine(txout) != ISMINE_NO && !IsSpentInChain(outpoint))
+        setCoins.insert(outpoint);
+    else
+        setCoins.erase(outpoint);
+}
+
+void CWallet::UpdateWalletCoins(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+    if (fWalletCoinsDirty)
+        return; // rebuilt from scratch by the next AvailableCoins
+
+    const uint256& hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.vout.size(); i++)
+        UpdateWalletCoin(COutPoint(hash, i), wtx.vout[i]);
+
+    // whether wtx is in the active chain decides if the coins it spends are available
+    BOOST_FOREACH(const CTxIn& txin, wtx.vin) {
+        std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(txin.prevout.hash);
+        if (mi != mapWallet.end() && txin.prevout.n < mi->second.vout.size())
+            UpdateWalletCoin(txin.prevout, mi->second.vout[txin.prevout.n]);
+    }
+}
+
+void CWallet::RebuildWalletCoins() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    int64_t nStart = GetTimeMillis();
+    for (int nType = 0; nType < WALLET_COIN_TYPE_COUNT; nType++)
+        setWalletCoins[nType].clear();
+
+    for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
+        for (unsigned int i = 0; i < it->second.vout.size(); i++)
+            UpdateWalletCoin(COutPoint(it->first, i), it->second.vout[i]);
+    }
+    fWalletCoinsDirty = false;
+
+    size_t nCoins = 0;
+    for (int nType = 0; nType < WALLET_COIN_TYPE_COUNT; nType++)
+        nCoins += setWalletCoins[nType].size();
+    LogPrint("selectcoins", "CWallet::%s -- %d coins indexed  %dms\n", __func__, nCoins, GetTimeMillis() - nStart);
+}
+
 bool CWallet::EncryptWallet(const SecureString& strWalletPassphrase)
 {
     if (IsCrypted())
@@ -872,6 +1001,14 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx)& item, mapWallet)
             item.second.MarkDirty();
+        fWalletCoinsDirty = true;
+
+        // what IsMine means decides which inputs count for the PrivateSend rounds too
+        if (!mapOutpointRoundsCache.empty()) {
+            std::unique_ptr<CWalletDB> pwalletdb(fFileBacked ? new CWalletDB(strWalletFile, "r+", false) : NULL);
+            while (!mapOutpointRoundsCache.empty())
+                ForgetPrivateSendRounds(mapOutpointRoundsCache.begin()->first.hash, pwalletdb.get());
+        }
     }
 
     fAnonymizableTallyCached = false;
@@ -889,6 +1026,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
         wtx.BindWallet(this);
         wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
         AddToSpends(hash);
+        fWalletCoinsDirty = true;
         BOOST_FOREACH(const CTxIn& txin, wtx.vin) {
             if (mapWallet.count(txin.prevout.hash)) {
                 CWalletTx& prevtx = mapWallet[txin.prevout.hash];
@@ -1001,6 +1139,17 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
 
         // Break debit/credit balance caches:
         wtx.MarkDirty();
+        UpdateWalletCoins(wtx);
+
+        if (fInsertedNew) {
+            // rounds of wallet transactions spending this one were computed without it
+            ForgetDescendantPrivateSendRounds(hash, pwalletdb);
+            for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+                if (IsMine(wtx.vout[i]) && CPrivateSend::IsDenominatedAmount(wtx.vout[i].nValue))
+                    GetRealOutpointPrivateSendRounds(COutPoint(hash, i), 0);
+            }
+            SavePrivateSendRounds(pwalletdb);
+        }
 
         // Notify UI of new or updated transaction
         NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
@@ -1100,6 +1249,7 @@ bool CWallet::AbandonTransaction(const uint256& hashTx)
             wtx.setAbandoned();
             wtx.MarkDirty();
             wtx.WriteToDisk(&walletdb);
+            ForgetPrivateSendRounds(now, &walletdb);
             NotifyTransactionChanged(this, wtx.GetHash(), CT_UPDATED);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them abandoned too
             TxSpends::const_iterator iter = mapTxSpends.lower_bound(COutPoint(hashTx, 0));
@@ -1165,6 +1315,7 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
             wtx.hashBlock = hashBlock;
             wtx.MarkDirty();
             wtx.WriteToDisk(&walletdb);
+            ForgetPrivateSendRounds(now, &walletdb);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them conflicted too
             TxSpends::const_iterator iter = mapTxSpends.lower_bound(COutPoint(now, 0));
             while (iter != mapTxSpends.end() && iter->first.hash == now) {
@@ -1242,7 +1393,7 @@ CAmount CWallet::GetDebit(const CTxIn &txin, const isminefilter& filter) const
 // Recursively determine the rounds of a given input (How deep is the PrivateSend chain for a given input)
 int CWallet::GetRealOutpointPrivateSendRounds(const COutPoint& outpoint, int nRounds) const
 {
-    static std::map<uint256, CMutableTransaction> mDenomWtxes;
+    AssertLockHeld(cs_wallet);
 
     if(nRounds >= 16) return 15; // 16 rounds max
 
@@ -1250,55 +1401,35 @@ int CWallet::GetRealOutpointPrivateSendRounds(const COutPoint& outpoint, int nRo
     unsigned int nout = outpoint.n;
 
     const CWalletTx* wtx = GetWalletTx(hash);
-    if(wtx != NULL)
-    {
-        std::map<uint256, CMutableTransaction>::const_iterator mdwi = mDenomWtxes.find(hash);
-        if (mdwi == mDenomWtxes.end()) {
-            // not known yet, let's add it
-            LogPrint("privatesend", "GetRealOutpointPrivateSendRounds INSERTING %s\n", hash.ToString());
-            mDenomWtxes[hash] = CMutableTransaction(*wtx);
-        } else if(mDenomWtxes[hash].vout[nout].nRounds != -10) {
-            // found and it's not an initial value, just return it
-            return mDenomWtxes[hash].vout[nout].nRounds;
-        }
+    if(wtx == NULL) return nRounds - 1;
 
+    // bounds check
+    if (nout >= wtx->vout.size()) {
+        // should never actually hit this
+        LogPrint("privatesend", "GetRealOutpointPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, -4);
+        return -4;
+    }
 
-        // bounds check
-        if (nout >= wtx->vout.size()) {
-            // should never actually hit this
-            LogPrint("privatesend", "GetRealOutpointPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, -4);
-            return -4;
-        }
-
-        if (CPrivateSend::IsCollateralAmount(wtx->vout[nout].nValue)) {
-            mDenomWtxes[hash].vout[nout].nRounds = -3;
-            LogPrint("privatesend", "GetRealOutpointPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
-        }
+    if (CPrivateSend::IsCollateralAmount(wtx->vout[nout].nValue)) return -3;
 
-        //make sure the final output is non-denominate
-        if (!CPrivateSend::IsDenominatedAmount(wtx->vout[nout].nValue)) { //NOT DENOM
-            mDenomWtxes[hash].vout[nout].nRounds = -2;
-            LogPrint("privatesend", "GetRealOutpointPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
-        }
+    //make sure the final output is non-denominate
+    if (!CPrivateSend::IsDenominatedAmount(wtx->vout[nout].nValue)) return -2; //NOT DENOM
 
-        bool fAllDenoms = true;
-        BOOST_FOREACH(CTxOut out, wtx->vout) {
-            fAllDenoms = fAllDenoms && CPrivateSend::IsDenominatedAmount(out.nValue);
-        }
+    std::map<COutPoint, int>::const_iterator mi = mapOutpointRoundsCache.find(outpoint);
+    if (mi != mapOutpointRoundsCache.end()) return mi->second;
 
-        // this one is denominated but there is another non-denominated output found in the same tx
-        if (!fAllDenoms) {
-            mDenomWtxes[hash].vout[nout].nRounds = 0;
-            LogPrint("privatesend", "GetRealOutpointPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
-        }
+    int nResult = 0;
+    bool fAllDenoms = true;
+    BOOST_FOREACH(const CTxOut& out, wtx->vout) {
+        fAllDenoms = fAllDenoms && CPrivateSend::IsDenominatedAmount(out.nValue);
+    }
 
+    // a denominated output next to a non-denominated one in the same tx starts a new chain
+    if (fAllDenoms) {
         int nShortest = -10; // an initial value, should be no way to get this by calculations
         bool fDenomFound = false;
         // only denoms here so let's look up
-        BOOST_FOREACH(CTxIn txinNext, wtx->vin) {
+        BOOST_FOREACH(const CTxIn& txinNext, wtx->vin) {
             if (IsMine(txinNext)) {
                 int n = GetRealOutpointPrivateSendRounds(txinNext.prevout, nRounds + 1);
                 // denom found, find the shortest chain or initially assign nShortest with the first found value
@@ -1308,20 +1439,91 @@ int CWallet::GetRealOutpointPrivateSendRounds(const COutPoint& outpoint, int nRo
                 }
             }
         }
-        mDenomWtxes[hash].vout[nout].nRounds = fDenomFound
+        nResult = fDenomFound
                 ? (nShortest >= 15 ? 16 : nShortest + 1) // good, we a +1 to the shortest one but only 16 rounds max allowed
                 : 0;            // too bad, we are the fist one in that chain
-        LogPrint("privatesend", "GetRealOutpointPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-        return mDenomWtxes[hash].vout[nout].nRounds;
     }
 
-    return nRounds - 1;
+    mapOutpointRoundsCache[outpoint] = nResult;
+    setOutpointRoundsUnsaved.insert(outpoint);
+    LogPrint("privatesend", "GetRealOutpointPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, nResult);
+    return nResult;
+}
+
+void CWallet::SavePrivateSendRounds(CWalletDB* pwalletdb) const
+{
+    AssertLockHeld(cs_wallet);
+
+    if (setOutpointRoundsUnsaved.empty())
+        return;
+    if (!fFileBacked) {
+        setOutpointRoundsUnsaved.clear();
+        return;
+    }
+
+    // Do not flush the wallet here for performance reasons
+    std::unique_ptr<CWalletDB> pwalletdbNew;
+    if (!pwalletdb) {
+        pwalletdbNew.reset(new CWalletDB(strWalletFile, "r+", false));
+        pwalletdb = pwalletdbNew.get();
+    }
+
+    BOOST_FOREACH(const COutPoint& outpoint, setOutpointRoundsUnsaved) {
+        std::map<COutPoint, int>::const_iterator mi = mapOutpointRoundsCache.find(outpoint);
+        if (mi != mapOutpointRoundsCache.end())
+            pwalletdb->WritePrivateSendRounds(outpoint, mi->second);
+    }
+    setOutpointRoundsUnsaved.clear();
+}
+
+void CWallet::ForgetPrivateSendRounds(const uint256& hashTx, CWalletDB* pwalletdb)
+{
+    AssertLockHeld(cs_wallet);
+
+    std::map<COutPoint, int>::iterator mi = mapOutpointRoundsCache.lower_bound(COutPoint(hashTx, 0));
+    while (mi != mapOutpointRoundsCache.end() && mi->first.hash == hashTx) {
+        bool fSaved = !setOutpointRoundsUnsaved.erase(mi->first);
+        if (fSaved && pwalletdb)
+            pwalletdb->ErasePrivateSendRounds(mi->first);
+        mapOutpointRoundsCache.erase(mi++);
+    }
+}
+
+void CWallet::ForgetDescendantPrivateSendRounds(const uint256& hashTx, CWalletDB* pwalletdb)
+{
+    AssertLockHeld(cs_wallet);
+
+    std::set<uint256> todo;
+    std::set<uint256> done;
+
+    todo.insert(hashTx);
+
+    while (!todo.empty()) {
+        uint256 now = *todo.begin();
+        todo.erase(now);
+        done.insert(now);
+        ForgetPrivateSendRounds(now, pwalletdb);
+        TxSpends::const_iterator iter = mapTxSpends.lower_bound(COutPoint(now, 0));
+        while (iter != mapTxSpends.end() && iter->first.hash == now) {
+            if (!done.count(iter->second)) {
+                todo.insert(iter->second);
+            }
+            iter++;
+        }
+    }
+}
+
+bool CWallet::LoadPrivateSendRounds(const COutPoint& outpoint, int nRounds)
+{
+    mapOutpointRoundsCache[outpoint] = nRounds;
+    return true;
 }
 
 // respect current settings
 int CWallet::GetOutpointPrivateSendRounds(const COutPoint& outpoint) const
 {
     LOCK(cs_wallet);
+    // rounds computed here are written with the next transaction or flush, not on every lookup
     int realPrivateSendRounds = GetRealOutpointPrivateSendRounds(outpoint, 0);
     return realPrivateSendRounds > privateSendClient.nPrivateSendRounds ? privateSendClient.nPrivateSendRounds : realPrivateSendRounds;
 }
@@ -1672,12 +1874,159 @@ bool CWalletTx::WriteToDisk(CWalletDB *pwalletdb)
     return pwalletdb->WriteTx(GetHash(), *this);
 }
 
+/**
+ * What the outputs a wallet can own contain: its keys, key IDs and P2SH
+ * script IDs as pushed data and its watch-only scripts as a whole. Every
+ * output IsMine accepts matches, so transactions without a match that don't
+ * touch the wallet otherwise can be skipped by a rescan.
+ */
+class CWalletScanFilter
+{
+public:
+    std::set<std::vector<unsigned char> > setData;
+    std::set<CScript> setScripts;
+
+    bool IsRelevant(const CTxOut& txout) const
+    {
+        const CScript& script = txout.scriptPubKey;
+        if (!setScripts.empty() && setScripts.count(script))
+            return true;
+
+        CScript::const_iterator pc = script.begin();
+        std::vector<unsigned char> vchData;
+        opcodetype opcode;
+        while (pc < script.end()) {
+            if (!script.GetOp(pc, opcode, vchData))
+                break;
+            if (!vchData.empty() && setData.count(vchData))
+                return true;
+        }
+        return false;
+    }
+};
+
+void CWallet::GetScanFilter(CWalletScanFilter& filter) const
+{
+    AssertLockHeld(cs_wallet);
+
+    std::set<CKeyID> setKeyIDs;
+    GetKeys(setKeyIDs);
+    for (std::map<CKeyID, CHDPubKey>::const_iterator it = mapHdPubKeys.begin(); it != mapHdPubKeys.end(); ++it)
+        setKeyIDs.insert(it->first);
+
+    BOOST_FOREACH(const CKeyID& keyID, setKeyIDs) {
+        filter.setData.insert(std::vector<unsigned char>(keyID.begin(), keyID.end()));
+        CPubKey pubkey;
+        if (GetPubKey(keyID, pubkey))
+            filter.setData.insert(std::vector<unsigned char>(pubkey.begin(), pubkey.end()));
+    }
+
+    {
+        LOCK(cs_KeyStore);
+        for (ScriptMap::const_iterator it = mapScripts.begin(); it != mapScripts.end(); ++it)
+            filter.setData.insert(std::vector<unsigned char>(it->first.begin(), it->first.end()));
+        filter.setScripts.insert(setWatchOnly.begin(), setWatchOnly.end());
+    }
+}
+
+/**
+ * Blocks of a rescan, read and matched against a CWalletScanFilter by a
+ * group of threads while the wallet goes through the results in order.
+ * The threads stay at most a window of blocks ahead of the wallet.
+ */
+class CWalletScanQueue
+{
+private:
+    struct CScanResult {
+        CBlock block;
+        std::vector<bool> vMatch;
+    };
+
+    const std::vector<CBlockIndex*>& vBlocks;
+    const CWalletScanFilter& filter;
+    const Consensus::Params& consensusParams;
+
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::map<size_t, CScanResult> mapResults;
+    size_t nNext;
+    size_t nWanted;
+    size_t nWindow;
+    bool fStop;
+    boost::thread_group threadGroup;
+
+    void Thread()
+    {
+        while (true) {
+            size_t nIndex;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (!fStop && nNext < vBlocks.size() && nNext >= nWanted + nWindow)
+                    cond.wait(lock);
+                if (fStop || nNext >= vBlocks.size())
+                    return;
+                nIndex = nNext++;
+            }
+
+            CScanResult result;
+            if (!ReadBlockFromDisk(result.block, vBlocks[nIndex], consensusParams))
+                LogPrintf("CWalletScanQueue::%s -- failed to read block %d\n", __func__, vBlocks[nIndex]->nHeight);
+            result.vMatch.resize(result.block.vtx.size());
+            for (size_t i = 0; i < result.block.vtx.size(); i++) {
+                BOOST_FOREACH(const CTxOut& txout, result.block.vtx[i].vout) {
+                    if (filter.IsRelevant(txout)) {
+                        result.vMatch[i] = true;
+                        break;
+                    }
+                }
+            }
+
+            boost::unique_lock<boost::mutex> lock(mutex);
+            std::swap(mapResults[nIndex], result);
+            cond.notify_all();
+        }
+    }
+
+public:
+    CWalletScanQueue(const std::vector<CBlockIndex*>& vBlocksIn, const CWalletScanFilter& filterIn, const Consensus::Params& consensusParamsIn, int nThreads)
+        : vBlocks(vBlocksIn), filter(filterIn), consensusParams(consensusParamsIn),
+          nNext(0), nWanted(0), nWindow(nThreads * 8), fStop(false)
+    {
+        for (int i = 0; i < nThreads; i++)
+            threadGroup.create_thread(boost::bind(&CWalletScanQueue::Thread, this));
+    }
+
+    ~CWalletScanQueue()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fStop = true;
+            cond.notify_all();
+        }
+        threadGroup.join_all();
+    }
+
+    /** Wait for block nIndex, the blocks have to be taken in order */
+    void Get(size_t nIndex, CBlock& blockRet, std::vector<bool>& vMatchRet)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nWanted = nIndex;
+        cond.notify_all();
+        std::map<size_t, CScanResult>::iterator it;
+        while ((it = mapResults.find(nIndex)) == mapResults.end())
+            cond.wait(lock);
+        std::swap(blockRet, it->second.block);
+        std::swap(vMatchRet, it->second.vMatch);
+        mapResults.erase(it);
+    }
+};
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
  */
-int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
+int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate, CBlockIndex* pindexStop)
 {
     int ret = 0;
     int64_t nNow = GetTime();
@@ -1686,38 +2035,94 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
     CBlockIndex* pindex = pindexStart;
     {
         LOCK2(cs_main, cs_wallet);
+        fAbortRescan = false;
 
         // no need to read and scan block, if block was created before
         // our wallet birthday (as adjusted for block time variability)
-        while (pindex && nTimeFirstKey && (pindex->GetBlockTime() < (nTimeFirstKey - 7200)))
+        while (pindex && pindex != pindexStop && nTimeFirstKey && (pindex->GetBlockTime() < (nTimeFirstKey - 7200)))
             pindex = chainActive.Next(pindex);
 
+        // the chain can't change while we hold cs_main, which also keeps
+        // the block files from being pruned under the scan threads
+        std::vector<CBlockIndex*> vBlocks;
+        for (; pindex; pindex = chainActive.Next(pindex)) {
+            vBlocks.push_back(pindex);
+            if (pindex == pindexStop)
+                break;
+        }
+
+        nScanStartHeight = vBlocks.empty() ? 0 : vBlocks.front()->nHeight;
+        nScanStopHeight = vBlocks.empty() ? 0 : vBlocks.back()->nHeight;
+        nScanHeight = nScanStartHeight.load();
+        nScanStartTime = GetTimeMillis();
+        fScanningWallet = true;
+
         ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false);
+        double dProgressStart = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), vBlocks.empty() ? NULL : vBlocks.front(), false);
         double dProgressTip = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), chainActive.Tip(), false);
-        while (pindex)
+
+        CWalletScanFilter filter;
+        GetScanFilter(filter);
+        int nThreads = std::max(1, std::min(GetNumCores(), MAX_RESCAN_THREADS));
+        CWalletScanQueue queue(vBlocks, filter, chainParams.GetConsensus(), nThreads);
+
+        for (size_t i = 0; i < vBlocks.size(); i++)
         {
+            pindex = vBlocks[i];
+            if (fAbortRescan) {
+                LogPrintf("Rescan aborted at block %d\n", pindex->nHeight);
+                break;
+            }
+            nScanHeight = pindex->nHeight;
+
             if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
                 ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
 
             CBlock block;
-            ReadBlockFromDisk(block, pindex, Params().GetConsensus());
-            BOOST_FOREACH(CTransaction& tx, block.vtx)
+            std::vector<bool> vMatch;
+            queue.Get(i, block, vMatch);
+            for (size_t j = 0; j < block.vtx.size(); j++)
             {
+                const CTransaction& tx = block.vtx[j];
+                // none of the outputs can be ours, the transaction is only
+                // interesting if we know it or it spends from the wallet
+                if (!vMatch[j] && !mapWallet.count(tx.GetHash())) {
+                    bool fSpendsWallet = false;
+                    BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+                        if (mapWallet.count(txin.prevout.hash) || mapTxSpends.count(txin.prevout)) {
+                            fSpendsWallet = true;
+                            break;
+                        }
+                    }
+                    if (!fSpendsWallet)
+                        continue;
+                }
                 if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
                     ret++;
             }
-            pindex = chainActive.Next(pindex);
             if (GetTime() >= nNow + 60) {
                 nNow = GetTime();
                 LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex));
             }
         }
+        fScanningWallet = false;
         ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     }
     return ret;
 }
 
+bool CWallet::GetScanProgress(int& nStartHeightRet, int& nStopHeightRet, int& nHeightRet, int64_t& nDurationRet) const
+{
+    if (!fScanningWallet)
+        return false;
+
+    nStartHeightRet = nScanStartHeight;
+    nStopHeightRet = nScanStopHeight;
+    nHeightRet = nScanHeight;
+    nDurationRet = GetTimeMillis() - nScanStartTime;
+    return true;
+}
+
 void CWallet::ReacceptWalletTransactions()
 {
     // If transactions aren't being broadcasted, don't let them into local mempool either
@@ -1760,6 +2165,7 @@ bool CWalletTx::RelayWalletTransaction(CConnman* connman, std::string strCommand
             LogPrintf("Relaying wtx %s\n", hash.ToString());
 
             if(strCommand == NetMsgType::TXLOCKREQUEST) {
+                // cs_main is held here, CommitTransaction announces the locks this completes
                 instantsend.ProcessTxLockRequest(((CTxLockRequest)*this), *connman);
             }
             if (connman) {
@@ -2356,56 +2762,66 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        if (fWalletCoinsDirty)
+            RebuildWalletCoins();
+
+        // candidates from the buckets we are looking for, in the order of mapWallet
+        std::vector<COutPoint> vOutpoints;
+        for (int nType = 0; nType < WALLET_COIN_TYPE_COUNT; nType++) {
+            if (IsWalletCoinTypeAvailable((WalletCoinType)nType, nCoinType))
+                vOutpoints.insert(vOutpoints.end(), setWalletCoins[nType].begin(), setWalletCoins[nType].end());
+        }
+        std::sort(vOutpoints.begin(), vOutpoints.end());
+
+        const CWalletTx* pcoin = NULL;
+        bool fAvailable = false;
+        int nDepth = 0;
+        BOOST_FOREACH(const COutPoint& outpoint, vOutpoints)
         {
-            const uint256& wtxid = it->first;
-            const CWalletTx* pcoin = &(*it).second;
+            const uint256& wtxid = outpoint.hash;
+            unsigned int i = outpoint.n;
 
-            if (!CheckFinalTx(*pcoin))
-                continue;
+            // outputs of the same transaction are next to each other, check it once
+            if (!pcoin || pcoin->GetHash() != wtxid) {
+                std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(wtxid);
+                if (it == mapWallet.end())
+                    continue;
+                pcoin = &it->second;
+                fAvailable = false;
 
-            if (fOnlyConfirmed && !pcoin->IsTrusted())
-                continue;
+                if (!CheckFinalTx(*pcoin))
+                    continue;
 
-            if (pcoin->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0)
-                continue;
+                if (fOnlyConfirmed && !pcoin->IsTrusted())
+                    continue;
 
-            int nDepth = pcoin->GetDepthInMainChain(false);
-            // do not use IX for inputs that have less then INSTANTSEND_CONFIRMATIONS_REQUIRED blockchain confirmations
-            if (fUseInstantSend && nDepth < INSTANTSEND_CONFIRMATIONS_REQUIRED)
-                continue;
+                if (pcoin->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0)
+                    continue;
 
-            // We should not consider coins which aren't at least in our mempool
-            // It's possible for these to be conflicted via ancestors which we may never be able to detect
-            if (nDepth == 0 && !pcoin->InMempool())
-                continue;
+                nDepth = pcoin->GetDepthInMainChain(false);
+                // do not use IX for inputs that have less then INSTANTSEND_CONFIRMATIONS_REQUIRED blockchain confirmations
+                if (fUseInstantSend && nDepth < INSTANTSEND_CONFIRMATIONS_REQUIRED)
+                    continue;
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
-                bool found = false;
-                if(nCoinType == ONLY_DENOMINATED) {
-                    found = CPrivateSend::IsDenominatedAmount(pcoin->vout[i].nValue);
-                } else if(nCoinType == ONLY_NONDENOMINATED) {
-                    if (CPrivateSend::IsCollateralAmount(pcoin->vout[i].nValue)) continue; // do not use collateral amounts
-                    found = !CPrivateSend::IsDenominatedAmount(pcoin->vout[i].nValue);
-                } else if(nCoinType == ONLY_1000) {
-                    found = pcoin->vout[i].nValue == 1000*COIN;
-                } else if(nCoinType == ONLY_PRIVATESEND_COLLATERAL) {
-                    found = CPrivateSend::IsCollateralAmount(pcoin->vout[i].nValue);
-                } else {
-                    found = true;
-                }
-                if(!found) continue;
-
-                isminetype mine = IsMine(pcoin->vout[i]);
-                if (!(IsSpent(wtxid, i)) && mine != ISMINE_NO &&
-                    (!IsLockedCoin((*it).first, i) || nCoinType == ONLY_1000) &&
-                    (pcoin->vout[i].nValue > 0 || fIncludeZeroValue) &&
-                    (!coinControl || !coinControl->HasSelected() || coinControl->fAllowOtherInputs || coinControl->IsSelected(COutPoint((*it).first, i))))
-                        vCoins.push_back(COutput(pcoin, i, nDepth,
-                                                 ((mine & ISMINE_SPENDABLE) != ISMINE_NO) ||
-                                                  (coinControl && coinControl->fAllowWatchOnly && (mine & ISMINE_WATCH_SOLVABLE) != ISMINE_NO),
-                                                 (mine & (ISMINE_SPENDABLE | ISMINE_WATCH_SOLVABLE)) != ISMINE_NO));
+                // We should not consider coins which aren't at least in our mempool
+                // It's possible for these to be conflicted via ancestors which we may never be able to detect
+                if (nDepth == 0 && !pcoin->InMempool())
+                    continue;
+
+                fAvailable = true;
             }
+            if (!fAvailable)
+                continue;
+
+            isminetype mine = IsMine(pcoin->vout[i]);
+            if (!(IsSpent(wtxid, i)) && mine != ISMINE_NO &&
+                (!IsLockedCoin(wtxid, i) || nCoinType == ONLY_1000) &&
+                (pcoin->vout[i].nValue > 0 || fIncludeZeroValue) &&
+                (!coinControl || !coinControl->HasSelected() || coinControl->fAllowOtherInputs || coinControl->IsSelected(outpoint)))
+                    vCoins.push_back(COutput(pcoin, i, nDepth,
+                                             ((mine & ISMINE_SPENDABLE) != ISMINE_NO) ||
+                                              (coinControl && coinControl->fAllowWatchOnly && (mine & ISMINE_WATCH_SOLVABLE) != ISMINE_NO),
+                                             (mine & (ISMINE_SPENDABLE | ISMINE_WATCH_SOLVABLE)) != ISMINE_NO));
         }
     }
 }
@@ -3149,6 +3565,62 @@ bool CWallet::ConvertList(std::vector<CTxIn> vecTxIn, std::vector<CAmount>& vecA
     return true;
 }
 
+/**
+ * Copy the keys needed to sign vecTxDSIn from keystore to keystoreRet, false
+ * if an input isn't a P2PKH or P2PK one (these are signed sequentially).
+ */
+static bool GetSigningKeys(const CKeyStore& keystore, const std::vector<CTxDSIn>& vecTxDSIn, CBasicKeyStore& keystoreRet)
+{
+    BOOST_FOREACH(const CTxDSIn& txdsin, vecTxDSIn) {
+        txnouttype type;
+        std::vector<std::vector<unsigned char> > vSolutions;
+        if (!Solver(txdsin.prevPubKey, type, vSolutions))
+            return false;
+
+        CKeyID keyID;
+        if (type == TX_PUBKEYHASH)
+            keyID = CKeyID(uint160(vSolutions[0]));
+        else if (type == TX_PUBKEY)
+            keyID = CPubKey(vSolutions[0]).GetID();
+        else
+            return false;
+        if (keystoreRet.HaveKey(keyID))
+            continue;
+
+        CKey key;
+        CPubKey pubkey;
+        if (!keystore.GetKey(keyID, key) || !keystore.GetPubKey(keyID, pubkey) || !keystoreRet.AddKeyPubKey(key, pubkey))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Sign the inputs of txNew on nThreads threads. The keys must not come from
+ * the wallet itself, CWallet::GetKey needs cs_wallet which the caller holds.
+ */
+static bool SignInputsParallel(const CKeyStore& keystore, CMutableTransaction& txNew, const std::vector<CTxDSIn>& vecTxDSIn, int nThreads)
+{
+    const CTransaction txNewConst(txNew);
+    // one char per input, the threads must not share bytes
+    std::vector<char> vSigned(vecTxDSIn.size(), false);
+
+    boost::thread_group threadGroup;
+    size_t nChunk = (vecTxDSIn.size() + nThreads - 1) / nThreads;
+    for (size_t nBegin = 0; nBegin < vecTxDSIn.size(); nBegin += nChunk) {
+        size_t nEnd = std::min(nBegin + nChunk, vecTxDSIn.size());
+        threadGroup.create_thread([&, nBegin, nEnd]() {
+            for (size_t nIn = nBegin; nIn < nEnd; nIn++) {
+                vSigned[nIn] = ProduceSignature(TransactionSignatureCreator(&keystore, &txNewConst, nIn, SIGHASH_ALL),
+                                                vecTxDSIn[nIn].prevPubKey, txNew.vin[nIn].scriptSig);
+            }
+        });
+    }
+    threadGroup.join_all();
+
+    return std::find(vSigned.begin(), vSigned.end(), false) == vSigned.end();
+}
+
 bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend, CWalletTx& wtxNew, CReserveKey& reservekey, CAmount& nFeeRet,
                                 int& nChangePosRet, std::string& strFailReason, const CCoinControl* coinControl, bool sign, AvailableCoinsType nCoinType, bool fUseInstantSend)
 {
@@ -3417,25 +3889,38 @@ bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend, CWalletTx& wt
                     }
                 }
 
-                // Sign
-                int nIn = 0;
-                CTransaction txNewConst(txNew);
-                for (const auto& txdsin : vecTxDSInTmp)
+                // Sign, on several threads if there are many inputs
+                int nSignThreads = sign ? std::min<int>(GetArg("-signthreads", GetNumCores()), vecTxDSInTmp.size() / SIGN_INPUTS_PER_THREAD) : 0;
+                CBasicKeyStore keystoreInputs;
+                if (nSignThreads > 1 && GetSigningKeys(*this, vecTxDSInTmp, keystoreInputs))
                 {
-                    bool signSuccess;
-                    const CScript& scriptPubKey = txdsin.prevPubKey;
-                    CScript& scriptSigRes = txNew.vin[nIn].scriptSig;
-                    if (sign)
-                        signSuccess = ProduceSignature(TransactionSignatureCreator(this, &txNewConst, nIn, SIGHASH_ALL), scriptPubKey, scriptSigRes);
-                    else
-                        signSuccess = ProduceSignature(DummySignatureCreator(this), scriptPubKey, scriptSigRes);
-
-                    if (!signSuccess)
+                    if (!SignInputsParallel(keystoreInputs, txNew, vecTxDSInTmp, nSignThreads))
                     {
                         strFailReason = _("Signing transaction failed");
                         return false;
                     }
-                    nIn++;
+                }
+                else
+                {
+                    int nIn = 0;
+                    CTransaction txNewConst(txNew);
+                    for (const auto& txdsin : vecTxDSInTmp)
+                    {
+                        bool signSuccess;
+                        const CScript& scriptPubKey = txdsin.prevPubKey;
+                        CScript& scriptSigRes = txNew.vin[nIn].scriptSig;
+                        if (sign)
+                            signSuccess = ProduceSignature(TransactionSignatureCreator(this, &txNewConst, nIn, SIGHASH_ALL), scriptPubKey, scriptSigRes);
+                        else
+                            signSuccess = ProduceSignature(DummySignatureCreator(this), scriptPubKey, scriptSigRes);
+
+                        if (!signSuccess)
+                        {
+                            strFailReason = _("Signing transaction failed");
+                            return false;
+                        }
+                        nIn++;
+                    }
                 }
 
                 unsigned int nBytes = ::GetSerializeSize(txNew, SER_NETWORK, PROTOCOL_VERSION);
@@ -3553,6 +4038,9 @@ bool CWallet::CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey, CCon
             wtxNew.RelayWalletTransaction(connman, strCommand);
         }
     }
+    // a lock the request completed is announced once cs_main is released, see RelayWalletTransaction
+    if (strCommand == NetMsgType::TXLOCKREQUEST)
+        instantsend.NotifyLockedTransactions();
     return true;
 }
 
@@ -3622,8 +4110,22 @@ DBErrors CWallet::LoadWallet(bool& fFirstRunRet)
                 }
             }
         }
+
+        // drop the PrivateSend rounds of transactions which are gone, e.g. after -zapwallettxes
+        std::set<uint256> setHashesGone;
+        for (auto& pair : mapOutpointRoundsCache) {
+            if (!mapWallet.count(pair.first.hash))
+                setHashesGone.insert(pair.first.hash);
+        }
+        if (!setHashesGone.empty()) {
+            CWalletDB walletdb(strWalletFile, "r+", false);
+            for (auto& hash : setHashesGone)
+                ForgetPrivateSendRounds(hash, &walletdb);
+        }
     }
 
+    payoutQueue.LoadTransactions();
+
     if (nLoadWalletRet != DB_LOAD_OK)
         return nLoadWalletRet;
     fFirstRunRet = !vchDefaultKey.IsValid();
@@ -3785,6 +4287,12 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize)
         } else {
             nTargetSize *= 2;
         }
+        // derive the missing keys in one batch per chain, external ones first
+        std::vector<CPubKey> vecPubKeys, vecInternalPubKeys;
+        GenerateNewKeys(0, false, missingExternal, vecPubKeys);
+        GenerateNewKeys(0, true, missingInternal, vecInternalPubKeys);
+        vecPubKeys.insert(vecPubKeys.end(), vecInternalPubKeys.begin(), vecInternalPubKeys.end());
+
         bool fInternal = false;
         CWalletDB walletdb(strWalletFile);
         for (int64_t i = missingInternal + missingExternal; i--;)
@@ -3800,7 +4308,8 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize)
                 nEnd = std::max(nEnd, *(--setExternalKeyPool.end()) + 1);
             }
             // TODO: implement keypools for all accounts?
-            if (!walletdb.WritePool(nEnd, CKeyPool(GenerateNewKey(0, fInternal), fInternal)))
+            const CPubKey& pubkey = vecPubKeys[missingInternal + missingExternal - 1 - i];
+            if (!walletdb.WritePool(nEnd, CKeyPool(pubkey, fInternal)))
                 throw runtime_error("TopUpKeyPool(): writing generated key failed");
 
             if (fInternal) {
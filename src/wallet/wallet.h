@@ -17,12 +17,14 @@
 #include "utilstrencodings.h"
 #include "validationinterface.h"
 #include "wallet/crypter.h"
+#include "wallet/payout.h"
 #include "wallet/wallet_ismine.h"
 #include "wallet/walletdb.h"
 
 #include "privatesend.h"
 
 #include <algorithm>
+#include <atomic>
 #include <map>
 #include <set>
 #include <stdexcept>
@@ -69,6 +71,10 @@ static const bool DEFAULT_WALLETBROADCAST = true;
 
 //! if set, all keys will be derived by using BIP39/BIP44
 static const bool DEFAULT_USE_HD_WALLET = false;
+//! Most threads reading and filtering blocks for a rescan
+static const int MAX_RESCAN_THREADS = 8;
+//! Inputs every thread signs at least when CreateTransaction signs on several threads
+static const size_t SIGN_INPUTS_PER_THREAD = 16;
 
 class CBlockIndex;
 class CCoinControl;
@@ -76,6 +82,7 @@ class COutput;
 class CReserveKey;
 class CScript;
 class CTxMemPool;
+class CWalletScanFilter;
 class CWalletTx;
 
 /** (client) version numbers for particular wallet features */
@@ -100,6 +107,16 @@ enum AvailableCoinsType
     ONLY_PRIVATESEND_COLLATERAL
 };
 
+/** Buckets of the wallet's coin index, every output falls into exactly one */
+enum WalletCoinType
+{
+    WALLET_COIN_DENOMINATED,
+    WALLET_COIN_COLLATERAL,
+    WALLET_COIN_1000,
+    WALLET_COIN_OTHER,
+    WALLET_COIN_TYPE_COUNT
+};
+
 struct CompactTallyItem
 {
     CTxDestination txdest;
@@ -645,6 +662,45 @@ private:
 
     std::set<COutPoint> setWalletUTXO;
 
+    /**
+     * Our outputs which aren't spent by a wallet transaction in the active
+     * chain, by WalletCoinType. AvailableCoins only looks at these instead of
+     * every output of mapWallet. Rebuilt from mapWallet when dirty, i.e. after
+     * loading the wallet or when what IsMine means may have changed.
+     */
+    mutable std::set<COutPoint> setWalletCoins[WALLET_COIN_TYPE_COUNT];
+    mutable bool fWalletCoinsDirty;
+
+    static WalletCoinType GetWalletCoinType(CAmount nValue);
+    bool IsSpentInChain(const COutPoint& outpoint) const;
+    void UpdateWalletCoin(const COutPoint& outpoint, const CTxOut& txout) const;
+    /* Update the coin index for the outputs wtx creates and spends */
+    void UpdateWalletCoins(const CWalletTx& wtx);
+    void RebuildWalletCoins() const;
+
+    /**
+     * Real PrivateSend rounds of our denominated outpoints, also stored in the
+     * wallet file. The entries of a transaction and of everything spending it
+     * are dropped when it is added, abandoned or conflicted.
+     */
+    mutable std::map<COutPoint, int> mapOutpointRoundsCache;
+    /* entries of mapOutpointRoundsCache not written to the wallet file yet */
+    mutable std::set<COutPoint> setOutpointRoundsUnsaved;
+
+    void SavePrivateSendRounds(CWalletDB* pwalletdb = NULL) const;
+    void ForgetPrivateSendRounds(const uint256& hashTx, CWalletDB* pwalletdb);
+    void ForgetDescendantPrivateSendRounds(const uint256& hashTx, CWalletDB* pwalletdb);
+
+    /* state of the running rescan, read without the wallet lock which the rescan holds */
+    std::atomic<bool> fAbortRescan;
+    std::atomic<bool> fScanningWallet;
+    std::atomic<int> nScanStartHeight;
+    std::atomic<int> nScanStopHeight;
+    std::atomic<int> nScanHeight;
+    std::atomic<int64_t> nScanStartTime;
+
+    void GetScanFilter(CWalletScanFilter& filter) const;
+
     /* Mark a transaction (and its in-wallet descendants) as conflicting with a particular block. */
     void MarkConflicted(const uint256& hashBlock, const uint256& hashTx);
 
@@ -652,6 +708,8 @@ private:
 
     /* HD derive new child key (on internal or external chain) */
     void DeriveNewChildKey(const CKeyMetadata& metadata, CKey& secretRet, uint32_t nAccountIndex, bool fInternal /*= false*/);
+    /* the next nCount HD keys of an account's chain, writing the chain's counter once */
+    void DeriveNewChildKeys(const CKeyMetadata& metadata, std::vector<CKey>& vecSecretsRet, uint32_t nAccountIndex, bool fInternal, unsigned int nCount);
 
 public:
     /*
@@ -666,6 +724,9 @@ public:
     bool fFileBacked;
     const std::string strWalletFile;
 
+    /// Payments queued by the payout RPCs, see CPayoutQueue
+    CPayoutQueue payoutQueue;
+
     void LoadKeyPool(int nIndex, const CKeyPool &keypool)
     {
         if (keypool.fInternal) {
@@ -690,13 +751,13 @@ public:
     MasterKeyMap mapMasterKeys;
     unsigned int nMasterKeyMaxID;
 
-    CWallet()
+    CWallet() : payoutQueue(this)
     {
         SetNull();
     }
 
     CWallet(const std::string& strWalletFileIn) 
-    : strWalletFile(strWalletFileIn)
+    : strWalletFile(strWalletFileIn), payoutQueue(this)
     {
         SetNull();
 
@@ -725,6 +786,13 @@ public:
         fAnonymizableTallyCachedNonDenom = false;
         vecAnonymizableTallyCached.clear();
         vecAnonymizableTallyCachedNonDenom.clear();
+        fWalletCoinsDirty = true;
+        fAbortRescan = false;
+        fScanningWallet = false;
+        nScanStartHeight = 0;
+        nScanStopHeight = 0;
+        nScanHeight = 0;
+        nScanStartTime = 0;
     }
 
     std::map<uint256, CWalletTx> mapWallet;
@@ -801,6 +869,8 @@ public:
      * Generate a new key
      */
     CPubKey GenerateNewKey(uint32_t nAccountIndex, bool fInternal /*= false*/);
+    //! Generate nCount new keys, HD keys are derived as one batch
+    void GenerateNewKeys(uint32_t nAccountIndex, bool fInternal, unsigned int nCount, std::vector<CPubKey>& vecPubKeysRet);
     //! HaveKey implementation that also checks the mapHdPubKeys
     bool HaveKey(const CKeyID &address) const;
     //! GetPubKey implementation that also checks the mapHdPubKeys
@@ -833,6 +903,8 @@ public:
     bool EraseDestData(const CTxDestination &dest, const std::string &key);
     //! Adds a destination data tuple to the store, without saving it to disk
     bool LoadDestData(const CTxDestination &dest, const std::string &key, const std::string &value);
+    //! Adds PrivateSend rounds of an outpoint, without saving them to disk (used by LoadWallet)
+    bool LoadPrivateSendRounds(const COutPoint& outpoint, int nRounds);
     //! Look up a destination data tuple in the store, return true if found false otherwise
     bool GetDestData(const CTxDestination &dest, const std::string &key, std::string *value) const;
 
@@ -858,7 +930,19 @@ public:
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletDB* pwalletdb);
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
-    int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
+    /**
+     * Add the wallet's transactions of the active chain from pindexStart up to
+     * pindexStop (the tip if NULL). Blocks are read and filtered by several
+     * threads, only transactions which may involve the wallet are checked
+     * with the wallet lock. Returns the number of transactions added or
+     * updated.
+     */
+    int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false, CBlockIndex* pindexStop = NULL);
+    void AbortRescan() { fAbortRescan = true; }
+    bool IsAbortingRescan() const { return fAbortRescan; }
+    bool IsScanning() const { return fScanningWallet; }
+    /** Range and current height of the running rescan, false if there is none */
+    bool GetScanProgress(int& nStartHeightRet, int& nStopHeightRet, int& nHeightRet, int64_t& nDurationRet) const;
     void ReacceptWalletTransactions();
     void ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman);
     std::vector<uint256> ResendWalletTransactionsBefore(int64_t nTime, CConnman* connman);
@@ -68,6 +68,18 @@ bool CWalletDB::EraseTx(uint256 hash)
     return Erase(std::make_pair(std::string("tx"), hash));
 }
 
+bool CWalletDB::WritePrivateSendRounds(const COutPoint& outpoint, int nRounds)
+{
+    nWalletDBUpdated++;
+    return Write(std::make_pair(std::string("psrounds"), outpoint), nRounds);
+}
+
+bool CWalletDB::ErasePrivateSendRounds(const COutPoint& outpoint)
+{
+    nWalletDBUpdated++;
+    return Erase(std::make_pair(std::string("psrounds"), outpoint));
+}
+
 bool CWalletDB::WriteKey(const CPubKey& vchPubKey, const CPrivKey& vchPrivKey, const CKeyMetadata& keyMeta)
 {
     nWalletDBUpdated++;
@@ -177,6 +189,24 @@ bool CWalletDB::WriteMinVersion(int nVersion)
     return Write(std::string("minversion"), nVersion);
 }
 
+bool CWalletDB::WritePayout(const CPayout& payout)
+{
+    nWalletDBUpdated++;
+    return Write(std::make_pair(std::string("payout"), payout.nId), payout);
+}
+
+bool CWalletDB::ErasePayout(int64_t nId)
+{
+    nWalletDBUpdated++;
+    return Erase(std::make_pair(std::string("payout"), nId));
+}
+
+bool CWalletDB::WritePayoutNextId(int64_t nNextId)
+{
+    nWalletDBUpdated++;
+    return Write(std::string("payoutnextid"), nNextId);
+}
+
 bool CWalletDB::ReadAccount(const string& strAccount, CAccount& account)
 {
     account.SetNull();
@@ -214,7 +244,7 @@ void CWalletDB::ListAccountCreditDebit(const string& strAccount, list<CAccountin
 {
     bool fAllAccounts = (strAccount == "*");
 
-    Dbc* pcursor = GetCursor();
+    CDBCursor* pcursor = GetCursor();
     if (!pcursor)
         throw runtime_error("CWalletDB::ListAccountCreditDebit(): cannot create DB cursor");
     unsigned int fFlags = DB_SET_RANGE;
@@ -231,7 +261,7 @@ void CWalletDB::ListAccountCreditDebit(const string& strAccount, list<CAccountin
             break;
         else if (ret != 0)
         {
-            pcursor->close();
+            delete pcursor;
             throw runtime_error("CWalletDB::ListAccountCreditDebit(): error scanning DB");
         }
 
@@ -250,7 +280,7 @@ void CWalletDB::ListAccountCreditDebit(const string& strAccount, list<CAccountin
         entries.push_back(acentry);
     }
 
-    pcursor->close();
+    delete pcursor;
 }
 
 DBErrors CWalletDB::ReorderTransactions(CWallet* pwallet)
@@ -403,6 +433,26 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
 
             pwallet->AddToWallet(wtx, true, NULL);
         }
+        else if (strType == "psrounds")
+        {
+            COutPoint outpoint;
+            int nRounds;
+            ssKey >> outpoint;
+            ssValue >> nRounds;
+            pwallet->LoadPrivateSendRounds(outpoint, nRounds);
+        }
+        else if (strType == "payout")
+        {
+            CPayout payout;
+            ssValue >> payout;
+            pwallet->payoutQueue.Load(payout);
+        }
+        else if (strType == "payoutnextid")
+        {
+            int64_t nNextId;
+            ssValue >> nNextId;
+            pwallet->payoutQueue.LoadNextId(nNextId);
+        }
         else if (strType == "acentry")
         {
             string strAccount;
@@ -664,7 +714,7 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
         }
 
         // Get cursor
-        Dbc* pcursor = GetCursor();
+        CDBCursor* pcursor = GetCursor();
         if (!pcursor)
         {
             LogPrintf("Error getting wallet database cursor\n");
@@ -705,7 +755,7 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
             if (!strErr.empty())
                 LogPrintf("%s\n", strErr);
         }
-        pcursor->close();
+        delete pcursor;
 
         // Store initial external keypool size since we mostly use external keys in mixing
         pwallet->nKeysLeftSinceAutoBackup = pwallet->KeypoolCountExternalKeys();
@@ -774,7 +824,7 @@ DBErrors CWalletDB::FindWalletTx(CWallet* pwallet, vector<uint256>& vTxHash, vec
         }
 
         // Get cursor
-        Dbc* pcursor = GetCursor();
+        CDBCursor* pcursor = GetCursor();
         if (!pcursor)
         {
             LogPrintf("Error getting wallet database cursor\n");
@@ -808,7 +858,7 @@ DBErrors CWalletDB::FindWalletTx(CWallet* pwallet, vector<uint256>& vTxHash, vec
                 vWtx.push_back(wtx);
             }
         }
-        pcursor->close();
+        delete pcursor;
     }
     catch (const boost::thread_interrupted&) {
         throw;
@@ -867,6 +917,13 @@ void ThreadFlushWalletDB(const string& strFile)
 
         if (nLastFlushed != nWalletDBUpdated && GetTime() - nLastWalletUpdate >= 2)
         {
+            // A log store only needs its appends synced, there is no environment to checkpoint
+            if (logdbenv.Flush(strFile))
+            {
+                nLastFlushed = nWalletDBUpdated;
+                continue;
+            }
+
             TRY_LOCK(bitdb.cs_db,lockDb);
             if (lockDb)
             {
@@ -906,6 +963,16 @@ bool BackupWallet(const CWallet& wallet, const string& strDest)
 {
     if (!wallet.fFileBacked)
         return false;
+    if (CLogDB::IsLogFile(GetDataDir() / wallet.strWalletFile))
+    {
+        boost::filesystem::path pathDest(strDest);
+        if (boost::filesystem::is_directory(pathDest))
+            pathDest /= wallet.strWalletFile;
+        if (!logdbenv.Backup(wallet.strWalletFile, pathDest))
+            return false;
+        LogPrintf("copied wallet.dat to %s\n", pathDest.string());
+        return true;
+    }
     while (true)
     {
         {
@@ -24,6 +24,8 @@ class CAccountingEntry;
 struct CBlockLocator;
 class CKeyPool;
 class CMasterKey;
+class COutPoint;
+class CPayout;
 class CScript;
 class CWallet;
 class CWalletTx;
@@ -91,6 +93,9 @@ public:
     bool WriteTx(uint256 hash, const CWalletTx& wtx);
     bool EraseTx(uint256 hash);
 
+    bool WritePrivateSendRounds(const COutPoint& outpoint, int nRounds);
+    bool ErasePrivateSendRounds(const COutPoint& outpoint);
+
     bool WriteKey(const CPubKey& vchPubKey, const CPrivKey& vchPrivKey, const CKeyMetadata &keyMeta);
     bool WriteCryptedKey(const CPubKey& vchPubKey, const std::vector<unsigned char>& vchCryptedSecret, const CKeyMetadata &keyMeta);
     bool WriteMasterKey(unsigned int nID, const CMasterKey& kMasterKey);
@@ -113,6 +118,10 @@ public:
 
     bool WriteMinVersion(int nVersion);
 
+    bool WritePayout(const CPayout& payout);
+    bool ErasePayout(int64_t nId);
+    bool WritePayoutNextId(int64_t nNextId);
+
     /// This writes directly to the database, and will not update the CWallet's cached accounting entries!
     /// Use wallet.AddAccountingEntry instead, to write *and* update its caches.
     bool WriteAccountingEntry_Backend(const CAccountingEntry& acentry);
@@ -2,8 +2,10 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "base58.h"
 #include "chainparams.h"
 #include "streams.h"
+#include "txmempool.h"
 #include "zmqpublishnotifier.h"
 #include "validation.h"
 #include "util.h"
@@ -13,6 +15,7 @@ static std::multimap<std::string, CZMQAbstractPublishNotifier*> mapPublishNotifi
 static const char *MSG_HASHBLOCK  = "hashblock";
 static const char *MSG_HASHTX     = "hashtx";
 static const char *MSG_HASHTXLOCK = "hashtxlock";
+static const char *MSG_HASHADDRESSTX = "hashaddresstx";
 static const char *MSG_RAWBLOCK   = "rawblock";
 static const char *MSG_RAWTX      = "rawtx";
 static const char *MSG_RAWTXLOCK = "rawtxlock";
@@ -173,25 +176,51 @@ bool CZMQPublishHashTransactionLockNotifier::NotifyTransactionLock(const CTransa
     return SendMessage(MSG_HASHTXLOCK, data, 32);
 }
 
+bool CZMQPublishHashAddressTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
+{
+    if (!fAddressIndex)
+        return true;
+
+    // only transactions entering the mempool are indexed, the addresses were extracted on acceptance
+    uint256 hash = transaction.GetHash();
+    std::vector<std::pair<uint160, int> > vecAddresses;
+    if (!mempool.getTransactionAddresses(hash, vecAddresses))
+        return true;
+
+    char data[32];
+    for (unsigned int i = 0; i < 32; i++)
+        data[31 - i] = hash.begin()[i];
+
+    // one message per address, the topic ends with the address so subscribers can filter on it
+    for (std::vector<std::pair<uint160, int> >::const_iterator it = vecAddresses.begin(); it != vecAddresses.end(); ++it) {
+        CBitcoinAddress address;
+        if (it->second == 2)
+            address.Set(CScriptID(it->first));
+        else
+            address.Set(CKeyID(it->first));
+        std::string strTopic = MSG_HASHADDRESSTX + address.ToString();
+        LogPrint("zmq", "zmq: Publish %s %s\n", strTopic, hash.GetHex());
+        if (!SendMessage(strTopic.c_str(), data, 32))
+            return false;
+    }
+    return true;
+}
+
 bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
 {
     LogPrint("zmq", "zmq: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
 
-    const Consensus::Params& consensusParams = Params().GetConsensus();
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    std::vector<unsigned char> vchBlock;
     {
         LOCK(cs_main);
-        CBlock block;
-        if(!ReadBlockFromDisk(block, pindex, consensusParams))
+        if(!ReadRawBlockFromDisk(vchBlock, pindex))
         {
             zmqError("Can't read block from disk");
             return false;
         }
-
-        ss << block;
     }
 
-    return SendMessage(MSG_RAWBLOCK, &(*ss.begin()), ss.size());
+    return SendMessage(MSG_RAWBLOCK, vchBlock.data(), vchBlock.size());
 }
 
 bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &transaction)